@@ -0,0 +1,377 @@
+/**
+ * @file bench.c
+ *
+ * Microbenchmarks for the translation hot path
+ *
+ * Usage:
+ *   simulator_bench [--reps=N] [--accesses=N] [--filter=TEXT]
+ *                   [--pte-format=sim|hw] [--la57]
+ *                   [--page-table=radix|hashed|cuckoo]
+ *
+ * Each benchmark runs once to warm up and then --reps times, and reports
+ * the fastest and the median repetition. check_tlb, walk and translate run
+ * over the same precomputed address streams:
+ *   sequential  64-byte steps through the footprint
+ *   strided     one access every BENCH_STRIDE_PAGES pages, wrapping around
+ *   random      uniformly random words
+ *   zipf        Zipf-distributed pages (s = BENCH_ZIPF_S), hot pages spread
+ *               over the footprint
+ * The streams come from the workload generator (see workload.h).
+ * Setup maps the whole footprint with map_range() into a fresh context, once
+ * with 4K pages and once with 2M pages, and reports time per page.
+ * --pte-format picks the page table entry format of every context, and
+ * --la57 gives them 5-level page tables. --page-table=hashed puts the pages
+ * in a hashed page table instead of radix trees, and --page-table=cuckoo
+ * in elastic cuckoo page tables.
+ */
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "address_space.h"
+#include "page_table.h"
+#include "sim_config.h"
+#include "sim_context.h"
+#include "tlb.h"
+#include "translation.h"
+#include "workload.h"
+
+#define BENCH_PID 1
+#define BENCH_VA_BASE 0x10000000000ULL
+// PA offsets that keep map_range() from using pages larger than 4K or 2M
+#define BENCH_PA_OFFSET 0x1000ULL
+#define BENCH_PA_OFFSET_2M 0x200000ULL
+// 64 MiB of 4K pages: well past the STLB reach
+#define BENCH_FOOTPRINT_PAGES (1U << 14)
+// 16 GiB of 2M pages for the 2M setup benchmark
+#define BENCH_FOOTPRINT_2M_PAGES (1U << 13)
+#define BENCH_STRIDE_PAGES 17
+#define BENCH_ZIPF_S 0.99
+#define BENCH_SEED 0x2545F4914F6CDD1DULL
+
+#define DEFAULT_REPS 5
+#define DEFAULT_ACCESSES (1U << 20)
+
+typedef enum bench_pattern {
+  PATTERN_SEQUENTIAL = 0,
+  PATTERN_STRIDED = 1,
+  PATTERN_RANDOM = 2,
+  PATTERN_ZIPF = 3,
+  PATTERN_MAX = 4,
+} bench_pattern_t;
+
+static const char *pattern_names[PATTERN_MAX] = {"sequential", "strided",
+                                                 "random", "zipf"};
+
+/**
+ * One benchmark run over a stream. Returns a value that depends on every
+ * operation so the compiler cannot drop them.
+ */
+typedef uint64_t (*stream_bench_fn)(ptw_sim_context_t *ctx,
+                                    address_context_t *stream, size_t n);
+
+typedef struct bench_opts {
+  uint32_t reps;
+  size_t accesses;
+  const char *filter; //< Only run benchmarks whose name contains this
+  pte_format_t pte_format;
+  uint8_t pt_levels;
+  pt_backend_t pt_backend;
+} bench_opts_t;
+
+static volatile uint64_t sink;
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static int build_stream(address_context_t *stream, size_t n,
+                        bench_pattern_t pattern) {
+  static const workload_kind_t kinds[PATTERN_MAX] = {
+      WORKLOAD_SEQUENTIAL, WORKLOAD_STRIDE, WORKLOAD_UNIFORM, WORKLOAD_ZIPF};
+
+  workload_config_t cfg;
+  default_workload_config(&cfg);
+  cfg.kind = kinds[pattern];
+  cfg.base_va = BENCH_VA_BASE;
+  cfg.footprint = (uint64_t)BENCH_FOOTPRINT_PAGES << 12;
+  cfg.stride = (uint64_t)BENCH_STRIDE_PAGES << 12;
+  cfg.zipf_s = BENCH_ZIPF_S;
+  cfg.first_pid = BENCH_PID;
+  cfg.seed = BENCH_SEED;
+
+  workload_t *w = malloc(sizeof(workload_t));
+  if (w == NULL || workload_init(w, &cfg) != 0) {
+    free(w);
+    return -1;
+  }
+  workload_fill(w, stream, n);
+  free(w);
+  return 0;
+}
+
+static uint64_t bench_check_tlb(ptw_sim_context_t *ctx,
+                                address_context_t *stream, size_t n) {
+  uint64_t acc = 0;
+  tlb_update_ctx_t tuc;
+  for (size_t i = 0; i < n; i++) {
+    acc += check_tlb(&stream[i], ctx, &tuc);
+  }
+  return acc;
+}
+
+static uint64_t bench_walk(ptw_sim_context_t *ctx, address_context_t *stream,
+                           size_t n) {
+  uint64_t acc = 0;
+  walk_ctx_t w_ctx;
+  for (size_t i = 0; i < n; i++) {
+    acc += walk(&stream[i], ctx, &w_ctx);
+  }
+  return acc;
+}
+
+static uint64_t bench_translate(ptw_sim_context_t *ctx,
+                                address_context_t *stream, size_t n) {
+  uint64_t acc = 0;
+  for (size_t i = 0; i < n; i++) {
+    acc += translate(&stream[i], ctx);
+  }
+  return acc;
+}
+
+static void report(const char *name, const char *pattern, uint64_t *ns,
+                   uint32_t reps, size_t ops) {
+  qsort(ns, reps, sizeof(uint64_t), compare_u64);
+  double best = (double)ns[0] / ops;
+  double median = (double)ns[reps / 2] / ops;
+  printf("%-10s %-11s %10.2f %10.2f %12.2f\n", name, pattern, best, median,
+         1e3 / median);
+}
+
+static bool selected(const bench_opts_t *opts, const char *name) {
+  return opts->filter == NULL || strstr(name, opts->filter) != NULL;
+}
+
+/**
+ * Time `fn` over every pattern. The TLBs are warmed by translating the
+ * stream once before the warmup run.
+ */
+static int run_stream_bench(const bench_opts_t *opts, ptw_sim_context_t *ctx,
+                            address_context_t *streams[PATTERN_MAX],
+                            const char *name, stream_bench_fn fn) {
+  if (!selected(opts, name)) {
+    return 0;
+  }
+
+  uint64_t *ns = malloc(opts->reps * sizeof(uint64_t));
+  if (ns == NULL) {
+    return -1;
+  }
+
+  for (int p = 0; p < PATTERN_MAX; p++) {
+    sink += bench_translate(ctx, streams[p], opts->accesses);
+    sink += fn(ctx, streams[p], opts->accesses);
+    for (uint32_t rep = 0; rep < opts->reps; rep++) {
+      uint64_t start = now_ns();
+      sink += fn(ctx, streams[p], opts->accesses);
+      ns[rep] = now_ns() - start;
+    }
+    report(name, pattern_names[p], ns, opts->reps, opts->accesses);
+  }
+
+  free(ns);
+  return 0;
+}
+
+/**
+ * Time mapping the footprint into a fresh context
+ */
+static int run_setup_bench(const bench_opts_t *opts, const sim_config_t *cfg,
+                           const char *name, page_size_t page_size) {
+  if (!selected(opts, name)) {
+    return 0;
+  }
+
+  bool small = page_size == FOUR_K;
+  size_t n_pages = small ? BENCH_FOOTPRINT_PAGES : BENCH_FOOTPRINT_2M_PAGES;
+  size_t len = n_pages << page_size_shift(page_size);
+  uintptr_t pa =
+      BENCH_VA_BASE + (small ? BENCH_PA_OFFSET : BENCH_PA_OFFSET_2M);
+  permissions_t perms = {0};
+  perms.val.read = 1;
+
+  uint64_t *ns = malloc(opts->reps * sizeof(uint64_t));
+  if (ns == NULL) {
+    return -1;
+  }
+
+  int ret = 0;
+  for (uint32_t rep = 0; rep <= opts->reps && ret == 0; rep++) {
+    ptw_sim_context_t ctx = {0};
+    if (create_sim_context(&ctx, 0, cfg) != 0) {
+      ret = -1;
+      break;
+    }
+
+    uint64_t start = now_ns();
+    ret = map_range(&ctx, BENCH_PID, BENCH_VA_BASE, pa, len, perms);
+    uint64_t elapsed = now_ns() - start;
+
+    // Rep 0 is the warmup
+    if (rep > 0) {
+      ns[rep - 1] = elapsed;
+    }
+    destroy_sim_context(&ctx);
+  }
+
+  if (ret == 0) {
+    report(name, "-", ns, opts->reps, n_pages);
+  }
+  free(ns);
+  return ret;
+}
+
+static int parse_args(int argc, char **argv, bench_opts_t *opts) {
+  static const struct option long_opts[] = {
+      {"reps", required_argument, NULL, 'r'},
+      {"accesses", required_argument, NULL, 'a'},
+      {"filter", required_argument, NULL, 'f'},
+      {"pte-format", required_argument, NULL, 'p'},
+      {"la57", no_argument, NULL, '5'},
+      {"page-table", required_argument, NULL, 't'},
+      {NULL, 0, NULL, 0},
+  };
+
+  opts->reps = DEFAULT_REPS;
+  opts->accesses = DEFAULT_ACCESSES;
+  opts->filter = NULL;
+  opts->pte_format = PTE_FORMAT_SIM;
+  opts->pt_levels = PT_LEVELS;
+  opts->pt_backend = PT_BACKEND_RADIX;
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", long_opts, NULL)) != -1) {
+    char *end;
+    unsigned long n;
+    switch (opt) {
+    case 'r':
+    case 'a':
+      n = strtoul(optarg, &end, 10);
+      if (*end != '\0' || n == 0 || n > UINT32_MAX) {
+        fprintf(stderr, "Bad count '%s'.\n", optarg);
+        return -1;
+      }
+      if (opt == 'r') {
+        opts->reps = (uint32_t)n;
+      } else {
+        opts->accesses = n;
+      }
+      break;
+    case 'f':
+      opts->filter = optarg;
+      break;
+    case 'p':
+      if (parse_pte_format(optarg, &opts->pte_format) != 0) {
+        fprintf(stderr, "Unknown page table entry format '%s'.\n", optarg);
+        return -1;
+      }
+      break;
+    case '5':
+      opts->pt_levels = PT_LEVELS_LA57;
+      break;
+    case 't':
+      if (parse_pt_backend(optarg, &opts->pt_backend) != 0) {
+        fprintf(stderr, "Unknown page table organization '%s'.\n", optarg);
+        return -1;
+      }
+      break;
+    default:
+      return -1;
+    }
+  }
+
+  return optind == argc ? 0 : -1;
+}
+
+int main(int argc, char **argv) {
+  bench_opts_t opts;
+  if (parse_args(argc, argv, &opts) != 0) {
+    fprintf(stderr,
+            "Usage: %s [--reps=N] [--accesses=N] [--filter=TEXT]\n"
+            "          [--pte-format=sim|hw] [--la57]\n"
+            "          [--page-table=radix|hashed|cuckoo]\n",
+            argv[0]);
+    return 1;
+  }
+
+  sim_config_t cfg;
+  default_sim_config(&cfg);
+  cfg.pte_format = opts.pte_format;
+  cfg.pt_levels = opts.pt_levels;
+  cfg.pt_backend = opts.pt_backend;
+
+  ptw_sim_context_t ctx = {0};
+  permissions_t perms = {0};
+  perms.val.read = 1;
+  if (create_sim_context(&ctx, 0, &cfg) != 0 ||
+      map_range(&ctx, BENCH_PID, BENCH_VA_BASE,
+                BENCH_VA_BASE + BENCH_PA_OFFSET,
+                (size_t)BENCH_FOOTPRINT_PAGES << 12, perms) != 0) {
+    destroy_sim_context(&ctx);
+    return 1;
+  }
+
+  address_context_t *streams[PATTERN_MAX] = {0};
+  int ret = 0;
+  for (int p = 0; p < PATTERN_MAX; p++) {
+    streams[p] = malloc(opts.accesses * sizeof(address_context_t));
+    if (streams[p] == NULL ||
+        build_stream(streams[p], opts.accesses, p) != 0) {
+      ret = -1;
+      break;
+    }
+  }
+
+  printf("%u reps of %zu accesses over %u 4K pages, %s page table, %u "
+         "levels of %s entries\n",
+         opts.reps, opts.accesses, BENCH_FOOTPRINT_PAGES,
+         pt_backend_name(opts.pt_backend), opts.pt_levels,
+         pte_format_name(opts.pte_format));
+  printf("%-10s %-11s %10s %10s %12s\n", "benchmark", "pattern", "best ns",
+         "median ns", "M ops/s");
+
+  if (ret == 0) {
+    ret = run_stream_bench(&opts, &ctx, streams, "check_tlb", bench_check_tlb);
+  }
+  if (ret == 0) {
+    ret = run_stream_bench(&opts, &ctx, streams, "walk", bench_walk);
+  }
+  if (ret == 0) {
+    ret = run_stream_bench(&opts, &ctx, streams, "translate", bench_translate);
+  }
+  if (ret == 0) {
+    ret = run_setup_bench(&opts, &cfg, "setup-4k", FOUR_K);
+  }
+  if (ret == 0) {
+    ret = run_setup_bench(&opts, &cfg, "setup-2m", TWO_M);
+  }
+
+  for (int p = 0; p < PATTERN_MAX; p++) {
+    free(streams[p]);
+  }
+  destroy_sim_context(&ctx);
+  return ret != 0;
+}
@@ -0,0 +1,794 @@
+/**
+ * @file address_space.c
+ *
+ * Sparse page table construction
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "address_space.h"
+#include "ecpt.h"
+#include "hashed_pt.h"
+#include "hw_pte.h"
+#include "page_table.h"
+#include "pt_arena.h"
+#include "pwc.h"
+#include "shootdown.h"
+#include "tlb.h"
+
+/**
+ * Page table entries of either pte_format_t
+ *
+ * The tree code below goes through these helpers, so it exists once for both
+ * formats. `level` is always the level of the table holding the entry,
+ * counted from the root of the context's geometry.
+ *
+ * The hashed and cuckoo page tables keep whole pages rather than tables, as
+ * packed leaves. Their entries go through the leaf helpers below as
+ * hw_pte_t.
+ */
+
+static inline bool radix(const ptw_sim_context_t *ctx) {
+  return ctx->pt_backend == PT_BACKEND_RADIX;
+}
+
+static inline bool hashed(const ptw_sim_context_t *ctx) {
+  return ctx->pt_backend == PT_BACKEND_HASHED;
+}
+
+static inline bool cuckoo(const ptw_sim_context_t *ctx) {
+  return ctx->pt_backend == PT_BACKEND_CUCKOO;
+}
+
+static inline bool hw_format(const ptw_sim_context_t *ctx) {
+  return ctx->pte_format == PTE_FORMAT_HW;
+}
+
+// Leaves are hw_pte_t, in packed radix tables or in a hashed organization
+static inline bool packed_leaves(const ptw_sim_context_t *ctx) {
+  return hw_format(ctx) || !radix(ctx);
+}
+
+static inline size_t table_bytes(const ptw_sim_context_t *ctx) {
+  return hw_format(ctx) ? HW_PT_TABLE_BYTES : PT_TABLE_BYTES;
+}
+
+static inline void *entry_at(const ptw_sim_context_t *ctx, void *table,
+                             size_t index) {
+  return hw_format(ctx) ? (void *)&((hw_pte_t *)table)[index]
+                        : (void *)&((pte_t *)table)[index];
+}
+
+static inline bool entry_valid(const ptw_sim_context_t *ctx,
+                               const void *entry) {
+  return hw_format(ctx) ? hw_pte_present(*(const hw_pte_t *)entry)
+                        : ((const pte_t *)entry)->page_metadata.valid;
+}
+
+static inline page_size_t level_leaf_size(const ptw_sim_context_t *ctx,
+                                          uint8_t level) {
+  return pt_level_leaf_size(&pt_geometry(ctx)[level]);
+}
+
+static inline bool entry_is_table(const ptw_sim_context_t *ctx,
+                                  const void *entry, uint8_t level) {
+  return hw_format(ctx) ? hw_pte_is_table(*(const hw_pte_t *)entry,
+                                          level_leaf_size(ctx, level))
+                        : is_table_pointer((const pte_t *)entry);
+}
+
+static inline void *entry_child(const ptw_sim_context_t *ctx,
+                                const void *entry) {
+  return hw_format(ctx)
+             ? (void *)hw_pte_addr(*(const hw_pte_t *)entry)
+             : (void *)((const pte_t *)entry)->phys_frame.fourk_pte_index;
+}
+
+static inline page_size_t entry_page_size(const ptw_sim_context_t *ctx,
+                                          const void *entry, uint8_t level) {
+  return hw_format(ctx) ? level_leaf_size(ctx, level)
+                        : ((const pte_t *)entry)->page_metadata.page_size;
+}
+
+static inline bool entry_global(const ptw_sim_context_t *ctx,
+                                const void *entry) {
+  return packed_leaves(ctx) ? (*(const hw_pte_t *)entry & HW_PTE_G) != 0
+                            : ((const pte_t *)entry)->page_metadata.global;
+}
+
+static inline void entry_set_global(const ptw_sim_context_t *ctx, void *entry,
+                                    bool global) {
+  if (packed_leaves(ctx)) {
+    hw_pte_t *e = (hw_pte_t *)entry;
+    *e = global ? *e | HW_PTE_G : *e & ~HW_PTE_G;
+  } else {
+    ((pte_t *)entry)->page_metadata.global = global;
+  }
+}
+
+static inline void entry_clear(const ptw_sim_context_t *ctx, void *entry) {
+  memset(entry, 0, hw_format(ctx) ? sizeof(hw_pte_t) : sizeof(pte_t));
+}
+
+int create_address_space(ptw_sim_context_t *ctx, uint32_t pid) {
+  if (pid >= MAX_PID) {
+    fprintf(stderr, "Invalid PID %u.\n", pid);
+    return -1;
+  }
+
+  // The hashed page table is shared and already exists
+  if (hashed(ctx) || ctx->page_table_pointers[pid] != NULL ||
+      ctx->ecpt[pid] != NULL) {
+    return 0;
+  }
+
+  if (cuckoo(ctx)) {
+    ctx->ecpt[pid] = create_ecpt(ctx->ecpt_slots);
+    if (ctx->ecpt[pid] == NULL) {
+      fprintf(stderr, "Failed to allocate page tables for PID %u.\n", pid);
+      return -1;
+    }
+    return 0;
+  }
+
+  pt_arena_t *arena = create_pt_arena();
+  void *root = arena ? pt_arena_alloc(arena, table_bytes(ctx), 0) : NULL;
+  if (root == NULL) {
+    fprintf(stderr, "Failed to allocate page tables for PID %u.\n", pid);
+    destroy_pt_arena(arena);
+    return -1;
+  }
+
+  ctx->page_table_arenas[pid] = arena;
+  ctx->page_table_pointers[pid] = root;
+  return 0;
+}
+
+/**
+ * Returns true if `pid` has page tables to look in
+ */
+static inline bool has_address_space(const ptw_sim_context_t *ctx,
+                                     uint32_t pid) {
+  return hashed(ctx)   ? hpt_page_sizes(ctx->hpt, pid) != 0
+         : cuckoo(ctx) ? ctx->ecpt[pid] != NULL
+                       : ctx->page_table_pointers[pid] != NULL;
+}
+
+/**
+ * Free a tree of individually allocated tables
+ *
+ * Leaf entries hold physical frames rather than table pointers, so only
+ * descend through entries that point at a table.
+ */
+static void free_table_tree(pte_t *table, uint8_t level, uint8_t n_levels) {
+  if (level + 1 < n_levels) {
+    for (size_t i = 0; i < NUM_ENTRIES_PER_PAGE; i++) {
+      if (is_table_pointer(&table[i])) {
+        free_table_tree((pte_t *)table[i].phys_frame.fourk_pte_index,
+                        level + 1, n_levels);
+      }
+    }
+  }
+  free(table);
+}
+
+void destroy_address_space(ptw_sim_context_t *ctx, uint32_t pid) {
+  if (pid >= MAX_PID || !has_address_space(ctx, pid)) {
+    return;
+  }
+
+  // Nothing cached on any core may outlive the tables. The PWCs point
+  // straight at them.
+  for (uint32_t c = 0; c < ctx->n_cores; c++) {
+    mmu_core_t *core = &ctx->cores[c];
+    tlb_t *tlbs[] = {core->oneg_tlb, core->twom_tlb, core->fourk_tlb,
+                     core->stlb};
+    for (size_t i = 0; i < sizeof(tlbs) / sizeof(tlbs[0]); i++) {
+      if (tlbs[i] != NULL) {
+        flush_tlb_pid(tlbs[i], pid);
+      }
+    }
+    for (int level = 0; level < PWC_LEVELS; level++) {
+      if (core->pwc[level] != NULL) {
+        flush_pwc_pid(core->pwc[level], pid);
+      }
+    }
+    core->pid_mask &= ~(1ULL << pid);
+  }
+
+  if (hashed(ctx)) {
+    hpt_remove_pid(ctx->hpt, pid);
+    return;
+  }
+  if (cuckoo(ctx)) {
+    destroy_ecpt(ctx->ecpt[pid]);
+    ctx->ecpt[pid] = NULL;
+    return;
+  }
+
+  // Arena-backed tables all go at once
+  if (ctx->page_table_arenas[pid] != NULL) {
+    destroy_pt_arena(ctx->page_table_arenas[pid]);
+  } else {
+    free_table_tree(ctx->page_table_pointers[pid], 0, pt_n_levels(ctx));
+  }
+
+  ctx->page_table_arenas[pid] = NULL;
+  ctx->page_table_pointers[pid] = NULL;
+}
+
+/**
+ * Return the table an interior entry points at, allocating it if the entry
+ * is empty. `level` is the level of the table below the entry. Returns NULL
+ * if the entry is a leaf or allocation fails.
+ */
+static void *get_or_alloc_table(ptw_sim_context_t *ctx, uint32_t pid,
+                                void *entry, uintptr_t va, uint8_t level) {
+  if (entry_is_table(ctx, entry, level - 1)) {
+    return entry_child(ctx, entry);
+  }
+
+  // A larger page already covers this VA
+  if (entry_valid(ctx, entry)) {
+    fprintf(stderr, "VA 0x%lx is already mapped by a larger page.\n", va);
+    return NULL;
+  }
+
+  // Only hand-built pte_t trees have no arena
+  pt_arena_t *arena = ctx->page_table_arenas[pid];
+  void *table = arena ? pt_arena_alloc(arena, table_bytes(ctx), level)
+                      : calloc(NUM_ENTRIES_PER_PAGE, sizeof(pte_t));
+  if (table == NULL) {
+    fprintf(stderr, "Failed to allocate a page table for PID %u.\n", pid);
+    return NULL;
+  }
+
+  if (hw_format(ctx)) {
+    *(hw_pte_t *)entry = hw_pte_encode_table(table);
+    return table;
+  }
+
+  pte_t *pte = (pte_t *)entry;
+  pte->phys_frame.fourk_pte_index = (uintptr_t)table;
+  pte->vpn = va;
+  pte->page_metadata.valid = 1;
+  pte->page_metadata.page_size = PG_SIZE_MAX;
+
+  // Interior entries are permissive. The leaf decides the real permissions.
+  pte->page_metadata.permissions.raw = 0;
+  pte->page_metadata.permissions.val.read = 1;
+  pte->page_metadata.permissions.val.write = 1;
+  pte->page_metadata.permissions.val.execute = 1;
+
+  return table;
+}
+
+/**
+ * Program a leaf entry at `level`
+ *
+ * An entry that points at a table is left alone. Overwriting it would leak
+ * the table and every mapping under it. `replaced` is set if the entry
+ * already held a leaf, which other cores may have cached. A replaced leaf
+ * keeps its privilege and global bit.
+ */
+static int set_leaf(const ptw_sim_context_t *ctx, void *entry, uint8_t level,
+                    uintptr_t va, uintptr_t pa, page_size_t page_size,
+                    permissions_t perms, bool *replaced) {
+  if (entry_is_table(ctx, entry, level)) {
+    fprintf(stderr, "VA 0x%lx already has smaller pages mapped.\n", va);
+    return -1;
+  }
+
+  *replaced = entry_valid(ctx, entry);
+
+  if (hw_format(ctx)) {
+    hw_pte_t *e = (hw_pte_t *)entry;
+    uint8_t user_supervisor = *replaced ? hw_pte_user_supervisor(*e) : 0;
+    *e = hw_pte_encode_leaf(pa, page_size, perms, user_supervisor,
+                            entry_global(ctx, e));
+    return 0;
+  }
+
+  pte_t *pte = (pte_t *)entry;
+  pte->vpn = va;
+  pte->phys_frame.fourk_pte_index = pa;
+  pte->page_metadata.valid = 1;
+  pte->page_metadata.page_size = page_size;
+  pte->page_metadata.permissions = perms;
+  return 0;
+}
+
+/**
+ * Page table level whose entries are leaves of `page_size`
+ */
+static inline uint8_t leaf_level(const ptw_sim_context_t *ctx,
+                                 page_size_t page_size) {
+  return pt_leaf_level(pt_geometry(ctx), pt_n_levels(ctx), page_size);
+}
+
+static inline size_t level_index(const ptw_sim_context_t *ctx, uintptr_t va,
+                                 uint8_t level) {
+  return pt_level_index(&pt_geometry(ctx)[level], va);
+}
+
+static inline uint64_t level_span(const ptw_sim_context_t *ctx,
+                                  uint8_t level) {
+  return 1ULL << pt_geometry(ctx)[level].shift;
+}
+
+/**
+ * Returns true if [va, va + len) lies below the highest VA the context's
+ * geometry translates, reporting the range otherwise. Higher VAs would alias
+ * lower ones.
+ */
+static bool range_mappable(const ptw_sim_context_t *ctx, uintptr_t va,
+                           size_t len) {
+  uint64_t limit = 1ULL << pt_va_bits(pt_geometry(ctx));
+  if (va >= limit || len > limit - va) {
+    fprintf(stderr, "Range 0x%lx+0x%zx is beyond %u-bit VAs.\n", va, len,
+            pt_va_bits(pt_geometry(ctx)));
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Map one page into the hashed page table
+ *
+ * Like in the radix tree, a page can't go inside a larger page or over
+ * smaller ones, which lookups would find first. A replaced page keeps its
+ * privilege and global bit.
+ */
+static int hashed_map(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va,
+                      uintptr_t pa, page_size_t page_size,
+                      permissions_t perms, bool *replaced) {
+  page_size_t found;
+  if (hpt_find(ctx->hpt, pid, va, &found) != NULL && found > page_size) {
+    fprintf(stderr, "VA 0x%lx is already mapped by a larger page.\n", va);
+    return -1;
+  }
+  if (hpt_has_smaller(ctx->hpt, pid, va, page_size)) {
+    fprintf(stderr, "VA 0x%lx already has smaller pages mapped.\n", va);
+    return -1;
+  }
+
+  hpt_entry_t *e = hpt_insert(ctx->hpt, pid, va, page_size, replaced);
+  if (e == NULL) {
+    fprintf(stderr, "Failed to allocate a hashed page table entry.\n");
+    return -1;
+  }
+
+  uint8_t user_supervisor = *replaced ? hw_pte_user_supervisor(e->pte) : 0;
+  e->pte = hw_pte_encode_leaf(pa, page_size, perms, user_supervisor,
+                              *replaced && (e->pte & HW_PTE_G));
+  return 0;
+}
+
+/**
+ * Drop the sizes of `va`'s regions from every core's cuckoo walk caches,
+ * after a region gained or lost its last page of some size
+ */
+static void cwc_invalidate(ptw_sim_context_t *ctx, uint32_t pid,
+                           uintptr_t va) {
+  static const pwc_level_t cwcs[] = {PWC_PDP, PWC_PDE};
+  for (uint32_t c = 0; c < ctx->n_cores; c++) {
+    for (size_t i = 0; i < sizeof(cwcs) / sizeof(cwcs[0]); i++) {
+      pwc_t *cwc = ctx->cores[c].pwc[cwcs[i]];
+      if (cwc != NULL) {
+        pwc_invalidate(cwc, va, pid);
+      }
+    }
+  }
+}
+
+/**
+ * Map one page into the PID's cuckoo page tables
+ *
+ * The CWTs count the pages in each region, so finding smaller pages under
+ * the new one is one lookup rather than a scan. A replaced page keeps its
+ * privilege and global bit.
+ */
+static int cuckoo_map(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va,
+                      uintptr_t pa, page_size_t page_size,
+                      permissions_t perms, bool *replaced) {
+  if (create_address_space(ctx, pid) != 0) {
+    return -1;
+  }
+  ecpt_t *ecpt = ctx->ecpt[pid];
+
+  page_size_t found;
+  ecpt_slot_t *slot = ecpt_find(ecpt, va, &found);
+  if (slot != NULL && found > page_size) {
+    fprintf(stderr, "VA 0x%lx is already mapped by a larger page.\n", va);
+    return -1;
+  }
+  uint8_t smaller = page_size == ONE_G
+                        ? ecpt_region_sizes(ecpt, ECPT_CWT_PUD, va) &
+                              (PG_SIZE_BIT(FOUR_K) | PG_SIZE_BIT(TWO_M))
+                    : page_size == TWO_M
+                        ? ecpt_region_sizes(ecpt, ECPT_CWT_PMD, va) &
+                              PG_SIZE_BIT(FOUR_K)
+                        : 0;
+  if (smaller != 0) {
+    fprintf(stderr, "VA 0x%lx already has smaller pages mapped.\n", va);
+    return -1;
+  }
+
+  *replaced = slot != NULL;
+  if (*replaced) {
+    slot->val = hw_pte_encode_leaf(pa, page_size, perms,
+                                   hw_pte_user_supervisor(slot->val),
+                                   (slot->val & HW_PTE_G) != 0);
+    return 0;
+  }
+
+  bool regions_changed;
+  if (ecpt_insert(ecpt, va, page_size,
+                  hw_pte_encode_leaf(pa, page_size, perms, 0, false),
+                  &regions_changed) != 0) {
+    fprintf(stderr, "Failed to grow the cuckoo page tables of PID %u.\n",
+            pid);
+    return -1;
+  }
+  if (regions_changed) {
+    cwc_invalidate(ctx, pid, va);
+  }
+  return 0;
+}
+
+/**
+ * Map one page into whichever hashed organization the context uses
+ */
+static int map_hashed_page(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va,
+                           uintptr_t pa, page_size_t page_size,
+                           permissions_t perms, bool *replaced) {
+  return hashed(ctx) ? hashed_map(ctx, pid, va, pa, page_size, perms, replaced)
+                     : cuckoo_map(ctx, pid, va, pa, page_size, perms,
+                                  replaced);
+}
+
+/**
+ * Return the table holding the leaf entry of `va` for pages of `page_size`,
+ * creating the address space and any missing interior tables on the way.
+ * Returns NULL if a larger page is in the way or allocation fails.
+ */
+static void *get_leaf_table(ptw_sim_context_t *ctx, uint32_t pid,
+                            uintptr_t va, page_size_t page_size) {
+  if (create_address_space(ctx, pid) != 0) {
+    return NULL;
+  }
+
+  // The root level never holds a leaf, so the walk always descends at least
+  // once
+  void *table = ctx->page_table_pointers[pid];
+  for (uint8_t level = 0; level < leaf_level(ctx, page_size); level++) {
+    table = get_or_alloc_table(
+        ctx, pid, entry_at(ctx, table, level_index(ctx, va, level)), va,
+        level + 1);
+    if (table == NULL) {
+      return NULL;
+    }
+  }
+  return table;
+}
+
+int map_page(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va, uintptr_t pa,
+             page_size_t page_size, permissions_t perms) {
+  if (ctx == NULL || pid >= MAX_PID) {
+    fprintf(stderr, "Invalid context or PID.\n");
+    return -1;
+  }
+
+  if (page_size != FOUR_K && page_size != TWO_M && page_size != ONE_G) {
+    fprintf(stderr, "Invalid page size %d.\n", page_size);
+    return -1;
+  }
+
+  // The walk only uses the bits above the page offset
+  uint64_t offset_mask = (1ULL << page_size_shift(page_size)) - 1;
+  va &= ~offset_mask;
+  pa &= ~offset_mask;
+
+  if (!range_mappable(ctx, va, offset_mask + 1)) {
+    return -1;
+  }
+
+  bool replaced;
+  if (!radix(ctx)) {
+    if (map_hashed_page(ctx, pid, va, pa, page_size, perms, &replaced) !=
+        0) {
+      return -1;
+    }
+  } else {
+    void *table = get_leaf_table(ctx, pid, va, page_size);
+    if (table == NULL) {
+      return -1;
+    }
+
+    uint8_t level = leaf_level(ctx, page_size);
+    if (set_leaf(ctx, entry_at(ctx, table, level_index(ctx, va, level)),
+                 level, va, pa, page_size, perms, &replaced) != 0) {
+      return -1;
+    }
+  }
+
+  if (replaced) {
+    tlb_shootdown(ctx, pid, va, page_size, 1);
+  }
+  return 0;
+}
+
+/**
+ * Largest page size that `va` and `pa` are both aligned to and that fits in
+ * `len`
+ */
+static page_size_t pick_page_size(uintptr_t va, uintptr_t pa, size_t len) {
+  static const page_size_t sizes[] = {ONE_G, TWO_M};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    uint64_t page = 1ULL << page_size_shift(sizes[i]);
+    if (((va | pa) & (page - 1)) == 0 && len >= page) {
+      return sizes[i];
+    }
+  }
+  return FOUR_K;
+}
+
+int map_range(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va, uintptr_t pa,
+              size_t len, permissions_t perms) {
+  if (ctx == NULL || pid >= MAX_PID) {
+    fprintf(stderr, "Invalid context or PID.\n");
+    return -1;
+  }
+
+  if (((va | pa | len) & OFFSET_MASK_4KB) != 0) {
+    fprintf(stderr, "Range 0x%lx+0x%zx -> 0x%lx is not 4K aligned.\n", va,
+            len, pa);
+    return -1;
+  }
+
+  if (!range_mappable(ctx, va, len)) {
+    return -1;
+  }
+
+  /**
+   * Each pass fills a run of same-size leaves in one table. A PTE table spans
+   * exactly one 2M region and a PDE table one 1G region, so running to the
+   * end of the table stops exactly where a larger page could start.
+   */
+  while (len > 0) {
+    page_size_t page_size = pick_page_size(va, pa, len);
+    uint64_t page = 1ULL << page_size_shift(page_size);
+
+    // Hashed organizations have no tables to fill, so one page per pass
+    if (!radix(ctx)) {
+      bool replaced;
+      if (map_hashed_page(ctx, pid, va, pa, page_size, perms, &replaced) !=
+          0) {
+        return -1;
+      }
+      if (replaced) {
+        tlb_shootdown(ctx, pid, va, page_size, 1);
+      }
+      va += page;
+      pa += page;
+      len -= page;
+      continue;
+    }
+
+    void *table = get_leaf_table(ctx, pid, va, page_size);
+    if (table == NULL) {
+      return -1;
+    }
+
+    uint8_t level = leaf_level(ctx, page_size);
+    size_t first = level_index(ctx, va, level);
+    size_t n = NUM_ENTRIES_PER_PAGE - first;
+    if (n > len / page) {
+      n = len / page;
+    }
+
+    // One shootdown covers the whole run if any page of it was mapped
+    uintptr_t run_va = va;
+    bool run_replaced = false;
+    int ret = 0;
+    for (size_t i = first; i < first + n && ret == 0; i++) {
+      bool replaced = false;
+      ret = set_leaf(ctx, entry_at(ctx, table, i), level, va, pa, page_size,
+                     perms, &replaced);
+      run_replaced |= replaced;
+      va += page;
+      pa += page;
+    }
+
+    if (run_replaced) {
+      tlb_shootdown(ctx, pid, run_va, page_size, n);
+    }
+    if (ret != 0) {
+      return -1;
+    }
+    len -= n * page;
+  }
+
+  return 0;
+}
+
+/**
+ * Find the entry a walk of `va` stops at: a leaf, an invalid entry, or a PTE.
+ * `level` is set to its level.
+ */
+static void *find_leaf(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va,
+                       uint8_t *level) {
+  void *table = ctx->page_table_pointers[pid];
+  for (uint8_t l = 0;; l++) {
+    void *entry = entry_at(ctx, table, level_index(ctx, va, l));
+    if (l == pt_n_levels(ctx) - 1 || !entry_is_table(ctx, entry, l)) {
+      *level = l;
+      return entry;
+    }
+    table = entry_child(ctx, entry);
+  }
+}
+
+/**
+ * Find the leaf that maps `va` in either organization
+ *
+ * Returns the leaf, or NULL if `va` isn't mapped. `span` is set to the bytes
+ * the leaf maps, or if there is none, to the size of an aligned region
+ * around `va` where nothing is mapped. `page_size` is set to the leaf's size.
+ */
+static void *find_page(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va,
+                       uint64_t *span, page_size_t *page_size) {
+  if (cuckoo(ctx)) {
+    ecpt_slot_t *slot = ecpt_find(ctx->ecpt[pid], va, page_size);
+    if (slot != NULL) {
+      *span = 1ULL << page_size_shift(*page_size);
+      return &slot->val;
+    }
+    // The CWTs tell how large an empty region around `va` is
+    const ecpt_t *ecpt = ctx->ecpt[pid];
+    *span = 1ULL << page_size_shift(
+                ecpt_region_sizes(ecpt, ECPT_CWT_PUD, va) == 0   ? ONE_G
+                : ecpt_region_sizes(ecpt, ECPT_CWT_PMD, va) == 0 ? TWO_M
+                                                                 : FOUR_K);
+    return NULL;
+  }
+
+  if (radix(ctx)) {
+    uint8_t level;
+    void *entry = find_leaf(ctx, pid, va, &level);
+    *span = level_span(ctx, level);
+    if (!entry_valid(ctx, entry)) {
+      return NULL;
+    }
+    *page_size = entry_page_size(ctx, entry, level);
+    return entry;
+  }
+
+  hpt_entry_t *e = hpt_find(ctx->hpt, pid, va, page_size);
+  if (e != NULL) {
+    *span = 1ULL << page_size_shift(*page_size);
+    return &e->pte;
+  }
+
+  // No page of the smallest size the PID maps covers `va`, and neither does
+  // a larger one, so that page's whole range is empty
+  uint8_t mapped = hpt_page_sizes(ctx->hpt, pid);
+  page_size_t smallest = mapped & PG_SIZE_BIT(FOUR_K)  ? FOUR_K
+                         : mapped & PG_SIZE_BIT(TWO_M) ? TWO_M
+                                                       : ONE_G;
+  *span = 1ULL << page_size_shift(smallest);
+  return NULL;
+}
+
+int set_page_global(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va,
+                    bool global) {
+  if (ctx == NULL || pid >= MAX_PID) {
+    fprintf(stderr, "Invalid context or PID.\n");
+    return -1;
+  }
+
+  if (!range_mappable(ctx, va, 1)) {
+    return -1;
+  }
+
+  uint64_t span;
+  page_size_t page_size;
+  void *entry = has_address_space(ctx, pid)
+                    ? find_page(ctx, pid, va, &span, &page_size)
+                    : NULL;
+  if (entry == NULL) {
+    fprintf(stderr, "VA 0x%lx is not mapped.\n", va);
+    return -1;
+  }
+
+  if (entry_global(ctx, entry) != global) {
+    entry_set_global(ctx, entry, global);
+    tlb_shootdown(ctx, pid, va & ~(span - 1), page_size, 1);
+  }
+  return 0;
+}
+
+int unmap_range(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va,
+                size_t len) {
+  if (ctx == NULL || pid >= MAX_PID) {
+    fprintf(stderr, "Invalid context or PID.\n");
+    return -1;
+  }
+
+  if (((va | len) & OFFSET_MASK_4KB) != 0) {
+    fprintf(stderr, "Range 0x%lx+0x%zx is not 4K aligned.\n", va, len);
+    return -1;
+  }
+
+  if (!has_address_space(ctx, pid)) {
+    return 0;
+  }
+
+  if (!range_mappable(ctx, va, len)) {
+    return -1;
+  }
+
+  // Consecutive pages of one size are shot down together
+  uintptr_t end = va + len;
+  uintptr_t run_va = 0;
+  size_t run_n = 0;
+  page_size_t run_size = FOUR_K;
+  int ret = 0;
+
+  while (va < end) {
+    uint64_t span;
+    page_size_t page_size;
+    void *entry = find_page(ctx, pid, va, &span, &page_size);
+
+    // Nothing is mapped anywhere in this entry's span
+    if (entry == NULL) {
+      va = (va & ~(span - 1)) + span;
+      continue;
+    }
+
+    if ((va & (span - 1)) != 0 || end - va < span) {
+      fprintf(stderr, "Unmapping 0x%lx would split a larger page.\n", va);
+      ret = -1;
+      break;
+    }
+
+    bool regions_changed = false;
+    if (hashed(ctx)) {
+      hpt_remove(ctx->hpt, pid, va, page_size);
+    } else if (cuckoo(ctx)) {
+      ecpt_remove(ctx->ecpt[pid], va, page_size, &regions_changed);
+    } else {
+      entry_clear(ctx, entry);
+    }
+    if (regions_changed) {
+      cwc_invalidate(ctx, pid, va);
+    }
+
+    if (run_n > 0 && (page_size != run_size || va != run_va + run_n * span)) {
+      tlb_shootdown(ctx, pid, run_va, run_size, run_n);
+      run_n = 0;
+    }
+    if (run_n == 0) {
+      run_va = va;
+      run_size = page_size;
+    }
+    run_n++;
+    va += span;
+  }
+
+  if (run_n > 0) {
+    tlb_shootdown(ctx, pid, run_va, run_size, run_n);
+  }
+  return ret;
+}
+
+uintptr_t allocate_physical_frame(uintptr_t vpn) {
+  static uintptr_t next_frame =
+      0x100000; // Example start address for physical memory
+  // Increment by 4KB for each allocation. Sharded replays fault from several
+  // threads at once.
+  return __atomic_fetch_add(&next_frame, KB(4), __ATOMIC_RELAXED);
+}
@@ -0,0 +1,479 @@
+/**
+ * @file compact_trace.c
+ *
+ * Delta/varint encoded, block framed traces. See compact_trace.h for the
+ * layout.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "compact_trace.h"
+#include "replay.h"
+
+/**
+ * Varint helpers (LEB128, 7 bits per byte, low bits first)
+ */
+
+static inline size_t put_varint(uint8_t *buf, uint64_t v) {
+  size_t n = 0;
+  while (v >= 0x80) {
+    buf[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  buf[n++] = (uint8_t)v;
+  return n;
+}
+
+/**
+ * Returns false if the varint runs past `end` or is longer than 10 bytes
+ */
+static inline bool get_varint(const uint8_t **pos, const uint8_t *end,
+                              uint64_t *v) {
+  const uint8_t *p = *pos;
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64 && p < end; shift += 7) {
+    uint8_t byte = *p++;
+    result |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *pos = p;
+      *v = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline uint64_t zigzag_encode(int64_t v) {
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t zigzag_decode(uint64_t v) {
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/**
+ * Encoder
+ */
+
+bool is_compact_trace(const char *path) {
+  char magic[8] = {0};
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    return false;
+  }
+  size_t n = fread(magic, 1, sizeof(magic), f);
+  fclose(f);
+  return n == sizeof(magic) &&
+         memcmp(magic, COMPACT_TRACE_MAGIC, sizeof(COMPACT_TRACE_MAGIC)) == 0;
+}
+
+int compact_trace_writer_open(compact_trace_writer_t *w, const char *path,
+                              uint32_t block_records) {
+  memset(w, 0, sizeof(*w));
+
+  if (block_records == 0) {
+    block_records = COMPACT_TRACE_DEFAULT_BLOCK_RECORDS;
+  }
+
+  w->f = fopen(path, "wb");
+  if (w->f == NULL) {
+    perror("compact_trace_writer_open: fopen");
+    return -1;
+  }
+
+  w->block_buf = malloc((size_t)block_records * COMPACT_RECORD_MAX_BYTES);
+  if (w->block_buf == NULL) {
+    fclose(w->f);
+    w->f = NULL;
+    return -1;
+  }
+
+  memcpy(w->header.magic, COMPACT_TRACE_MAGIC, sizeof(COMPACT_TRACE_MAGIC));
+  w->header.version = COMPACT_TRACE_VERSION;
+  w->header.block_records = block_records;
+
+  // Placeholder header. Rewritten on close once the totals are known.
+  if (fwrite(&w->header, sizeof(w->header), 1, w->f) != 1) {
+    fclose(w->f);
+    PTR_FREE(w->block_buf);
+    memset(w, 0, sizeof(*w));
+    return -1;
+  }
+
+  return 0;
+}
+
+static int flush_block(compact_trace_writer_t *w) {
+  if (w->block_count == 0) {
+    return 0;
+  }
+
+  if (w->n_blocks == w->index_cap) {
+    size_t cap = w->index_cap ? w->index_cap * 2 : 64;
+    compact_block_index_t *index = realloc(w->index, cap * sizeof(*index));
+    if (index == NULL) {
+      return -1;
+    }
+    w->index = index;
+    w->index_cap = cap;
+  }
+
+  w->index[w->n_blocks].offset = (uint64_t)ftell(w->f);
+  w->index[w->n_blocks].first_record = w->header.n_records - w->block_count;
+  w->n_blocks++;
+
+  compact_block_header_t bh = {.payload_len = (uint32_t)w->block_len,
+                               .n_records = w->block_count};
+  if (fwrite(&bh, sizeof(bh), 1, w->f) != 1 ||
+      fwrite(w->block_buf, 1, w->block_len, w->f) != w->block_len) {
+    return -1;
+  }
+
+  // Every block starts from fresh delta state
+  w->block_len = 0;
+  w->block_count = 0;
+  memset(w->last_va, 0, sizeof(w->last_va));
+  return 0;
+}
+
+int compact_trace_append(compact_trace_writer_t *w, const trace_record_t *rec) {
+  // The tag only has room for valid access types
+  address_context_t a_ctx;
+  if (!trace_record_to_address_context(rec, &a_ctx)) {
+    return -1;
+  }
+
+  uint64_t *last = &w->last_va[rec->pid & (TRACE_DELTA_SLOTS - 1)];
+  uint64_t tag = ((uint64_t)rec->pid << 3) |
+                 ((uint64_t)(rec->access_type & 0x3) << 1) |
+                 (rec->user_supervisor & 0x1);
+
+  uint8_t *buf = w->block_buf + w->block_len;
+  size_t n = put_varint(buf, tag);
+  n += put_varint(buf + n, zigzag_encode((int64_t)(rec->va - *last)));
+  *last = rec->va;
+
+  w->block_len += n;
+  w->block_count++;
+  w->header.n_records++;
+
+  if (w->block_count == w->header.block_records) {
+    return flush_block(w);
+  }
+  return 0;
+}
+
+int compact_trace_writer_close(compact_trace_writer_t *w) {
+  int ret = flush_block(w);
+
+  if (ret == 0) {
+    uint64_t n_blocks = w->n_blocks;
+    w->header.index_offset = (uint64_t)ftell(w->f);
+    if (fwrite(&n_blocks, sizeof(n_blocks), 1, w->f) != 1 ||
+        fwrite(w->index, sizeof(*w->index), w->n_blocks, w->f) !=
+            w->n_blocks) {
+      ret = -1;
+    }
+  }
+
+  if (ret == 0) {
+    if (fseek(w->f, 0, SEEK_SET) != 0 ||
+        fwrite(&w->header, sizeof(w->header), 1, w->f) != 1) {
+      ret = -1;
+    }
+  }
+
+  if (fclose(w->f) != 0) {
+    ret = -1;
+  }
+
+  PTR_FREE(w->block_buf);
+  PTR_FREE(w->index);
+  memset(w, 0, sizeof(*w));
+  return ret;
+}
+
+int convert_raw_trace(const char *raw_path, const char *compact_path,
+                      uint32_t block_records) {
+  replay_trace_t raw;
+  if (open_trace(raw_path, &raw) != 0) {
+    return -1;
+  }
+
+  compact_trace_writer_t w;
+  if (compact_trace_writer_open(&w, compact_path, block_records) != 0) {
+    close_trace(&raw);
+    return -1;
+  }
+
+  // Malformed records are dropped, as replaying the raw trace would skip
+  // them
+  int ret = 0;
+  size_t skipped = 0;
+  for (size_t i = 0; i < raw.n_records && ret == 0; i++) {
+    address_context_t a_ctx;
+    if (!trace_record_to_address_context(&raw.records[i], &a_ctx)) {
+      skipped++;
+      continue;
+    }
+    ret = compact_trace_append(&w, &raw.records[i]);
+  }
+
+  if (compact_trace_writer_close(&w) != 0) {
+    ret = -1;
+  }
+  close_trace(&raw);
+  if (ret == 0 && skipped > 0) {
+    fprintf(stderr, "Dropped %zu malformed records from %s.\n", skipped,
+            raw_path);
+  }
+  return ret;
+}
+
+/**
+ * Decoder
+ */
+
+int compact_trace_reader_open(compact_trace_reader_t *r, const char *path) {
+  memset(r, 0, sizeof(*r));
+
+  r->f = fopen(path, "rb");
+  if (r->f == NULL) {
+    perror("compact_trace_reader_open: fopen");
+    return -1;
+  }
+
+  uint64_t n_blocks = 0;
+  if (fread(&r->header, sizeof(r->header), 1, r->f) != 1 ||
+      memcmp(r->header.magic, COMPACT_TRACE_MAGIC,
+             sizeof(COMPACT_TRACE_MAGIC)) != 0 ||
+      r->header.version != COMPACT_TRACE_VERSION ||
+      fseek(r->f, (long)r->header.index_offset, SEEK_SET) != 0 ||
+      fread(&n_blocks, sizeof(n_blocks), 1, r->f) != 1) {
+    fprintf(stderr, "compact_trace_reader_open: %s has a bad header.\n", path);
+    compact_trace_reader_close(r);
+    return -1;
+  }
+
+  // Seeking needs a block to start from if there are records at all
+  if (n_blocks == 0 && r->header.n_records > 0) {
+    fprintf(stderr, "compact_trace_reader_open: %s has an empty index.\n",
+            path);
+    compact_trace_reader_close(r);
+    return -1;
+  }
+
+  r->n_blocks = n_blocks;
+  if (n_blocks > 0) {
+    r->index = malloc(n_blocks * sizeof(*r->index));
+    if (r->index == NULL ||
+        fread(r->index, sizeof(*r->index), n_blocks, r->f) != n_blocks) {
+      fprintf(stderr, "compact_trace_reader_open: %s has a bad index.\n",
+              path);
+      compact_trace_reader_close(r);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+void compact_trace_reader_close(compact_trace_reader_t *r) {
+  if (r->f != NULL) {
+    fclose(r->f);
+  }
+  PTR_FREE(r->index);
+  PTR_FREE(r->block_buf);
+  memset(r, 0, sizeof(*r));
+}
+
+/**
+ * Read block `b` into the block buffer and reset the delta state
+ */
+static int load_block(compact_trace_reader_t *r, size_t b) {
+  compact_block_header_t bh;
+  if (fseek(r->f, (long)r->index[b].offset, SEEK_SET) != 0 ||
+      fread(&bh, sizeof(bh), 1, r->f) != 1) {
+    r->corrupt = true;
+    return -1;
+  }
+
+  if (bh.payload_len > r->block_buf_cap) {
+    uint8_t *buf = realloc(r->block_buf, bh.payload_len);
+    if (buf == NULL) {
+      r->corrupt = true;
+      return -1;
+    }
+    r->block_buf = buf;
+    r->block_buf_cap = bh.payload_len;
+  }
+
+  if (fread(r->block_buf, 1, bh.payload_len, r->f) != bh.payload_len) {
+    r->corrupt = true;
+    return -1;
+  }
+
+  r->block_len = bh.payload_len;
+  r->block_pos = 0;
+  r->block_left = bh.n_records;
+  r->next_block = b + 1;
+  memset(r->last_va, 0, sizeof(r->last_va));
+  return 0;
+}
+
+/**
+ * Decode one record from the current block
+ */
+static inline bool decode_record(compact_trace_reader_t *r,
+                                 trace_record_t *rec) {
+  const uint8_t *pos = r->block_buf + r->block_pos;
+  const uint8_t *end = r->block_buf + r->block_len;
+  uint64_t tag, delta;
+
+  if (!get_varint(&pos, end, &tag) || !get_varint(&pos, end, &delta)) {
+    r->corrupt = true;
+    return false;
+  }
+
+  rec->pid = (uint32_t)(tag >> 3);
+  rec->access_type = (tag >> 1) & 0x3;
+  rec->user_supervisor = tag & 0x1;
+
+  uint64_t *last = &r->last_va[rec->pid & (TRACE_DELTA_SLOTS - 1)];
+  rec->va = *last + (uint64_t)zigzag_decode(delta);
+  *last = rec->va;
+
+  r->block_pos = pos - r->block_buf;
+  r->block_left--;
+  return true;
+}
+
+int compact_trace_seek(compact_trace_reader_t *r, uint64_t record) {
+  if (record >= r->header.n_records) {
+    return -1;
+  }
+
+  // Binary search for the last block starting at or before `record`
+  size_t lo = 0;
+  size_t hi = r->n_blocks;
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (r->index[mid].first_record <= record) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (load_block(r, lo) != 0) {
+    return -1;
+  }
+
+  // Deltas chain through the block, so decode up to the record
+  trace_record_t rec;
+  for (uint64_t i = r->index[lo].first_record; i < record; i++) {
+    if (!decode_record(r, &rec)) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+size_t compact_trace_read_records(compact_trace_reader_t *r,
+                                  trace_record_t *out, size_t max) {
+  size_t n = 0;
+  while (n < max && !r->corrupt) {
+    if (r->block_left == 0) {
+      if (r->next_block >= r->n_blocks || load_block(r, r->next_block) != 0) {
+        break;
+      }
+      continue;
+    }
+
+    if (!decode_record(r, &out[n])) {
+      break;
+    }
+    n++;
+  }
+  return n;
+}
+
+size_t compact_trace_next_batch(compact_trace_reader_t *r,
+                                address_context_t *out, size_t max,
+                                size_t *n_read) {
+  size_t n_out = 0;
+  size_t consumed = 0;
+  trace_record_t rec = {0};
+
+  while (n_out < max && !r->corrupt) {
+    if (r->block_left == 0) {
+      if (r->next_block >= r->n_blocks || load_block(r, r->next_block) != 0) {
+        break;
+      }
+      continue;
+    }
+
+    if (!decode_record(r, &rec)) {
+      break;
+    }
+    consumed++;
+
+    if (!trace_record_to_address_context(&rec, &out[n_out])) {
+      r->skipped++;
+      continue;
+    }
+    n_out++;
+  }
+
+  if (n_read != NULL) {
+    *n_read = consumed;
+  }
+  return n_out;
+}
+
+int replay_compact_trace(compact_trace_reader_t *r, ptw_sim_context_t *ctx,
+                         replay_fault_handler_t handler, void *arg,
+                         replay_stats_t *stats) {
+  if (r == NULL || ctx == NULL || stats == NULL) {
+    return -1;
+  }
+
+  *stats = (replay_stats_t){0};
+
+  address_context_t *batch = malloc(REPLAY_BATCH_SIZE * sizeof(*batch));
+  translation_result_t *results =
+      malloc(REPLAY_BATCH_SIZE * sizeof(*results));
+  if (batch == NULL || results == NULL) {
+    free(batch);
+    free(results);
+    return -1;
+  }
+
+  uint64_t skipped_before = r->skipped;
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  size_t n_read = 0;
+  size_t n;
+  while ((n = compact_trace_next_batch(r, batch, REPLAY_BATCH_SIZE,
+                                       &n_read)) > 0 ||
+         n_read > 0) {
+    stats->records += n_read;
+    replay_batch(ctx, batch, n, results, handler, arg, stats);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  stats->elapsed_ns = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ULL +
+                      (uint64_t)end.tv_nsec - (uint64_t)start.tv_nsec;
+  stats->skipped = r->skipped - skipped_before;
+
+  free(batch);
+  free(results);
+  return r->corrupt ? -1 : 0;
+}
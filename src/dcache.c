@@ -0,0 +1,173 @@
+/**
+ * @file dcache.c
+ *
+ * Data caches for page table reads
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dcache.h"
+
+static inline uint32_t dcache_set_index(const data_cache_t *cache,
+                                        uint64_t line) {
+  return (uint32_t)line & cache->set_mask;
+}
+
+/**
+ * Address an entry would have in hardware. Scaling the host address keeps
+ * entries of one table HW_PTE_SIZE bytes apart, and tables apart from each
+ * other.
+ */
+static inline uint64_t pte_hw_addr(const pte_t *entry) {
+  return (uintptr_t)entry / (sizeof(pte_t) / HW_PTE_SIZE);
+}
+
+data_cache_t *create_dcache(cache_geometry_t geometry,
+                            repl_policy_kind_t policy) {
+  uint32_t line = geometry.line_size;
+  uint64_t set_bytes = (uint64_t)geometry.ways * line;
+  if (geometry.ways == 0 || line == 0 || (line & (line - 1)) != 0 ||
+      geometry.size % set_bytes != 0) {
+    return NULL;
+  }
+
+  uint32_t sets = (uint32_t)(geometry.size / set_bytes);
+  if (sets == 0 || (sets & (sets - 1)) != 0) {
+    return NULL;
+  }
+
+  data_cache_t *cache = (data_cache_t *)calloc(1, sizeof(data_cache_t));
+  if (cache == NULL) {
+    return NULL;
+  }
+
+  cache->sets = sets;
+  cache->ways = geometry.ways;
+  cache->set_mask = sets - 1;
+  cache->line_size = line;
+  cache->line_shift = (uint8_t)__builtin_ctz(line);
+
+  size_t n = (size_t)sets * geometry.ways;
+  cache->tags = (uint64_t *)calloc(n, sizeof(uint64_t));
+  cache->slots_in_use = (uint32_t *)calloc(sets, sizeof(uint32_t));
+  cache->policy = create_repl_policy(policy, sets, geometry.ways, 0);
+  if (cache->tags == NULL || cache->slots_in_use == NULL ||
+      cache->policy == NULL) {
+    destroy_dcache(cache);
+    return NULL;
+  }
+
+  flush_dcache(cache);
+  return cache;
+}
+
+void destroy_dcache(data_cache_t *cache) {
+  if (cache == NULL) {
+    return;
+  }
+
+  PTR_FREE(cache->tags);
+  PTR_FREE(cache->slots_in_use);
+  destroy_repl_policy(cache->policy);
+  free(cache);
+}
+
+void flush_dcache(data_cache_t *cache) {
+  size_t n = (size_t)cache->sets * cache->ways;
+  for (size_t i = 0; i < n; i++) {
+    cache->tags[i] = TLB_INVALID_TAG;
+  }
+  memset(cache->slots_in_use, 0, cache->sets * sizeof(uint32_t));
+  reset_repl_policy(cache->policy);
+}
+
+bool dcache_lookup(data_cache_t *cache, uint64_t addr) {
+  uint64_t line = addr >> cache->line_shift;
+  uint32_t set = dcache_set_index(cache, line);
+  const uint64_t *tags = &cache->tags[(size_t)set * cache->ways];
+
+  for (uint32_t way = 0; way < cache->ways; way++) {
+    if (tags[way] == line) {
+      repl_on_hit(cache->policy, set, way);
+      cache->hits++;
+      return true;
+    }
+  }
+
+  cache->misses++;
+  return false;
+}
+
+void dcache_fill(data_cache_t *cache, uint64_t addr) {
+  uint64_t line = addr >> cache->line_shift;
+  uint32_t set = dcache_set_index(cache, line);
+  size_t base = (size_t)set * cache->ways;
+
+  // Make room if the set is full
+  if (cache->slots_in_use[set] == cache->ways) {
+    uint32_t victim = repl_victim(cache->policy, set);
+    cache->tags[base + victim] = TLB_INVALID_TAG;
+    cache->slots_in_use[set]--;
+    cache->evictions++;
+  }
+
+  for (uint32_t i = 0; i < cache->ways; i++) {
+    if (cache->tags[base + i] == TLB_INVALID_TAG) {
+      cache->tags[base + i] = line;
+      cache->slots_in_use[set]++;
+      repl_on_fill(cache->policy, set, i);
+      return;
+    }
+  }
+}
+
+uint32_t dcache_read(ptw_sim_context_t *ctx, uint64_t addr) {
+  const uint32_t hit_latency[CACHE_LEVELS] = {
+      [CACHE_L1D] = ctx->latency.l1d,
+      [CACHE_L2] = ctx->latency.l2,
+      [CACHE_LLC] = ctx->latency.llc,
+  };
+  bool cached = false;
+  int level;
+  for (level = CACHE_L1D; level < CACHE_LEVELS; level++) {
+    if (ctx->dcache[level] == NULL) {
+      continue;
+    }
+    cached = true;
+    if (dcache_lookup(ctx->dcache[level], addr)) {
+      break;
+    }
+  }
+
+  if (!cached) {
+    return ctx->latency.pt_read;
+  }
+
+  // Every level above the one that hit now holds the line too
+  for (int upper = CACHE_L1D; upper < level; upper++) {
+    if (ctx->dcache[upper] != NULL) {
+      dcache_fill(ctx->dcache[upper], addr);
+    }
+  }
+
+  return level < CACHE_LEVELS ? hit_latency[level] : ctx->latency.memory;
+}
+
+uint32_t dcache_read_pte(ptw_sim_context_t *ctx, const pte_t *entry) {
+  return dcache_read(ctx, pte_hw_addr(entry));
+}
+
+void print_dcache_stats(FILE *out, const char *name,
+                        const data_cache_t *cache) {
+  uint64_t lookups = cache->hits + cache->misses;
+  double miss_rate = lookups ? 100.0 * cache->misses / lookups : 0.0;
+  uint64_t size = (uint64_t)cache->sets * cache->ways * cache->line_size;
+  fprintf(out,
+          "%-8s %5luK %2u-way %3uB %-10s hits %-12lu misses %-12lu "
+          "(%6.2f%%) evictions %lu\n",
+          name, size >> 10, cache->ways, cache->line_size,
+          repl_policy_name(cache->policy->kind), cache->hits, cache->misses,
+          miss_rate, cache->evictions);
+}
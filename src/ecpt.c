@@ -0,0 +1,472 @@
+/**
+ * @file ecpt.c
+ *
+ * Elastic cuckoo page tables
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ecpt.h"
+
+// One odd multiplier per way, so each way hashes a key to a different slot
+static const uint64_t way_multipliers[ECPT_WAYS] = {
+    0x9e3779b97f4a7c15ULL,
+    0xc2b2ae3d27d4eb4fULL,
+    0x165667b19e3779f9ULL,
+};
+
+// Sizes in the order lookups try them
+static const page_size_t ecpt_sizes[] = {FOUR_K, TWO_M, ONE_G};
+
+// Each CWT entry packs one 20-bit page count per size
+#define CWT_COUNT_BITS 20
+#define CWT_COUNT_MASK ((1ULL << CWT_COUNT_BITS) - 1)
+
+static inline int cwt_count_shift(page_size_t page_size) {
+  return page_size == FOUR_K ? 0
+         : page_size == TWO_M ? CWT_COUNT_BITS
+                              : 2 * CWT_COUNT_BITS;
+}
+
+static inline uint64_t cwt_key(ecpt_cwt_level_t level, uint64_t va) {
+  return va >> (level == ECPT_CWT_PMD ? page_size_shift(TWO_M)
+                                      : page_size_shift(ONE_G));
+}
+
+static inline size_t way_bytes(uint32_t slots) {
+  // aligned_alloc wants a multiple of the alignment
+  size_t bytes = (size_t)slots * sizeof(ecpt_slot_t);
+  return (bytes + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+}
+
+static inline uint32_t way_hash(int way, uint64_t key) {
+  return (uint32_t)((key * way_multipliers[way]) >> 32);
+}
+
+static uint32_t next_random(ecpt_table_t *t) {
+  // xorshift64, seeded per table so runs are repeatable
+  t->rng ^= t->rng << 13;
+  t->rng ^= t->rng >> 7;
+  t->rng ^= t->rng << 17;
+  return (uint32_t)t->rng;
+}
+
+static void free_ways(ecpt_slot_t *ways[ECPT_WAYS]) {
+  for (int way = 0; way < ECPT_WAYS; way++) {
+    PTR_FREE(ways[way]);
+    ways[way] = NULL;
+  }
+}
+
+static int alloc_ways(ecpt_slot_t *ways[ECPT_WAYS], uint32_t slots) {
+  for (int way = 0; way < ECPT_WAYS; way++) {
+    ways[way] =
+        (ecpt_slot_t *)aligned_alloc(CACHE_LINE_SIZE, way_bytes(slots));
+    if (ways[way] == NULL) {
+      free_ways(ways);
+      return -1;
+    }
+    for (uint32_t i = 0; i < slots; i++) {
+      ways[way][i] = (ecpt_slot_t){ECPT_EMPTY, 0};
+    }
+  }
+  return 0;
+}
+
+static void init_table(ecpt_table_t *t) {
+  memset(t, 0, sizeof(*t));
+  t->rng = 0x2545f4914f6cdd1dULL;
+}
+
+static void free_table(ecpt_table_t *t) {
+  free_ways(t->ways);
+  free_ways(t->old);
+}
+
+ecpt_t *create_ecpt(uint32_t slots) {
+  if (slots == 0 || (slots & (slots - 1)) != 0) {
+    return NULL;
+  }
+
+  ecpt_t *ecpt = (ecpt_t *)calloc(1, sizeof(ecpt_t));
+  if (ecpt == NULL) {
+    return NULL;
+  }
+
+  // Tables are allocated on their first insert, so unused sizes cost nothing
+  for (int size = 0; size < PG_SIZE_MAX; size++) {
+    init_table(&ecpt->pages[size]);
+  }
+  for (int level = 0; level < ECPT_CWT_LEVELS; level++) {
+    init_table(&ecpt->cwt[level]);
+  }
+  ecpt->initial_slots = slots;
+  return ecpt;
+}
+
+void destroy_ecpt(ecpt_t *ecpt) {
+  if (ecpt == NULL) {
+    return;
+  }
+
+  for (int size = 0; size < PG_SIZE_MAX; size++) {
+    free_table(&ecpt->pages[size]);
+  }
+  for (int level = 0; level < ECPT_CWT_LEVELS; level++) {
+    free_table(&ecpt->cwt[level]);
+  }
+  free(ecpt);
+}
+
+static ecpt_slot_t *slot_of(const ecpt_table_t *t, int way, uint64_t key) {
+  uint32_t hash = way_hash(way, key);
+  if (t->old[way] != NULL) {
+    uint32_t index = hash & (t->old_slots - 1);
+    if (index >= t->rehash[way]) {
+      return &t->old[way][index];
+    }
+  }
+  return &t->ways[way][hash & (t->slots - 1)];
+}
+
+ecpt_slot_t *ecpt_probe(const ecpt_table_t *t, int way, uint64_t key) {
+  return slot_of(t, way, key);
+}
+
+static ecpt_slot_t *table_find(const ecpt_table_t *t, uint64_t key) {
+  if (t->entries == 0) {
+    return NULL;
+  }
+
+  for (int way = 0; way < ECPT_WAYS; way++) {
+    ecpt_slot_t *slot = slot_of(t, way, key);
+    if (slot->key == key) {
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Put `item` in its slot of `way`, moving whatever was there to another way,
+ * and so on. Returns true once every entry has a slot. Otherwise `item` is
+ * left holding the entry that has none.
+ */
+static bool place(ecpt_table_t *t, ecpt_slot_t *item, int way) {
+  for (int kick = 0; kick <= ECPT_MAX_KICKS; kick++) {
+    ecpt_slot_t *slot = slot_of(t, way, item->key);
+    ecpt_slot_t victim = *slot;
+    *slot = *item;
+    if (victim.key == ECPT_EMPTY) {
+      return true;
+    }
+
+    *item = victim;
+    t->kicks++;
+    // Any way but the one it was kicked out of
+    way = (way + 1 + (int)(next_random(t) % (ECPT_WAYS - 1))) % ECPT_WAYS;
+  }
+  return false;
+}
+
+/**
+ * Rehash every entry, and `homeless`, into a table twice as large, all at
+ * once. Only for when kicks can't find a slot, which the elastic resizes
+ * keep rare.
+ */
+static int rebuild(ecpt_table_t *t, ecpt_slot_t homeless) {
+  ecpt_slot_t *items =
+      (ecpt_slot_t *)malloc((t->entries + 1) * sizeof(ecpt_slot_t));
+  if (items == NULL) {
+    return -1;
+  }
+
+  size_t n = 0;
+  ecpt_slot_t **tables[] = {t->old, t->ways};
+  uint32_t slots[] = {t->old_slots, t->slots};
+  for (int i = 0; i < 2; i++) {
+    for (int way = 0; way < ECPT_WAYS && tables[i][way] != NULL; way++) {
+      for (uint32_t s = 0; s < slots[i]; s++) {
+        if (tables[i][way][s].key != ECPT_EMPTY) {
+          items[n++] = tables[i][way][s];
+        }
+      }
+    }
+  }
+  items[n++] = homeless;
+
+  ecpt_slot_t *ways[ECPT_WAYS];
+  uint32_t new_slots = t->slots * 2;
+  for (;;) {
+    if (alloc_ways(ways, new_slots) != 0) {
+      free(items);
+      return -1;
+    }
+
+    free_table(t);
+    memcpy(t->ways, ways, sizeof(ways));
+    t->slots = new_slots;
+    t->old_slots = 0;
+    memset(t->rehash, 0, sizeof(t->rehash));
+
+    size_t placed = 0;
+    while (placed < n) {
+      ecpt_slot_t item = items[placed];
+      if (!place(t, &item, (int)(next_random(t) % ECPT_WAYS))) {
+        break;
+      }
+      placed++;
+    }
+    if (placed == n) {
+      break;
+    }
+    new_slots *= 2;
+  }
+
+  t->resizes++;
+  free(items);
+  return 0;
+}
+
+/**
+ * Move up to `n` old slots into the new table, from the way whose rehash
+ * pointer is furthest behind. Frees the old table once it's empty.
+ */
+static int drain(ecpt_table_t *t, uint32_t n) {
+  while (t->old[0] != NULL && n-- > 0) {
+    int way = 0;
+    for (int w = 1; w < ECPT_WAYS; w++) {
+      if (t->rehash[w] < t->rehash[way]) {
+        way = w;
+      }
+    }
+
+    // Past the pointer, lookups of this slot's keys go to the new table
+    uint32_t index = t->rehash[way]++;
+    ecpt_slot_t item = t->old[way][index];
+    t->old[way][index].key = ECPT_EMPTY;
+    if (item.key != ECPT_EMPTY && !place(t, &item, way)) {
+      // Rebuilding empties the old table too
+      return rebuild(t, item);
+    }
+
+    if (t->rehash[way] == t->old_slots) {
+      bool drained = true;
+      for (int w = 0; w < ECPT_WAYS; w++) {
+        drained &= t->rehash[w] == t->old_slots;
+      }
+      if (drained) {
+        free_ways(t->old);
+        t->old_slots = 0;
+        memset(t->rehash, 0, sizeof(t->rehash));
+      }
+    }
+  }
+  return 0;
+}
+
+/**
+ * Start an elastic resize into a table twice as large. A resize still
+ * draining is finished first.
+ */
+static int grow(ecpt_table_t *t) {
+  uint32_t slots = t->slots;
+  if (drain(t, UINT32_MAX) != 0) {
+    return -1;
+  }
+  if (t->slots != slots) {
+    // Draining had to rebuild, which already doubled the table
+    return 0;
+  }
+
+  ecpt_slot_t *ways[ECPT_WAYS];
+  if (alloc_ways(ways, slots * 2) != 0) {
+    return -1;
+  }
+  memcpy(t->old, t->ways, sizeof(t->ways));
+  memcpy(t->ways, ways, sizeof(ways));
+  t->old_slots = slots;
+  t->slots = slots * 2;
+  memset(t->rehash, 0, sizeof(t->rehash));
+  t->resizes++;
+  return 0;
+}
+
+static int table_insert(ecpt_table_t *t, uint32_t initial_slots, uint64_t key,
+                        uint64_t val) {
+  if (t->ways[0] == NULL) {
+    if (alloc_ways(t->ways, initial_slots) != 0) {
+      return -1;
+    }
+    t->slots = initial_slots;
+  }
+
+  uint64_t capacity = (uint64_t)ECPT_WAYS * t->slots;
+  if ((t->entries + 1) * 100 > capacity * ECPT_RESIZE_PERCENT &&
+      grow(t) != 0) {
+    return -1;
+  }
+
+  t->entries++;
+  ecpt_slot_t item = {key, val};
+  if (!place(t, &item, (int)(next_random(t) % ECPT_WAYS)) &&
+      rebuild(t, item) != 0) {
+    return -1;
+  }
+  return drain(t, ECPT_REHASH_STEP);
+}
+
+static bool table_remove(ecpt_table_t *t, uint64_t key) {
+  ecpt_slot_t *slot = table_find(t, key);
+  if (slot == NULL) {
+    return false;
+  }
+  slot->key = ECPT_EMPTY;
+  t->entries--;
+  return true;
+}
+
+uint8_t ecpt_page_sizes(const ecpt_t *ecpt) {
+  uint8_t sizes = 0;
+  for (size_t i = 0; i < sizeof(ecpt_sizes) / sizeof(ecpt_sizes[0]); i++) {
+    sizes |= ecpt->pages[ecpt_sizes[i]].entries ? PG_SIZE_BIT(ecpt_sizes[i])
+                                                : 0;
+  }
+  return sizes;
+}
+
+uint8_t ecpt_region_sizes(const ecpt_t *ecpt, ecpt_cwt_level_t level,
+                          uint64_t va) {
+  const ecpt_slot_t *slot = table_find(&ecpt->cwt[level], cwt_key(level, va));
+  uint8_t sizes = 0;
+  for (size_t i = 0; slot != NULL && i < sizeof(ecpt_sizes) /
+                                             sizeof(ecpt_sizes[0]);
+       i++) {
+    uint64_t count = slot->val >> cwt_count_shift(ecpt_sizes[i]);
+    sizes |= (count & CWT_COUNT_MASK) ? PG_SIZE_BIT(ecpt_sizes[i]) : 0;
+  }
+  return sizes;
+}
+
+ecpt_slot_t *ecpt_find(ecpt_t *ecpt, uint64_t va, page_size_t *page_size) {
+  for (size_t i = 0; i < sizeof(ecpt_sizes) / sizeof(ecpt_sizes[0]); i++) {
+    page_size_t size = ecpt_sizes[i];
+    ecpt_slot_t *slot =
+        table_find(&ecpt->pages[size], va >> page_size_shift(size));
+    if (slot != NULL) {
+      *page_size = size;
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Add `delta` pages of `page_size` to the count of the region of `level`
+ * holding `va`. Sets `changed` if the count went from or to zero.
+ */
+static int count_page(ecpt_t *ecpt, ecpt_cwt_level_t level, uint64_t va,
+                      page_size_t page_size, int delta, bool *changed) {
+  ecpt_table_t *t = &ecpt->cwt[level];
+  uint64_t key = cwt_key(level, va);
+  int shift = cwt_count_shift(page_size);
+  ecpt_slot_t *slot = table_find(t, key);
+
+  if (slot == NULL) {
+    *changed = true;
+    return delta > 0 ? table_insert(t, ecpt->initial_slots, key, 1ULL << shift)
+                     : 0;
+  }
+
+  slot->val += delta > 0 ? 1ULL << shift : -(1ULL << shift);
+  if (((slot->val >> shift) & CWT_COUNT_MASK) == (delta > 0 ? 1 : 0)) {
+    *changed = true;
+  }
+  if (slot->val == 0) {
+    table_remove(t, key);
+  }
+  return 0;
+}
+
+int ecpt_insert(ecpt_t *ecpt, uint64_t va, page_size_t page_size,
+                uint64_t pte, bool *regions_changed) {
+  *regions_changed = false;
+  if (table_insert(&ecpt->pages[page_size], ecpt->initial_slots,
+                   va >> page_size_shift(page_size), pte) != 0) {
+    return -1;
+  }
+
+  // 2M regions only count the pages inside them
+  if (page_size != ONE_G &&
+      count_page(ecpt, ECPT_CWT_PMD, va, page_size, 1, regions_changed) != 0) {
+    return -1;
+  }
+  return count_page(ecpt, ECPT_CWT_PUD, va, page_size, 1, regions_changed);
+}
+
+bool ecpt_remove(ecpt_t *ecpt, uint64_t va, page_size_t page_size,
+                 bool *regions_changed) {
+  *regions_changed = false;
+  if (!table_remove(&ecpt->pages[page_size],
+                    va >> page_size_shift(page_size))) {
+    return false;
+  }
+
+  if (page_size != ONE_G) {
+    count_page(ecpt, ECPT_CWT_PMD, va, page_size, -1, regions_changed);
+  }
+  count_page(ecpt, ECPT_CWT_PUD, va, page_size, -1, regions_changed);
+  return true;
+}
+
+static size_t table_memory(const ecpt_table_t *t) {
+  size_t bytes = 0;
+  if (t->ways[0] != NULL) {
+    bytes += ECPT_WAYS * way_bytes(t->slots);
+  }
+  if (t->old[0] != NULL) {
+    bytes += ECPT_WAYS * way_bytes(t->old_slots);
+  }
+  return bytes;
+}
+
+void print_ecpt_stats(FILE *out, const ecpt_stats_t *stats,
+                      ecpt_t *const *tables, size_t n) {
+  uint64_t entries = 0;
+  uint64_t slots = 0;
+  uint64_t resizes = 0;
+  uint64_t kicks = 0;
+  size_t bytes = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (tables[i] == NULL) {
+      continue;
+    }
+    for (size_t s = 0; s < sizeof(ecpt_sizes) / sizeof(ecpt_sizes[0]); s++) {
+      const ecpt_table_t *t = &tables[i]->pages[ecpt_sizes[s]];
+      entries += t->entries;
+      slots += t->ways[0] != NULL ? (uint64_t)ECPT_WAYS * t->slots : 0;
+      resizes += t->resizes;
+      kicks += t->kicks;
+      bytes += table_memory(t);
+    }
+    for (int level = 0; level < ECPT_CWT_LEVELS; level++) {
+      bytes += table_memory(&tables[i]->cwt[level]);
+    }
+  }
+
+  double lookups = stats->lookups ? (double)stats->lookups : 1.0;
+  fprintf(out, "Cuckoo walks:     %lu (%.2f page + %.2f CWT reads, %.2f "
+               "sizes probed per walk)\n",
+          stats->lookups, stats->page_reads / lookups,
+          stats->cwt_reads / lookups, stats->sizes_probed / lookups);
+  fprintf(out, "Probe latency:    %.2f cycles per walk in parallel, %.2f one "
+               "after another\n",
+          stats->parallel_cycles / lookups, stats->serial_cycles / lookups);
+  fprintf(out, "Cuckoo tables:    %lu pages in %lu slots (load %.2f), %lu "
+               "resizes, %lu kicks\n",
+          entries, slots, slots ? (double)entries / slots : 0.0, resizes,
+          kicks);
+  fprintf(out, "Table memory:     %.2f MiB\n", bytes / (1024.0 * 1024.0));
+}
@@ -0,0 +1,178 @@
+/**
+ * @file event_trace.c
+ *
+ * Per-thread event rings and the thread that drains them to a file
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "event_trace.h"
+
+// How long the drain thread sleeps when every ring is empty
+#define DRAIN_IDLE_NS 1000000L
+
+__thread event_ring_t *event_ring;
+__thread uint32_t event_ring_epoch;
+_Atomic uint32_t event_trace_epoch;
+
+/**
+ * The one tracing session that can be running
+ */
+static struct {
+  pthread_mutex_t lock; //< Guards rings and n_rings
+  event_ring_t *rings;
+  uint16_t n_rings;
+  FILE *out;
+  pthread_t drainer;
+  _Atomic bool running;
+  _Atomic bool stopping;
+  bool write_failed; //< Only touched by the drain thread until it is joined
+} session = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+event_ring_t *event_trace_attach(void) {
+  if (!atomic_load_explicit(&session.running, memory_order_acquire)) {
+    return NULL;
+  }
+
+  event_ring_t *r = calloc(1, sizeof(event_ring_t));
+  if (r == NULL) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&session.lock);
+  r->thread = session.n_rings++;
+  r->next = session.rings;
+  session.rings = r;
+  pthread_mutex_unlock(&session.lock);
+
+  event_ring = r;
+  event_ring_epoch = atomic_load(&event_trace_epoch);
+  return r;
+}
+
+/**
+ * Write whatever `r` holds. Returns the number of events written.
+ */
+static uint64_t drain_ring(event_ring_t *r) {
+  uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+  uint64_t n = head - tail;
+
+  // Up to two writes, since the events might wrap around the end
+  uint64_t done = 0;
+  while (done < n) {
+    uint64_t start = (tail + done) & (EVENT_RING_SIZE - 1);
+    uint64_t chunk = n - done;
+    if (chunk > EVENT_RING_SIZE - start) {
+      chunk = EVENT_RING_SIZE - start;
+    }
+    if (fwrite(&r->events[start], sizeof(trace_event_t), chunk,
+               session.out) != chunk) {
+      session.write_failed = true;
+    }
+    done += chunk;
+  }
+
+  atomic_store_explicit(&r->tail, head, memory_order_release);
+  return n;
+}
+
+static uint64_t drain_all(void) {
+  uint64_t n = 0;
+  pthread_mutex_lock(&session.lock);
+  for (event_ring_t *r = session.rings; r != NULL; r = r->next) {
+    n += drain_ring(r);
+  }
+  pthread_mutex_unlock(&session.lock);
+  return n;
+}
+
+static void *drain_main(void *arg) {
+  const struct timespec idle = {0, DRAIN_IDLE_NS};
+  while (!atomic_load_explicit(&session.stopping, memory_order_acquire)) {
+    if (drain_all() == 0) {
+      nanosleep(&idle, NULL);
+    }
+  }
+
+  // Recording has stopped, so this gets the rest
+  drain_all();
+  return NULL;
+}
+
+int event_trace_start(const char *path) {
+  if (atomic_load(&session.running)) {
+    fprintf(stderr, "Event tracing is already running.\n");
+    return -1;
+  }
+
+  session.out = fopen(path, "wb");
+  if (session.out == NULL) {
+    perror("event_trace_start: fopen");
+    return -1;
+  }
+
+  event_trace_header_t header = {.version = EVENT_TRACE_VERSION,
+                                 .event_size = sizeof(trace_event_t)};
+  memcpy(header.magic, EVENT_TRACE_MAGIC, sizeof(header.magic));
+  if (fwrite(&header, sizeof(header), 1, session.out) != 1) {
+    fclose(session.out);
+    return -1;
+  }
+
+  session.rings = NULL;
+  session.n_rings = 0;
+  session.write_failed = false;
+  atomic_store(&session.stopping, false);
+  atomic_store(&session.running, true);
+
+  if (pthread_create(&session.drainer, NULL, drain_main, NULL) != 0) {
+    fprintf(stderr, "Failed to start the event drain thread.\n");
+    atomic_store(&session.running, false);
+    fclose(session.out);
+    return -1;
+  }
+  return 0;
+}
+
+int64_t event_trace_stop(void) {
+  if (!atomic_load(&session.running)) {
+    return 0;
+  }
+
+  // The rings are about to be freed. Make every thread attach again before
+  // it records, which fails until the next session starts.
+  atomic_store(&session.running, false);
+  atomic_fetch_add(&event_trace_epoch, 1);
+  atomic_store(&session.stopping, true);
+  pthread_join(session.drainer, NULL);
+
+  int64_t dropped = 0;
+  event_ring_t *r = session.rings;
+  while (r != NULL) {
+    event_ring_t *next = r->next;
+    dropped += r->dropped;
+    free(r);
+    r = next;
+  }
+  session.rings = NULL;
+
+  bool failed = session.write_failed;
+  if (fclose(session.out) != 0) {
+    failed = true;
+  }
+  session.out = NULL;
+
+  if (failed) {
+    fprintf(stderr, "Failed to write the event trace.\n");
+    return -1;
+  }
+  return dropped;
+}
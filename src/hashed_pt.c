@@ -0,0 +1,262 @@
+/**
+ * @file hashed_pt.c
+ *
+ * Global hashed page table
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hashed_pt.h"
+
+// Overflow entries are carved out of table-sized blocks
+#define HPT_BLOCK_ENTRIES (PT_TABLE_ALIGN / sizeof(hpt_entry_t))
+
+// Sizes in the order lookups probe them
+static const page_size_t hpt_sizes[] = {FOUR_K, TWO_M, ONE_G};
+
+static inline size_t bucket_bytes(uint32_t n_buckets) {
+  // aligned_alloc wants a multiple of the alignment
+  size_t bytes = (size_t)n_buckets * sizeof(hpt_entry_t);
+  return (bytes + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+}
+
+hashed_pt_t *create_hashed_pt(uint32_t n_buckets) {
+  if (n_buckets == 0 || (n_buckets & (n_buckets - 1)) != 0) {
+    return NULL;
+  }
+
+  hashed_pt_t *hpt = (hashed_pt_t *)calloc(1, sizeof(hashed_pt_t));
+  if (hpt == NULL) {
+    return NULL;
+  }
+
+  hpt->n_buckets = n_buckets;
+  hpt->buckets = (hpt_entry_t *)aligned_alloc(CACHE_LINE_SIZE,
+                                              bucket_bytes(n_buckets));
+  hpt->chains = create_pt_arena();
+  if (hpt->buckets == NULL || hpt->chains == NULL) {
+    destroy_hashed_pt(hpt);
+    return NULL;
+  }
+
+  memset(hpt->buckets, 0, bucket_bytes(n_buckets));
+  for (uint32_t i = 0; i < n_buckets; i++) {
+    hpt->buckets[i].tag = TLB_INVALID_TAG;
+  }
+  return hpt;
+}
+
+void destroy_hashed_pt(hashed_pt_t *hpt) {
+  if (hpt == NULL) {
+    return;
+  }
+
+  PTR_FREE(hpt->buckets);
+  destroy_pt_arena(hpt->chains);
+  free(hpt);
+}
+
+/**
+ * Take an overflow entry off the free list, carving a new block if it's
+ * empty. Blocks aren't tables of any level, so the arena doesn't count them
+ * per level.
+ */
+static hpt_entry_t *alloc_overflow(hashed_pt_t *hpt) {
+  if (hpt->free == NULL) {
+    hpt_entry_t *block = (hpt_entry_t *)pt_arena_alloc(
+        hpt->chains, PT_TABLE_ALIGN, PT_MAX_LEVELS);
+    if (block == NULL) {
+      return NULL;
+    }
+    for (size_t i = 0; i < HPT_BLOCK_ENTRIES; i++) {
+      block[i].next = hpt->free;
+      hpt->free = &block[i];
+    }
+  }
+
+  hpt_entry_t *e = hpt->free;
+  hpt->free = e->next;
+  return e;
+}
+
+static void free_overflow(hashed_pt_t *hpt, hpt_entry_t *e) {
+  e->tag = TLB_INVALID_TAG;
+  e->next = hpt->free;
+  hpt->free = e;
+}
+
+hpt_entry_t *hpt_find(const hashed_pt_t *hpt, uint32_t pid, uint64_t va,
+                      page_size_t *page_size) {
+  uint8_t sizes = hpt_page_sizes(hpt, pid);
+  for (size_t i = 0; i < sizeof(hpt_sizes) / sizeof(hpt_sizes[0]); i++) {
+    if (!(sizes & PG_SIZE_BIT(hpt_sizes[i]))) {
+      continue;
+    }
+
+    uint64_t tag = tlb_tag(va, hpt_sizes[i]);
+    for (hpt_entry_t *e = hpt_bucket(hpt, pid, tag); e != NULL; e = e->next) {
+      if (hpt_entry_matches(e, pid, tag)) {
+        *page_size = hpt_sizes[i];
+        return e;
+      }
+    }
+  }
+  return NULL;
+}
+
+bool hpt_has_smaller(const hashed_pt_t *hpt, uint32_t pid, uint64_t va,
+                     page_size_t page_size) {
+  uint8_t sizes = hpt_page_sizes(hpt, pid);
+  uint64_t span = 1ULL << page_size_shift(page_size);
+  uint64_t base = va & ~(span - 1);
+  for (size_t i = 0; i < sizeof(hpt_sizes) / sizeof(hpt_sizes[0]); i++) {
+    page_size_t size = hpt_sizes[i];
+    if (size >= page_size || !(sizes & PG_SIZE_BIT(size))) {
+      continue;
+    }
+
+    uint64_t step = 1ULL << page_size_shift(size);
+    for (uint64_t addr = base; addr < base + span; addr += step) {
+      uint64_t tag = tlb_tag(addr, size);
+      for (const hpt_entry_t *e = hpt_bucket(hpt, pid, tag); e != NULL;
+           e = e->next) {
+        if (hpt_entry_matches(e, pid, tag)) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+hpt_entry_t *hpt_insert(hashed_pt_t *hpt, uint32_t pid, uint64_t va,
+                        page_size_t page_size, bool *existed) {
+  uint64_t tag = tlb_tag(va, page_size);
+  hpt_entry_t *bucket = hpt_bucket(hpt, pid, tag);
+  for (hpt_entry_t *e = bucket; e != NULL; e = e->next) {
+    if (hpt_entry_matches(e, pid, tag)) {
+      *existed = true;
+      return e;
+    }
+  }
+
+  // The bucket's own entry first, then a new entry at the head of the chain
+  hpt_entry_t *e = bucket;
+  if (bucket->tag != TLB_INVALID_TAG) {
+    e = alloc_overflow(hpt);
+    if (e == NULL) {
+      return NULL;
+    }
+    e->next = bucket->next;
+    bucket->next = e;
+    hpt->overflow++;
+  }
+
+  e->tag = tag;
+  e->pid = pid;
+  e->pte = 0;
+  hpt->pages[pid][page_size]++;
+  hpt->entries++;
+  *existed = false;
+  return e;
+}
+
+/**
+ * Unlink `e` from the chain of `bucket`. `prev` is the entry before it, or
+ * NULL if `e` is the bucket's own entry.
+ */
+static void remove_entry(hashed_pt_t *hpt, hpt_entry_t *bucket,
+                         hpt_entry_t *prev, hpt_entry_t *e) {
+  hpt->pages[e->pid][e->tag >> TLB_TAG_SIZE_SHIFT]--;
+  hpt->entries--;
+
+  // The bucket's entry can't move, so the first overflow entry takes its
+  // place
+  if (e == bucket) {
+    hpt_entry_t *next = bucket->next;
+    if (next == NULL) {
+      bucket->tag = TLB_INVALID_TAG;
+      bucket->pte = 0;
+      return;
+    }
+    *bucket = *next;
+    e = next;
+    prev = bucket;
+  }
+
+  prev->next = e->next;
+  free_overflow(hpt, e);
+  hpt->overflow--;
+}
+
+bool hpt_remove(hashed_pt_t *hpt, uint32_t pid, uint64_t va,
+                page_size_t page_size) {
+  uint64_t tag = tlb_tag(va, page_size);
+  hpt_entry_t *bucket = hpt_bucket(hpt, pid, tag);
+  hpt_entry_t *prev = NULL;
+  for (hpt_entry_t *e = bucket; e != NULL; prev = e, e = e->next) {
+    if (hpt_entry_matches(e, pid, tag)) {
+      remove_entry(hpt, bucket, prev, e);
+      return true;
+    }
+  }
+  return false;
+}
+
+void hpt_remove_pid(hashed_pt_t *hpt, uint32_t pid) {
+  if (hpt_page_sizes(hpt, pid) == 0) {
+    return;
+  }
+
+  for (uint32_t i = 0; i < hpt->n_buckets; i++) {
+    hpt_entry_t *bucket = &hpt->buckets[i];
+    hpt_entry_t *prev = NULL;
+    hpt_entry_t *e = bucket;
+    while (e != NULL) {
+      if (e->tag == TLB_INVALID_TAG || e->pid != pid) {
+        prev = e;
+        e = e->next;
+        continue;
+      }
+      // What followed `e` is now at prev->next, or in the bucket itself
+      remove_entry(hpt, bucket, prev, e);
+      e = prev != NULL ? prev->next : bucket;
+    }
+  }
+}
+
+void print_hpt_stats(FILE *out, const hpt_stats_t *stats,
+                     hashed_pt_t *const *tables, size_t n) {
+  uint64_t buckets = 0;
+  uint64_t entries = 0;
+  uint64_t overflow = 0;
+  size_t bytes = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (tables[i] == NULL) {
+      continue;
+    }
+    buckets += tables[i]->n_buckets;
+    entries += tables[i]->entries;
+    overflow += tables[i]->overflow;
+    bytes += bucket_bytes(tables[i]->n_buckets) +
+             tables[i]->chains->bytes_used;
+  }
+
+  double lookups = stats->lookups ? (double)stats->lookups : 1.0;
+  fprintf(out, "Hashed lookups:   %lu (%.2f probes, %.2f entries read per "
+               "lookup)\n",
+          stats->lookups, stats->probes / lookups, stats->mem_refs / lookups);
+  fprintf(out, "Entries read:    ");
+  for (int refs = 0; refs <= HPT_REFS_HIST; refs++) {
+    fprintf(out, " %d%s: %lu", refs, refs == HPT_REFS_HIST ? "+" : "",
+            stats->refs[refs]);
+  }
+  fprintf(out, "\n");
+  fprintf(out, "Hashed table:     %lu pages in %lu buckets (load %.2f), %lu "
+               "in chains\n",
+          entries, buckets, buckets ? (double)entries / buckets : 0.0,
+          overflow);
+  fprintf(out, "Table memory:     %.2f MiB\n", bytes / (1024.0 * 1024.0));
+}
@@ -0,0 +1,46 @@
+/**
+ * @file hw_pte.c
+ *
+ * Conversion between pte_t and packed hardware entries
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "hw_pte.h"
+
+hw_pte_t hw_pte_from_pte(const pte_t *entry) {
+  if (!entry->page_metadata.valid) {
+    return 0;
+  }
+
+  // Interior entries are marked with PG_SIZE_MAX
+  if (entry->page_metadata.page_size == PG_SIZE_MAX) {
+    return hw_pte_encode_table((const void *)entry->phys_frame.fourk_pte_index);
+  }
+
+  hw_pte_t e = hw_pte_encode_leaf(
+      entry->phys_frame.fourk_pte_index, entry->page_metadata.page_size,
+      entry->page_metadata.permissions, entry->page_metadata.user_supervisor,
+      entry->page_metadata.global);
+  return e | (entry->page_metadata.dirty ? HW_PTE_D : 0);
+}
+
+void hw_pte_to_pte(hw_pte_t e, page_size_t level_size, uintptr_t va,
+                   uint32_t pid, pte_t *entry) {
+  memset(entry, 0, sizeof(*entry));
+  if (!hw_pte_present(e)) {
+    return;
+  }
+
+  entry->vpn = va;
+  entry->phys_frame.fourk_pte_index = hw_pte_addr(e);
+  entry->page_metadata.pid = pid;
+  entry->page_metadata.valid = 1;
+  entry->page_metadata.permissions = hw_pte_permissions(e);
+  entry->page_metadata.user_supervisor = hw_pte_user_supervisor(e);
+  entry->page_metadata.global = (e & HW_PTE_G) != 0;
+  entry->page_metadata.dirty = (e & HW_PTE_D) != 0;
+  entry->page_metadata.page_size =
+      hw_pte_is_leaf(e, level_size) ? level_size : PG_SIZE_MAX;
+}
@@ -0,0 +1,147 @@
+/**
+ * @file address_space.h
+ *
+ * Building and tearing down per-PID page tables
+ *
+ * Page tables are built sparsely: mapping a VA creates only the interior
+ * tables on its path, so memory use follows the mapped footprint rather than
+ * the size of the address space.
+ */
+
+#ifndef ADDRESS_SPACE_H
+#define ADDRESS_SPACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hw_structures.h"
+#include "page_table_api.h"
+#include "util.h"
+
+/**
+ * @brief Returns true if a page table entry points at a lower-level table.
+ *
+ * Interior entries are marked with PG_SIZE_MAX. Anything else that is valid
+ * is a leaf whose phys_frame is a physical address, not a table.
+ */
+static inline bool is_table_pointer(const pte_t *entry) {
+  return entry->page_metadata.valid &&
+         entry->page_metadata.page_size == PG_SIZE_MAX;
+}
+
+/**
+ * @brief Creates an empty address space for a PID.
+ *
+ * Sets up the PID's page table arena and an empty top-level table. Does
+ * nothing if the PID already has one.
+ *
+ * @param ctx The simulation context.
+ * @param pid The PID.
+ * @return 0 on success, -1 on a bad PID or allocation failure.
+ */
+int create_address_space(ptw_sim_context_t *ctx, uint32_t pid);
+
+/**
+ * @brief Frees every page table of a PID.
+ *
+ * Arena-backed address spaces are released one chunk at a time. Tables
+ * installed by hand with malloc() are freed by walking the tree. The PID's
+ * TLB and paging-structure cache entries are invalidated first, so nothing
+ * cached points at freed tables.
+ *
+ * @param ctx The simulation context.
+ * @param pid The PID. PIDs without an address space are ignored.
+ */
+void destroy_address_space(ptw_sim_context_t *ctx, uint32_t pid);
+
+/**
+ * @brief Maps one page.
+ *
+ * Walks the PID's page table from the top, allocating only the interior
+ * tables that don't exist yet, then programs the leaf at the level that
+ * matches `page_size`. The address space is created if the PID has none.
+ *
+ * A mapping that would replace a table with a leaf, or descend through an
+ * existing larger page, is refused rather than silently dropping the old
+ * mapping. Replacing a leaf of the same size is allowed, and shoots down the
+ * old translation on every core that may cache it.
+ *
+ * @param ctx The simulation context.
+ * @param pid PID to map the page in.
+ * @param va Virtual address in the page. Offset bits are ignored.
+ * @param pa Physical address of the page. Offset bits are ignored.
+ * @param page_size FOUR_K, TWO_M or ONE_G.
+ * @param perms Permissions of the page.
+ * @return 0 on success, -1 on bad arguments, a conflicting mapping, or
+ * allocation failure.
+ */
+int map_page(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va, uintptr_t pa,
+             page_size_t page_size, permissions_t perms);
+
+/**
+ * @brief Maps a contiguous range with the largest pages that fit.
+ *
+ * Splits [va, va + len) into 1G, 2M and 4K pages. A page size is used
+ * wherever both the VA and the PA are aligned to it and enough of the range
+ * is left. Each interior table on the way is looked up or allocated once per
+ * run of leaves, and the leaves of a run are filled in one loop.
+ *
+ * If a page in the range conflicts with an existing mapping, as described
+ * for `map_page`, mapping stops there. Pages before it stay mapped.
+ *
+ * @param ctx The simulation context.
+ * @param pid PID to map the range in.
+ * @param va Start of the range. Must be 4K aligned.
+ * @param pa Physical address `va` maps to. Must be 4K aligned.
+ * @param len Length of the range in bytes. Must be a multiple of 4K.
+ * @param perms Permissions of every page in the range.
+ * @return 0 on success, -1 on bad arguments, a conflicting mapping, or
+ * allocation failure.
+ */
+int map_range(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va, uintptr_t pa,
+              size_t len, permissions_t perms);
+
+/**
+ * @brief Sets or clears the global bit of a mapped page.
+ *
+ * TLB entries made from a global page survive flushes of non-global entries,
+ * like kernel mappings surviving a CR3 write. If the bit changes, the page is
+ * shot down so no core keeps a translation with the old bit.
+ *
+ * @param ctx The simulation context.
+ * @param pid PID the page is mapped in.
+ * @param va Any address in the page.
+ * @param global New value of the bit.
+ * @return 0 on success, -1 on a bad PID or if nothing maps `va`.
+ */
+int set_page_global(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va,
+                    bool global);
+
+/**
+ * @brief Removes every mapping in a range, like munmap().
+ *
+ * Pages of any size are cleared, and then shot down on every core that may
+ * cache them, one shootdown per run of consecutive same-size pages. Holes in
+ * the range are skipped. Interior tables are kept even if they end up empty.
+ *
+ * @param ctx The simulation context.
+ * @param pid PID to unmap the range in.
+ * @param va Start of the range. Must be 4K aligned.
+ * @param len Length of the range in bytes. Must be a multiple of 4K.
+ * @return 0 on success, -1 on bad arguments or if the range would split a
+ * larger page. Pages before that one stay unmapped.
+ */
+int unmap_range(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va,
+                size_t len);
+
+/**
+ * @brief Allocates the next free simulated physical 4 KiB frame.
+ *
+ * Safe to call from several threads.
+ *
+ * @param vpn Virtual page the frame is for. Currently unused.
+ * @return Base physical address of the frame.
+ */
+uintptr_t allocate_physical_frame(uintptr_t vpn);
+
+#endif
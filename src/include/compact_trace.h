@@ -0,0 +1,221 @@
+/**
+ * @file compact_trace.h
+ *
+ * Compact on-disk trace format and its streaming decoder
+ *
+ * Layout (integers in host byte order, like raw traces):
+ *
+ * +--------------------+
+ * | file header        | magic, version, records per block, record count,
+ * |                    | offset of the block index
+ * +--------------------+
+ * | block 0            | block header (payload bytes, record count) followed
+ * | block 1            | by the encoded records
+ * | ...                |
+ * +--------------------+
+ * | block index        | block count, then (file offset, first record) for
+ * |                    | every block
+ * +--------------------+
+ *
+ * Each record is two varints:
+ *   1. (pid << 3) | (access_type << 1) | user_supervisor
+ *   2. zigzag(va - previous va of the same PID)
+ *
+ * Delta state is kept in TRACE_DELTA_SLOTS slots indexed by PID and is reset
+ * at the start of every block, so any block can be decoded on its own. That
+ * is what makes seeking through the index possible.
+ */
+
+#ifndef COMPACT_TRACE_H
+#define COMPACT_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "page_table_api.h"
+#include "replay.h"
+
+#define COMPACT_TRACE_MAGIC "PTWCTRC"
+#define COMPACT_TRACE_VERSION 1
+#define COMPACT_TRACE_DEFAULT_BLOCK_RECORDS 65536
+
+// Must be a power of 2
+#define TRACE_DELTA_SLOTS 64
+
+// Worst case encoded size of one record: two 10-byte varints
+#define COMPACT_RECORD_MAX_BYTES 20
+
+/**
+ * File header
+ */
+typedef struct compact_trace_header {
+  char magic[8];          //< COMPACT_TRACE_MAGIC, NUL terminated
+  uint32_t version;       //< COMPACT_TRACE_VERSION
+  uint32_t block_records; //< Maximum records per block
+  uint64_t n_records;     //< Total records in the trace
+  uint64_t index_offset;  //< File offset of the block index
+} compact_trace_header_t;
+
+_Static_assert(sizeof(compact_trace_header_t) == 32,
+               "compact trace header is 32 bytes");
+
+/**
+ * Block header. Precedes each block's payload.
+ */
+typedef struct compact_block_header {
+  uint32_t payload_len; //< Bytes of encoded records that follow
+  uint32_t n_records;   //< Records in this block
+} compact_block_header_t;
+
+/**
+ * Block index entry
+ */
+typedef struct compact_block_index {
+  uint64_t offset;       //< File offset of the block header
+  uint64_t first_record; //< Number of the block's first record
+} compact_block_index_t;
+
+/**
+ * Streaming encoder. Buffers one block at a time.
+ */
+typedef struct compact_trace_writer {
+  FILE *f;
+  compact_trace_header_t header;
+  uint8_t *block_buf;   //< Encoded records of the current block
+  size_t block_len;     //< Bytes used in block_buf
+  uint32_t block_count; //< Records in the current block
+  uint64_t last_va[TRACE_DELTA_SLOTS];
+  compact_block_index_t *index;
+  size_t n_blocks;
+  size_t index_cap;
+} compact_trace_writer_t;
+
+/**
+ * Streaming decoder. Holds the index and one decoded block's bytes.
+ */
+typedef struct compact_trace_reader {
+  FILE *f;
+  compact_trace_header_t header;
+  compact_block_index_t *index;
+  size_t n_blocks;
+  size_t next_block;     //< Next block to load
+  uint8_t *block_buf;    //< Payload of the current block
+  size_t block_buf_cap;  //< Allocated size of block_buf
+  size_t block_len;      //< Payload bytes of the current block
+  size_t block_pos;      //< Decode position in block_buf
+  uint32_t block_left;   //< Records not yet decoded in the current block
+  uint64_t last_va[TRACE_DELTA_SLOTS];
+  uint64_t skipped;      //< Malformed records dropped by the decoder
+  bool corrupt;          //< Set when a block fails to decode
+} compact_trace_reader_t;
+
+/**
+ * @brief Returns true if the file at `path` starts with the compact magic.
+ */
+bool is_compact_trace(const char *path);
+
+/**
+ * @brief Creates a compact trace file.
+ *
+ * @param w Writer to initialize.
+ * @param path Output path. Truncated if it exists.
+ * @param block_records Records per block, or 0 for the default.
+ * @return 0 on success, -1 on failure.
+ */
+int compact_trace_writer_open(compact_trace_writer_t *w, const char *path,
+                              uint32_t block_records);
+
+/**
+ * @brief Appends a record to the trace.
+ *
+ * @return 0 on success, -1 on I/O failure or a malformed record (one replay
+ * would skip), which isn't written.
+ */
+int compact_trace_append(compact_trace_writer_t *w, const trace_record_t *rec);
+
+/**
+ * @brief Flushes the last block, writes the index, and closes the file.
+ *
+ * @return 0 on success, -1 on I/O failure.
+ */
+int compact_trace_writer_close(compact_trace_writer_t *w);
+
+/**
+ * @brief Converts a raw trace into a compact trace.
+ *
+ * Malformed records, which replaying the raw trace skips, are dropped, so
+ * both traces translate the same accesses.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int convert_raw_trace(const char *raw_path, const char *compact_path,
+                      uint32_t block_records);
+
+/**
+ * @brief Opens a compact trace and reads its header and block index.
+ *
+ * @return 0 on success, -1 on failure (I/O error, bad header, or an index
+ * that doesn't cover the records).
+ */
+int compact_trace_reader_open(compact_trace_reader_t *r, const char *path);
+
+/**
+ * @brief Closes a compact trace and frees the reader's buffers.
+ */
+void compact_trace_reader_close(compact_trace_reader_t *r);
+
+/**
+ * @brief Positions the reader so the next record decoded is `record`.
+ *
+ * Uses the block index to jump to the right block, then decodes forward
+ * within it.
+ *
+ * @return 0 on success, -1 if `record` is past the end or the block is
+ * corrupt.
+ */
+int compact_trace_seek(compact_trace_reader_t *r, uint64_t record);
+
+/**
+ * @brief Decodes up to `max` records as they were written.
+ *
+ * Unlike `compact_trace_next_batch`, nothing is validated or dropped, so
+ * the caller sees every record, malformed or not.
+ *
+ * @return Number of records written to `out`. Fewer than `max` at the end
+ * of the trace or on a corrupt block (check `r->corrupt`).
+ */
+size_t compact_trace_read_records(compact_trace_reader_t *r,
+                                  trace_record_t *out, size_t max);
+
+/**
+ * @brief Decodes up to `max` records into address contexts.
+ *
+ * Malformed records (bad PID, access type or reserved field) are dropped
+ * and counted in `r->skipped`, so fewer than `max` contexts may come back
+ * before the end of the trace.
+ *
+ * @param r The reader.
+ * @param out Output array of at least `max` contexts.
+ * @param max Capacity of `out`.
+ * @param n_read Output. Records consumed from the trace, including skipped
+ * ones. May be NULL.
+ * @return Number of contexts written to `out`. 0 at the end of the trace or
+ * on a corrupt block (check `r->corrupt`).
+ */
+size_t compact_trace_next_batch(compact_trace_reader_t *r,
+                                address_context_t *out, size_t max,
+                                size_t *n_read);
+
+/**
+ * @brief Streams a compact trace through `translate`, one batch at a time.
+ *
+ * Same semantics as `replay_trace`.
+ *
+ * @return 0 on success, -1 on invalid arguments or a corrupt trace.
+ */
+int replay_compact_trace(compact_trace_reader_t *r, ptw_sim_context_t *ctx,
+                         replay_fault_handler_t handler, void *arg,
+                         replay_stats_t *stats);
+
+#endif
@@ -13,20 +13,35 @@
 #define VA_SIZE 48
 #define PA_SIZE 48
 
+// VA bits with 5-level paging (LA57)
+#define VA_SIZE_LA57 57
+
 // 30 bits are needed for offset into 1G page
-#define VPN_MASK_1GB (~((1ULL << (VA_SIZE - 30ULL)) - 1))
+#define VPN_MASK_1GB (~((1ULL << 30ULL) - 1))
 #define OFFSET_MASK_1GB (~VPN_MASK_1GB)
 
 // 21 bits are needed for offset into 2M page
-#define VPN_MASK_2MB (~((1ULL << (VA_SIZE - 21ULL)) - 1))
+#define VPN_MASK_2MB (~((1ULL << 21ULL) - 1))
 #define OFFSET_MASK_2MB (~VPN_MASK_2MB)
 
 // 12 bits are needed as an offset into the 4k page
-#define VPN_MASK_4KB (~((1ULL << (VA_SIZE - 12ULL)) - 1))
+#define VPN_MASK_4KB (~((1ULL << 12ULL) - 1))
 #define OFFSET_MASK_4KB (~VPN_MASK_4KB)
 
 #define MAX_PID 32
 
+// Simulated cores per context. Cores track the PIDs they run in a 64-bit mask.
+#define MAX_CORES 64
+
+// Levels of the radix page table: SDP, PDP, PDE, PTE
+#define PT_LEVELS 4
+
+// Levels with 5-level paging (LA57): a PML5 table above the SDP
+#define PT_LEVELS_LA57 5
+
+// Most levels of any paging mode, for sizing per-level arrays
+#define PT_MAX_LEVELS PT_LEVELS_LA57
+
 /**
  * Fault codes
  */
@@ -36,4 +51,11 @@
 #define EUNAUTHORIZED 3
 #define EACCESS 4
 
+// Fault codes run from 1 to EACCESS, so histograms index them directly
+#define N_FAULT_CODES (EACCESS + 1)
+
+// Translations return a PA or a negated fault code, so the top few values of
+// the address space are reserved for faults
+#define IS_FAULT(addr) ((uintptr_t)(addr) >= (uintptr_t)(-EACCESS))
+
 #endif
\ No newline at end of file
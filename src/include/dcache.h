@@ -0,0 +1,97 @@
+/**
+ * @file dcache.h
+ * Header for the data cache model that page table reads go through
+ *
+ * Walks read page table entries through an L1D, an L2 and an LLC, so a walk
+ * costs less when the entries it needs are still cached. Only page table
+ * reads are simulated. The translated accesses themselves never touch the
+ * caches.
+ *
+ * Entries are cached at the address they would have in hardware, where they
+ * are HW_PTE_SIZE bytes rather than sizeof(pte_t), so a line holds as many
+ * neighbouring entries as it would on a real machine.
+ */
+
+#ifndef DCACHE_H
+#define DCACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "hw_structures.h"
+#include "page_table_api.h"
+
+/**
+ * @brief Allocates an empty data cache.
+ *
+ * @param geometry Size, ways and line size. The line size must be a power of
+ * 2 and the size a power of 2 number of sets of `ways` lines.
+ * @param policy Replacement policy.
+ * @return The new cache, or NULL on invalid geometry (including one the
+ * policy can't handle) or allocation failure.
+ */
+data_cache_t *create_dcache(cache_geometry_t geometry,
+                            repl_policy_kind_t policy);
+
+/**
+ * @brief Frees a cache created with `create_dcache`. NULL is ignored.
+ */
+void destroy_dcache(data_cache_t *cache);
+
+/**
+ * @brief Invalidates every line of a cache.
+ */
+void flush_dcache(data_cache_t *cache);
+
+/**
+ * @brief Looks up the line holding `addr`. Counts a hit or a miss.
+ *
+ * @return true on a hit.
+ */
+bool dcache_lookup(data_cache_t *cache, uint64_t addr);
+
+/**
+ * @brief Brings the line holding `addr` into the cache.
+ *
+ * Evicts with the cache's replacement policy if the set is full. The line
+ * must not already be cached.
+ */
+void dcache_fill(data_cache_t *cache, uint64_t addr);
+
+/**
+ * @brief Reads an address through the data caches.
+ *
+ * Looks the line up in each level in turn, from the L1D down, and fills it
+ * into every level that missed.
+ *
+ * @param ctx Context whose caches and latencies to use.
+ * @param addr Address being read.
+ * @return Cycles the read took: the latency of the level that hit, the
+ * memory latency if none did, or `pt_read` if the context has no data caches.
+ */
+uint32_t dcache_read(ptw_sim_context_t *ctx, uint64_t addr);
+
+/**
+ * @brief Reads a pte_t through the data caches.
+ *
+ * Like `dcache_read`, at the address the entry would have in hardware, so
+ * HW_PTE_SIZE-byte entries share lines the way packed ones do.
+ *
+ * @param ctx Context whose caches and latencies to use.
+ * @param entry The entry being read.
+ * @return Cycles the read took.
+ */
+uint32_t dcache_read_pte(ptw_sim_context_t *ctx, const pte_t *entry);
+
+/**
+ * @brief Prints a cache's geometry, policy, and hit/miss/eviction counts.
+ *
+ * @param out Stream to print to.
+ * @param name Label for the cache, e.g. "L2".
+ * @param cache The cache.
+ */
+void print_dcache_stats(FILE *out, const char *name,
+                        const data_cache_t *cache);
+
+#endif
@@ -0,0 +1,183 @@
+/**
+ * @file ecpt.h
+ *
+ * Elastic cuckoo page tables
+ *
+ * An alternative to the radix tree, after Skarlatos et al., "Elastic Cuckoo
+ * Page Tables" (ASPLOS 2020). Each PID has one d-ary cuckoo hash table per
+ * page size. A page can live in any of the ECPT_WAYS ways, at a slot picked
+ * by that way's hash of its VPN, so a lookup reads one slot per way and the
+ * hardware issues all of those reads at once. Inserting into a full slot
+ * kicks its page to another way.
+ *
+ * Tables grow elastically: once a table is ECPT_RESIZE_PERCENT full, a table
+ * twice as large is allocated and the old one is drained into it a few slots
+ * per insert. Each way has a rehash pointer; old slots below it have moved,
+ * so a lookup reads the new table for them and the old table otherwise. A
+ * lookup still reads one slot per way while a resize is going on.
+ *
+ * Cuckoo walk tables (CWTs) record, per 2M and per 1G region, how many pages
+ * of each size the region holds. The walker caches which sizes a region has
+ * in cuckoo walk caches (CWCs), so it can skip the tables of the other sizes.
+ * CWTs are cuckoo tables too.
+ */
+
+#ifndef ECPT_H
+#define ECPT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "config.h"
+#include "hw_structures.h"
+
+// Ways per table, all probed in parallel
+#define ECPT_WAYS 3
+
+// Tables resize once this share of their slots is in use
+#define ECPT_RESIZE_PERCENT 60
+
+// Old slots moved to the new table per insert while resizing
+#define ECPT_REHASH_STEP 4
+
+// Kicks before an insert gives up and rebuilds the table twice as large
+#define ECPT_MAX_KICKS 32
+
+// Key of an empty slot. VPNs are far shorter.
+#define ECPT_EMPTY UINT64_MAX
+
+/**
+ * One slot of a cuckoo table
+ */
+typedef struct ecpt_slot {
+  uint64_t key; //< VPN of the page or region, or ECPT_EMPTY
+  uint64_t val; //< hw_pte_t of the page, or the region's CWT counts
+} ecpt_slot_t;
+
+/**
+ * An elastic d-ary cuckoo hash table
+ */
+typedef struct ecpt_table {
+  ecpt_slot_t *ways[ECPT_WAYS]; //< NULL until the first insert
+  uint32_t slots;               //< Per way. A power of 2.
+  ecpt_slot_t *old[ECPT_WAYS];  //< Table being drained, or NULL
+  uint32_t old_slots;
+  uint32_t rehash[ECPT_WAYS]; //< Old slots below this have been moved
+  uint64_t entries;
+  uint64_t kicks;   //< Entries displaced by inserts
+  uint64_t resizes; //< Elastic resizes and rebuilds
+  uint64_t rng;     //< Picks the way of each insert and kick
+} ecpt_table_t;
+
+/**
+ * Cuckoo walk table levels
+ */
+typedef enum ecpt_cwt_level {
+  ECPT_CWT_PMD = 0, //< 2M regions. Count 4K and 2M pages.
+  ECPT_CWT_PUD = 1, //< 1G regions. Count pages of every size.
+  ECPT_CWT_LEVELS = 2
+} ecpt_cwt_level_t;
+
+/**
+ * Elastic cuckoo page tables of one PID
+ */
+typedef struct ecpt {
+  ecpt_table_t pages[PG_SIZE_MAX]; //< By page_size_t. Keys are VPNs of that
+                                   // size.
+  ecpt_table_t cwt[ECPT_CWT_LEVELS]; //< Keys are region numbers
+  uint32_t initial_slots;            //< Slots per way of a new table
+} ecpt_t;
+
+/**
+ * Elastic cuckoo page table walk counters
+ */
+typedef struct ecpt_stats {
+  uint64_t lookups;         //< Walks, including ones that faulted
+  uint64_t page_reads;      //< Page table slots read
+  uint64_t cwt_reads;       //< CWT slots read after CWC misses
+  uint64_t sizes_probed;    //< Page sizes whose ways were read
+  uint64_t parallel_cycles; //< Latency of those reads, issued all at once
+  uint64_t serial_cycles;   //< What the same reads cost one after another
+} ecpt_stats_t;
+
+/**
+ * @brief Allocates empty cuckoo page tables for one PID.
+ *
+ * @param slots Initial slots per way of each table. Must be a non-zero
+ * power of 2.
+ * @return The tables, or NULL on a bad slot count or allocation failure.
+ */
+ecpt_t *create_ecpt(uint32_t slots);
+
+/**
+ * @brief Frees tables created with `create_ecpt`. NULL is ignored.
+ */
+void destroy_ecpt(ecpt_t *ecpt);
+
+/**
+ * @brief Returns the slot of `way` that a lookup of `key` reads.
+ *
+ * While the table is resizing, that's in the old table unless the rehash
+ * pointer of the way has passed it. The table must have been allocated.
+ */
+ecpt_slot_t *ecpt_probe(const ecpt_table_t *t, int way, uint64_t key);
+
+/**
+ * @brief Returns the PG_SIZE_BIT() mask of the page sizes `ecpt` has pages
+ * of.
+ */
+uint8_t ecpt_page_sizes(const ecpt_t *ecpt);
+
+/**
+ * @brief Returns the PG_SIZE_BIT() mask of the sizes of the pages in the
+ * region of `level` holding `va`, from its CWT entry.
+ *
+ * A 1G page isn't counted in the 2M regions it covers.
+ */
+uint8_t ecpt_region_sizes(const ecpt_t *ecpt, ecpt_cwt_level_t level,
+                          uint64_t va);
+
+/**
+ * @brief Finds the page that maps `va`, of any size.
+ *
+ * Nothing is counted. Use this to manage mappings, not to translate. The
+ * slot is only valid until the next insert, which may move it.
+ *
+ * @param page_size Set to the size of the page found.
+ * @return The page's slot, whose `val` is its hw_pte_t, or NULL if `va`
+ * isn't mapped.
+ */
+ecpt_slot_t *ecpt_find(ecpt_t *ecpt, uint64_t va, page_size_t *page_size);
+
+/**
+ * @brief Adds a page that isn't mapped yet, and counts it in the CWTs.
+ *
+ * @param regions_changed Set if a region gained its first page of this
+ * size, so cached region sizes are stale.
+ * @return 0 on success, -1 if growing a table failed.
+ */
+int ecpt_insert(ecpt_t *ecpt, uint64_t va, page_size_t page_size,
+                uint64_t pte, bool *regions_changed);
+
+/**
+ * @brief Removes the page of `page_size` at `va`, if it's mapped.
+ *
+ * @param regions_changed Set if a region lost its last page of this size.
+ * @return true if a page was removed.
+ */
+bool ecpt_remove(ecpt_t *ecpt, uint64_t va, page_size_t page_size,
+                 bool *regions_changed);
+
+/**
+ * @brief Prints the walk counters and the size and memory of the tables.
+ *
+ * @param out Stream to print to.
+ * @param stats Walk counters.
+ * @param tables Tables whose sizes to sum. NULL entries are skipped.
+ * @param n Number of entries in `tables`.
+ */
+void print_ecpt_stats(FILE *out, const ecpt_stats_t *stats,
+                      ecpt_t *const *tables, size_t n);
+
+#endif
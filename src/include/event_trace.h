@@ -0,0 +1,190 @@
+/**
+ * @file event_trace.h
+ *
+ * Hot-path event tracing
+ *
+ * TLB lookups, evictions and page table reads can be recorded one event at a
+ * time, to see why a miss rate looks the way it does. Events go into a ring
+ * buffer owned by the thread that records them, so recording never takes a
+ * lock or makes a system call. A background thread drains every ring into a
+ * binary file. If a ring fills up faster than it is drained, new events are
+ * dropped and counted rather than stalling the simulation.
+ *
+ * The hooks in the translation code are compiled in only when EVENT_TRACE is
+ * defined (make EVENT_TRACE=1). EVENT_TRACE_MASK picks the categories, e.g.
+ * -DEVENT_TRACE_MASK=EVENT_CAT_WALK for walk events only. Without
+ * EVENT_TRACE, the hooks expand to nothing and their arguments are never
+ * evaluated. The ring buffers and the drain thread are always built, so
+ * event_trace_record() can be called directly either way.
+ *
+ * File layout: an event_trace_header_t, then trace_event_t records in host
+ * byte order. Events of one thread are in the order they happened. Events of
+ * different threads are interleaved in no particular order.
+ */
+
+#ifndef EVENT_TRACE_H
+#define EVENT_TRACE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Event categories, for EVENT_TRACE_MASK
+#define EVENT_CAT_TLB 0x1
+#define EVENT_CAT_WALK 0x2
+
+#ifndef EVENT_TRACE_MASK
+#define EVENT_TRACE_MASK (EVENT_CAT_TLB | EVENT_CAT_WALK)
+#endif
+
+// Events per thread ring. Must be a power of 2.
+#define EVENT_RING_SIZE (1U << 16)
+
+#define EVENT_TRACE_MAGIC "PTWEVENT"
+#define EVENT_TRACE_VERSION 1
+
+/**
+ * Event types
+ */
+typedef enum event_type {
+  EVENT_TLB_HIT = 0,    //< arg: trace_unit_t of the TLB
+  EVENT_TLB_MISS = 1,   //< arg: trace_unit_t of the TLB
+  EVENT_TLB_EVICT = 2,  //< arg: trace_unit_t. VA and PID of the victim
+  EVENT_WALK_READ = 3,  //< arg: level read, 0 is the SDP
+  EVENT_WALK_DONE = 4,  //< arg: page size found
+  EVENT_WALK_FAULT = 5, //< arg: fault code
+} event_type_t;
+
+/**
+ * Which TLB a TLB event is about
+ */
+typedef enum trace_unit {
+  TRACE_UNIT_1G_TLB = 0,
+  TRACE_UNIT_2M_TLB = 1,
+  TRACE_UNIT_4K_TLB = 2,
+  TRACE_UNIT_STLB = 3,
+} trace_unit_t;
+
+/**
+ * One event as stored in the file
+ */
+typedef struct trace_event {
+  uint64_t va;
+  uint32_t pid;
+  uint16_t thread; //< Recording thread, numbered by its first event
+  uint8_t type;    //< event_type_t
+  uint8_t arg;     //< Depends on the type
+} trace_event_t;
+
+_Static_assert(sizeof(trace_event_t) == 16, "trace events are 16 bytes");
+
+/**
+ * File header
+ */
+typedef struct event_trace_header {
+  char magic[8]; //< EVENT_TRACE_MAGIC, not NUL-terminated
+  uint32_t version;
+  uint32_t event_size; //< sizeof(trace_event_t)
+} event_trace_header_t;
+
+/**
+ * Single-producer, single-consumer ring of one thread's events
+ *
+ * The recording thread only advances head, the drain thread only advances
+ * tail. Both are free-running counters.
+ */
+typedef struct event_ring {
+  trace_event_t events[EVENT_RING_SIZE];
+  _Atomic uint64_t head;
+  _Atomic uint64_t tail;
+  uint64_t dropped;   //< Events lost to a full ring
+  uint16_t thread;
+  struct event_ring *next; //< Registry of every ring
+} event_ring_t;
+
+// Calling thread's ring, valid while event_ring_epoch matches the session
+extern __thread event_ring_t *event_ring;
+extern __thread uint32_t event_ring_epoch;
+extern _Atomic uint32_t event_trace_epoch;
+
+/**
+ * @brief Starts recording into `path`, replacing it.
+ *
+ * Starts the drain thread. Only one trace can be recorded at a time.
+ *
+ * @return 0 on success, -1 if tracing is already running or the file or
+ * thread could not be created.
+ */
+int event_trace_start(const char *path);
+
+/**
+ * @brief Stops recording, drains every ring, and closes the file.
+ *
+ * Every thread that recorded events must be done recording, since the rings
+ * are freed.
+ *
+ * @return Number of events dropped because a ring was full, or -1 if the
+ * file could not be written.
+ */
+int64_t event_trace_stop(void);
+
+/**
+ * @brief Gives the calling thread a ring for the current session.
+ *
+ * @return The ring, or NULL if tracing is not running.
+ */
+event_ring_t *event_trace_attach(void);
+
+/**
+ * @brief Records one event. Does nothing if tracing is not running.
+ */
+static inline void event_trace_record(event_type_t type, uint8_t arg,
+                                      uint32_t pid, uint64_t va) {
+  event_ring_t *r = event_ring;
+  if (r == NULL || event_ring_epoch != atomic_load_explicit(
+                                           &event_trace_epoch,
+                                           memory_order_relaxed)) {
+    if ((r = event_trace_attach()) == NULL) {
+      return;
+    }
+  }
+
+  uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  uint64_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+  if (head - tail == EVENT_RING_SIZE) {
+    r->dropped++;
+    return;
+  }
+
+  r->events[head & (EVENT_RING_SIZE - 1)] = (trace_event_t){
+      .va = va, .pid = pid, .thread = r->thread, .type = type, .arg = arg};
+  atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+/**
+ * Hooks for the translation code. Each compiles to nothing unless its
+ * category is enabled.
+ */
+
+#if defined(EVENT_TRACE) && (EVENT_TRACE_MASK & EVENT_CAT_TLB)
+#define TRACE_TLB_EVENT(type, unit, pid, va)                                   \
+  event_trace_record((type), (unit), (pid), (va))
+#else
+#define TRACE_TLB_EVENT(type, unit, pid, va) ((void)0)
+#endif
+
+#if defined(EVENT_TRACE) && (EVENT_TRACE_MASK & EVENT_CAT_WALK)
+#define TRACE_WALK_EVENT(type, arg, pid, va)                                   \
+  event_trace_record((type), (arg), (pid), (va))
+#else
+#define TRACE_WALK_EVENT(type, arg, pid, va) ((void)0)
+#endif
+
+// True if any hook is compiled in
+#if defined(EVENT_TRACE) && (EVENT_TRACE_MASK != 0)
+#define EVENT_TRACE_HOOKS 1
+#else
+#define EVENT_TRACE_HOOKS 0
+#endif
+
+#endif
@@ -0,0 +1,172 @@
+/**
+ * @file hashed_pt.h
+ *
+ * Global hashed page table
+ *
+ * An alternative to the per-PID radix trees: one table shared by every PID,
+ * indexed by a hash of the PID and the page's VPN. Each bucket holds one
+ * entry inline, and colliding pages hang off it in a chain of overflow
+ * entries, like Itanium's long-format VHPT. The page size isn't known before
+ * the lookup, so a lookup probes one bucket per page size the PID has
+ * mapped, smallest first.
+ *
+ * A lookup reads the bucket's entry and then follows the chain, so its cost
+ * is the number of entries read rather than a fixed number of levels.
+ * Entries are 32 bytes, two per cache line, and hold the page as a packed
+ * hw_pte_t.
+ */
+
+#ifndef HASHED_PT_H
+#define HASHED_PT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "config.h"
+#include "hw_structures.h"
+#include "pt_arena.h"
+
+/**
+ * One entry of the hashed page table, in a bucket or a chain
+ */
+typedef struct hpt_entry {
+  uint64_t tag;           //< tlb_tag() of the page, or TLB_INVALID_TAG if
+                          // the entry is empty
+  uint64_t pte;           //< The page, as a hw_pte_t leaf
+  uint32_t pid;           //< Owning PID
+  uint32_t reserved;      //< Pads the entry to 32 bytes
+  struct hpt_entry *next; //< Next entry of the chain, or NULL
+} hpt_entry_t;
+
+_Static_assert(sizeof(hpt_entry_t) == 32, "two entries per cache line");
+
+/**
+ * Hashed page table
+ */
+typedef struct hashed_pt {
+  hpt_entry_t *buckets; //< Bucket array, one entry each
+  uint32_t n_buckets;   //< A power of 2
+  pt_arena_t *chains;   //< Where overflow entries are carved from
+  hpt_entry_t *free;    //< Overflow entries not in any chain
+  uint64_t pages[MAX_PID][PG_SIZE_MAX]; //< Pages mapped per PID and size
+  uint64_t entries;     //< Pages mapped, over every PID
+  uint64_t overflow;    //< Of those, pages in overflow entries
+} hashed_pt_t;
+
+// Lookups that read this many entries or more share a histogram bucket
+#define HPT_REFS_HIST 8
+
+/**
+ * Hashed page table lookup counters
+ */
+typedef struct hpt_stats {
+  uint64_t lookups;  //< Lookups, including ones that faulted
+  uint64_t probes;   //< Buckets probed, one per page size tried
+  uint64_t mem_refs; //< Entries read, buckets and chains alike
+  uint64_t refs[HPT_REFS_HIST + 1]; //< Lookups by entries read
+} hpt_stats_t;
+
+/**
+ * @brief Allocates an empty hashed page table.
+ *
+ * @param n_buckets Number of buckets. Must be a non-zero power of 2.
+ * @return The table, or NULL on a bad bucket count or allocation failure.
+ */
+hashed_pt_t *create_hashed_pt(uint32_t n_buckets);
+
+/**
+ * @brief Frees a table created with `create_hashed_pt`. NULL is ignored.
+ */
+void destroy_hashed_pt(hashed_pt_t *hpt);
+
+/**
+ * @brief Returns the bucket a page of `pid` with tag `tag` hashes to.
+ */
+static inline hpt_entry_t *hpt_bucket(const hashed_pt_t *hpt, uint32_t pid,
+                                      uint64_t tag) {
+  // Multiplicative hashing. The PID goes between the largest VPN and the
+  // page size, and the high half of the product mixes every bit of the key.
+  uint64_t key = tag ^ ((uint64_t)pid << (VA_SIZE_LA57 - 12));
+  uint64_t hash = (key * 0x9e3779b97f4a7c15ULL) >> 32;
+  return &hpt->buckets[hash & (hpt->n_buckets - 1)];
+}
+
+/**
+ * @brief Returns true if `e` maps the page of `pid` with tag `tag`.
+ */
+static inline bool hpt_entry_matches(const hpt_entry_t *e, uint32_t pid,
+                                     uint64_t tag) {
+  return e->tag == tag && e->pid == pid;
+}
+
+/**
+ * @brief Returns the PG_SIZE_BIT() mask of the page sizes `pid` has mapped.
+ */
+static inline uint8_t hpt_page_sizes(const hashed_pt_t *hpt, uint32_t pid) {
+  uint8_t sizes = 0;
+  for (int size = 0; size < PG_SIZE_MAX; size++) {
+    sizes |= hpt->pages[pid][size] ? PG_SIZE_BIT(size) : 0;
+  }
+  return sizes;
+}
+
+/**
+ * @brief Finds the page of `pid` that maps `va`, of any size.
+ *
+ * Nothing is counted. Use this to manage mappings, not to translate.
+ *
+ * @param page_size Set to the size of the page found.
+ * @return The page's entry, or NULL if `va` isn't mapped.
+ */
+hpt_entry_t *hpt_find(const hashed_pt_t *hpt, uint32_t pid, uint64_t va,
+                      page_size_t *page_size);
+
+/**
+ * @brief Returns true if `pid` has a page smaller than `page_size` inside
+ * the page of that size at `va`.
+ *
+ * Looks up every smaller page the range could hold, of the sizes `pid` has
+ * mapped, so a 1G range with 4K pages around costs 2^18 lookups.
+ */
+bool hpt_has_smaller(const hashed_pt_t *hpt, uint32_t pid, uint64_t va,
+                     page_size_t page_size);
+
+/**
+ * @brief Returns the entry for the page of `pid` at `va`, adding an empty
+ * one to the page's bucket if there is none.
+ *
+ * A new entry gets the page's tag and PID and an empty `pte` for the caller
+ * to fill in.
+ *
+ * @param existed Set if the page already had an entry.
+ * @return The entry, or NULL if allocating an overflow entry failed.
+ */
+hpt_entry_t *hpt_insert(hashed_pt_t *hpt, uint32_t pid, uint64_t va,
+                        page_size_t page_size, bool *existed);
+
+/**
+ * @brief Removes the page of `pid` at `va`, if it's mapped.
+ *
+ * @return true if a page was removed.
+ */
+bool hpt_remove(hashed_pt_t *hpt, uint32_t pid, uint64_t va,
+                page_size_t page_size);
+
+/**
+ * @brief Removes every page of `pid`.
+ */
+void hpt_remove_pid(hashed_pt_t *hpt, uint32_t pid);
+
+/**
+ * @brief Prints the lookup counters and the memory the tables use.
+ *
+ * @param out Stream to print to.
+ * @param stats Lookup counters.
+ * @param tables Tables whose memory to sum. NULL entries are skipped.
+ * @param n Number of entries in `tables`.
+ */
+void print_hpt_stats(FILE *out, const hpt_stats_t *stats,
+                     hashed_pt_t *const *tables, size_t n);
+
+#endif
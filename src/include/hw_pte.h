@@ -0,0 +1,159 @@
+/**
+ * @file hw_pte.h
+ *
+ * Packed 8-byte page table entries in the x86-64 format
+ *
+ * Used by contexts whose pte_format is PTE_FORMAT_HW. An entry is the
+ * physical address of the page or table it points at, plus flag bits:
+ *
+ *   63  62:52  51:12  11:9  8  7   6  5  4:3  2   1   0
+ *   NX  -      PFN    -     G  PS  D  A  -    US  RW  P
+ *
+ * PS marks a 1G leaf in a PDP entry or a 2M leaf in a PDE entry. Every
+ * present PTE is a 4K leaf. The format has no VPN or PID, so a walk can't
+ * detect a malformed table the way pte_t tables allow, and no read bit, so
+ * every present page is readable.
+ */
+
+#ifndef HW_PTE_H
+#define HW_PTE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "hw_structures.h"
+#include "page_table.h"
+
+typedef uint64_t hw_pte_t;
+
+_Static_assert(sizeof(hw_pte_t) == HW_PTE_SIZE, "hw_pte_t is 8 bytes");
+
+#define HW_PTE_P (1ULL << 0)   //< Present
+#define HW_PTE_RW (1ULL << 1)  //< Writable
+#define HW_PTE_US (1ULL << 2)  //< User accessible
+#define HW_PTE_A (1ULL << 5)   //< Accessed, set by the walker
+#define HW_PTE_D (1ULL << 6)   //< Dirty, set by the walker on a write
+#define HW_PTE_PS (1ULL << 7)  //< Page size: a leaf above the PTE level
+#define HW_PTE_G (1ULL << 8)   //< Global
+#define HW_PTE_NX (1ULL << 63) //< No execute
+
+// Physical address bits, 4K aligned. Host table addresses fit too.
+#define HW_PTE_ADDR_MASK 0x000FFFFFFFFFF000ULL
+
+// Bytes of one table of 512 entries: exactly one 4 KiB page
+#define HW_PT_TABLE_BYTES (512 * sizeof(hw_pte_t))
+
+/**
+ * @brief Returns true if the entry is present.
+ */
+static inline bool hw_pte_present(hw_pte_t e) { return (e & HW_PTE_P) != 0; }
+
+/**
+ * @brief Returns the physical address an entry points at.
+ */
+static inline uint64_t hw_pte_addr(hw_pte_t e) { return e & HW_PTE_ADDR_MASK; }
+
+/**
+ * @brief Returns true if a present entry maps a page rather than pointing at
+ * a table.
+ *
+ * @param e The entry.
+ * @param level_size Size of the pages leaves at the entry's level map
+ * (`pt_level_leaf_size`). The 4K level is always the last, so every present
+ * entry there is a leaf.
+ */
+static inline bool hw_pte_is_leaf(hw_pte_t e, page_size_t level_size) {
+  return level_size == FOUR_K || (e & HW_PTE_PS) != 0;
+}
+
+/**
+ * @brief Returns true if a present entry points at a table. `level_size` is
+ * as for `hw_pte_is_leaf`.
+ */
+static inline bool hw_pte_is_table(hw_pte_t e, page_size_t level_size) {
+  return hw_pte_present(e) && !hw_pte_is_leaf(e, level_size);
+}
+
+/**
+ * @brief Decodes the R/W/X bits of an entry. Present entries are always
+ * readable.
+ */
+static inline permissions_t hw_pte_permissions(hw_pte_t e) {
+  permissions_t perms = {0};
+  perms.val.read = hw_pte_present(e);
+  perms.val.write = (e & HW_PTE_RW) != 0;
+  perms.val.execute = (e & HW_PTE_NX) == 0;
+  return perms;
+}
+
+/**
+ * @brief Decodes the privilege of an entry as pte_t stores it: 0 for a user
+ * page, 1 for a supervisor page.
+ */
+static inline uint8_t hw_pte_user_supervisor(hw_pte_t e) {
+  return (e & HW_PTE_US) == 0;
+}
+
+/**
+ * @brief Encodes an entry pointing at a lower-level table.
+ *
+ * Interior entries are permissive. The leaf decides the real permissions.
+ */
+static inline hw_pte_t hw_pte_encode_table(const void *table) {
+  return ((uintptr_t)table & HW_PTE_ADDR_MASK) | HW_PTE_P | HW_PTE_RW |
+         HW_PTE_US;
+}
+
+/**
+ * @brief Encodes a leaf entry.
+ *
+ * @param pa Physical address of the page. Offset bits are dropped.
+ * @param page_size Size of the page. PS is set for 2M and 1G pages.
+ * @param perms R/W/X bits. Read is implied by the entry being present.
+ * @param user_supervisor 0 for a user page, 1 for a supervisor page.
+ * @param global Whether the page is global.
+ */
+static inline hw_pte_t hw_pte_encode_leaf(uint64_t pa, page_size_t page_size,
+                                          permissions_t perms,
+                                          uint8_t user_supervisor,
+                                          bool global) {
+  hw_pte_t e = (pa & HW_PTE_ADDR_MASK &
+                ~((1ULL << page_size_shift(page_size)) - 1)) |
+               HW_PTE_P;
+  e |= perms.val.write ? HW_PTE_RW : 0;
+  e |= perms.val.execute ? 0 : HW_PTE_NX;
+  e |= user_supervisor ? 0 : HW_PTE_US;
+  e |= page_size != FOUR_K ? HW_PTE_PS : 0;
+  e |= global ? HW_PTE_G : 0;
+  return e;
+}
+
+/**
+ * @brief Encodes a pte_t in the hardware format.
+ *
+ * Table pointers are copied as they are, so they still point at pte_t
+ * tables. The VPN and PID are dropped.
+ *
+ * @param entry Entry to encode.
+ * @return The packed entry. 0 (not present) if `entry` is invalid.
+ */
+hw_pte_t hw_pte_from_pte(const pte_t *entry);
+
+/**
+ * @brief Decodes a packed entry into a pte_t.
+ *
+ * @param e Entry to decode.
+ * @param level_size Size of the pages leaves at the level the entry was read
+ * from map, or PG_SIZE_MAX if the level holds no leaves.
+ * @param va Any address the entry translates. Stored as the VPN, which the
+ * packed format doesn't keep.
+ * @param pid PID the entry belongs to, which the packed format doesn't keep
+ * either.
+ * @param entry Output.
+ */
+void hw_pte_to_pte(hw_pte_t e, page_size_t level_size, uintptr_t va,
+                   uint32_t pid,
+                   pte_t *entry);
+
+#endif
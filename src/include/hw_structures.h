@@ -11,9 +11,97 @@
 #include <stdint.h>
 
 #include "config.h"
+#include "replacement.h"
 #include "util.h"
 
-#define TLB_ENTRY_COUNT 32
+/**
+ * Default TLB geometries (sets x ways)
+ * Roughly a modern x86 L1 DTLB: 64-entry 4-way 4K, 32-entry 4-way 2M, and a
+ * 4-entry fully associative 1G TLB
+ */
+#define FOURK_TLB_SETS 16
+#define FOURK_TLB_WAYS 4
+#define TWOM_TLB_SETS 8
+#define TWOM_TLB_WAYS 4
+#define ONEG_TLB_SETS 1
+#define ONEG_TLB_WAYS 4
+
+/**
+ * Default STLB geometry
+ * A shared second-level TLB behind the three L1 TLBs, roughly a modern x86
+ * STLB: 1536 entries, 12-way, holding 4K and 2M pages
+ */
+#define STLB_SETS 128
+#define STLB_WAYS 12
+
+/**
+ * Default paging-structure cache geometries (sets x ways)
+ * Roughly what x86 cores are measured to have: a couple of SDP (PML4)
+ * entries, a few PDP entries, and a few dozen PDE entries, all fully
+ * associative
+ */
+#define PWC_SDP_SETS 1
+#define PWC_SDP_WAYS 2
+#define PWC_PDP_SETS 1
+#define PWC_PDP_WAYS 4
+#define PWC_PDE_SETS 1
+#define PWC_PDE_WAYS 32
+
+/**
+ * Default translation latencies, in cycles
+ * Roughly a recent x86 core. An L1 TLB hit is hidden in the load pipeline,
+ * an STLB hit costs about 9 cycles, and starting the walker, paging-structure
+ * cache probes included, a few more. Page table reads cost whatever the
+ * data cache level that holds the entry costs, or a DRAM access. Without
+ * data caches, each read is charged as an average L2 hit. A minor page fault
+ * costs on the order of a microsecond.
+ */
+#define LATENCY_L1_TLB_CYCLES 1
+#define LATENCY_STLB_CYCLES 9
+#define LATENCY_WALK_START_CYCLES 4
+#define LATENCY_PT_READ_CYCLES 20
+#define LATENCY_FAULT_CYCLES 2500
+#define LATENCY_L1D_CYCLES 5
+#define LATENCY_L2_CYCLES 14
+#define LATENCY_LLC_CYCLES 42
+#define LATENCY_MEMORY_CYCLES 200
+
+/**
+ * Default data cache geometries (bytes, ways, line size)
+ * Roughly a recent x86 core: a 32 KiB 8-way L1D, a 1 MiB 16-way L2, and an
+ * 8 MiB 16-way LLC shared by every core
+ */
+#define L1D_SIZE (32U << 10)
+#define L1D_WAYS 8
+#define L2_SIZE (1U << 20)
+#define L2_WAYS 16
+#define LLC_SIZE (8U << 20)
+#define LLC_WAYS 16
+#define CACHE_LINE_SIZE 64
+
+// Size of a page table entry in hardware, as opposed to sizeof(pte_t)
+#define HW_PTE_SIZE 8
+
+// Buckets of the hashed page table. Each holds one 32-byte entry inline.
+#define HPT_BUCKETS (1U << 16)
+
+// Initial slots per way of each elastic cuckoo page table. Tables double as
+// they fill.
+#define ECPT_SLOTS (1U << 10)
+
+/**
+ * Default TLB shootdown costs, in cycles
+ * Ballpark figures for a modern x86 server. Sending an IPI is cheap for the
+ * sender, but delivery and the interrupt entry and exit on the target are
+ * not, and INVLPG costs on the order of a hundred cycles. Like Linux, a core
+ * flushes the whole PID instead once more than 33 pages are invalidated.
+ */
+#define SHOOTDOWN_IPI_SEND_CYCLES 100
+#define SHOOTDOWN_IPI_LATENCY_CYCLES 1000
+#define SHOOTDOWN_IPI_HANDLER_CYCLES 1500
+#define SHOOTDOWN_INVLPG_CYCLES 150
+#define SHOOTDOWN_FLUSH_CYCLES 500
+#define SHOOTDOWN_FLUSH_THRESHOLD 33
 
 typedef enum page_size {
   FOUR_K = 0,
@@ -22,27 +110,46 @@ typedef enum page_size {
   PG_SIZE_MAX = 4
 } page_size_t;
 
+/**
+ * Number of VA bits below the VPN for each page size
+ */
+static inline uint8_t page_size_shift(page_size_t page_size) {
+  switch (page_size) {
+  case ONE_G:
+    return 30;
+  case TWO_M:
+    return 21;
+  default:
+    return 12;
+  }
+}
+
+// Bit for a page size in a TLB's `page_sizes` mask
+#define PG_SIZE_BIT(page_size) (1U << (page_size))
+
 /**
  * TLB entry
- * Note that page size is not stored in the TLB. This is because each page size
- * has a separaate TLB
+ * The L1 TLBs each hold one page size. The STLB holds several, so the page
+ * size is part of the tag (see tlb_tag()).
+ *
+ * This is the logical view of one entry. tlb_t stores its entries as a
+ * structure of arrays, one array per field, see below.
  */
 typedef struct tlb_entry {
   uint64_t
       va; /* In a real TLB, this is a CAM structure (or some kind of multi-way,
              set-associative lookup) , so the VA itself is programmed into the
              block of flipflops that are used for the CAM lookup. So it's not
-             technically wrong to have it here. However, for simplicity, we will
-             implement the TLB lookup in this program as iterating through all
-             the TLB entries and comparing against this.If/when we add cycle
-             counting, we will reflect the true nature of the TLB by
-             undercounting carefully. */
+             technically wrong to have it here. Lookups only compare against
+             the ways of the set the VPN indexes, like a set-associative TLB
+             would. */
   uint64_t phys_frame; // Offset into page - u64 type because we use this for
                        // all 3 page table sizes.
   uint8_t user_supervisor : 1;
   permissions_t permissions;
   uint32_t pid;
-  uint8_t plru_counter; // Counter for PLRU eviction
+  page_size_t page_size;
+  uint8_t global : 1; // Survives flushes of non-global entries
   uint8_t valid : 1;
 } tlb_entry_t;
 
@@ -50,12 +157,66 @@ typedef struct tlb_entry {
 typedef tlb_entry_t tlbe_t;
 
 /**
- * TLB
+ * TLB geometry
+ */
+typedef struct tlb_geometry {
+  uint32_t sets; //< Number of sets. Must be a power of 2
+  uint32_t ways; //< Entries per set. 1 set of N ways is fully associative
+} tlb_geometry_t;
+
+// Tag of an empty TLB entry. No VPN is this large.
+#define TLB_INVALID_TAG SIXTY_FOUR_BIT_MASK
+
+// The page size is kept in the top bits of the tag, above the largest VPN
+#define TLB_TAG_SIZE_SHIFT 60
+#define TLB_TAG_VPN_MASK ((1ULL << TLB_TAG_SIZE_SHIFT) - 1)
+
+_Static_assert(VA_SIZE_LA57 - 12 <= TLB_TAG_SIZE_SHIFT,
+               "a 4K VPN of a 57-bit VA must fit below the page size bits");
+
+/**
+ * Tag of `va` as a page of `page_size`
+ *
+ * Including the size means a TLB holding several page sizes can't confuse a
+ * 4K VPN with a 2M VPN that happens to have the same value.
+ */
+static inline uint64_t tlb_tag(uint64_t va, page_size_t page_size) {
+  return (va >> page_size_shift(page_size)) |
+         ((uint64_t)page_size << TLB_TAG_SIZE_SHIFT);
+}
+
+// Alignment of the TLB arrays. One cache line.
+#define TLB_ARRAY_ALIGN 64
+
+/**
+ * Set-associative TLB
+ *
+ * Entries are stored as a structure of arrays so that a lookup streams
+ * through packed tags and PIDs and can compare several of them per SIMD
+ * instruction. Index i of every array is the same entry. Arrays are
+ * set-major: set s is entries [s * ways, s * ways + ways).
+ *
+ * The set is picked by the low VPN bits, so a lookup compares at most `ways`
+ * entries no matter how large the TLB is. A TLB holding several page sizes is
+ * probed once per size, each probe indexing with that size's VPN.
  */
 typedef struct tlb {
-  tlbe_t arr[TLB_ENTRY_COUNT];
-  uint8_t slots_in_use;
-  bool occupancy[TLB_ENTRY_COUNT];
+  uint64_t *tags;              //< tlb_tag(), or TLB_INVALID_TAG if empty
+  uint32_t *pids;              //< Owning PID
+  uint64_t *phys_frames;       //< Translated address the entry was made from
+  permissions_t *permissions;  //< R/W/X bits
+  uint8_t *user_supervisor;    //< 0 for user, 1 for supervisor
+  uint8_t *globals;            //< Global bit of the leaf PTE
+  uint32_t *slots_in_use;      //< Valid entries per set
+  repl_policy_t *policy;       //< Picks victims when a set is full
+  uint32_t sets;
+  uint32_t ways;
+  uint32_t set_mask;  //< sets - 1
+  uint8_t page_sizes; //< PG_SIZE_BIT() of every page size the TLB holds
+  uint8_t trace_unit; //< trace_unit_t naming the TLB in event traces
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
 } tlb_t;
 
 /**
@@ -83,7 +244,8 @@ typedef struct page_table_entry {
     permissions_t permissions;   //< R/W/X bits
     uint8_t user_supervisor : 1; //< 0 for user page, 1 for supervisor page
                                  // Uint8 instead of bool to use bitfield
-    uint8_t global : 1;          //< Currently unused global bit
+    uint8_t global : 1;          //< Global page. TLB entries made from it
+                                 // survive non-global flushes
     uint8_t valid : 1;           //< Valid bit
     uint8_t noncacheable : 1;    //< Non-cacheable (streaming, last use, etc.)
     uint8_t dirty : 1; //<useful when I implement swapping pages to disk
@@ -95,4 +257,164 @@ typedef struct page_table_entry {
 // Shorthand
 typedef page_table_entry_t pte_t;
 
+/**
+ * Page table entry formats
+ *
+ * PTE_FORMAT_SIM tables hold pte_t, which keeps the VPN and PID of every
+ * entry for sanity checks but is four times the size of a hardware entry.
+ * PTE_FORMAT_HW tables hold packed 8-byte x86-64 entries (see hw_pte.h), so
+ * a table of 512 entries is one 4 KiB page, like in hardware.
+ */
+typedef enum pte_format {
+  PTE_FORMAT_SIM = 0,
+  PTE_FORMAT_HW = 1,
+  PTE_FORMAT_MAX = 2
+} pte_format_t;
+
+/**
+ * Page table organizations
+ *
+ * PT_BACKEND_RADIX gives each PID its own radix tree, walked level by level.
+ * PT_BACKEND_HASHED keeps every PID's pages in one global hashed page table
+ * with collision chains, like PowerPC's HPT or Itanium's long-format VHPT
+ * (see hashed_pt.h).
+ * PT_BACKEND_CUCKOO gives each PID elastic cuckoo page tables, one per page
+ * size, whose ways are all probed at once (see ecpt.h).
+ */
+typedef enum pt_backend {
+  PT_BACKEND_RADIX = 0,
+  PT_BACKEND_HASHED = 1,
+  PT_BACKEND_CUCKOO = 2,
+  PT_BACKEND_MAX = 3
+} pt_backend_t;
+
+/**
+ * Paging-structure cache levels
+ *
+ * Each level caches entries of that page table level that point at a table.
+ * A hit in the PDE cache lets a walk go straight to the PTE table, a hit in
+ * the PDP cache to the PDE table, and so on.
+ */
+typedef enum pwc_level {
+  PWC_SDP = 0,
+  PWC_PDP = 1,
+  PWC_PDE = 2,
+  PWC_LEVELS = 3
+} pwc_level_t;
+
+/**
+ * Paging-structure cache (page walk cache) for one page table level
+ *
+ * Same layout as tlb_t: set-associative, structure of arrays, set-major. The
+ * tag is the VA bits that index this level and every level above it, so one
+ * entry stands for the whole path from the root down to the cached entry.
+ * Only pointers to tables are cached, never leaves.
+ */
+typedef struct pwc {
+  uint64_t *tags;         //< VA >> shift, or TLB_INVALID_TAG if empty
+  uint32_t *pids;         //< Owning PID
+  void **tables;          //< Table the cached entry points at, of either
+                          // pte_format_t
+  uint32_t *slots_in_use; //< Valid entries per set
+  repl_policy_t *policy;  //< Picks victims when a set is full
+  uint32_t sets;
+  uint32_t ways;
+  uint32_t set_mask; //< sets - 1
+  uint8_t shift;     //< Lowest VA bit indexing this level
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+} pwc_t;
+
+/**
+ * Data cache levels that page table reads go through
+ */
+typedef enum cache_level {
+  CACHE_L1D = 0,
+  CACHE_L2 = 1,
+  CACHE_LLC = 2, //< Shared by every core
+  CACHE_LEVELS = 3
+} cache_level_t;
+
+// Levels below this one are private to each core
+#define CACHE_PRIVATE_LEVELS CACHE_LLC
+
+/**
+ * Data cache geometry
+ */
+typedef struct cache_geometry {
+  uint32_t size;      //< Bytes. 0 disables the level
+  uint32_t ways;      //< Lines per set
+  uint32_t line_size; //< Bytes. Must be a power of 2
+} cache_geometry_t;
+
+/**
+ * Physically tagged data cache
+ *
+ * Same layout as pwc_t. The simulator only sends page table reads through
+ * it, and only needs to know whether a line is present, so a line is just
+ * its tag.
+ */
+typedef struct data_cache {
+  uint64_t *tags;         //< Address >> line_shift, or TLB_INVALID_TAG
+  uint32_t *slots_in_use; //< Valid lines per set
+  repl_policy_t *policy;  //< Picks victims when a set is full
+  uint32_t sets;
+  uint32_t ways;
+  uint32_t set_mask; //< sets - 1
+  uint32_t line_size;
+  uint8_t line_shift; //< log2(line_size)
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+} data_cache_t;
+
+/**
+ * Private translation structures of one core
+ *
+ * Page tables are shared by every core. TLBs and paging-structure caches are
+ * not, so changing a mapping means invalidating it on every core that might
+ * cache it.
+ */
+typedef struct mmu_core {
+  tlb_t *oneg_tlb;
+  tlb_t *twom_tlb;
+  tlb_t *fourk_tlb;
+  tlb_t *stlb; //< NULL if the core has no STLB
+  pwc_t *pwc[PWC_LEVELS];
+  data_cache_t *dcache[CACHE_PRIVATE_LEVELS]; //< NULL for a disabled level
+  uint64_t pid_mask; //< Bit per PID that has translated on this core. Only
+                     // these cores are sent shootdowns for the PID.
+} mmu_core_t;
+
+_Static_assert(MAX_PID <= 64, "mmu_core_t.pid_mask has a bit per PID");
+
+/**
+ * Translation latency model, in cycles
+ */
+typedef struct latency_model {
+  uint32_t l1_tlb;     //< L1 TLB lookup, paid by every translation
+  uint32_t stlb;       //< STLB lookup, paid after an L1 TLB miss
+  uint32_t walk_start; //< Starting a walk, paging-structure cache probes too
+  uint32_t pt_read;    //< Each page table entry a walk reads, when there are
+                       // no data caches
+  uint32_t fault;      //< Raising a fault to the OS
+  uint32_t l1d;        //< Page table read that hits in the L1D
+  uint32_t l2;         //< ... in the L2
+  uint32_t llc;        //< ... in the LLC
+  uint32_t memory;     //< ... that misses every data cache
+} latency_model_t;
+
+/**
+ * TLB shootdown cost model, in cycles
+ */
+typedef struct shootdown_cost {
+  uint32_t ipi_send;        //< Initiator cycles per IPI sent
+  uint32_t ipi_latency;     //< From sending an IPI to the target taking it
+  uint32_t ipi_handler;     //< Target cycles to enter and leave the handler
+  uint32_t invlpg;          //< Cycles for one core to invalidate one page
+  uint32_t flush;           //< Cycles for one core to flush a whole PID
+  uint32_t flush_threshold; //< More pages than this flush the whole PID
+} shootdown_cost_t;
+
 #endif
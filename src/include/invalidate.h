@@ -0,0 +1,88 @@
+/**
+ * @file invalidate.h
+ *
+ * Selective TLB invalidation on the current core
+ *
+ * TLB entries are tagged with the PID (the PCID, in x86 terms) that made
+ * them, so switching address spaces doesn't have to flush anything, and
+ * changing a mapping only has to drop the entries it affects. These are the
+ * invalidations the OS can ask one core for: a single page (INVLPG), a range
+ * of pages, every entry of a PID (INVPCID single-context), and every
+ * non-global entry (a CR3 write without PCIDs). Entries made from global
+ * pages survive the last one, like kernel mappings do.
+ *
+ * Each call charges the per-page or flush cost from ctx->shootdown_cost and
+ * adds to ctx->invalidation_stats. Other cores are not touched, see
+ * shootdown.h for that.
+ */
+
+#ifndef INVALIDATE_H
+#define INVALIDATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "page_table_api.h"
+
+/**
+ * @brief Invalidates the translation of one page, like INVLPG.
+ *
+ * Every TLB drops the PID's entry for the page holding `va`, whatever its
+ * size and even if it is global. Paging-structure cache entries on the way
+ * to it are dropped too.
+ *
+ * @param ctx The simulation context.
+ * @param pid PID the page belongs to.
+ * @param va Any address in the page.
+ * @return Cycles charged.
+ */
+uint64_t invalidate_page(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va);
+
+/**
+ * @brief Invalidates every page overlapping a range, like munmap() does.
+ *
+ * Issues one `invalidate_page` per 4K page. Above
+ * `shootdown_cost.flush_threshold` pages, the PID's non-global entries are
+ * flushed instead, since that is cheaper, along with its global entries in
+ * the range. Either way, the same entries are dropped.
+ *
+ * @param ctx The simulation context.
+ * @param pid PID the range belongs to.
+ * @param va Start of the range.
+ * @param len Length of the range in bytes. 0 invalidates nothing.
+ * @return Cycles charged.
+ */
+uint64_t invalidate_range(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va,
+                          size_t len);
+
+/**
+ * @brief Invalidates every non-global entry of one PID, like INVPCID
+ * single-context.
+ *
+ * The PID's paging-structure cache entries are dropped too.
+ *
+ * @param ctx The simulation context.
+ * @param pid The PID.
+ * @return Cycles charged.
+ */
+uint64_t invalidate_pid(ptw_sim_context_t *ctx, uint32_t pid);
+
+/**
+ * @brief Invalidates every non-global entry of every PID, like a CR3 write
+ * on a core without PCIDs.
+ *
+ * The paging-structure caches are flushed entirely, since they don't track
+ * the global bit.
+ *
+ * @param ctx The simulation context.
+ * @return Cycles charged.
+ */
+uint64_t invalidate_nonglobal(ptw_sim_context_t *ctx);
+
+/**
+ * @brief Prints the invalidation counters and cycle total.
+ */
+void print_invalidation_stats(FILE *out, const ptw_sim_context_t *ctx);
+
+#endif
@@ -7,15 +7,17 @@
 #ifndef PAGE_TABLE_H
 #define PAGE_TABLE_H
 
+#include <stdio.h>
+
 #include "config.h"
 #include "hw_structures.h"
 #include "page_table_api.h"
 #include "util.h"
 
 /**
- * Bit arithmetic macros for decoding pieces of addresses
+ * Bit positions of each level's index in the VA
  *
- * TODO: Check for off-by-one errors in the bit maps.
+ * Each level consumes 9 bits of the VA.
  */
 
 #define N_SDP_BITS_COMPLEMENT 9ULL
@@ -30,46 +32,138 @@
 #define N_BITS_PTE_COMPLEMENT 9ULL
 #define PTE_STARTING_BIT 12ULL
 
-// SDP bits are the top 9 ([39:47])
-#define SDP_BIT_MASK                                                           \
-  (((1ULL << (VA_SIZE - N_SDP_BITS_COMPLEMENT)) - 1ULL) << PDP_STARTING_BIT)
-#define GET_SDP_BITS(va) ((va & (SDP_BIT_MASK)))
-
-// PDP bits are the next 9 ([30:38])
-#define PDP_BIT_MASK                                                           \
-  (((1ULL << (((VA_SIZE - (N_SDP_BITS_COMPLEMENT + N_PDP_BITS_COMPLEMENT))) -  \
-              1ULL))                                                           \
-    << PDP_STARTING_BIT))
-#define GET_PDP_BITS(va) ((va & (PDP_BIT_MASK)))
-// Offset is the bottom bits while the mask is the top bits
-#define GET_PDP_OFFSET(va) ((va & ~PDP_BIT_MASK))
-
-// PDE bits are the middle 9 ([21:29])
-#define PDE_BIT_MASK                                                           \
-  (((1ULL << (VA_SIZE - (N_PDP_BITS_COMPLEMENT + N_PDP_BITS_COMPLEMENT +       \
-                         N_BITS_PDE_COMPLEMENT))) -                            \
-    1ULL)                                                                      \
-   << PDE_STARTING_BIT)
-#define GET_PDE_BITS(va) ((va & (PDE_BIT_MASK)))
-#define GET_PDE_OFFSET(va) (va & ~PDE_BIT_MASK)
-
-// PTE bits are the middle 9 below PDE ([12:20])
-#define PTE_BIT_MASK                                                           \
-  (((1ULL << (VA_SIZE - (N_PDP_BITS_COMPLEMENT + N_PDP_BITS_COMPLEMENT +       \
-                         N_BITS_PDE_COMPLEMENT + N_BITS_PTE_COMPLEMENT))) -    \
-    1ULL)                                                                      \
-   << PTE_STARTING_BIT)
-#define GET_PTE_BITS(va) ((va & (PTE_BIT_MASK)))
-#define GET_PTE_OFFSET(va) (va & ~PTE_BIT_MASK)
-
-// Shift the bits back to get the index
-#define GET_SDP_ENTRY_IDX(VA) ((GET_SDP_BITS(VA) >> SDP_STARTING_BIT))
-#define GET_PDP_ENTRY_IDX(VA) ((GET_PDP_BITS(VA) >> PDP_STARTING_BIT))
-#define GET_PDE_ENTRY_IDX(VA) ((GET_PDE_BITS(VA) >> PDE_STARTING_BIT))
-#define GET_PTE_ENTRY_IDX(VA) ((GET_PTE_BITS(VA) >> PTE_STARTING_BIT))
+// PML5 bits are [48:56], only used with 5-level paging
+#define N_PML5_BITS_COMPLEMENT 9ULL
+#define PML5_STARTING_BIT 48ULL
 
 #define NUM_ENTRIES_PER_PAGE 512
 
+/**
+ * Page table level descriptor
+ *
+ * A paging geometry is a table of these, from the root level down. The walker
+ * and the mapping code are driven by the table rather than by code per level,
+ * so another level or page size is a new table, not another copy of the walk.
+ */
+typedef struct pt_level_desc {
+  uint8_t shift;      //< Lowest VA bit indexing the level
+  uint8_t bits;       //< Index bits, so a table has 1 << bits entries
+  uint8_t leaf_sizes; //< PG_SIZE_BIT() of the page sizes a leaf here maps.
+                      // 0 if the level only points at tables.
+} pt_level_desc_t;
+
+// x86-64 4-level paging: SDP, PDP, PDE, PTE
+static const pt_level_desc_t pt_levels_4[PT_LEVELS] = {
+    {SDP_STARTING_BIT, N_SDP_BITS_COMPLEMENT, 0},
+    {PDP_STARTING_BIT, N_PDP_BITS_COMPLEMENT, PG_SIZE_BIT(ONE_G)},
+    {PDE_STARTING_BIT, N_BITS_PDE_COMPLEMENT, PG_SIZE_BIT(TWO_M)},
+    {PTE_STARTING_BIT, N_BITS_PTE_COMPLEMENT, PG_SIZE_BIT(FOUR_K)},
+};
+
+// x86-64 5-level paging (LA57): PML5, SDP, PDP, PDE, PTE
+static const pt_level_desc_t pt_levels_5[PT_LEVELS_LA57] = {
+    {PML5_STARTING_BIT, N_PML5_BITS_COMPLEMENT, 0},
+    {SDP_STARTING_BIT, N_SDP_BITS_COMPLEMENT, 0},
+    {PDP_STARTING_BIT, N_PDP_BITS_COMPLEMENT, PG_SIZE_BIT(ONE_G)},
+    {PDE_STARTING_BIT, N_BITS_PDE_COMPLEMENT, PG_SIZE_BIT(TWO_M)},
+    {PTE_STARTING_BIT, N_BITS_PTE_COMPLEMENT, PG_SIZE_BIT(FOUR_K)},
+};
+
+/**
+ * @brief Returns the number of page table levels of a context.
+ *
+ * A context that never set `pt_levels` uses 4-level paging.
+ */
+static inline uint8_t pt_n_levels(const ptw_sim_context_t *ctx) {
+  return ctx->pt_levels == PT_LEVELS_LA57 ? PT_LEVELS_LA57 : PT_LEVELS;
+}
+
+/**
+ * @brief Returns the level descriptors of a context, from the root down.
+ */
+static inline const pt_level_desc_t *
+pt_geometry(const ptw_sim_context_t *ctx) {
+  return pt_n_levels(ctx) == PT_LEVELS_LA57 ? pt_levels_5 : pt_levels_4;
+}
+
+/**
+ * @brief Returns the number of VA bits a geometry translates. Higher VAs
+ * can't be mapped.
+ */
+static inline uint8_t pt_va_bits(const pt_level_desc_t *levels) {
+  return levels[0].shift + levels[0].bits;
+}
+
+/**
+ * @brief Returns the name of a level of a geometry with `n_levels` levels,
+ * e.g. "SDP".
+ */
+static inline const char *pt_level_name(uint8_t n_levels, uint8_t level) {
+  static const char *names[PT_MAX_LEVELS] = {"PML5", "SDP", "PDP", "PDE",
+                                             "PTE"};
+  return names[PT_MAX_LEVELS - n_levels + level];
+}
+
+/**
+ * @brief Returns the index of `va`'s entry in a table of `level`.
+ */
+static inline size_t pt_level_index(const pt_level_desc_t *level,
+                                    uint64_t va) {
+  return (va >> level->shift) & ((1ULL << level->bits) - 1);
+}
+
+/**
+ * @brief Returns the VA bits that index `level`.
+ */
+static inline uint64_t pt_level_bits(const pt_level_desc_t *level,
+                                     uint64_t va) {
+  return va & (((1ULL << level->bits) - 1) << level->shift);
+}
+
+/**
+ * @brief Returns the size of the pages leaves at `level` map, or PG_SIZE_MAX
+ * if the level holds no leaves.
+ */
+static inline page_size_t pt_level_leaf_size(const pt_level_desc_t *level) {
+  static const page_size_t sizes[] = {FOUR_K, TWO_M, ONE_G};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    if (level->leaf_sizes & PG_SIZE_BIT(sizes[i])) {
+      return sizes[i];
+    }
+  }
+  return PG_SIZE_MAX;
+}
+
+/**
+ * @brief Returns the level of `levels` whose entries are leaves of
+ * `page_size`, or `n_levels` if none is.
+ */
+static inline uint8_t pt_leaf_level(const pt_level_desc_t *levels,
+                                    uint8_t n_levels, page_size_t page_size) {
+  uint8_t level = 0;
+  while (level < n_levels &&
+         !(levels[level].leaf_sizes & PG_SIZE_BIT(page_size))) {
+    level++;
+  }
+  return level;
+}
+
+/**
+ * Walk context struct
+ *
+ * Output params of a walk that the caller needs on top of the PA, like which
+ * TLB the translation belongs in.
+ */
+typedef struct walk_ctx {
+  page_size_t page_size; //< Size of the leaf that terminated the walk
+  uint8_t global;        //< Global bit of that leaf
+  permissions_t permissions; //< R/W/X bits of that leaf
+  uint8_t user_supervisor;   //< Privilege of that leaf, 1 for supervisor
+  uint8_t levels;        //< Number of page table levels that were read.
+                         // Levels skipped thanks to a PWC hit don't count.
+  uint32_t cycles;       //< Latency of the walk, start-up and reads included
+} walk_ctx_t;
+
 /**
  * Function declarations for page tables
  */
@@ -88,6 +182,8 @@
  * mode.
  * @param ctx A pointer to the page table walker simulation context, which
  * contains information like page table pointers and system-wide configuration.
+ * @param w_ctx Output param. Filled with the leaf page size on success, and
+ * with the number of levels read and the cycles they took either way.
  *
  * @return The physical address corresponding to the given virtual address, or
  * an appropriate error code if the translation fails:
@@ -112,9 +208,27 @@
  * - If no valid translation is found, returns an error code indicating a page
  * fault.
  *
+ * The levels come from a table of `pt_level_desc_t` (`pt_levels_4`), and
+ * there is one walker per geometry and entry format, specialized from the
+ * same code.
+ *
+ * Before reading any table, the paging-structure caches in `ctx->pwc` are
+ * probed from the PDE level up. The walk starts at the table below the
+ * deepest hit, and every interior entry it reads is cached on the way down.
+ * Each walk is counted in `ctx->walk_stats`.
+ *
  * This function assumes that each VA maps to a single PA within the context of
  * a PID.
  */
-uintptr_t walk(address_context_t *a_ctx, ptw_sim_context_t *ctx);
+uintptr_t walk(address_context_t *a_ctx, ptw_sim_context_t *ctx,
+               walk_ctx_t *w_ctx);
+
+/**
+ * @brief Prints the number of walks and page table reads per walk.
+ *
+ * @param out Stream to print to.
+ * @param ctx The simulation context.
+ */
+void print_walk_stats(FILE *out, const ptw_sim_context_t *ctx);
 
 #endif
@@ -9,7 +9,10 @@
 #define PAGE_TABLE_API_H
 
 #include "config.h"
+#include "ecpt.h"
+#include "hashed_pt.h"
 #include "hw_structures.h"
+#include "pt_arena.h"
 #include "util.h"
 #include <stdint.h>
 
@@ -25,6 +28,65 @@ typedef struct address_context {
   uint32_t pid;
 } address_context_t;
 
+/**
+ * Page table walker counters
+ */
+typedef struct walk_stats {
+  uint64_t walks;    //< Walks started, including ones that faulted
+  uint64_t pt_reads; //< Page table entries read by those walks
+  uint64_t leaves[PG_SIZE_MAX];      //< Successful walks by page size found
+  uint64_t depth[PT_MAX_LEVELS + 1]; //< Walks by number of entries read
+  uint64_t faults[N_FAULT_CODES];    //< Faulting walks by fault code
+} walk_stats_t;
+
+/**
+ * Translation counters of one PID
+ */
+typedef struct pid_stats {
+  uint64_t translations; //< Translations, faulting and coalesced ones included
+  uint64_t tlb_hits;     //< Resolved by an L1 TLB
+  uint64_t stlb_hits;    //< Resolved by the STLB
+  uint64_t coalesced;    //< Reused the previous access's translation
+  uint64_t walks;        //< Resolved by a page table walk
+  uint64_t faults;       //< Faulted
+  uint64_t cycles;       //< Modeled latency of all of the above
+} pid_stats_t;
+
+/**
+ * Translation cycle counters, split by where the cycles went
+ */
+typedef struct cycle_stats {
+  uint64_t translations; //< Translations charged, faulting ones included
+  uint64_t tlb_cycles;   //< L1 TLB and STLB lookups
+  uint64_t walk_cycles;  //< Page table walks
+  uint64_t fault_cycles; //< Faults
+} cycle_stats_t;
+
+/**
+ * TLB shootdown counters
+ */
+typedef struct shootdown_stats {
+  uint64_t shootdowns;        //< Mapping changes some core had to invalidate
+  uint64_t ipis;              //< IPIs sent to other cores
+  uint64_t pages_invalidated; //< Pages invalidated, summed over cores
+  uint64_t pid_flushes;       //< Times a core flushed a whole PID instead
+  uint64_t initiator_cycles;  //< Cycles spent by the core changing mappings,
+                              // including waiting for the other cores
+  uint64_t remote_cycles;     //< Cycles spent by interrupted cores, summed
+} shootdown_stats_t;
+
+/**
+ * Counters of the invalidations a core issues for its own TLBs, see
+ * invalidate.h
+ */
+typedef struct invalidation_stats {
+  uint64_t pages;             //< Pages invalidated one at a time, like INVLPG
+  uint64_t pid_flushes;       //< Flushes of one PID
+  uint64_t nonglobal_flushes; //< Flushes of every PID's non-global entries
+  uint64_t entries;           //< TLB entries the above invalidated
+  uint64_t cycles;            //< Modeled cost of all of the above
+} invalidation_stats_t;
+
 /**
  * Context struct
  *
@@ -35,10 +97,29 @@ typedef struct address_context {
 typedef struct ptw_sim_context {
   /**
    * Three TLBs
+   *
+   * These and the STLB, PWC and private data cache pointers below belong to
+   * the current core, `cores[current_core]`. switch_core() repoints them.
    */
   tlb_t *oneg_tlb;
   tlb_t *twom_tlb;
   tlb_t *fourk_tlb;
+  /**
+   * Shared second-level TLB, consulted when all three L1 TLBs miss. NULL if
+   * the simulated MMU has none.
+   */
+  tlb_t *stlb;
+  /**
+   * Paging-structure caches, indexed by pwc_level_t. A NULL level is not
+   * cached.
+   */
+  pwc_t *pwc[PWC_LEVELS];
+  /**
+   * Data caches that page table reads go through, indexed by cache_level_t.
+   * The private levels belong to the current core. The LLC belongs to the
+   * context and is shared by every core. A NULL level is not simulated.
+   */
+  data_cache_t *dcache[CACHE_LEVELS];
   /**
    * Array of pointers to page tables
    * In sim, these are indexes into the PT array
@@ -48,11 +129,49 @@ typedef struct ptw_sim_context {
    * 512 SDP entries, each of which is 64b consumes 1 page
    * In real hardware, we'd shave this to be 64b exactly.
    * In simulator, add extra metadata to make life easy.
+   *
+   * The tables hold pte_t or hw_pte_t, depending on `pte_format`. With
+   * 5-level paging, each root is a PML5 table, one level above the SDP.
+   */
+  void *page_table_pointers[MAX_PID];
+  pte_format_t pte_format;
+  uint8_t pt_levels; //< PT_LEVELS, or PT_LEVELS_LA57 for 57-bit VAs
+
+  /**
+   * Page table organization. With PT_BACKEND_HASHED, every PID's pages live
+   * in `hpt` and the radix tables above stay empty. With PT_BACKEND_CUCKOO,
+   * each PID's pages live in its `ecpt`, created with `ecpt_slots` slots per
+   * way, and the PDP and PDE PWCs serve as its cuckoo walk caches.
+   */
+  pt_backend_t pt_backend;
+  hashed_pt_t *hpt;
+  hpt_stats_t hpt_stats;
+  ecpt_t *ecpt[MAX_PID];
+  uint32_t ecpt_slots;
+  ecpt_stats_t ecpt_stats;
+
+  /**
+   * Where each PID's page tables come from. A NULL arena means the tables
+   * were allocated one by one and are freed by walking the tree.
    */
-  pte_t *page_table_pointers[MAX_PID];
+  pt_arena_t *page_table_arenas[MAX_PID];
 
-  // TODO: add backend management pointers here for easy programming of falid
-  // page tables
+  walk_stats_t walk_stats;
+
+  latency_model_t latency;
+  cycle_stats_t cycle_stats;
+  pid_stats_t pid_stats[MAX_PID];
+
+  /**
+   * Simulated cores. Each has private TLBs and paging-structure caches and
+   * shares the page tables above.
+   */
+  mmu_core_t cores[MAX_CORES];
+  uint32_t n_cores;
+  uint32_t current_core;
+  shootdown_cost_t shootdown_cost;
+  shootdown_stats_t shootdown_stats;
+  invalidation_stats_t invalidation_stats;
 
 } ptw_sim_context_t;
 
@@ -0,0 +1,100 @@
+/**
+ * @file pt_arena.h
+ *
+ * Arena allocator for page table pages
+ *
+ * Each address space gets its own arena. Tables are carved out of large
+ * anonymous mappings with a bump pointer and are never freed one at a time;
+ * destroying the arena unmaps every chunk at once. Chunks start small and
+ * double up to PT_ARENA_MAX_CHUNK, so a tiny address space doesn't reserve
+ * much, while a big one ends up on a handful of hugepage-backed chunks.
+ */
+
+#ifndef PT_ARENA_H
+#define PT_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "config.h"
+#include "hw_structures.h"
+
+// Every table starts on a 4 KiB boundary, like a real page table page
+#define PT_TABLE_ALIGN 4096
+
+// Bytes of one table of 512 pte_t
+#define PT_TABLE_BYTES (512 * sizeof(pte_t))
+
+_Static_assert(PT_TABLE_BYTES % PT_TABLE_ALIGN == 0,
+               "tables must keep the arena's bump pointer aligned");
+
+// Chunk sizes. Chunks of at least PT_ARENA_HUGEPAGE bytes are aligned to it
+// and backed by huge pages when the host allows.
+#define PT_ARENA_MIN_CHUNK (64ULL * 1024)
+#define PT_ARENA_MAX_CHUNK (64ULL * 1024 * 1024)
+#define PT_ARENA_HUGEPAGE (2ULL * 1024 * 1024)
+
+/**
+ * One mapping the arena carves tables out of
+ */
+typedef struct pt_arena_chunk {
+  void *base;
+  size_t len;
+} pt_arena_chunk_t;
+
+/**
+ * Page table arena
+ */
+typedef struct pt_arena {
+  pt_arena_chunk_t *chunks; //< Every chunk mapped so far
+  size_t n_chunks;
+  size_t max_chunks;         //< Capacity of `chunks`
+  uint8_t *cursor;           //< Next free byte of the newest chunk
+  uint8_t *end;              //< End of the newest chunk
+  size_t bytes_mapped;       //< Sum of chunk lengths
+  size_t bytes_used;         //< Sum of table sizes handed out
+  uint64_t tables[PT_MAX_LEVELS]; //< Tables handed out per level, 0 is the
+                                  // root
+} pt_arena_t;
+
+/**
+ * @brief Allocates an empty arena. No memory is mapped until the first table
+ * is requested.
+ *
+ * @return The arena, or NULL if allocation fails.
+ */
+pt_arena_t *create_pt_arena(void);
+
+/**
+ * @brief Unmaps every chunk of the arena and frees it, along with every table
+ * it handed out. NULL is ignored.
+ */
+void destroy_pt_arena(pt_arena_t *arena);
+
+/**
+ * @brief Hands out one zeroed, PT_TABLE_ALIGN-aligned table of any entry
+ * format.
+ *
+ * @param arena The arena.
+ * @param bytes Size of the table. Must be a non-zero multiple of
+ * PT_TABLE_ALIGN, at most PT_ARENA_MIN_CHUNK.
+ * @param level Page table level the table is for, 0 for the root. Only used
+ * for the per-level counts.
+ * @return The table, or NULL on a bad size or if mapping a new chunk failed.
+ */
+void *pt_arena_alloc(pt_arena_t *arena, size_t bytes, uint8_t level);
+
+/**
+ * @brief Prints the tables handed out per level and the memory mapped, summed
+ * over several arenas.
+ *
+ * @param out Stream to print to.
+ * @param arenas Arenas to sum. NULL entries are skipped.
+ * @param n Number of entries in `arenas`.
+ * @param n_levels Levels of the arenas' page tables, which name the counts.
+ */
+void print_pt_arena_stats(FILE *out, pt_arena_t *const *arenas, size_t n,
+                          uint8_t n_levels);
+
+#endif
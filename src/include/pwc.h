@@ -0,0 +1,86 @@
+/**
+ * @file pwc.h
+ * Header for paging-structure cache APIs
+ */
+
+#ifndef PWC_H
+#define PWC_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "hw_structures.h"
+
+/**
+ * @brief Allocates an empty paging-structure cache for one level.
+ *
+ * @param geometry Sets and ways. `sets` must be a non-zero power of 2 and
+ * `ways` must be non-zero.
+ * @param level Page table level whose entries are cached.
+ * @param policy Replacement policy.
+ * @return The new cache, or NULL on invalid geometry (including one the
+ * policy can't handle) or allocation failure.
+ */
+pwc_t *create_pwc(tlb_geometry_t geometry, pwc_level_t level,
+                  repl_policy_kind_t policy);
+
+/**
+ * @brief Frees a cache created with `create_pwc`. NULL is ignored.
+ */
+void destroy_pwc(pwc_t *pwc);
+
+/**
+ * @brief Invalidates every entry of a paging-structure cache.
+ */
+void flush_pwc(pwc_t *pwc);
+
+/**
+ * @brief Invalidates every entry of one PID.
+ *
+ * Needed whenever that PID's page tables are freed, since entries point
+ * straight at the tables.
+ */
+void flush_pwc_pid(pwc_t *pwc, uint32_t pid);
+
+/**
+ * @brief Invalidates the entry on the walk path of `va`, if there is one.
+ *
+ * @return true if an entry was invalidated.
+ */
+bool pwc_invalidate(pwc_t *pwc, uint64_t va, uint32_t pid);
+
+/**
+ * @brief Looks up the table the walk of `va` reaches below this level.
+ *
+ * Counts a hit or a miss.
+ *
+ * @param pwc The cache.
+ * @param va Virtual address being walked.
+ * @param pid PID owning the page table.
+ * @return The cached table, or NULL on a miss.
+ */
+void *pwc_lookup(pwc_t *pwc, uint64_t va, uint32_t pid);
+
+/**
+ * @brief Caches the table an entry of this level points at.
+ *
+ * Evicts with the cache's replacement policy if the set is full.
+ *
+ * @param pwc The cache.
+ * @param va Virtual address being walked.
+ * @param pid PID owning the page table.
+ * @param table Table the walked entry points at, in the context's PTE
+ * format.
+ */
+void pwc_fill(pwc_t *pwc, uint64_t va, uint32_t pid, void *table);
+
+/**
+ * @brief Prints a cache's geometry, policy, and hit/miss/eviction counts.
+ *
+ * @param out Stream to print to.
+ * @param name Label for the cache, e.g. "PDE PWC".
+ * @param pwc The cache.
+ */
+void print_pwc_stats(FILE *out, const char *name, const pwc_t *pwc);
+
+#endif
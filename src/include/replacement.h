@@ -0,0 +1,113 @@
+/**
+ * @file replacement.h
+ *
+ * Replacement policies for set-associative structures
+ *
+ * A policy only tracks recency/frequency state for a sets x ways array and
+ * picks victims. It knows nothing about what the structure stores, so TLBs
+ * and any other set-associative structure can share it. The owning structure
+ * tells the policy about hits and fills, and asks for a victim only when a
+ * set is full.
+ */
+
+#ifndef REPLACEMENT_H
+#define REPLACEMENT_H
+
+#include <stdint.h>
+
+/**
+ * Available policies
+ */
+typedef enum repl_policy_kind {
+  REPL_LFU_DECAY = 0, //< LFU with decay (the original TLB policy)
+  REPL_LRU = 1,       //< True LRU
+  REPL_TREE_PLRU = 2, //< Tree pseudo-LRU. Ways must be a power of 2, <= 64
+  REPL_BIT_PLRU = 3,  //< Bit pseudo-LRU (MRU bits)
+  REPL_SRRIP = 4,     //< Static re-reference interval prediction
+  REPL_BRRIP = 5,     //< Bimodal re-reference interval prediction
+  REPL_RANDOM = 6,    //< Uniform random
+  REPL_POLICY_MAX = 7
+} repl_policy_kind_t;
+
+typedef struct repl_policy repl_policy_t;
+
+/**
+ * Policy interface. Every policy implements all three hooks.
+ */
+typedef struct repl_policy_ops {
+  const char *name;
+  void (*on_hit)(repl_policy_t *p, uint32_t set, uint32_t way);
+  void (*on_fill)(repl_policy_t *p, uint32_t set, uint32_t way);
+  uint32_t (*victim)(repl_policy_t *p, uint32_t set);
+} repl_policy_ops_t;
+
+/**
+ * Policy instance
+ *
+ * `entry_state` has one word per way (sets * ways, set-major) and
+ * `set_state` one word per set. Each policy decides what goes in them.
+ */
+struct repl_policy {
+  const repl_policy_ops_t *ops;
+  repl_policy_kind_t kind;
+  uint32_t sets;
+  uint32_t ways;
+  uint64_t *entry_state;
+  uint64_t *set_state;
+  uint64_t clock; //< Access counter, for LRU timestamps
+  uint64_t rng;   //< xorshift64 state, for random and BRRIP
+};
+
+/**
+ * @brief Creates a policy for a sets x ways structure.
+ *
+ * @param kind Which policy.
+ * @param sets Number of sets.
+ * @param ways Ways per set.
+ * @param seed RNG seed for random and BRRIP. 0 picks a fixed default so runs
+ * are reproducible.
+ * @return The policy, or NULL if the policy does not support the geometry or
+ * allocation fails.
+ */
+repl_policy_t *create_repl_policy(repl_policy_kind_t kind, uint32_t sets,
+                                  uint32_t ways, uint64_t seed);
+
+/**
+ * @brief Frees a policy. NULL is ignored.
+ */
+void destroy_repl_policy(repl_policy_t *p);
+
+/**
+ * @brief Forgets all recency/frequency state, as after a full flush.
+ */
+void reset_repl_policy(repl_policy_t *p);
+
+/**
+ * @brief Returns the policy's name, e.g. "lru".
+ */
+const char *repl_policy_name(repl_policy_kind_t kind);
+
+/**
+ * @brief Looks up a policy by name.
+ *
+ * @return 0 on success, -1 if the name is unknown.
+ */
+int parse_repl_policy(const char *name, repl_policy_kind_t *kind);
+
+/**
+ * Hooks called by the owning structure
+ */
+
+static inline void repl_on_hit(repl_policy_t *p, uint32_t set, uint32_t way) {
+  p->ops->on_hit(p, set, way);
+}
+
+static inline void repl_on_fill(repl_policy_t *p, uint32_t set, uint32_t way) {
+  p->ops->on_fill(p, set, way);
+}
+
+static inline uint32_t repl_victim(repl_policy_t *p, uint32_t set) {
+  return p->ops->victim(p, set);
+}
+
+#endif
@@ -0,0 +1,198 @@
+/**
+ * @file replay.h
+ *
+ * Trace-driven replay of address streams through translate()
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "page_table_api.h"
+#include "translation.h"
+#include "util.h"
+
+// Accesses handed to translate_batch() at a time during replay
+#define REPLAY_BATCH_SIZE 4096
+
+/**
+ * Access type of a trace record. Mapped onto the permissions the access needs.
+ */
+typedef enum access_type {
+  ACCESS_READ = 0,
+  ACCESS_WRITE = 1,
+  ACCESS_EXECUTE = 2,
+  ACCESS_TYPE_MAX = 3
+} access_type_t;
+
+/**
+ * On-disk trace record
+ *
+ * A raw trace is a flat array of these in host byte order with no header, so
+ * the file size must be a multiple of 16 bytes.
+ */
+typedef struct trace_record {
+  uint64_t va;
+  uint32_t pid;
+  uint8_t access_type;     //< One of access_type_t
+  uint8_t user_supervisor; //< 0 for user, 1 for supervisor
+  uint16_t reserved;       //< Must be 0
+} trace_record_t;
+
+_Static_assert(sizeof(trace_record_t) == 16, "trace records are 16 bytes");
+
+/**
+ * A memory-mapped raw trace
+ */
+typedef struct replay_trace {
+  const trace_record_t *records;
+  size_t n_records;
+  size_t map_len;
+  int fd;
+} replay_trace_t;
+
+/**
+ * Replay statistics
+ */
+typedef struct replay_stats {
+  uint64_t records;        //< Records read from the trace
+  uint64_t translations;   //< Records that translated (possibly after a fault)
+  uint64_t coalesced;      //< Translations reused from the previous record
+  uint64_t faults;         //< Records whose first translation faulted
+  uint64_t faults_handled; //< Faults the fault handler fixed
+  uint64_t skipped;        //< Malformed records (bad PID, access type or
+                           // reserved field)
+  uint64_t elapsed_ns;     //< Wall time spent in the replay loop
+} replay_stats_t;
+
+/**
+ * Called when a translation faults during replay.
+ *
+ * Return 0 if the fault was fixed (e.g. a page was mapped) and the access
+ * should be retried, or non-zero to count it as an unhandled fault.
+ */
+typedef int (*replay_fault_handler_t)(ptw_sim_context_t *ctx,
+                                      address_context_t *a_ctx,
+                                      uintptr_t fault, void *arg);
+
+/**
+ * @brief Fault handler that demand-maps a 4 KiB RWX page on a not-present
+ * fault.
+ *
+ * Matches `replay_fault_handler_t` so it can be handed to `replay_trace`.
+ * Other fault types are left unhandled.
+ *
+ * @param ctx Pointer to the simulation context.
+ * @param a_ctx Address context of the faulting access.
+ * @param fault The fault code returned by `translate`.
+ * @param arg Unused.
+ * @return 0 if a mapping was installed, -1 otherwise.
+ */
+int demand_map_fault_handler(ptw_sim_context_t *ctx, address_context_t *a_ctx,
+                             uintptr_t fault, void *arg);
+
+/**
+ * @brief Converts an access type into the permissions the access requires.
+ */
+static inline permissions_t access_type_to_permissions(uint8_t access_type) {
+  permissions_t perms = {0};
+  perms.val.read = (access_type == ACCESS_READ);
+  perms.val.write = (access_type == ACCESS_WRITE);
+  perms.val.execute = (access_type == ACCESS_EXECUTE);
+  return perms;
+}
+
+/**
+ * @brief Fills an address context from a trace record.
+ *
+ * @return false if the record is malformed and must be skipped.
+ */
+static inline bool trace_record_to_address_context(const trace_record_t *rec,
+                                                   address_context_t *a_ctx) {
+  if (rec->pid >= MAX_PID || rec->access_type >= ACCESS_TYPE_MAX ||
+      rec->reserved != 0) {
+    return false;
+  }
+
+  a_ctx->va = rec->va;
+  a_ctx->pid = rec->pid;
+  a_ctx->permissions = access_type_to_permissions(rec->access_type);
+  a_ctx->user_supervisor = rec->user_supervisor & 0x1;
+  return true;
+}
+
+/**
+ * @brief Translates one access and handles a fault if there is one.
+ *
+ * This is the body of the replay loop, shared by every trace format.
+ *
+ * @param ctx Simulation context to translate against.
+ * @param a_ctx The access.
+ * @param handler Fault handler, or NULL to count faults only.
+ * @param arg Passed through to the handler.
+ * @param stats Counters to update. `records` is left to the caller.
+ */
+void replay_access(ptw_sim_context_t *ctx, address_context_t *a_ctx,
+                   replay_fault_handler_t handler, void *arg,
+                   replay_stats_t *stats);
+
+/**
+ * @brief Translates a batch of accesses, handling faults as they come up.
+ *
+ * Same result as replay_access() on each access in order, but goes through
+ * translate_batch().
+ *
+ * @param ctx Simulation context to translate against.
+ * @param batch The accesses.
+ * @param n Number of accesses in `batch`.
+ * @param results Scratch space for at least `n` results.
+ * @param handler Fault handler, or NULL to count faults only.
+ * @param arg Passed through to the handler.
+ * @param stats Counters to update. `records` is left to the caller.
+ */
+void replay_batch(ptw_sim_context_t *ctx, const address_context_t *batch,
+                  size_t n, translation_result_t *results,
+                  replay_fault_handler_t handler, void *arg,
+                  replay_stats_t *stats);
+
+/**
+ * @brief Memory-maps a raw trace file for replay.
+ *
+ * @param path Path to the trace.
+ * @param trace Output. Describes the mapping on success.
+ * @return 0 on success, -1 on failure (unreadable file or a size that is not a
+ * multiple of the record size).
+ */
+int open_trace(const char *path, replay_trace_t *trace);
+
+/**
+ * @brief Unmaps a trace opened with `open_trace`.
+ */
+void close_trace(replay_trace_t *trace);
+
+/**
+ * @brief Streams every record of a trace through `translate`.
+ *
+ * Each record becomes one translation. If it faults and a handler is given,
+ * the handler gets one chance to fix the fault before the access is retried.
+ *
+ * @param trace The mapped trace.
+ * @param ctx Simulation context to translate against.
+ * @param handler Fault handler, or NULL to count faults only.
+ * @param arg Passed through to the handler.
+ * @param stats Output. Zeroed and filled in.
+ * @return 0 on success, -1 on invalid arguments.
+ */
+int replay_trace(const replay_trace_t *trace, ptw_sim_context_t *ctx,
+                 replay_fault_handler_t handler, void *arg,
+                 replay_stats_t *stats);
+
+/**
+ * @brief Prints replay statistics, including throughput.
+ */
+void print_replay_stats(FILE *out, const replay_stats_t *stats);
+
+#endif
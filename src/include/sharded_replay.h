@@ -0,0 +1,82 @@
+/**
+ * @file sharded_replay.h
+ *
+ * Parallel trace replay
+ *
+ * Records are split into shards by PID, and each shard is replayed on its own
+ * thread against its own simulation context. PIDs never share page tables, so
+ * the shards are independent. What changes compared to a single-threaded
+ * replay is that PIDs in different shards no longer compete for the same
+ * TLBs and caches: each shard behaves like a core that only runs its own
+ * PIDs.
+ */
+
+#ifndef SHARDED_REPLAY_H
+#define SHARDED_REPLAY_H
+
+#include <stdint.h>
+
+#include "page_table_api.h"
+#include "replay.h"
+#include "sim_config.h"
+
+// More shards than PIDs would leave some empty
+#define MAX_REPLAY_SHARDS MAX_PID
+
+/**
+ * One shard of a sharded replay
+ */
+typedef struct replay_shard {
+  ptw_sim_context_t ctx; //< The shard's TLBs, caches, and address spaces
+  replay_stats_t stats;  //< Counters for the shard's records only
+} replay_shard_t;
+
+/**
+ * A finished sharded replay
+ */
+typedef struct sharded_replay {
+  uint32_t n_shards;
+  replay_shard_t *shards;
+  replay_stats_t stats; //< Sum over all shards. elapsed_ns is wall time.
+} sharded_replay_t;
+
+/**
+ * @brief Shard a PID belongs to.
+ */
+static inline uint32_t replay_shard_of(uint32_t pid, uint32_t n_shards) {
+  return pid % n_shards;
+}
+
+/**
+ * @brief Replays a raw or compact trace on `n_shards` threads.
+ *
+ * The calling thread streams the trace and hands each shard's thread
+ * batches of its own PIDs' records through a short queue. Compact traces are
+ * decoded a batch at a time. Memory use depends on the batch size, queue
+ * depth and number of shards, not on the length of the trace. The calling
+ * thread waits whenever a shard's queue is full.
+ *
+ * Malformed records are counted by the shard of their PID. Records with an
+ * out-of-range PID are counted by shard 0.
+ *
+ * @param replay Output. Holds the shards, whose contexts stay alive for
+ * inspection until destroy_sharded_replay(). Zeroed on failure.
+ * @param path Trace to replay.
+ * @param cfg Configuration for every shard's context.
+ * @param n_shards Number of shards (and threads), 1 to MAX_REPLAY_SHARDS.
+ * @param handler Fault handler, or NULL to count faults only. Called from
+ * several threads at once, with a different context each time.
+ * @param arg Passed through to the handler.
+ * @return 0 on success, -1 if the trace can't be read, a context can't be
+ * created, a thread can't be started, or a shard's replay fails.
+ */
+int run_sharded_replay(sharded_replay_t *replay, const char *path,
+                       const sim_config_t *cfg, uint32_t n_shards,
+                       replay_fault_handler_t handler, void *arg);
+
+/**
+ * @brief Frees the shards and their contexts. The replay is left zeroed.
+ */
+void destroy_sharded_replay(sharded_replay_t *replay);
+
+#endif
@@ -0,0 +1,45 @@
+/**
+ * @file shootdown.h
+ *
+ * TLB shootdowns between simulated cores
+ *
+ * Page tables are shared by all cores, but every core caches translations in
+ * its own TLBs and paging-structure caches. When a mapping changes, the core
+ * making the change invalidates its own copy and interrupts every other core
+ * that has run the PID (one IPI each), then waits until they have invalidated
+ * theirs. The cost of each step comes from ctx->shootdown_cost.
+ */
+
+#ifndef SHOOTDOWN_H
+#define SHOOTDOWN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "page_table_api.h"
+
+/**
+ * @brief Invalidates changed pages on every core that may cache them.
+ *
+ * Called by the address space code after a mapping is replaced or removed.
+ * The current core is the initiator. Cores that have never translated for
+ * `pid` are skipped, and if no core has, nothing is counted. A core with
+ * more than `flush_threshold` pages to invalidate flushes the whole PID
+ * instead.
+ *
+ * @param ctx The simulation context.
+ * @param pid PID whose mapping changed.
+ * @param va Start of the first changed page.
+ * @param page_size Size of the changed pages.
+ * @param n_pages Number of consecutive changed pages.
+ */
+void tlb_shootdown(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va,
+                   page_size_t page_size, size_t n_pages);
+
+/**
+ * @brief Prints the shootdown counters and cycle totals.
+ */
+void print_shootdown_stats(FILE *out, const ptw_sim_context_t *ctx);
+
+#endif
@@ -0,0 +1,113 @@
+/**
+ * @file sim_config.h
+ *
+ * Runtime configuration of the simulated MMU
+ */
+
+#ifndef SIM_CONFIG_H
+#define SIM_CONFIG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hw_structures.h"
+
+/**
+ * Simulator configuration
+ *
+ * Everything that can be changed without rebuilding the simulator. Fill with
+ * `default_sim_config` and override what you need.
+ */
+typedef struct sim_config {
+  tlb_geometry_t oneg_tlb;
+  tlb_geometry_t twom_tlb;
+  tlb_geometry_t fourk_tlb;
+  repl_policy_kind_t tlb_policy; //< Replacement policy of the L1 TLBs
+  tlb_geometry_t stlb;           //< STLB geometry. 0 sets disables the STLB
+  repl_policy_kind_t stlb_policy;
+  bool stlb_oneg; //< Whether the STLB also holds 1G pages
+  tlb_geometry_t pwc[PWC_LEVELS]; //< Per pwc_level_t. 0 sets disables a level
+  repl_policy_kind_t pwc_policy;
+  cache_geometry_t dcache[CACHE_LEVELS]; //< Per cache_level_t. Size 0
+                                         // disables a level
+  repl_policy_kind_t dcache_policy;
+  latency_model_t latency;
+  uint32_t n_cores; //< Cores with private TLBs and caches, 1 to MAX_CORES
+  shootdown_cost_t shootdown_cost;
+  pte_format_t pte_format; //< Format of the page tables
+  uint8_t pt_levels; //< PT_LEVELS, or PT_LEVELS_LA57 for 5-level paging
+  pt_backend_t pt_backend; //< Page table organization
+  uint32_t hpt_buckets;    //< Buckets of the hashed page table
+  uint32_t ecpt_slots;     //< Initial slots per way of cuckoo page tables
+} sim_config_t;
+
+/**
+ * @brief Fills a config with the defaults from hw_structures.h.
+ */
+void default_sim_config(sim_config_t *cfg);
+
+/**
+ * @brief Returns the PG_SIZE_BIT() mask of the page sizes the STLB holds.
+ */
+static inline uint8_t stlb_page_sizes(const sim_config_t *cfg) {
+  return PG_SIZE_BIT(FOUR_K) | PG_SIZE_BIT(TWO_M) |
+         (cfg->stlb_oneg ? PG_SIZE_BIT(ONE_G) : 0);
+}
+
+/**
+ * @brief Parses a TLB geometry written as "<sets>x<ways>", e.g. "64x4".
+ *
+ * @return 0 on success, -1 if the string is malformed or the set count is not
+ * a power of 2.
+ */
+int parse_tlb_geometry(const char *str, tlb_geometry_t *geometry);
+
+/**
+ * @brief Parses a data cache geometry written as "<size>x<ways>[x<line>]",
+ * e.g. "32Kx8" or "8Mx16x128".
+ *
+ * The size takes an optional K or M suffix. The line size defaults to
+ * CACHE_LINE_SIZE.
+ *
+ * @return 0 on success, -1 if the string is malformed, the line size is not a
+ * power of 2, or the size is not a power of 2 number of sets.
+ */
+int parse_cache_geometry(const char *str, cache_geometry_t *geometry);
+
+/**
+ * @brief Overrides latencies from a list like "stlb=7,pt-read=30".
+ *
+ * Keys are l1-tlb, stlb, walk-start, pt-read, fault, l1d, l2, llc and
+ * memory. Latencies not in the list keep their value.
+ *
+ * @return 0 on success, -1 on an unknown key or a malformed value. The model
+ * may be partly updated on failure.
+ */
+int parse_latency_model(const char *str, latency_model_t *latency);
+
+/**
+ * @brief Parses a page table entry format name, "sim" or "hw".
+ *
+ * @return 0 on success, -1 on an unknown name.
+ */
+int parse_pte_format(const char *name, pte_format_t *format);
+
+/**
+ * @brief Returns the name `parse_pte_format` accepts for a format.
+ */
+const char *pte_format_name(pte_format_t format);
+
+/**
+ * @brief Parses a page table organization name, "radix", "hashed" or
+ * "cuckoo".
+ *
+ * @return 0 on success, -1 on an unknown name.
+ */
+int parse_pt_backend(const char *name, pt_backend_t *backend);
+
+/**
+ * @brief Returns the name `parse_pt_backend` accepts for an organization.
+ */
+const char *pt_backend_name(pt_backend_t backend);
+
+#endif
@@ -0,0 +1,62 @@
+/**
+ * @file sim_context.h
+ *
+ * Creating and destroying simulation contexts
+ */
+
+#ifndef SIM_CONTEXT_H
+#define SIM_CONTEXT_H
+
+#include <stddef.h>
+
+#include "page_table_api.h"
+#include "sim_config.h"
+
+/**
+ * @brief Builds the hardware structures of a context from a configuration.
+ *
+ * Creates the TLBs, the STLB, the paging-structure caches, and the private
+ * data caches described by `cfg` for each of its cores, the shared LLC, and
+ * an empty address space for each PID below `max_pid`. Other PIDs get an
+ * address space when something is first mapped for them. The context starts
+ * out running on core 0.
+ *
+ * @param ctx Context to fill. Must be zeroed.
+ * @param max_pid Number of PIDs to create address spaces for up front.
+ * @param cfg Simulator configuration.
+ * @return 0 on success, -1 on an invalid configuration or allocation
+ * failure. On failure, everything already created is released.
+ */
+int create_sim_context(ptw_sim_context_t *ctx, size_t max_pid,
+                       const sim_config_t *cfg);
+
+/**
+ * @brief Frees every TLB, cache, and address space of a context.
+ *
+ * The context is left zeroed and can be passed to `create_sim_context`
+ * again.
+ */
+void destroy_sim_context(ptw_sim_context_t *ctx);
+
+/**
+ * @brief Adds the hit, miss, eviction, walk, cycle, per-PID, and shootdown
+ * counters of `src` to `dst`.
+ *
+ * The counters of every core of `src` go to the current core of `dst`. Used
+ * to sum up the contexts of a sharded replay, or the cores of one context.
+ * Both contexts should come from the same configuration. A structure missing
+ * from either one is skipped.
+ */
+void merge_sim_stats(ptw_sim_context_t *dst, const ptw_sim_context_t *src);
+
+/**
+ * @brief Runs the context on another core.
+ *
+ * Translations from here on use that core's TLBs and caches, and mapping
+ * changes are initiated from it.
+ *
+ * @return 0 on success, -1 if the context has no such core.
+ */
+int switch_core(ptw_sim_context_t *ctx, uint32_t core);
+
+#endif
@@ -0,0 +1,61 @@
+/**
+ * @file stats.h
+ *
+ * Machine-readable export of the simulator's counters
+ *
+ * Everything the replay summary prints, plus the histograms it leaves out,
+ * can be written as JSON or CSV at the end of a run. Both formats carry the
+ * same counters, grouped into sections:
+ *
+ * - replay: trace records, translations, faults and wall time
+ * - tlbs, pwcs, dcaches: geometry, hits, misses and evictions per structure
+ * - walks: walk and page table read totals
+ * - walk_page_sizes: successful walks by the page size they found
+ * - walk_depths: walks by number of page table entries read
+ * - walk_faults: faulting walks by fault type
+ * - cycles: modeled translation latency, see latency_model_t
+ * - shootdowns: TLB shootdown counters
+ * - invalidations: invalidations cores issued for their own TLBs
+ * - pids: translations of every PID that translated anything, by where each
+ *   was resolved
+ *
+ * JSON is one object with a member per section. CSV has one row per counter:
+ * section,component,counter,value. Component names the structure, page size,
+ * depth, fault type or PID the counter belongs to, and is empty for section
+ * totals.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+#include "page_table_api.h"
+#include "replay.h"
+
+/**
+ * Export formats
+ */
+typedef enum stats_format {
+  STATS_JSON = 0,
+  STATS_CSV = 1,
+} stats_format_t;
+
+/**
+ * @brief Writes every counter of `ctx` in the given format.
+ *
+ * @param replay Replay counters to include, or NULL to leave the replay
+ * section out.
+ */
+void write_stats(FILE *out, stats_format_t format, const ptw_sim_context_t *ctx,
+                 const replay_stats_t *replay);
+
+/**
+ * @brief Writes every counter of `ctx` to a file, replacing it.
+ *
+ * @return 0 on success, -1 if the file could not be written.
+ */
+int export_stats(const char *path, stats_format_t format,
+                 const ptw_sim_context_t *ctx, const replay_stats_t *replay);
+
+#endif
@@ -8,34 +8,138 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #include "hw_structures.h"
 #include "page_table_api.h"
 
 /**
- * @brief Evicts an entry from the TLB using a modified LFU algorithm with
- * decay.
+ * @brief Allocates an empty set-associative TLB.
  *
- * This function identifies the entry with the lowest counter value and evicts
- * it to make room for a new entry. If there are empty slots, no eviction is
- * performed.
+ * @param geometry Sets and ways. `sets` must be a non-zero power of 2 and
+ * `ways` must be non-zero.
+ * @param page_sizes PG_SIZE_BIT() of each page size the TLB caches, e.g.
+ * PG_SIZE_BIT(FOUR_K) | PG_SIZE_BIT(TWO_M) for an STLB.
+ * @param policy Replacement policy.
+ * @return The new TLB, or NULL on invalid geometry (including one the policy
+ * can't handle), an empty page size mask, or allocation failure.
+ */
+tlb_t *create_tlb(tlb_geometry_t geometry, uint8_t page_sizes,
+                  repl_policy_kind_t policy);
+
+/**
+ * @brief Frees a TLB created with `create_tlb`. NULL is ignored.
+ */
+void destroy_tlb(tlb_t *tlb);
+
+/**
+ * @brief Invalidates every entry of a TLB.
+ */
+void flush_tlb(tlb_t *tlb);
+
+/**
+ * @brief Invalidates every entry of one PID, global ones included.
+ *
+ * @return Number of entries invalidated.
+ */
+uint32_t flush_tlb_pid(tlb_t *tlb, uint32_t pid);
+
+/**
+ * @brief Invalidates every entry of one PID except global ones.
+ *
+ * @return Number of entries invalidated.
+ */
+uint32_t flush_tlb_pid_nonglobal(tlb_t *tlb, uint32_t pid);
+
+/**
+ * @brief Invalidates every entry of every PID except global ones.
+ *
+ * @return Number of entries invalidated.
+ */
+uint32_t flush_tlb_nonglobal(tlb_t *tlb);
+
+/**
+ * @brief Invalidates the global entries of one PID whose page overlaps
+ * [first, last].
+ *
+ * @return Number of entries invalidated.
+ */
+uint32_t flush_tlb_pid_global_range(tlb_t *tlb, uint32_t pid, uint64_t first,
+                                    uint64_t last);
+
+/**
+ * @brief Invalidates one page of one PID.
+ *
+ * @param tlb The TLB.
+ * @param va Any address in the page.
+ * @param page_size Size of the page. TLBs that don't hold it are untouched.
+ * @param pid Owning PID.
+ * @return Number of entries invalidated.
+ */
+uint32_t tlb_invalidate_page(tlb_t *tlb, uint64_t va, page_size_t page_size,
+                             uint32_t pid);
+
+/**
+ * @brief Reads one entry of a TLB into the logical entry struct.
+ *
+ * For inspection and debugging. Lookups never build a tlbe_t.
+ *
+ * @param tlb The TLB.
+ * @param idx Entry index, set * ways + way.
+ * @param tlbe Output. `va` is the VPN shifted back into place and
+ * `page_size` is decoded from the tag.
+ */
+void get_tlb_entry(const tlb_t *tlb, uint32_t idx, tlbe_t *tlbe);
+
+/**
+ * @brief Prints a TLB's geometry, policy, and hit/miss/eviction counts.
+ *
+ * @param out Stream to print to.
+ * @param name Label for the TLB, e.g. "4K TLB".
+ * @param tlb The TLB.
+ */
+void print_tlb_stats(FILE *out, const char *name, const tlb_t *tlb);
+
+/**
+ * @brief Returns the set a VA maps to as a page of `page_size`.
+ */
+static inline uint32_t tlb_set_index(const tlb_t *tlb, uint64_t va,
+                                     page_size_t page_size) {
+  return (uint32_t)(va >> page_size_shift(page_size)) & tlb->set_mask;
+}
+
+/**
+ * @brief Returns true if the TLB caches pages of `page_size`.
+ */
+static inline bool tlb_holds_size(const tlb_t *tlb, page_size_t page_size) {
+  return (tlb->page_sizes & PG_SIZE_BIT(page_size)) != 0;
+}
+
+/**
+ * @brief Evicts an entry from the TLB using the TLB's replacement policy.
+ *
+ * If the set `va` maps to is full, the policy picks a victim in that set and
+ * it is invalidated to make room for a new entry. If the set has empty ways,
+ * no eviction is performed.
  *
  * @param tlb Pointer to the TLB structure.
+ * @param va Virtual address about to be inserted.
+ * @param page_size Page size of the translation about to be inserted.
  */
-void lru_evict(tlb_t *tlb);
+void tlb_evict(tlb_t *tlb, uint64_t va, page_size_t page_size);
 
 /**
- * @brief Updates the TLB with a new translation entry.
+ * @brief Updates the TLB with a translation entry.
  *
- * This function finds a free slot in the TLB and populates it with the provided
- * virtual-to-physical mapping. The caller must ensure there is a free slot.
+ * If the set the VA maps to already caches the page for the PID, that entry
+ * is rewritten in place. Otherwise the policy makes room if the set is full,
+ * and the entry takes a free way.
  *
  * @param tlb Pointer to the TLB structure.
- * @param a_ctx Pointer to the address context structure containing the
- * translation information.
- * @param phys_frame Physical frame address to be mapped.
+ * @param entry The translation. Its permissions and privilege are the leaf
+ * PTE's, not those of the access that walked it. `valid` is ignored.
  */
-void update_tlb(tlb_t *tlb, address_context_t *a_ctx, uint64_t phys_frame);
+void update_tlb(tlb_t *tlb, const tlbe_t *entry);
 
 /**
  * @brief Updates multiple TLBs based on the specified flags.
@@ -47,18 +151,17 @@ void update_tlb(tlb_t *tlb, address_context_t *a_ctx, uint64_t phys_frame);
  * @param update_twom Update the 2 MiB page TLB if true.
  * @param update_fourk Update the 4 KiB page TLB if true.
  * @param ctx Pointer to the page table walk simulation context.
- * @param a_ctx Pointer to the address context structure containing the
- * translation information.
+ * @param entry The translation, as for `update_tlb`.
  */
 void update_tlbs(bool update_oneg, bool update_twom, bool update_fourk,
-                 ptw_sim_context_t *ctx, address_context_t *a_ctx);
+                 ptw_sim_context_t *ctx, const tlbe_t *entry);
 
 /**
  * @brief Checks for a TLB hit and handles a TLB miss if necessary.
  *
  * Searches the TLBs for a matching virtual-to-physical translation. On a hit,
- * returns the physical address. On a miss, evicts entries if necessary, walks
- * the page tables, and updates the TLBs with the new translation.
+ * returns the physical address. On a miss, records which TLBs missed in `tuc`
+ * so the caller can fill the right one once the walk finishes.
  *
  * @param a_ctx Pointer to the address context structure containing the
  * translation information.
@@ -68,4 +171,31 @@ void update_tlbs(bool update_oneg, bool update_twom, bool update_fourk,
 uintptr_t check_tlb(address_context_t *a_ctx, ptw_sim_context_t *ctx,
                     tlb_update_ctx_t *tuc);
 
+/**
+ * @brief Looks a translation up in the STLB.
+ *
+ * Called after all three L1 TLBs missed. The STLB is probed once for each
+ * page size it holds and counts one hit or one miss per call. Filling the L1
+ * TLB on a hit is left to the caller.
+ *
+ * @param a_ctx Pointer to the address context structure containing the
+ * translation information.
+ * @param ctx Pointer to the page table walk simulation context. `ctx->stlb`
+ * must not be NULL.
+ * @param hit Output. The entry that hit, to refill the L1 TLB with.
+ * @return Physical address on a hit, or SIXTY_FOUR_BIT_MASK on a miss.
+ */
+uintptr_t check_stlb(address_context_t *a_ctx, ptw_sim_context_t *ctx,
+                     tlbe_t *hit);
+
+/**
+ * @brief Inserts a walked translation into the STLB.
+ *
+ * Does nothing if there is no STLB or it doesn't hold pages of `page_size`.
+ *
+ * @param ctx Pointer to the page table walk simulation context.
+ * @param entry The translation, as for `update_tlb`.
+ */
+void update_stlb(ptw_sim_context_t *ctx, const tlbe_t *entry);
+
 #endif
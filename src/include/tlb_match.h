@@ -0,0 +1,76 @@
+/**
+ * @file tlb_match.h
+ *
+ * Tag + PID match kernel for structure-of-arrays TLBs
+ *
+ * The AVX2 path compares 4 tags and 4 PIDs per instruction, the SSE4.1 path
+ * compares 2. Which one is used is decided at compile time from the target
+ * flags (see ARCH_FLAGS in the Makefile). The scalar loop handles whatever is
+ * left over and is the whole implementation on other targets.
+ */
+
+#ifndef TLB_MATCH_H
+#define TLB_MATCH_H
+
+#include <stdint.h>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief Finds the first entry in [start, n) whose tag and PID both match.
+ *
+ * @param tags Tag array of one set (or a whole fully associative TLB).
+ * @param pids PID array, parallel to `tags`.
+ * @param start First index to compare.
+ * @param n Number of entries in the arrays.
+ * @param tag Tag to look for.
+ * @param pid PID to look for.
+ * @return Index of the first match, or -1 if there is none.
+ */
+static inline int64_t tlb_match(const uint64_t *tags, const uint32_t *pids,
+                                uint32_t start, uint32_t n, uint64_t tag,
+                                uint32_t pid) {
+  uint32_t i = start;
+
+#if defined(__AVX2__)
+  __m256i vtag = _mm256_set1_epi64x((long long)tag);
+  __m128i vpid = _mm_set1_epi32((int)pid);
+  for (; i + 4 <= n; i += 4) {
+    __m256i tag_eq = _mm256_cmpeq_epi64(
+        _mm256_loadu_si256((const __m256i *)(tags + i)), vtag);
+    // Widen the 32-bit PID compare to line up with the 64-bit tag lanes
+    __m256i pid_eq = _mm256_cvtepi32_epi64(
+        _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(pids + i)), vpid));
+    int mask = _mm256_movemask_pd(
+        _mm256_castsi256_pd(_mm256_and_si256(tag_eq, pid_eq)));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#elif defined(__SSE4_1__)
+  __m128i vtag = _mm_set1_epi64x((long long)tag);
+  __m128i vpid = _mm_set1_epi32((int)pid);
+  for (; i + 2 <= n; i += 2) {
+    __m128i tag_eq =
+        _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i *)(tags + i)), vtag);
+    __m128i pid_eq = _mm_cvtepi32_epi64(
+        _mm_cmpeq_epi32(_mm_loadl_epi64((const __m128i *)(pids + i)), vpid));
+    int mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_and_si128(tag_eq, pid_eq)));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#endif
+
+  for (; i < n; i++) {
+    if (tags[i] == tag && pids[i] == pid) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+#endif
@@ -7,9 +7,35 @@
 #ifndef TRANSLATION_H
 #define TRANSLATION_H
 
+#include <stddef.h>
+#include <stdio.h>
+
 #include "hw_structures.h"
 #include "page_table_api.h"
 
+/**
+ * Where a translation was resolved
+ */
+typedef enum translation_source {
+  TRANSLATION_TLB = 0,       //< Hit in an L1 TLB
+  TRANSLATION_STLB = 1,      //< Hit in the STLB
+  TRANSLATION_WALK = 2,      //< Page table walk
+  TRANSLATION_COALESCED = 3, //< Same page as the previous access in a batch
+  TRANSLATION_FAULT = 4,     //< No valid translation
+} translation_source_t;
+
+/**
+ * Result of one access in a batch
+ */
+typedef struct translation_result {
+  uintptr_t pa;                //< Physical address, or a fault code (IS_FAULT)
+  translation_source_t source; //< Where the translation came from
+  uint32_t cycles;             //< Modeled latency of the translation
+} translation_result_t;
+
+// How many accesses ahead translate_batch() prefetches page table entries
+#define TRANSLATE_PREFETCH_DISTANCE 8
+
 /**
  * @brief Translates a virtual address to a physical address.
  *
@@ -41,4 +67,50 @@
  */
 uintptr_t translate(address_context_t *a_ctx, ptw_sim_context_t *ctx);
 
+/**
+ * @brief translate(), also reporting the modeled latency.
+ *
+ * Every translation pays the L1 TLB lookup. An L1 miss adds the STLB lookup
+ * (when there is an STLB), an STLB miss adds the walk, and a fault adds the
+ * fault cost. The latencies come from ctx->latency. translate() charges the
+ * same cycles to ctx->cycle_stats; this only also hands them back.
+ *
+ * @param cycles Output param. Cycles the translation took.
+ * @return Same as translate().
+ */
+uintptr_t translate_timed(address_context_t *a_ctx, ptw_sim_context_t *ctx,
+                          uint32_t *cycles);
+
+/**
+ * @brief Translates a batch of accesses in order.
+ *
+ * Equivalent to calling translate() on each access, with two shortcuts:
+ * - An access to the same 4K page as the previous one, with the same PID,
+ *   user/supervisor bit and permissions, reuses the previous translation
+ *   instead of probing the TLBs again. Like a load queue merging same-page
+ *   accesses, coalesced accesses do not count as TLB hits and do not touch
+ *   replacement state. They are charged an L1 TLB hit.
+ * - The leaf page table entry of the access TRANSLATE_PREFETCH_DISTANCE
+ *   ahead is prefetched, so a walk for it is less likely to stall on the
+ *   host's memory.
+ *
+ * Stops after the first access that faults. Later accesses might depend on
+ * the fault being handled (e.g. a demand-mapped page), so the caller fixes it
+ * and calls again with the rest of the batch.
+ *
+ * @param ctx Simulation context to translate against.
+ * @param in Accesses to translate.
+ * @param n Number of accesses in `in`.
+ * @param out One result per access. Must have room for `n` results.
+ * @return Number of results written. Less than `n` only if the last one is a
+ * fault.
+ */
+size_t translate_batch(ptw_sim_context_t *ctx, const address_context_t *in,
+                       size_t n, translation_result_t *out);
+
+/**
+ * @brief Prints the cycles charged to translations so far.
+ */
+void print_cycle_stats(FILE *out, const ptw_sim_context_t *ctx);
+
 #endif
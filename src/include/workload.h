@@ -0,0 +1,121 @@
+/**
+ * @file workload.h
+ *
+ * Synthetic address streams
+ *
+ * A workload generates accesses one at a time from a small amount of state,
+ * so a stream of any length can be translated without being stored. The
+ * same configuration and seed always give the same stream.
+ *
+ * Each PID gets its own region of `footprint` bytes at `base_va`, and its own
+ * position in the pattern. With several PIDs, the stream moves to the next
+ * PID every `pid_quantum` accesses, round-robin, like a scheduler time slice.
+ */
+
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "page_table_api.h"
+#include "replay.h"
+
+/**
+ * Access patterns
+ */
+typedef enum workload_kind {
+  WORKLOAD_SEQUENTIAL = 0,    //< Scan the footprint a cache line at a time
+  WORKLOAD_STRIDE = 1,        //< Scan it in `stride`-byte steps
+  WORKLOAD_UNIFORM = 2,       //< Uniformly random 8-byte words
+  WORKLOAD_ZIPF = 3,          //< Pages ranked by a Zipf distribution
+  WORKLOAD_POINTER_CHASE = 4, //< Walk one random cycle through every page
+  WORKLOAD_GUPS = 5,          //< Random read-modify-write of 8-byte words
+  WORKLOAD_KIND_MAX = 6
+} workload_kind_t;
+
+/**
+ * Workload description
+ */
+typedef struct workload_config {
+  workload_kind_t kind;
+  uint64_t base_va;   //< Start of every PID's region, 4K aligned
+  uint64_t footprint; //< Bytes per PID, a non-zero multiple of 4K
+  uint64_t stride;    //< Bytes between WORKLOAD_STRIDE accesses
+  double zipf_s;      //< Skew of WORKLOAD_ZIPF, > 0
+  uint32_t first_pid;
+  uint32_t n_pids;        //< PIDs first_pid to first_pid + n_pids - 1
+  uint32_t pid_quantum;   //< Accesses per PID before switching, > 0
+  uint8_t write_percent;  //< Share of writes, 0 to 100. GUPS ignores it.
+  uint64_t seed;          //< Any value. 0 picks a fixed default.
+} workload_config_t;
+
+/**
+ * Generator state
+ */
+typedef struct workload {
+  workload_config_t cfg;
+  uint64_t rng;
+  uint64_t n_pages;           //< footprint / 4K
+  uint64_t cursor[MAX_PID];   //< Per-PID position in the pattern
+  uint32_t pid_index;         //< Current PID, relative to first_pid
+  uint32_t quantum_left;      //< Accesses left in the current time slice
+  bool write_pending;         //< GUPS: the last read still needs its write
+  uint64_t write_va;          //< GUPS: VA of that write
+  uint64_t chase_mask;        //< Pointer chase: LCG modulus - 1
+  double zipf_h_x1;           //< Zipf: precomputed rejection-inversion terms
+  double zipf_h_n;
+  double zipf_slack;
+} workload_t;
+
+/**
+ * @brief Fills `cfg` with a 64 MiB uniform random workload on PID 1.
+ */
+void default_workload_config(workload_config_t *cfg);
+
+/**
+ * @brief Prepares a generator.
+ *
+ * @return 0 on success, -1 if the configuration is invalid.
+ */
+int workload_init(workload_t *w, const workload_config_t *cfg);
+
+/**
+ * @brief Generates the next access. The stream never ends.
+ */
+void workload_next(workload_t *w, address_context_t *a_ctx);
+
+/**
+ * @brief Generates the next `n` accesses into `out`.
+ */
+void workload_fill(workload_t *w, address_context_t *out, size_t n);
+
+/**
+ * @brief Translates the next `n` accesses of a workload.
+ *
+ * Accesses are generated and translated a batch at a time, like a trace
+ * replay, so memory use does not depend on `n`.
+ *
+ * @param handler Fault handler, or NULL to count faults only.
+ * @param arg Passed through to the handler.
+ * @param stats Output. Zeroed and filled in, with one record per access.
+ * @return 0 on success, -1 on bad arguments or allocation failure.
+ */
+int run_workload(ptw_sim_context_t *ctx, workload_t *w, uint64_t n,
+                 replay_fault_handler_t handler, void *arg,
+                 replay_stats_t *stats);
+
+/**
+ * @brief Name of a workload kind, e.g. "zipf".
+ */
+const char *workload_kind_name(workload_kind_t kind);
+
+/**
+ * @brief Looks a workload kind up by name.
+ *
+ * @return 0 on success, -1 if the name is unknown.
+ */
+int parse_workload_kind(const char *name, workload_kind_t *kind);
+
+#endif
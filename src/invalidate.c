@@ -0,0 +1,157 @@
+/**
+ * @file invalidate.c
+ *
+ * Selective TLB invalidation on the current core
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "invalidate.h"
+#include "pwc.h"
+#include "tlb.h"
+
+#define N_CORE_TLBS 4
+
+static const page_size_t page_sizes[] = {FOUR_K, TWO_M, ONE_G};
+
+/**
+ * The current core's TLBs. The STLB slot is NULL if there is none.
+ */
+static void current_tlbs(ptw_sim_context_t *ctx, tlb_t *tlbs[N_CORE_TLBS]) {
+  tlbs[0] = ctx->oneg_tlb;
+  tlbs[1] = ctx->twom_tlb;
+  tlbs[2] = ctx->fourk_tlb;
+  tlbs[3] = ctx->stlb;
+}
+
+/**
+ * Drop every entry for the page holding `va`, of any size, without charging
+ * for it
+ */
+static void drop_page(ptw_sim_context_t *ctx, tlb_t *tlbs[N_CORE_TLBS],
+                      uint32_t pid, uintptr_t va) {
+  invalidation_stats_t *stats = &ctx->invalidation_stats;
+  for (size_t i = 0; i < N_CORE_TLBS; i++) {
+    if (tlbs[i] == NULL) {
+      continue;
+    }
+    for (size_t s = 0; s < sizeof(page_sizes) / sizeof(page_sizes[0]); s++) {
+      stats->entries += tlb_invalidate_page(tlbs[i], va, page_sizes[s], pid);
+    }
+  }
+  for (int level = 0; level < PWC_LEVELS; level++) {
+    if (ctx->pwc[level] != NULL) {
+      pwc_invalidate(ctx->pwc[level], va, pid);
+    }
+  }
+}
+
+uint64_t invalidate_page(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va) {
+  tlb_t *tlbs[N_CORE_TLBS];
+  current_tlbs(ctx, tlbs);
+  drop_page(ctx, tlbs, pid, va);
+
+  uint64_t cycles = ctx->shootdown_cost.invlpg;
+  ctx->invalidation_stats.pages++;
+  ctx->invalidation_stats.cycles += cycles;
+  return cycles;
+}
+
+/**
+ * Flush one PID, keeping its global entries or not, and charge for it
+ */
+static uint64_t flush_pid(ptw_sim_context_t *ctx, uint32_t pid,
+                          bool keep_global) {
+  tlb_t *tlbs[N_CORE_TLBS];
+  current_tlbs(ctx, tlbs);
+  for (size_t i = 0; i < N_CORE_TLBS; i++) {
+    if (tlbs[i] != NULL) {
+      ctx->invalidation_stats.entries +=
+          keep_global ? flush_tlb_pid_nonglobal(tlbs[i], pid)
+                      : flush_tlb_pid(tlbs[i], pid);
+    }
+  }
+  for (int level = 0; level < PWC_LEVELS; level++) {
+    if (ctx->pwc[level] != NULL) {
+      flush_pwc_pid(ctx->pwc[level], pid);
+    }
+  }
+
+  uint64_t cycles = ctx->shootdown_cost.flush;
+  ctx->invalidation_stats.pid_flushes++;
+  ctx->invalidation_stats.cycles += cycles;
+  return cycles;
+}
+
+uint64_t invalidate_range(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va,
+                          size_t len) {
+  if (len == 0) {
+    return 0;
+  }
+
+  uint8_t shift = page_size_shift(FOUR_K);
+  uintptr_t first = va & ~(uintptr_t)OFFSET_MASK_4KB;
+  uintptr_t last = (va + len - 1) & ~(uintptr_t)OFFSET_MASK_4KB;
+  uint64_t n_pages = ((last - first) >> shift) + 1;
+  tlb_t *tlbs[N_CORE_TLBS];
+  current_tlbs(ctx, tlbs);
+
+  // Past the threshold, flush the PID instead. Its global entries outside
+  // the range survive, as they would one INVLPG at a time.
+  if (n_pages > ctx->shootdown_cost.flush_threshold) {
+    uint64_t cycles = flush_pid(ctx, pid, true);
+    uint64_t end = last + (1ULL << shift) - 1;
+    for (size_t i = 0; i < N_CORE_TLBS; i++) {
+      if (tlbs[i] != NULL) {
+        ctx->invalidation_stats.entries +=
+            flush_tlb_pid_global_range(tlbs[i], pid, first, end);
+      }
+    }
+    return cycles;
+  }
+
+  for (uintptr_t page = first; page <= last; page += 1ULL << shift) {
+    drop_page(ctx, tlbs, pid, page);
+  }
+
+  uint64_t cycles = n_pages * ctx->shootdown_cost.invlpg;
+  ctx->invalidation_stats.pages += n_pages;
+  ctx->invalidation_stats.cycles += cycles;
+  return cycles;
+}
+
+uint64_t invalidate_pid(ptw_sim_context_t *ctx, uint32_t pid) {
+  return flush_pid(ctx, pid, true);
+}
+
+uint64_t invalidate_nonglobal(ptw_sim_context_t *ctx) {
+  tlb_t *tlbs[N_CORE_TLBS];
+  current_tlbs(ctx, tlbs);
+  for (size_t i = 0; i < N_CORE_TLBS; i++) {
+    if (tlbs[i] != NULL) {
+      ctx->invalidation_stats.entries += flush_tlb_nonglobal(tlbs[i]);
+    }
+  }
+  for (int level = 0; level < PWC_LEVELS; level++) {
+    if (ctx->pwc[level] != NULL) {
+      flush_pwc(ctx->pwc[level]);
+    }
+  }
+
+  uint64_t cycles = ctx->shootdown_cost.flush;
+  ctx->invalidation_stats.nonglobal_flushes++;
+  ctx->invalidation_stats.cycles += cycles;
+  return cycles;
+}
+
+void print_invalidation_stats(FILE *out, const ptw_sim_context_t *ctx) {
+  const invalidation_stats_t *s = &ctx->invalidation_stats;
+  fprintf(out, "Local invalidations: %lu pages, %lu PID flushes, %lu "
+               "non-global flushes\n",
+          s->pages, s->pid_flushes, s->nonglobal_flushes);
+  fprintf(out, "Entries invalidated: %lu (%lu cycles)\n", s->entries,
+          s->cycles);
+}
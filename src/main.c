@@ -1,22 +1,118 @@
 /**
  * @file main.c - contains the place that memory is allocated and setup is done
+ *
+ * Usage:
+ *   simulator                  Run the built-in tests
+ *   simulator replay [options] <trace>
+ *                              Replay a raw or compact trace through the MMU
+ *                              model
+ *     --tlb-4k=SETSxWAYS       4K TLB geometry (default 16x4)
+ *     --tlb-2m=SETSxWAYS       2M TLB geometry (default 8x4)
+ *     --tlb-1g=SETSxWAYS       1G TLB geometry (default 1x4)
+ *     --policy=NAME            TLB replacement policy (default lfu-decay)
+ *     --stlb=SETSxWAYS|off     STLB geometry (default 128x12)
+ *     --stlb-policy=NAME       STLB replacement policy (default lru)
+ *     --stlb-1g                Let the STLB hold 1G pages too
+ *     --pwc-sdp=SETSxWAYS|off  SDP paging-structure cache (default 1x2)
+ *     --pwc-pdp=SETSxWAYS|off  PDP paging-structure cache (default 1x4)
+ *     --pwc-pde=SETSxWAYS|off  PDE paging-structure cache (default 1x32)
+ *     --pwc-policy=NAME        Paging-structure cache policy (default lru)
+ *     --l1d=SIZExWAYS[xLINE]|off
+ *                              L1 data cache for page table reads
+ *                              (default 32Kx8x64)
+ *     --l2=SIZExWAYS[xLINE]|off
+ *                              L2 cache (default 1Mx16x64)
+ *     --llc=SIZExWAYS[xLINE]|off
+ *                              Shared last-level cache (default 8Mx16x64)
+ *     --dcache-policy=NAME     Data cache replacement policy (default lru)
+ *     --pte-format=NAME        Page table entry format: sim (32-byte pte_t)
+ *                              or hw (packed 8-byte x86-64) (default sim)
+ *     --la57                   5-level paging with 57-bit VAs
+ *     --page-table=NAME        Page table organization: radix, hashed or
+ *                              cuckoo (default radix)
+ *     --hpt-buckets=N          Buckets of the hashed page table, a power
+ *                              of 2 (default 64K)
+ *     --ecpt-slots=N           Initial slots per way of cuckoo page
+ *                              tables, a power of 2 (default 1K)
+ *     --threads=N              Replay on N threads, sharded by PID
+ *                              (default 1)
+ *     --latency=KEY=N,...      Override translation latencies in cycles.
+ *                              Keys: l1-tlb, stlb, walk-start, pt-read,
+ *                              fault, l1d, l2, llc, memory
+ *     --stats-json=PATH        Also write every counter to PATH as JSON
+ *     --stats-csv=PATH         Also write every counter to PATH as CSV
+ *     --event-trace=PATH       Record TLB and walk events to PATH. Needs a
+ *                              build with `make EVENT_TRACE=1`
+ *   simulator workload [options]
+ *                              Translate a synthetic address stream. Takes
+ *                              the replay options except --threads, plus:
+ *     --pattern=NAME           sequential, stride, uniform, zipf,
+ *                              pointer-chase or gups (default uniform)
+ *     --accesses=N             Accesses to generate (default 1M)
+ *     --footprint=BYTES[K|M|G] Region each PID touches (default 64M)
+ *     --base-va=ADDR           Start of that region (default 1T). Needs
+ *                              --la57 at or above 2^48
+ *     --stride=BYTES[K|M|G]    Step of the stride pattern (default 4K)
+ *     --zipf-s=S               Zipf skew (default 0.99)
+ *     --pids=N                 Round-robin over PIDs 1 to N (default 1)
+ *     --quantum=N              Accesses per PID before switching
+ *                              (default 1000)
+ *     --write-percent=N        Share of writes (default 0)
+ *     --seed=N                 Random seed (default fixed)
+ *   simulator convert <raw> <compact>
+ *                              Convert a raw trace to the compact format
  */
 
+#include <getopt.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 // Source files
+#include "compact_trace.h"
+#include "dcache.h"
+#include "event_trace.h"
 #include "hw_structures.h"
 #include "page_table.h"
 #include "page_table_api.h"
+#include "pwc.h"
+#include "replay.h"
+#include "sharded_replay.h"
+#include "sim_config.h"
+#include "sim_context.h"
+#include "stats.h"
 #include "tlb.h"
 #include "translation.h"
 #include "util.h"
+#include "workload.h"
 
 // Test files
+#include "address_space_test.h"
+#include "ecpt_test.h"
+#include "event_tracing.h"
+#include "hashed_pt_test.h"
+#include "hw_pte_test.h"
+#include "la57.h"
+#include "latency_model.h"
+#include "multicore.h"
+#include "page_walk_cache.h"
+#include "pt_arena_test.h"
+#include "pt_dcache.h"
+#include "sharded_replay_test.h"
 #include "simple_mapping.h"
+#include "stats_export.h"
+#include "stlb.h"
 #include "test_utils.h"
+#include "tlb_invalidate.h"
+#include "tlb_policy.h"
+#include "trace_replay.h"
+#include "translate_batch.h"
+#include "walk_geometry.h"
+#include "workload_gen.h"
+
+#define DEFAULT_WORKLOAD_ACCESSES (1ULL << 20)
 
 static void print_test_results(uint64_t test_counter, uint64_t test_run) {
   for (uint8_t i = 0; i < 64; i++) {
@@ -27,20 +123,719 @@ static void print_test_results(uint64_t test_counter, uint64_t test_run) {
   }
 }
 
-int main() {
-
+/**
+ * Each test gets a fresh context so TLB and page table state don't leak
+ * between tests
+ */
+static uint64_t run_test(int (*test)(ptw_sim_context_t *)) {
   ptw_sim_context_t sim_ctx = {0};
+  initialize_sim_context(&sim_ctx, MAX_PID);
+  int ret = test(&sim_ctx);
+  teardown_sim_context(&sim_ctx, MAX_PID);
+  return ret != 0;
+}
 
+static int run_tests() {
   uint64_t result = 0;
   uint64_t test_run = 0;
 
   uint8_t test_counter = 0;
   printf("Test %hhu is simple mapping test\n", test_counter);
   test_run |= (1 << test_counter);
-  result |= (run_simple_mapping_test(&sim_ctx) << test_counter);
+  result |= (run_test(run_simple_mapping_test) << test_counter);
+  test_counter++;
+
+  printf("Test %hhu is trace replay test\n", test_counter);
+  test_run |= (1 << test_counter);
+  result |= (run_test(run_trace_replay_test) << test_counter);
+  test_counter++;
+
+  printf("Test %hhu is TLB replacement policy test\n", test_counter);
+  test_run |= (1 << test_counter);
+  result |= (run_test(run_tlb_policy_test) << test_counter);
+  test_counter++;
+
+  printf("Test %hhu is STLB test\n", test_counter);
+  test_run |= (1 << test_counter);
+  result |= (run_test(run_stlb_test) << test_counter);
+  test_counter++;
+
+  printf("Test %hhu is page walk cache test\n", test_counter);
+  test_run |= (1 << test_counter);
+  result |= (run_test(run_page_walk_cache_test) << test_counter);
+  test_counter++;
+
+  printf("Test %hhu is page table arena test\n", test_counter);
+  test_run |= (1 << test_counter);
+  result |= (run_test(run_pt_arena_test) << test_counter);
+  test_counter++;
+
+  printf("Test %hhu is address space test\n", test_counter);
+  test_run |= (1 << test_counter);
+  result |= (run_test(run_address_space_test) << test_counter);
+  test_counter++;
+
+  printf("Test %hhu is batched translation test\n", test_counter);
+  test_run |= (1 << test_counter);
+  result |= (run_test(run_translate_batch_test) << test_counter);
+  test_counter++;
+
+  printf("Test %hhu is sharded replay test\n", test_counter);
+  test_run |= (1 << test_counter);
+  result |= (run_test(run_sharded_replay_test) << test_counter);
+  test_counter++;
+
+  printf("Test %hhu is multi-core shootdown test\n", test_counter);
+  test_run |= (1 << test_counter);
+  result |= (run_test(run_multicore_test) << test_counter);
+  test_counter++;
+
+  printf("Test %hhu is translation latency test\n", test_counter);
+  test_run |= (1 << test_counter);
+  result |= (run_test(run_latency_model_test) << test_counter);
+  test_counter++;
+
+  printf("Test %hhu is statistics export test\n", test_counter);
+  test_run |= (1 << test_counter);
+  result |= (run_test(run_stats_export_test) << test_counter);
+  test_counter++;
+
+  printf("Test %hhu is event tracing test\n", test_counter);
+  test_run |= (1 << test_counter);
+  result |= (run_test(run_event_tracing_test) << test_counter);
+  test_counter++;
+
+  printf("Test %hhu is workload generator test\n", test_counter);
+  test_run |= (1 << test_counter);
+  result |= (run_test(run_workload_gen_test) << test_counter);
+  test_counter++;
+
+  printf("Test %hhu is page table data cache test\n", test_counter);
+  test_run |= (1 << test_counter);
+  result |= (run_test(run_pt_dcache_test) << test_counter);
+  test_counter++;
+
+  printf("Test %hhu is TLB invalidation test\n", test_counter);
+  test_run |= (1 << test_counter);
+  result |= (run_test(run_tlb_invalidate_test) << test_counter);
+  test_counter++;
+
+  printf("Test %hhu is hardware PTE test\n", test_counter);
+  test_run |= (1 << test_counter);
+  result |= (run_test(run_hw_pte_test) << test_counter);
+  test_counter++;
+
+  printf("Test %hhu is walk geometry test\n", test_counter);
+  test_run |= (1 << test_counter);
+  result |= (run_test(run_walk_geometry_test) << test_counter);
+  test_counter++;
+
+  printf("Test %hhu is 5-level paging test\n", test_counter);
+  test_run |= (1 << test_counter);
+  result |= (run_test(run_la57_test) << test_counter);
+  test_counter++;
+
+  printf("Test %hhu is hashed page table test\n", test_counter);
+  test_run |= (1 << test_counter);
+  result |= (run_test(run_hashed_pt_test) << test_counter);
+  test_counter++;
+
+  printf("Test %hhu is elastic cuckoo page table test\n", test_counter);
+  test_run |= (1 << test_counter);
+  result |= (run_test(run_ecpt_test) << test_counter);
   test_counter++;
 
   print_test_results(result, test_run);
 
-  return (result == 0);
+  return (result != 0);
+}
+
+static void print_usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [replay [options] <trace> | workload [options] |\n"
+          "           convert <raw> <compact>]\n"
+          "Replay options:\n"
+          "  --tlb-4k=SETSxWAYS  4K TLB geometry\n"
+          "  --tlb-2m=SETSxWAYS  2M TLB geometry\n"
+          "  --tlb-1g=SETSxWAYS  1G TLB geometry\n"
+          "  --policy=NAME       TLB replacement policy: lfu-decay, lru,\n"
+          "                      tree-plru, bit-plru, srrip, brrip, random\n"
+          "  --stlb=SETSxWAYS    STLB geometry, or 'off' for no STLB\n"
+          "  --stlb-policy=NAME  STLB replacement policy\n"
+          "  --stlb-1g           Let the STLB hold 1G pages too\n"
+          "  --pwc-sdp=SETSxWAYS SDP paging-structure cache, or 'off'\n"
+          "  --pwc-pdp=SETSxWAYS PDP paging-structure cache, or 'off'\n"
+          "  --pwc-pde=SETSxWAYS PDE paging-structure cache, or 'off'\n"
+          "  --pwc-policy=NAME   Paging-structure cache replacement policy\n"
+          "  --l1d=SIZExWAYS[xLINE]\n"
+          "                      L1 data cache for page table reads, e.g.\n"
+          "                      32Kx8, or 'off'\n"
+          "  --l2=SIZExWAYS[xLINE]\n"
+          "                      L2 cache, or 'off'\n"
+          "  --llc=SIZExWAYS[xLINE]\n"
+          "                      Shared last-level cache, or 'off'\n"
+          "  --dcache-policy=NAME Data cache replacement policy\n"
+          "  --pte-format=NAME   Page table entry format: sim, hw\n"
+          "  --la57              5-level paging with 57-bit VAs\n"
+          "  --page-table=NAME   Page table organization: radix, hashed,\n"
+          "                      cuckoo\n"
+          "  --hpt-buckets=N     Buckets of the hashed page table\n"
+          "  --ecpt-slots=N      Initial slots per way of cuckoo page tables\n"
+          "  --threads=N         Replay on N threads, one shard of PIDs each\n"
+          "  --latency=KEY=N,... Translation latencies in cycles. Keys:\n"
+          "                      l1-tlb, stlb, walk-start, pt-read, fault,\n"
+          "                      l1d, l2, llc, memory\n"
+          "  --stats-json=PATH   Write every counter to PATH as JSON\n"
+          "  --stats-csv=PATH    Write every counter to PATH as CSV\n"
+          "  --event-trace=PATH  Record TLB and walk events to PATH\n"
+          "                      (needs make EVENT_TRACE=1)\n"
+          "Workload options (and the replay options but --threads):\n"
+          "  --pattern=NAME      sequential, stride, uniform, zipf,\n"
+          "                      pointer-chase, gups\n"
+          "  --accesses=N        Accesses to generate\n"
+          "  --footprint=SIZE    Bytes each PID touches, e.g. 64M\n"
+          "  --base-va=ADDR      Start of that region, e.g. 0x1000000000000\n"
+          "  --stride=SIZE       Step of the stride pattern, e.g. 4K\n"
+          "  --zipf-s=S          Zipf skew\n"
+          "  --pids=N            Round-robin over PIDs 1 to N\n"
+          "  --quantum=N         Accesses per PID before switching\n"
+          "  --write-percent=N   Share of writes\n"
+          "  --seed=N            Random seed\n",
+          prog);
+}
+
+/**
+ * Everything "replay" or "workload" was asked to do
+ */
+typedef struct replay_args {
+  sim_config_t cfg;
+  uint32_t threads;
+  const char *path; //< Trace to replay, or NULL for a workload
+  workload_config_t workload;
+  uint64_t accesses; //< Length of the workload
+  const char *stats_json; //< Where to export the counters, or NULL
+  const char *stats_csv;
+  const char *event_trace; //< Where to record events, or NULL
+} replay_args_t;
+
+/**
+ * Parse a count, or a size with an optional K, M or G suffix
+ */
+static int parse_u64(const char *s, bool size, uint64_t *out) {
+  char *end;
+  unsigned long long n = strtoull(s, &end, 0);
+  if (end == s || s[0] == '-') {
+    return -1;
+  }
+
+  int shift = 0;
+  if (size && *end != '\0' && end[1] == '\0') {
+    switch (*end) {
+    case 'K':
+      shift = 10;
+      break;
+    case 'M':
+      shift = 20;
+      break;
+    case 'G':
+      shift = 30;
+      break;
+    default:
+      return -1;
+    }
+    end++;
+  }
+  if (*end != '\0' || n > (UINT64_MAX >> shift)) {
+    return -1;
+  }
+
+  *out = (uint64_t)n << shift;
+  return 0;
+}
+
+/**
+ * Parse a workload option. Returns 1 if `opt` is not one.
+ */
+static int parse_workload_opt(int opt, const char *arg, replay_args_t *args) {
+  workload_config_t *w = &args->workload;
+  uint64_t n;
+  char *end;
+
+  switch (opt) {
+  case 'W':
+    if (parse_workload_kind(arg, &w->kind) != 0) {
+      fprintf(stderr, "Unknown workload '%s'.\n", arg);
+      return 1;
+    }
+    return 0;
+  case 'A':
+    return parse_u64(arg, false, &args->accesses);
+  case 'F':
+    return parse_u64(arg, true, &w->footprint);
+  case 'B':
+    return parse_u64(arg, false, &w->base_va);
+  case 'R':
+    return parse_u64(arg, true, &w->stride);
+  case 'Z':
+    w->zipf_s = strtod(arg, &end);
+    return *end != '\0' || end == arg ? -1 : 0;
+  case 'N':
+    if (parse_u64(arg, false, &n) != 0 || n > MAX_PID - w->first_pid) {
+      return -1;
+    }
+    w->n_pids = (uint32_t)n;
+    return 0;
+  case 'Q':
+    if (parse_u64(arg, false, &n) != 0 || n > UINT32_MAX) {
+      return -1;
+    }
+    w->pid_quantum = (uint32_t)n;
+    return 0;
+  case 'X':
+    if (parse_u64(arg, false, &n) != 0 || n > 100) {
+      return -1;
+    }
+    w->write_percent = (uint8_t)n;
+    return 0;
+  case 'e':
+    return parse_u64(arg, false, &w->seed);
+  default:
+    return 1;
+  }
+}
+
+/**
+ * Parse "replay [options] <trace>" or "workload [options]". argv[0] is the
+ * command.
+ */
+static int parse_replay_args(int argc, char **argv, replay_args_t *args) {
+  sim_config_t *cfg = &args->cfg;
+  bool workload = strcmp(argv[0], "workload") == 0;
+  static const struct option long_opts[] = {
+      {"tlb-4k", required_argument, NULL, '4'},
+      {"tlb-2m", required_argument, NULL, '2'},
+      {"tlb-1g", required_argument, NULL, '1'},
+      {"policy", required_argument, NULL, 'p'},
+      {"stlb", required_argument, NULL, 's'},
+      {"stlb-policy", required_argument, NULL, 'P'},
+      {"stlb-1g", no_argument, NULL, 'G'},
+      {"pwc-sdp", required_argument, NULL, 'S'},
+      {"pwc-pdp", required_argument, NULL, 'D'},
+      {"pwc-pde", required_argument, NULL, 'E'},
+      {"pwc-policy", required_argument, NULL, 'w'},
+      {"l1d", required_argument, NULL, 'd'},
+      {"l2", required_argument, NULL, 'l'},
+      {"llc", required_argument, NULL, 'c'},
+      {"dcache-policy", required_argument, NULL, 'y'},
+      {"pte-format", required_argument, NULL, 'f'},
+      {"la57", no_argument, NULL, '5'},
+      {"page-table", required_argument, NULL, 'O'},
+      {"hpt-buckets", required_argument, NULL, 'H'},
+      {"ecpt-slots", required_argument, NULL, 'K'},
+      {"threads", required_argument, NULL, 't'},
+      {"latency", required_argument, NULL, 'L'},
+      {"stats-json", required_argument, NULL, 'J'},
+      {"stats-csv", required_argument, NULL, 'C'},
+      {"event-trace", required_argument, NULL, 'T'},
+      {"pattern", required_argument, NULL, 'W'},
+      {"accesses", required_argument, NULL, 'A'},
+      {"footprint", required_argument, NULL, 'F'},
+      {"base-va", required_argument, NULL, 'B'},
+      {"stride", required_argument, NULL, 'R'},
+      {"zipf-s", required_argument, NULL, 'Z'},
+      {"pids", required_argument, NULL, 'N'},
+      {"quantum", required_argument, NULL, 'Q'},
+      {"write-percent", required_argument, NULL, 'X'},
+      {"seed", required_argument, NULL, 'e'},
+      {NULL, 0, NULL, 0},
+  };
+
+  default_sim_config(cfg);
+  default_workload_config(&args->workload);
+  args->accesses = DEFAULT_WORKLOAD_ACCESSES;
+  args->path = NULL;
+  args->threads = 1;
+  args->stats_json = NULL;
+  args->stats_csv = NULL;
+  args->event_trace = NULL;
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", long_opts, NULL)) != -1) {
+    tlb_geometry_t *geometry = NULL;
+    switch (opt) {
+    case '4':
+      geometry = &cfg->fourk_tlb;
+      break;
+    case '2':
+      geometry = &cfg->twom_tlb;
+      break;
+    case '1':
+      geometry = &cfg->oneg_tlb;
+      break;
+    case 'p':
+      if (parse_repl_policy(optarg, &cfg->tlb_policy) != 0) {
+        fprintf(stderr, "Unknown replacement policy '%s'.\n", optarg);
+        return -1;
+      }
+      continue;
+    case 's':
+      if (strcmp(optarg, "off") == 0) {
+        cfg->stlb = (tlb_geometry_t){0, 0};
+        continue;
+      }
+      geometry = &cfg->stlb;
+      break;
+    case 'P':
+      if (parse_repl_policy(optarg, &cfg->stlb_policy) != 0) {
+        fprintf(stderr, "Unknown replacement policy '%s'.\n", optarg);
+        return -1;
+      }
+      continue;
+    case 'G':
+      cfg->stlb_oneg = true;
+      continue;
+    case 'S':
+    case 'D':
+    case 'E':
+      geometry = &cfg->pwc[opt == 'S' ? PWC_SDP : opt == 'D' ? PWC_PDP
+                                                             : PWC_PDE];
+      if (strcmp(optarg, "off") == 0) {
+        *geometry = (tlb_geometry_t){0, 0};
+        continue;
+      }
+      break;
+    case 'w':
+      if (parse_repl_policy(optarg, &cfg->pwc_policy) != 0) {
+        fprintf(stderr, "Unknown replacement policy '%s'.\n", optarg);
+        return -1;
+      }
+      continue;
+    case 'd':
+    case 'l':
+    case 'c': {
+      cache_geometry_t *dcache =
+          &cfg->dcache[opt == 'd' ? CACHE_L1D : opt == 'l' ? CACHE_L2
+                                                           : CACHE_LLC];
+      if (strcmp(optarg, "off") == 0) {
+        dcache->size = 0;
+      } else if (parse_cache_geometry(optarg, dcache) != 0) {
+        fprintf(stderr, "Bad cache geometry '%s'. Expected SIZExWAYS[xLINE] "
+                        "with a power of 2 set count and line size.\n",
+                optarg);
+        return -1;
+      }
+      continue;
+    }
+    case 'y':
+      if (parse_repl_policy(optarg, &cfg->dcache_policy) != 0) {
+        fprintf(stderr, "Unknown replacement policy '%s'.\n", optarg);
+        return -1;
+      }
+      continue;
+    case 'f':
+      if (parse_pte_format(optarg, &cfg->pte_format) != 0) {
+        fprintf(stderr, "Unknown page table entry format '%s'.\n", optarg);
+        return -1;
+      }
+      continue;
+    case '5':
+      cfg->pt_levels = PT_LEVELS_LA57;
+      continue;
+    case 'O':
+      if (parse_pt_backend(optarg, &cfg->pt_backend) != 0) {
+        fprintf(stderr, "Unknown page table organization '%s'.\n", optarg);
+        return -1;
+      }
+      continue;
+    case 'H':
+    case 'K': {
+      uint64_t n;
+      if (parse_u64(optarg, true, &n) != 0 || n == 0 || n > UINT32_MAX ||
+          (n & (n - 1)) != 0) {
+        fprintf(stderr, "%s count must be a power of 2.\n",
+                opt == 'H' ? "Bucket" : "Slot");
+        return -1;
+      }
+      *(opt == 'H' ? &cfg->hpt_buckets : &cfg->ecpt_slots) = (uint32_t)n;
+      continue;
+    }
+    case 't': {
+      char *end;
+      unsigned long n = strtoul(optarg, &end, 10);
+      if (*end != '\0' || n == 0 || n > MAX_REPLAY_SHARDS) {
+        fprintf(stderr, "Thread count must be 1 to %d.\n", MAX_REPLAY_SHARDS);
+        return -1;
+      }
+      args->threads = (uint32_t)n;
+      continue;
+    }
+    case 'L':
+      if (parse_latency_model(optarg, &cfg->latency) != 0) {
+        fprintf(stderr, "Bad latency list '%s'.\n", optarg);
+        return -1;
+      }
+      continue;
+    case 'J':
+      args->stats_json = optarg;
+      continue;
+    case 'C':
+      args->stats_csv = optarg;
+      continue;
+    case 'T':
+      if (!EVENT_TRACE_HOOKS) {
+        fprintf(stderr, "Built without event tracing. Rebuild with "
+                        "`make clean && make EVENT_TRACE=1`.\n");
+        return -1;
+      }
+      args->event_trace = optarg;
+      continue;
+    default: {
+      int ret = workload ? parse_workload_opt(opt, optarg, args) : 1;
+      if (ret != 0) {
+        if (ret < 0) {
+          fprintf(stderr, "Bad value '%s'.\n", optarg);
+        }
+        return -1;
+      }
+      continue;
+    }
+    }
+
+    if (parse_tlb_geometry(optarg, geometry) != 0) {
+      fprintf(stderr, "Bad TLB geometry '%s'. Expected SETSxWAYS with a "
+                      "power of 2 set count.\n",
+              optarg);
+      return -1;
+    }
+  }
+
+  if (workload) {
+    if (args->threads > 1) {
+      fprintf(stderr, "Workloads run on one thread.\n");
+      return -1;
+    }
+    // Otherwise every access would fault on an unmappable page
+    int va_bits = cfg->pt_levels == PT_LEVELS_LA57 ? VA_SIZE_LA57 : VA_SIZE;
+    const workload_config_t *w = &args->workload;
+    uint64_t limit = 1ULL << va_bits;
+    if (w->base_va >= limit || w->footprint > limit - w->base_va) {
+      fprintf(stderr, "Workload region is beyond %d-bit VAs.%s\n", va_bits,
+              va_bits == VA_SIZE ? " Try --la57." : "");
+      return -1;
+    }
+    return optind == argc ? 0 : -1;
+  }
+
+  if (optind != argc - 1) {
+    return -1;
+  }
+
+  args->path = argv[optind];
+  return 0;
+}
+
+/**
+ * Print the replay and hardware structure statistics of a finished replay,
+ * and export them if asked to. `arenas` and `ecpts` hold each PID's page
+ * table arena and cuckoo page tables, wherever they live, and `hpts` the
+ * `n_hpts` hashed page tables, if any.
+ */
+static int report_sim_stats(const replay_args_t *args,
+                            const replay_stats_t *stats,
+                            const ptw_sim_context_t *ctx,
+                            pt_arena_t *const *arenas,
+                            hashed_pt_t *const *hpts, size_t n_hpts,
+                            ecpt_t *const *ecpts) {
+  static const char *pwc_names[PWC_LEVELS] = {"SDP PWC", "PDP PWC",
+                                              "PDE PWC"};
+  static const char *cwc_names[PWC_LEVELS] = {NULL, "PUD CWC", "PMD CWC"};
+  static const char *dcache_names[CACHE_LEVELS] = {"L1D", "L2", "LLC"};
+
+  print_replay_stats(stdout, stats);
+  print_tlb_stats(stdout, "1G TLB", ctx->oneg_tlb);
+  print_tlb_stats(stdout, "2M TLB", ctx->twom_tlb);
+  print_tlb_stats(stdout, "4K TLB", ctx->fourk_tlb);
+  if (ctx->stlb != NULL) {
+    print_tlb_stats(stdout, "STLB", ctx->stlb);
+  }
+
+  print_walk_stats(stdout, ctx);
+  print_cycle_stats(stdout, ctx);
+  bool cuckoo = ctx->pt_backend == PT_BACKEND_CUCKOO;
+  if (ctx->pt_backend == PT_BACKEND_HASHED) {
+    print_hpt_stats(stdout, &ctx->hpt_stats, hpts, n_hpts);
+  } else if (cuckoo) {
+    print_ecpt_stats(stdout, &ctx->ecpt_stats, ecpts, MAX_PID);
+  } else {
+    print_pt_arena_stats(stdout, arenas, MAX_PID, pt_n_levels(ctx));
+  }
+  for (int level = 0; level < PWC_LEVELS; level++) {
+    if (ctx->pwc[level] != NULL) {
+      print_pwc_stats(stdout, (cuckoo ? cwc_names : pwc_names)[level],
+                      ctx->pwc[level]);
+    }
+  }
+  for (int level = 0; level < CACHE_LEVELS; level++) {
+    if (ctx->dcache[level] != NULL) {
+      print_dcache_stats(stdout, dcache_names[level], ctx->dcache[level]);
+    }
+  }
+
+  int ret = 0;
+  if (args->stats_json != NULL &&
+      export_stats(args->stats_json, STATS_JSON, ctx, stats) != 0) {
+    ret = -1;
+  }
+  if (args->stats_csv != NULL &&
+      export_stats(args->stats_csv, STATS_CSV, ctx, stats) != 0) {
+    ret = -1;
+  }
+  return ret;
+}
+
+/**
+ * Replay a trace on several threads and print the summed statistics
+ */
+static int run_sharded(const replay_args_t *args) {
+  uint32_t threads = args->threads;
+  sharded_replay_t replay;
+  if (run_sharded_replay(&replay, args->path, &args->cfg, threads,
+                         demand_map_fault_handler, NULL) != 0) {
+    return 1;
+  }
+
+  // Sum the shards into an empty context of the same shape
+  ptw_sim_context_t total = {0};
+  if (create_sim_context(&total, 0, &args->cfg) != 0) {
+    destroy_sharded_replay(&replay);
+    return 1;
+  }
+
+  pt_arena_t *arenas[MAX_PID];
+  ecpt_t *ecpts[MAX_PID];
+  for (uint32_t pid = 0; pid < MAX_PID; pid++) {
+    const ptw_sim_context_t *shard =
+        &replay.shards[replay_shard_of(pid, threads)].ctx;
+    arenas[pid] = shard->page_table_arenas[pid];
+    ecpts[pid] = shard->ecpt[pid];
+  }
+  hashed_pt_t *hpts[MAX_REPLAY_SHARDS];
+  for (uint32_t i = 0; i < threads; i++) {
+    hpts[i] = replay.shards[i].ctx.hpt;
+    merge_sim_stats(&total, &replay.shards[i].ctx);
+  }
+
+  printf("Shards:           %u\n", threads);
+  int ret = report_sim_stats(args, &replay.stats, &total, arenas, hpts,
+                             threads, ecpts);
+
+  destroy_sim_context(&total);
+  destroy_sharded_replay(&replay);
+  return ret != 0;
+}
+
+/**
+ * Replay a trace, demand-mapping 4K pages on first touch
+ */
+static int run_replay(const replay_args_t *args) {
+  const char *path = args->path;
+  bool compact = is_compact_trace(path);
+  replay_trace_t trace;
+  compact_trace_reader_t reader;
+
+  if (compact ? compact_trace_reader_open(&reader, path) != 0
+              : open_trace(path, &trace) != 0) {
+    return 1;
+  }
+
+  // Address spaces are created as the trace first touches each PID
+  ptw_sim_context_t sim_ctx = {0};
+  replay_stats_t stats;
+  int ret = create_sim_context(&sim_ctx, 0, &args->cfg);
+  if (ret == 0) {
+    ret = compact ? replay_compact_trace(&reader, &sim_ctx,
+                                         demand_map_fault_handler, NULL,
+                                         &stats)
+                  : replay_trace(&trace, &sim_ctx, demand_map_fault_handler,
+                                 NULL, &stats);
+  }
+  if (ret == 0) {
+    ret = report_sim_stats(args, &stats, &sim_ctx, sim_ctx.page_table_arenas,
+                           &sim_ctx.hpt, 1, sim_ctx.ecpt);
+  }
+
+  destroy_sim_context(&sim_ctx);
+  if (compact) {
+    compact_trace_reader_close(&reader);
+  } else {
+    close_trace(&trace);
+  }
+  return ret != 0;
+}
+
+/**
+ * Translate a synthetic workload, demand-mapping 4K pages on first touch
+ */
+static int run_synthetic(const replay_args_t *args) {
+  workload_t *w = malloc(sizeof(workload_t));
+  if (w == NULL || workload_init(w, &args->workload) != 0) {
+    free(w);
+    return 1;
+  }
+
+  ptw_sim_context_t sim_ctx = {0};
+  replay_stats_t stats;
+  int ret = create_sim_context(&sim_ctx, 0, &args->cfg);
+  if (ret == 0) {
+    ret = run_workload(&sim_ctx, w, args->accesses, demand_map_fault_handler,
+                       NULL, &stats);
+  }
+  if (ret == 0) {
+    printf("Workload:         %s\n", workload_kind_name(w->cfg.kind));
+    ret = report_sim_stats(args, &stats, &sim_ctx, sim_ctx.page_table_arenas,
+                           &sim_ctx.hpt, 1, sim_ctx.ecpt);
+  }
+
+  destroy_sim_context(&sim_ctx);
+  free(w);
+  return ret != 0;
+}
+
+int main(int argc, char **argv) {
+
+  if (argc >= 2 && (strcmp(argv[1], "replay") == 0 ||
+                    strcmp(argv[1], "workload") == 0)) {
+    replay_args_t args;
+    if (parse_replay_args(argc - 1, argv + 1, &args) != 0) {
+      print_usage(argv[0]);
+      return 1;
+    }
+    if (args.event_trace != NULL && event_trace_start(args.event_trace) != 0) {
+      return 1;
+    }
+
+    int ret = args.path == NULL    ? run_synthetic(&args)
+              : args.threads > 1 ? run_sharded(&args)
+                                 : run_replay(&args);
+
+    if (args.event_trace != NULL) {
+      int64_t dropped = event_trace_stop();
+      if (dropped < 0) {
+        return 1;
+      }
+      printf("Events dropped:   %ld\n", dropped);
+    }
+    return ret;
+  }
+
+  if (argc == 4 && strcmp(argv[1], "convert") == 0) {
+    return convert_raw_trace(argv[2], argv[3], 0) != 0;
+  }
+
+  if (argc != 1) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  return run_tests();
 }
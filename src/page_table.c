@@ -5,224 +5,550 @@
  */
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
+#include "dcache.h"
+#include "ecpt.h"
+#include "event_trace.h"
+#include "hashed_pt.h"
+#include "hw_pte.h"
 #include "page_table.h"
 #include "page_table_api.h"
+#include "pwc.h"
+#include "sim_config.h"
 #include "util.h"
 
-uintptr_t walk(address_context_t *a_ctx, ptw_sim_context_t *ctx) {
-  /**
-   * First, use the PID to look up the pointer to the directory table
-   *
-   * Use the top (VA_SIZE - (9*3)) bits of the address as the index in the
-   * directory pointer table. The physical frame that it points at is the base
-   * of a page directory.
-   *
-   * That points to a directory page table entry. Use the next 9 bits as an
-   * index into the directory.
-   *
-   * That points us to a page table entry. Use that page table entry (in
-   * whatever size it is labelled as)
-   *
-   * Assume, for now, that within a PID, an address has only one match
-   */
-
-  uintptr_t pa = 0;
+/**
+ * Find the deepest paging-structure cache that knows the path to `va`
+ *
+ * Probes the PDE cache first, then PDP, then SDP, stopping at the first hit.
+ * Returns the page table level to read next, counted from the root of a
+ * geometry with `n_levels` levels, and sets `table` to the table at that
+ * level. The caches hold SDP, PDP and PDE entries whatever the geometry, so
+ * with 5-level paging a miss starts at the PML5 table, and PML5 entries
+ * aren't cached.
+ */
+static inline uint8_t pwc_resume(ptw_sim_context_t *ctx, uint64_t va,
+                                 uint32_t pid, uint8_t n_levels,
+                                 void **table) {
+  for (int level = PWC_PDE; level >= PWC_SDP; level--) {
+    if (ctx->pwc[level] == NULL) {
+      continue;
+    }
 
-  uint64_t va = a_ctx->va;
-  // Pointer to the page table base. That is a block of 512 SDP entries
-  uint32_t pid = a_ctx->pid;
-  pte_t *page_table_base = ctx->page_table_pointers[pid];
+    void *cached = pwc_lookup(ctx->pwc[level], va, pid);
+    if (cached != NULL) {
+      *table = cached;
+      return level + 1 + (n_levels - PT_LEVELS);
+    }
+  }
 
-  // Top 9 bits of VA specify SPDP pointer
-  // No page size maps to a real page at this level
-  uint16_t sdp_offset = GET_SDP_ENTRY_IDX(va);
-  pte_t *sdp = &page_table_base[sdp_offset];
+  *table = ctx->page_table_pointers[pid];
+  return 0;
+}
 
-  // If the VA doesn't match the VPN, we have a malformed SDP
-  if (GET_SDP_BITS(va) != GET_SDP_BITS(sdp->vpn)) {
-    return -EFAULT;
+/**
+ * Remember the table an interior entry points at, if that level is cached
+ */
+static inline void pwc_remember(ptw_sim_context_t *ctx, pwc_level_t level,
+                                uint64_t va, uint32_t pid, void *table) {
+  if (ctx->pwc[level] != NULL) {
+    pwc_fill(ctx->pwc[level], va, pid, table);
   }
+}
 
-  // If valid bit not set, then we have TNV (Translation Not Valid)
-  // Alert the OS and make them fix it or whatever
-  if ((sdp->page_metadata.valid != 0x1)) {
-    return -EINVAL;
-  }
+/**
+ * An entry of either pte_format_t, as the walker sees it
+ */
+typedef struct walk_entry {
+  uint64_t addr;           //< Table or page the entry points at
+  permissions_t perms;     //< R/W/X bits
+  uint8_t user_supervisor; //< 0 for a user page, 1 for a supervisor page
+  bool global;
+  bool leaf;      //< Maps a page rather than pointing at a table
+  bool malformed; //< A leaf of a size its level can't hold
+} walk_entry_t;
 
-  // Check permissions - Need at least read.
-  // Don't check against requested permissions since the page doesn't map here.
-  permissions_t r_permissions = {0};
-  r_permissions.val.read = 1;
+/**
+ * Read the entry of `va` in `table`, a table of `level`, and decode it
+ *
+ * Counts the read and charges its latency, which depends on where the entry
+ * is cached. Packed entries get their accessed bit set. Returns 0, or the
+ * fault the entry raises before any permission check. `slot` is set to the
+ * entry.
+ */
+static inline __attribute__((always_inline)) uintptr_t
+read_entry(ptw_sim_context_t *ctx, walk_ctx_t *w_ctx,
+           const address_context_t *a_ctx, const pt_level_desc_t *l,
+           uint8_t level, bool last, void *table, pte_format_t format,
+           void **slot, walk_entry_t *out) {
+  size_t index = pt_level_index(l, a_ctx->va);
+  TRACE_WALK_EVENT(EVENT_WALK_READ, level, a_ctx->pid, a_ctx->va);
+  w_ctx->levels++;
+
+  if (format == PTE_FORMAT_HW) {
+    hw_pte_t *entry = &((hw_pte_t *)table)[index];
+    *slot = entry;
+    w_ctx->cycles += dcache_read(ctx, (uintptr_t)entry);
+
+    hw_pte_t e = *entry;
+    if (!hw_pte_present(e)) {
+      return -EINVAL;
+    }
 
-  if (!check_permissions(r_permissions, sdp->page_metadata.permissions)) {
-    return -EUNAUTHORIZED;
+    // Only write the entry back if a bit actually changes
+    if (!(e & HW_PTE_A)) {
+      *entry = e |= HW_PTE_A;
+    }
+
+    out->addr = hw_pte_addr(e);
+    out->perms = hw_pte_permissions(e);
+    out->user_supervisor = hw_pte_user_supervisor(e);
+    out->global = (e & HW_PTE_G) != 0;
+    out->leaf = last || (e & HW_PTE_PS);
+    out->malformed = out->leaf && l->leaf_sizes == 0;
+    return 0;
   }
 
-  // Don't check noncacheable, user_supervisor, dirty, global until we find the
-  // right page size for a match
+  pte_t *entry = &((pte_t *)table)[index];
+  *slot = entry;
+  w_ctx->cycles += dcache_read_pte(ctx, entry);
 
-  // The phys_frame is overloaded. In this case, it points at a 4k page.
-  // This address should always be 4k-aligned
-  pte_t *pdp_base = (pte_t *)sdp->phys_frame.oneg_pte_index;
-  // Next 9 bits of VA specify PDP pointer
-  // If PDP pointer is marked 1G page, return immediately with that frame
-  uint16_t pdp_offset = GET_PDP_ENTRY_IDX(va);
-  pte_t *pdp = &pdp_base[pdp_offset];
+  // If valid bit not set, then we have TNV (Translation Not Valid)
+  if (!entry->page_metadata.valid) {
+    return -EINVAL;
+  }
 
-  // If the VA doesn't match the VPN, we have a malformed PDP
-  if (GET_PDP_BITS(va) != GET_PDP_BITS(pdp->vpn)) {
+  // If the VA doesn't match the VPN, the entry is malformed
+  if (pt_level_bits(l, a_ctx->va) != pt_level_bits(l, entry->vpn)) {
     return -EFAULT;
   }
 
-  // If not valid, return TNV
-  if (!pdp->page_metadata.valid) {
+  // A page size the level can't hold points at a table, except at the last
+  // level, where nothing else can follow
+  bool size_ok = (l->leaf_sizes &
+                  PG_SIZE_BIT(entry->page_metadata.page_size)) != 0;
+  out->addr = entry->phys_frame.fourk_pte_index;
+  out->perms = entry->page_metadata.permissions;
+  out->user_supervisor = entry->page_metadata.user_supervisor;
+  out->global = entry->page_metadata.global;
+  out->leaf = last || size_ok;
+  out->malformed = !size_ok;
+  return 0;
+}
+
+/**
+ * Walk `n_levels` levels of tables, described by `levels`, of one format
+ *
+ * Always inlined into a walker per geometry and format, where `levels`,
+ * `n_levels` and `format` are constants, so each level's shift and width
+ * fold into the loop and the format checks disappear.
+ *
+ * Before touching memory, the paging-structure caches are checked. A hit
+ * skips every level above the cached entry, so the walk starts at the first
+ * table that actually gets read. Each interior entry that is read on the way
+ * down is cached for the next walk.
+ *
+ * Interior entries only need read permission. The requested permissions
+ * and user/supervisor mode are checked against the leaf. Noncacheable and
+ * dirty bits are ignored until swap and caches exist, except that the walker
+ * sets the dirty bit of a packed entry it writes through, like hardware.
+ */
+static inline __attribute__((always_inline)) uintptr_t
+walk_levels(address_context_t *a_ctx, ptw_sim_context_t *ctx,
+            walk_ctx_t *w_ctx, const pt_level_desc_t *levels,
+            uint8_t n_levels, pte_format_t format) {
+  uint64_t va = a_ctx->va;
+  uint32_t pid = a_ctx->pid;
+  if (pid >= MAX_PID || ctx->page_table_pointers[pid] == NULL) {
     return -EINVAL;
   }
 
-  // If the page is labelled as a 1G page, that means we found our page and we
-  // should do the translation
-  if (pdp->page_metadata.page_size == ONE_G) {
+  permissions_t r_permissions = {0};
+  r_permissions.val.read = 1;
+
+  // Higher VAs would alias lower ones in the root table
+  if (va >> pt_va_bits(levels)) {
+    return -EFAULT;
+  }
+
+  void *table;
+  uint8_t start = pwc_resume(ctx, va, pid, n_levels, &table);
+
+  // Fully unrolled, so every level's descriptor is a constant. Levels above
+  // the PWC hit are skipped.
+#pragma GCC unroll 8
+  for (uint8_t level = 0; level < n_levels; level++) {
+    if (level < start) {
+      continue;
+    }
 
-    // Check for permissions
-    if (!check_permissions(a_ctx->permissions,
-                           pdp->page_metadata.permissions)) {
+    const pt_level_desc_t *l = &levels[level];
+    void *slot;
+    walk_entry_t e;
+    uintptr_t fault = read_entry(ctx, w_ctx, a_ctx, l, level,
+                                 level == n_levels - 1, table, format, &slot,
+                                 &e);
+    if (fault != 0) {
+      return fault;
+    }
+
+    if (!e.leaf) {
+      if (!check_permissions(r_permissions, e.perms)) {
+        return -EUNAUTHORIZED;
+      }
+
+      // The frame is overloaded. Here, it points at a 4K-aligned table.
+      table = (void *)e.addr;
+      int pwc_level = level - (n_levels - PT_LEVELS);
+      if (pwc_level >= PWC_SDP && pwc_level < PWC_LEVELS) {
+        pwc_remember(ctx, pwc_level, va, pid, table);
+      }
+      continue;
+    }
+
+    if (!check_permissions(a_ctx->permissions, e.perms)) {
       return -EUNAUTHORIZED;
     }
 
     // user_supervisor must be the same
-    if (a_ctx->user_supervisor != pdp->page_metadata.user_supervisor) {
+    if (a_ctx->user_supervisor != e.user_supervisor) {
       return -EACCESS;
     }
 
-    // Ignore noncacheable and dirty until swap and caches exist, respectively
-
-    pa |= GET_PDP_BITS(pdp->phys_frame.oneg_pte_index);
-    pa |= GET_PDP_OFFSET(va);
+    if (e.malformed) {
+      return -EFAULT;
+    }
 
-    return pa;
-  }
+    if (format == PTE_FORMAT_HW && a_ctx->permissions.val.write) {
+      *(hw_pte_t *)slot |= HW_PTE_D;
+    }
 
-  // Otherwise, only check read_permissions and continue walking
-  if (!check_permissions(r_permissions, pdp->page_metadata.permissions)) {
-    return -EUNAUTHORIZED;
+    uint64_t offset_mask = (1ULL << l->shift) - 1;
+    w_ctx->page_size = pt_level_leaf_size(l);
+    w_ctx->global = e.global;
+    w_ctx->permissions = e.perms;
+    w_ctx->user_supervisor = e.user_supervisor;
+    return (e.addr & ~offset_mask) | (va & offset_mask);
   }
 
-  pte_t *pde_base = (pte_t *)pdp->phys_frame.twom_pte_index;
-  uint16_t pde_offset = GET_PDP_ENTRY_IDX(va);
-  pte_t *pde = &pde_base[pde_offset];
+  // Only reachable if a PWC hands back a level past the last one
+  return -EFAULT;
+}
 
-  // Otherwise, use that to look up the PDE
-  // If PDE page is marked as a 2M page, then return immediately with that frame
+typedef uintptr_t (*walk_fn)(address_context_t *a_ctx, ptw_sim_context_t *ctx,
+                             walk_ctx_t *w_ctx);
 
-  // If the VA doesn't match the VPN, we have a malformed PDP
-  if (GET_PDE_BITS(va) != GET_PDE_BITS(pde->vpn)) {
-    return -EFAULT;
-  }
-
-  // If not valid, return TNV
-  if (!pde->page_metadata.valid) {
-    return -EINVAL;
-  }
+static uintptr_t walk_4level_sim(address_context_t *a_ctx,
+                                 ptw_sim_context_t *ctx, walk_ctx_t *w_ctx) {
+  return walk_levels(a_ctx, ctx, w_ctx, pt_levels_4, PT_LEVELS,
+                     PTE_FORMAT_SIM);
+}
 
-  // If the page is labelled as a 1G page, that means we found our page and we
-  // should do the translation
-  if (pde->page_metadata.page_size == TWO_M) {
+static uintptr_t walk_4level_hw(address_context_t *a_ctx,
+                                ptw_sim_context_t *ctx, walk_ctx_t *w_ctx) {
+  return walk_levels(a_ctx, ctx, w_ctx, pt_levels_4, PT_LEVELS,
+                     PTE_FORMAT_HW);
+}
 
-    // Check for permissions
-    if (!check_permissions(a_ctx->permissions,
-                           pde->page_metadata.permissions)) {
-      return -EUNAUTHORIZED;
-    }
+static uintptr_t walk_5level_sim(address_context_t *a_ctx,
+                                 ptw_sim_context_t *ctx, walk_ctx_t *w_ctx) {
+  return walk_levels(a_ctx, ctx, w_ctx, pt_levels_5, PT_LEVELS_LA57,
+                     PTE_FORMAT_SIM);
+}
 
-    // user_supervisor must be the same
-    if (a_ctx->user_supervisor != pde->page_metadata.user_supervisor) {
-      return -EACCESS;
-    }
+static uintptr_t walk_5level_hw(address_context_t *a_ctx,
+                                ptw_sim_context_t *ctx, walk_ctx_t *w_ctx) {
+  return walk_levels(a_ctx, ctx, w_ctx, pt_levels_5, PT_LEVELS_LA57,
+                     PTE_FORMAT_HW);
+}
 
-    // Ignore noncacheable and dirty until swap and caches exist, respectively
+// One specialized walker per geometry and entry format, indexed by whether
+// the context uses 5-level paging
+static const walk_fn walkers[2][PTE_FORMAT_MAX] = {
+    {
+        [PTE_FORMAT_SIM] = walk_4level_sim,
+        [PTE_FORMAT_HW] = walk_4level_hw,
+    },
+    {
+        [PTE_FORMAT_SIM] = walk_5level_sim,
+        [PTE_FORMAT_HW] = walk_5level_hw,
+    },
+};
 
-    pa |= GET_PDE_BITS(pde->phys_frame.twom_pte_index);
-    pa |= GET_PDE_OFFSET(va);
+/**
+ * Check a leaf found in the hashed or cuckoo page tables and return the PA,
+ * like the last level of a radix walk
+ */
+static uintptr_t hashed_leaf(const address_context_t *a_ctx, hw_pte_t *entry,
+                             page_size_t page_size, walk_ctx_t *w_ctx) {
+  hw_pte_t pte = *entry;
+  if (!check_permissions(a_ctx->permissions, hw_pte_permissions(pte))) {
+    return -EUNAUTHORIZED;
+  }
+  if (a_ctx->user_supervisor != hw_pte_user_supervisor(pte)) {
+    return -EACCESS;
+  }
 
-    return pa;
+  hw_pte_t updated = pte | HW_PTE_A;
+  if (a_ctx->permissions.val.write) {
+    updated |= HW_PTE_D;
+  }
+  if (updated != pte) {
+    *entry = updated;
   }
 
-  // ONE_G page can also be mapped here
-  if (pde->page_metadata.page_size == ONE_G) {
+  uint64_t offset_mask = (1ULL << page_size_shift(page_size)) - 1;
+  w_ctx->page_size = page_size;
+  w_ctx->global = (pte & HW_PTE_G) != 0;
+  w_ctx->permissions = hw_pte_permissions(pte);
+  w_ctx->user_supervisor = hw_pte_user_supervisor(pte);
+  return (hw_pte_addr(pte) & ~offset_mask) | (a_ctx->va & offset_mask);
+}
 
-    pa |= GET_PDP_BITS(pde->phys_frame.oneg_pte_index);
-    pa |= GET_PDP_OFFSET(va);
+/**
+ * Look `va` up in the hashed page table
+ *
+ * Probes the bucket of each page size the PID has mapped, smallest first,
+ * and follows each bucket's chain until the tag matches. Every entry read is
+ * one memory reference, charged like a radix table read. `w_ctx->levels` is
+ * set to the entries read, saturated to fit.
+ */
+static uintptr_t walk_hashed(address_context_t *a_ctx, ptw_sim_context_t *ctx,
+                             walk_ctx_t *w_ctx) {
+  static const page_size_t sizes[] = {FOUR_K, TWO_M, ONE_G};
+  const hashed_pt_t *hpt = ctx->hpt;
+  hpt_stats_t *stats = &ctx->hpt_stats;
+  uint64_t va = a_ctx->va;
+  uint32_t pid = a_ctx->pid;
+  uint64_t refs = 0;
+  uintptr_t pa = -EINVAL;
 
-    return pa;
+  if (pid >= MAX_PID) {
+    goto done;
+  }
+  if (va >> pt_va_bits(pt_geometry(ctx))) {
+    pa = -EFAULT;
+    goto done;
   }
 
-  // Otherwise, only check read_permissions and continue walking
-  if (!check_permissions(r_permissions, pdp->page_metadata.permissions)) {
-    return -EUNAUTHORIZED;
+  uint8_t mapped = hpt_page_sizes(hpt, pid);
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    if (!(mapped & PG_SIZE_BIT(sizes[i]))) {
+      continue;
+    }
+
+    stats->probes++;
+    uint64_t tag = tlb_tag(va, sizes[i]);
+    for (hpt_entry_t *e = hpt_bucket(hpt, pid, tag); e != NULL; e = e->next) {
+      TRACE_WALK_EVENT(EVENT_WALK_READ, refs, pid, va);
+      refs++;
+      w_ctx->cycles += dcache_read(ctx, (uintptr_t)e);
+      if (hpt_entry_matches(e, pid, tag)) {
+        pa = hashed_leaf(a_ctx, &e->pte, sizes[i], w_ctx);
+        goto done;
+      }
+    }
   }
 
-  // Otherwise use that to look up the leaf-level PTE
-  // If that PTE is invalid or not matching, return fault and the OS will need
-  // to make page entries.
-  pte_t *pte_base = (pte_t *)pde->phys_frame.fourk_pte_index;
-  uint16_t pte_offset = GET_PTE_ENTRY_IDX(va);
-  pte_t *pte = &pte_base[pte_offset];
+done:
+  stats->lookups++;
+  stats->mem_refs += refs;
+  stats->refs[refs < HPT_REFS_HIST ? refs : HPT_REFS_HIST]++;
+  w_ctx->levels = refs < UINT8_MAX ? refs : UINT8_MAX;
+  return pa;
+}
 
-  // Otherwise, use that to look up the PDE
-  // If PDE page is marked as a 2M page, then return immediately with that frame
+// A cuckoo walk cache entry holds a region's page sizes where a PWC entry
+// holds a table. The flag keeps an empty region from reading as a miss.
+#define CWC_VALID 0x100
 
-  // If the VA doesn't match the VPN, we have a malformed PDP
-  if (GET_PTE_BITS(va) != GET_PTE_BITS(pte->vpn)) {
-    return -EFAULT;
-  }
+static inline void *cwc_entry(uint8_t sizes) {
+  return (void *)(uintptr_t)(CWC_VALID | sizes);
+}
 
-  // If not valid, return TNV
-  if (!pte->page_metadata.valid) {
-    return -EINVAL;
-  }
+static inline uint8_t cwc_sizes(const void *entry) {
+  return (uint8_t)(uintptr_t)entry;
+}
 
-  // Check for permissions
-  if (!check_permissions(a_ctx->permissions, pde->page_metadata.permissions)) {
-    return -EUNAUTHORIZED;
+/**
+ * Cuckoo walk reads, which are all issued at once
+ */
+typedef struct cuckoo_reads {
+  uint32_t n;
+  uint32_t slowest; //< Latency of the slowest read, the walk's
+  uint64_t total;   //< Latency of all of them back to back
+} cuckoo_reads_t;
+
+static inline void cuckoo_read(ptw_sim_context_t *ctx, cuckoo_reads_t *reads,
+                               const address_context_t *a_ctx,
+                               const void *slot) {
+  TRACE_WALK_EVENT(EVENT_WALK_READ, reads->n, a_ctx->pid, a_ctx->va);
+  uint32_t cycles = dcache_read(ctx, (uintptr_t)slot);
+  reads->n++;
+  reads->total += cycles;
+  if (cycles > reads->slowest) {
+    reads->slowest = cycles;
   }
+}
 
-  // user_supervisor must be the same
-  if (a_ctx->user_supervisor != pde->page_metadata.user_supervisor) {
-    return -EACCESS;
+/**
+ * Read every way of the CWT entry of `va`'s region, to refill the cuckoo
+ * walk cache `cwc`. Returns the sizes in the region.
+ */
+static uint8_t cuckoo_refill(ptw_sim_context_t *ctx, cuckoo_reads_t *reads,
+                             const address_context_t *a_ctx, pwc_t *cwc,
+                             ecpt_cwt_level_t level) {
+  const ecpt_t *ecpt = ctx->ecpt[a_ctx->pid];
+  const ecpt_table_t *cwt = &ecpt->cwt[level];
+  uint8_t shift = page_size_shift(level == ECPT_CWT_PMD ? TWO_M : ONE_G);
+  if (cwt->ways[0] != NULL) {
+    for (int way = 0; way < ECPT_WAYS; way++) {
+      cuckoo_read(ctx, reads, a_ctx,
+                  ecpt_probe(cwt, way, a_ctx->va >> shift));
+    }
   }
 
-  // Ignore noncacheable and dirty until swap and caches exist, respectively
-
-  // At this point, all 3 page sizes are valid, the only difference is what
-  // macro we use. So we can pull out the checks and run them up front.
-  if (pte->page_metadata.page_size == ONE_G) {
+  uint8_t sizes = ecpt_region_sizes(ecpt, level, a_ctx->va);
+  pwc_fill(cwc, a_ctx->va, a_ctx->pid, cwc_entry(sizes));
+  return sizes;
+}
 
-    pa |= GET_PDP_BITS(pte->phys_frame.oneg_pte_index);
-    pa |= GET_PDP_OFFSET(va);
+/**
+ * Look `va` up in the PID's elastic cuckoo page tables
+ *
+ * The cuckoo walk caches narrow down the page sizes to probe. The PDE cache
+ * holds the sizes in `va`'s 2M region and the PDP cache those in its 1G
+ * region. A miss reads the region's CWT entry to refill the cache, but
+ * doesn't wait for it. Then every way of every size left is read. All of
+ * those reads are issued at once, so the walk takes as long as the slowest
+ * one rather than their sum. `w_ctx->levels` is set to the reads, saturated
+ * to fit.
+ */
+static uintptr_t walk_cuckoo(address_context_t *a_ctx, ptw_sim_context_t *ctx,
+                             walk_ctx_t *w_ctx) {
+  static const page_size_t sizes[] = {FOUR_K, TWO_M, ONE_G};
+  ecpt_stats_t *stats = &ctx->ecpt_stats;
+  uint64_t va = a_ctx->va;
+  uint32_t pid = a_ctx->pid;
+  cuckoo_reads_t reads = {0};
+  uint32_t cwt_reads = 0;
+  uintptr_t pa = -EINVAL;
 
-    return pa;
+  if (pid >= MAX_PID || ctx->ecpt[pid] == NULL) {
+    goto done;
+  }
+  if (va >> pt_va_bits(pt_geometry(ctx))) {
+    pa = -EFAULT;
+    goto done;
   }
 
-  if (pte->page_metadata.page_size == TWO_M) {
+  // A 2M region without pages can still be inside a 1G page
+  ecpt_t *ecpt = ctx->ecpt[pid];
+  uint8_t probe = ecpt_page_sizes(ecpt);
+  pwc_t *pmd = ctx->pwc[PWC_PDE];
+  pwc_t *pud = ctx->pwc[PWC_PDP];
+  void *pmd_hit = pmd != NULL ? pwc_lookup(pmd, va, pid) : NULL;
+  if (pmd_hit != NULL) {
+    uint8_t region = cwc_sizes(pmd_hit);
+    probe &= region ? region : PG_SIZE_BIT(ONE_G);
+  } else {
+    void *pud_hit = pud != NULL ? pwc_lookup(pud, va, pid) : NULL;
+    if (pud_hit != NULL) {
+      probe &= cwc_sizes(pud_hit);
+    } else if (pud != NULL) {
+      cuckoo_refill(ctx, &reads, a_ctx, pud, ECPT_CWT_PUD);
+    }
+    if (pmd != NULL) {
+      cuckoo_refill(ctx, &reads, a_ctx, pmd, ECPT_CWT_PMD);
+    }
+  }
+  cwt_reads = reads.n;
 
-    pa |= GET_PDE_BITS(pte->phys_frame.twom_pte_index);
-    pa |= GET_PDE_OFFSET(va);
+  hw_pte_t *leaf = NULL;
+  page_size_t leaf_size = FOUR_K;
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    if (!(probe & PG_SIZE_BIT(sizes[i]))) {
+      continue;
+    }
 
-    return pa;
+    stats->sizes_probed++;
+    const ecpt_table_t *t = &ecpt->pages[sizes[i]];
+    uint64_t key = va >> page_size_shift(sizes[i]);
+    for (int way = 0; way < ECPT_WAYS; way++) {
+      ecpt_slot_t *slot = ecpt_probe(t, way, key);
+      cuckoo_read(ctx, &reads, a_ctx, slot);
+      if (slot->key == key) {
+        leaf = &slot->val;
+        leaf_size = sizes[i];
+      }
+    }
+  }
+  if (leaf != NULL) {
+    pa = hashed_leaf(a_ctx, leaf, leaf_size, w_ctx);
   }
 
-  if (pte->page_metadata.page_size == TWO_M) {
+done:
+  stats->lookups++;
+  stats->cwt_reads += cwt_reads;
+  stats->page_reads += reads.n - cwt_reads;
+  stats->parallel_cycles += reads.slowest;
+  stats->serial_cycles += reads.total;
+  w_ctx->cycles += reads.slowest;
+  w_ctx->levels = reads.n < UINT8_MAX ? reads.n : UINT8_MAX;
+  return pa;
+}
 
-    pa |= GET_PTE_BITS(pte->phys_frame.fourk_pte_index);
-    pa |= GET_PTE_OFFSET(va);
+uintptr_t walk(address_context_t *a_ctx, ptw_sim_context_t *ctx,
+               walk_ctx_t *w_ctx) {
+  w_ctx->levels = 0;
+  w_ctx->cycles = ctx->latency.walk_start;
+  uintptr_t pa;
+  switch (ctx->pt_backend) {
+  case PT_BACKEND_HASHED:
+    pa = walk_hashed(a_ctx, ctx, w_ctx);
+    break;
+  case PT_BACKEND_CUCKOO:
+    pa = walk_cuckoo(a_ctx, ctx, w_ctx);
+    break;
+  default:
+    pa = walkers[pt_n_levels(ctx) == PT_LEVELS_LA57][ctx->pte_format](
+        a_ctx, ctx, w_ctx);
+    break;
+  }
 
-    return pa;
+  // Faulting walks read memory too, so they count. Only radix walks have
+  // levels to histogram.
+  walk_stats_t *stats = &ctx->walk_stats;
+  stats->walks++;
+  stats->pt_reads += w_ctx->levels;
+  if (ctx->pt_backend == PT_BACKEND_RADIX) {
+    stats->depth[w_ctx->levels]++;
+  }
+  if (IS_FAULT(pa)) {
+    stats->faults[-pa]++;
+    TRACE_WALK_EVENT(EVENT_WALK_FAULT, -pa, a_ctx->pid, a_ctx->va);
+  } else {
+    stats->leaves[w_ctx->page_size]++;
+    TRACE_WALK_EVENT(EVENT_WALK_DONE, w_ctx->page_size, a_ctx->pid,
+                     a_ctx->va);
   }
+  return pa;
+}
 
-  // If we get here, the page was not found and this is a page fault.
-  // When paging exists, the OS can fix it
-  // Otherwise, return fault to the process
-  return -EFAULT;
+void print_walk_stats(FILE *out, const ptw_sim_context_t *ctx) {
+  const walk_stats_t *stats = &ctx->walk_stats;
+  double per_walk =
+      stats->walks ? (double)stats->pt_reads / stats->walks : 0.0;
+  if (ctx->pt_backend == PT_BACKEND_RADIX) {
+    fprintf(out, "Walks:            %lu (%u levels, %s entries)\n",
+            stats->walks, pt_n_levels(ctx), pte_format_name(ctx->pte_format));
+  } else {
+    fprintf(out, "Walks:            %lu (%s page table)\n", stats->walks,
+            pt_backend_name(ctx->pt_backend));
+  }
+  fprintf(out, "Page table reads: %lu (%.2f per walk)\n", stats->pt_reads,
+          per_walk);
 }
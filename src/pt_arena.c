@@ -0,0 +1,167 @@
+/**
+ * @file pt_arena.c
+ *
+ * Arena allocator for page table pages
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "page_table.h"
+#include "pt_arena.h"
+
+/**
+ * Map `len` bytes of zeroed memory
+ *
+ * Large chunks try explicit huge pages first. If none are reserved, they fall
+ * back to normal pages aligned to a huge page boundary and ask for
+ * transparent huge pages.
+ */
+static void *map_chunk(size_t len) {
+  if (len < PT_ARENA_HUGEPAGE) {
+    void *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+  }
+
+#ifdef MAP_HUGETLB
+  void *huge = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (huge != MAP_FAILED) {
+    return huge;
+  }
+#endif
+
+  // Over-map by one huge page, then trim both ends to get an aligned chunk
+  size_t padded = len + PT_ARENA_HUGEPAGE;
+  uint8_t *raw = mmap(NULL, padded, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED) {
+    return NULL;
+  }
+
+  uintptr_t aligned = ((uintptr_t)raw + PT_ARENA_HUGEPAGE - 1) &
+                      ~(uintptr_t)(PT_ARENA_HUGEPAGE - 1);
+  size_t head = aligned - (uintptr_t)raw;
+  size_t tail = padded - head - len;
+  if (head != 0) {
+    munmap(raw, head);
+  }
+  if (tail != 0) {
+    munmap((uint8_t *)aligned + len, tail);
+  }
+
+#ifdef MADV_HUGEPAGE
+  madvise((void *)aligned, len, MADV_HUGEPAGE);
+#endif
+
+  return (void *)aligned;
+}
+
+/**
+ * Map the next chunk, twice the size of the last one
+ */
+static int grow_arena(pt_arena_t *arena) {
+  if (arena->n_chunks == arena->max_chunks) {
+    size_t max_chunks = arena->max_chunks ? arena->max_chunks * 2 : 8;
+    pt_arena_chunk_t *chunks = (pt_arena_chunk_t *)realloc(
+        arena->chunks, max_chunks * sizeof(pt_arena_chunk_t));
+    if (chunks == NULL) {
+      return -1;
+    }
+    arena->chunks = chunks;
+    arena->max_chunks = max_chunks;
+  }
+
+  size_t len = PT_ARENA_MIN_CHUNK;
+  if (arena->n_chunks != 0) {
+    len = arena->chunks[arena->n_chunks - 1].len * 2;
+    if (len > PT_ARENA_MAX_CHUNK) {
+      len = PT_ARENA_MAX_CHUNK;
+    }
+  }
+
+  void *base = map_chunk(len);
+  if (base == NULL) {
+    return -1;
+  }
+
+  arena->chunks[arena->n_chunks++] = (pt_arena_chunk_t){base, len};
+  arena->cursor = (uint8_t *)base;
+  arena->end = (uint8_t *)base + len;
+  arena->bytes_mapped += len;
+  return 0;
+}
+
+pt_arena_t *create_pt_arena(void) {
+  return (pt_arena_t *)calloc(1, sizeof(pt_arena_t));
+}
+
+void destroy_pt_arena(pt_arena_t *arena) {
+  if (arena == NULL) {
+    return;
+  }
+
+  for (size_t i = 0; i < arena->n_chunks; i++) {
+    munmap(arena->chunks[i].base, arena->chunks[i].len);
+  }
+  PTR_FREE(arena->chunks);
+  free(arena);
+}
+
+void *pt_arena_alloc(pt_arena_t *arena, size_t bytes, uint8_t level) {
+  // Tables are a multiple of PT_TABLE_ALIGN and chunks start aligned, so the
+  // bump pointer never needs realigning
+  if (bytes == 0 || bytes % PT_TABLE_ALIGN != 0 ||
+      bytes > PT_ARENA_MIN_CHUNK) {
+    return NULL;
+  }
+
+  if ((size_t)(arena->end - arena->cursor) < bytes &&
+      grow_arena(arena) != 0) {
+    return NULL;
+  }
+
+  // Fresh anonymous memory is already zero, so every entry starts invalid
+  void *table = arena->cursor;
+  arena->cursor += bytes;
+  arena->bytes_used += bytes;
+  if (level < PT_MAX_LEVELS) {
+    arena->tables[level]++;
+  }
+  return table;
+}
+
+void print_pt_arena_stats(FILE *out, pt_arena_t *const *arenas, size_t n,
+                          uint8_t n_levels) {
+  uint64_t tables[PT_MAX_LEVELS] = {0};
+  uint64_t total = 0;
+  size_t chunks = 0;
+  size_t bytes_mapped = 0;
+  size_t bytes_used = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    if (arenas[i] == NULL) {
+      continue;
+    }
+    for (int level = 0; level < PT_MAX_LEVELS; level++) {
+      tables[level] += arenas[i]->tables[level];
+      total += arenas[i]->tables[level];
+    }
+    chunks += arenas[i]->n_chunks;
+    bytes_mapped += arenas[i]->bytes_mapped;
+    bytes_used += arenas[i]->bytes_used;
+  }
+
+  fprintf(out, "Page tables:      %lu (", total);
+  for (uint8_t level = 0; level < n_levels; level++) {
+    fprintf(out, "%s%s %lu", level ? ", " : "", pt_level_name(n_levels, level),
+            tables[level]);
+  }
+  fprintf(out, ")\n");
+  fprintf(out, "Table memory:     %.2f MiB used, %.2f MiB mapped in %zu "
+               "chunks\n",
+          bytes_used / (1024.0 * 1024.0),
+          bytes_mapped / (1024.0 * 1024.0), chunks);
+}
@@ -0,0 +1,148 @@
+/**
+ * @file pwc.c
+ *
+ * Paging-structure caches
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "page_table.h"
+#include "pwc.h"
+#include "tlb_match.h"
+
+static inline uint32_t pwc_set_index(const pwc_t *pwc, uint64_t va) {
+  return (uint32_t)(va >> pwc->shift) & pwc->set_mask;
+}
+
+pwc_t *create_pwc(tlb_geometry_t geometry, pwc_level_t level,
+                  repl_policy_kind_t policy) {
+  if (geometry.sets == 0 || (geometry.sets & (geometry.sets - 1)) != 0 ||
+      geometry.ways == 0 || level >= PWC_LEVELS) {
+    return NULL;
+  }
+
+  pwc_t *pwc = (pwc_t *)calloc(1, sizeof(pwc_t));
+  if (pwc == NULL) {
+    return NULL;
+  }
+
+  pwc->sets = geometry.sets;
+  pwc->ways = geometry.ways;
+  pwc->set_mask = geometry.sets - 1;
+  // Tags keep the lowest VA bit indexing the level and everything above
+  pwc->shift = pt_levels_4[level].shift;
+
+  size_t n = (size_t)geometry.sets * geometry.ways;
+  pwc->tags = (uint64_t *)calloc(n, sizeof(uint64_t));
+  pwc->pids = (uint32_t *)calloc(n, sizeof(uint32_t));
+  pwc->tables = (void **)calloc(n, sizeof(void *));
+  pwc->slots_in_use = (uint32_t *)calloc(geometry.sets, sizeof(uint32_t));
+  pwc->policy = create_repl_policy(policy, geometry.sets, geometry.ways, 0);
+  if (pwc->tags == NULL || pwc->pids == NULL || pwc->tables == NULL ||
+      pwc->slots_in_use == NULL || pwc->policy == NULL) {
+    destroy_pwc(pwc);
+    return NULL;
+  }
+
+  flush_pwc(pwc);
+  return pwc;
+}
+
+void destroy_pwc(pwc_t *pwc) {
+  if (pwc == NULL) {
+    return;
+  }
+
+  PTR_FREE(pwc->tags);
+  PTR_FREE(pwc->pids);
+  PTR_FREE(pwc->tables);
+  PTR_FREE(pwc->slots_in_use);
+  destroy_repl_policy(pwc->policy);
+  free(pwc);
+}
+
+void flush_pwc(pwc_t *pwc) {
+  size_t n = (size_t)pwc->sets * pwc->ways;
+  for (size_t i = 0; i < n; i++) {
+    pwc->tags[i] = TLB_INVALID_TAG;
+  }
+  memset(pwc->slots_in_use, 0, pwc->sets * sizeof(uint32_t));
+  reset_repl_policy(pwc->policy);
+}
+
+void flush_pwc_pid(pwc_t *pwc, uint32_t pid) {
+  size_t n = (size_t)pwc->sets * pwc->ways;
+  for (size_t i = 0; i < n; i++) {
+    if (pwc->tags[i] != TLB_INVALID_TAG && pwc->pids[i] == pid) {
+      pwc->tags[i] = TLB_INVALID_TAG;
+      pwc->slots_in_use[i / pwc->ways]--;
+    }
+  }
+}
+
+bool pwc_invalidate(pwc_t *pwc, uint64_t va, uint32_t pid) {
+  uint32_t set = pwc_set_index(pwc, va);
+  size_t base = (size_t)set * pwc->ways;
+
+  int64_t way = tlb_match(&pwc->tags[base], &pwc->pids[base], 0, pwc->ways,
+                          va >> pwc->shift, pid);
+  if (way < 0) {
+    return false;
+  }
+
+  pwc->tags[base + way] = TLB_INVALID_TAG;
+  pwc->slots_in_use[set]--;
+  return true;
+}
+
+void *pwc_lookup(pwc_t *pwc, uint64_t va, uint32_t pid) {
+  uint32_t set = pwc_set_index(pwc, va);
+  size_t base = (size_t)set * pwc->ways;
+
+  int64_t way = tlb_match(&pwc->tags[base], &pwc->pids[base], 0, pwc->ways,
+                          va >> pwc->shift, pid);
+  if (way < 0) {
+    pwc->misses++;
+    return NULL;
+  }
+
+  repl_on_hit(pwc->policy, set, (uint32_t)way);
+  pwc->hits++;
+  return pwc->tables[base + way];
+}
+
+void pwc_fill(pwc_t *pwc, uint64_t va, uint32_t pid, void *table) {
+  uint32_t set = pwc_set_index(pwc, va);
+  size_t base = (size_t)set * pwc->ways;
+
+  // Make room if the set is full
+  if (pwc->slots_in_use[set] == pwc->ways) {
+    uint32_t victim = repl_victim(pwc->policy, set);
+    pwc->tags[base + victim] = TLB_INVALID_TAG;
+    pwc->slots_in_use[set]--;
+    pwc->evictions++;
+  }
+
+  for (uint32_t i = 0; i < pwc->ways; i++) {
+    if (pwc->tags[base + i] == TLB_INVALID_TAG) {
+      pwc->tags[base + i] = va >> pwc->shift;
+      pwc->pids[base + i] = pid;
+      pwc->tables[base + i] = table;
+      pwc->slots_in_use[set]++;
+      repl_on_fill(pwc->policy, set, i);
+      return;
+    }
+  }
+}
+
+void print_pwc_stats(FILE *out, const char *name, const pwc_t *pwc) {
+  uint64_t lookups = pwc->hits + pwc->misses;
+  double miss_rate = lookups ? 100.0 * pwc->misses / lookups : 0.0;
+  fprintf(out,
+          "%-8s %5ux%-3u %-10s hits %-12lu misses %-12lu (%6.2f%%) "
+          "evictions %lu\n",
+          name, pwc->sets, pwc->ways, repl_policy_name(pwc->policy->kind),
+          pwc->hits, pwc->misses, miss_rate, pwc->evictions);
+}
@@ -0,0 +1,284 @@
+/**
+ * @file replacement.c
+ *
+ * Replacement policy implementations
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "replacement.h"
+#include "util.h"
+
+#define DEFAULT_RNG_SEED 0x9E3779B97F4A7C15ULL
+
+// RRIP uses 2-bit re-reference prediction values
+#define RRPV_MAX 3
+#define RRPV_LONG 2
+
+// BRRIP inserts with a long RRPV once every this many fills
+#define BRRIP_LONG_INTERVAL 32
+
+static inline uint64_t *entry_state(repl_policy_t *p, uint32_t set) {
+  return &p->entry_state[(size_t)set * p->ways];
+}
+
+static inline uint64_t next_rand(repl_policy_t *p) {
+  uint64_t x = p->rng;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  p->rng = x;
+  return x;
+}
+
+/**
+ * LFU with decay
+ *
+ * Each way has a saturating 8-bit use counter. Hits bump it. On eviction the
+ * way with the lowest counter goes and every other way decays by one, so
+ * stale but once-popular entries eventually become evictable.
+ */
+
+static void lfu_on_hit(repl_policy_t *p, uint32_t set, uint32_t way) {
+  uint64_t *counters = entry_state(p, set);
+  counters[way] = sat_inc((uint8_t)counters[way]);
+}
+
+static void lfu_on_fill(repl_policy_t *p, uint32_t set, uint32_t way) {
+  entry_state(p, set)[way] = 0;
+}
+
+static uint32_t lfu_victim(repl_policy_t *p, uint32_t set) {
+  uint64_t *counters = entry_state(p, set);
+  uint32_t evict_idx = 0;
+  for (uint32_t i = 1; i < p->ways; i++) {
+    if (counters[i] < counters[evict_idx]) {
+      evict_idx = i;
+    }
+  }
+
+  // Decay the survivors. Saturate at 0 rather than wrapping around to 255.
+  for (uint32_t i = 0; i < p->ways; i++) {
+    if (i != evict_idx && counters[i] > 0) {
+      counters[i]--;
+    }
+  }
+
+  return evict_idx;
+}
+
+/**
+ * True LRU
+ *
+ * Each way holds the time of its last use. The oldest goes.
+ */
+
+static void lru_touch(repl_policy_t *p, uint32_t set, uint32_t way) {
+  entry_state(p, set)[way] = ++p->clock;
+}
+
+static uint32_t lru_victim(repl_policy_t *p, uint32_t set) {
+  uint64_t *stamps = entry_state(p, set);
+  uint32_t evict_idx = 0;
+  for (uint32_t i = 1; i < p->ways; i++) {
+    if (stamps[i] < stamps[evict_idx]) {
+      evict_idx = i;
+    }
+  }
+  return evict_idx;
+}
+
+/**
+ * Tree pseudo-LRU
+ *
+ * A binary tree of ways - 1 bits per set, stored heap-style in set_state
+ * (node 1 is the root, node n has children 2n and 2n + 1). A bit of 0 means
+ * the victim is in the left subtree. Every access flips the bits on its path
+ * to point away from the accessed way.
+ */
+
+static void tree_plru_touch(repl_policy_t *p, uint32_t set, uint32_t way) {
+  uint64_t bits = p->set_state[set];
+  uint32_t node = 1;
+  for (uint32_t span = p->ways / 2; span > 0; span /= 2) {
+    bool right = (way & span) != 0;
+    // Point at the other half
+    if (right) {
+      bits &= ~(1ULL << node);
+    } else {
+      bits |= (1ULL << node);
+    }
+    node = 2 * node + right;
+  }
+  p->set_state[set] = bits;
+}
+
+static uint32_t tree_plru_victim(repl_policy_t *p, uint32_t set) {
+  uint64_t bits = p->set_state[set];
+  uint32_t node = 1;
+  uint32_t way = 0;
+  for (uint32_t span = p->ways / 2; span > 0; span /= 2) {
+    bool right = (bits >> node) & 1;
+    way |= right ? span : 0;
+    node = 2 * node + right;
+  }
+  return way;
+}
+
+/**
+ * Bit pseudo-LRU
+ *
+ * One MRU bit per way. An access sets its bit. When that would leave every
+ * bit set, all the other bits are cleared. The victim is the first way whose
+ * bit is clear.
+ */
+
+static void bit_plru_touch(repl_policy_t *p, uint32_t set, uint32_t way) {
+  uint64_t *mru = entry_state(p, set);
+  mru[way] = 1;
+
+  for (uint32_t i = 0; i < p->ways; i++) {
+    if (mru[i] == 0) {
+      return;
+    }
+  }
+
+  for (uint32_t i = 0; i < p->ways; i++) {
+    mru[i] = (i == way);
+  }
+}
+
+static uint32_t bit_plru_victim(repl_policy_t *p, uint32_t set) {
+  uint64_t *mru = entry_state(p, set);
+  for (uint32_t i = 0; i < p->ways; i++) {
+    if (mru[i] == 0) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+/**
+ * SRRIP / BRRIP
+ *
+ * Each way holds a re-reference prediction value (RRPV). Hits predict a near
+ * re-reference (0). The victim is the first way predicted distant (RRPV_MAX);
+ * if there is none, everyone ages by one and the search repeats. SRRIP
+ * inserts with a long prediction. BRRIP usually inserts distant, which keeps
+ * scans from flushing the working set.
+ */
+
+static void rrip_on_hit(repl_policy_t *p, uint32_t set, uint32_t way) {
+  entry_state(p, set)[way] = 0;
+}
+
+static void srrip_on_fill(repl_policy_t *p, uint32_t set, uint32_t way) {
+  entry_state(p, set)[way] = RRPV_LONG;
+}
+
+static void brrip_on_fill(repl_policy_t *p, uint32_t set, uint32_t way) {
+  bool long_insert = (next_rand(p) % BRRIP_LONG_INTERVAL) == 0;
+  entry_state(p, set)[way] = long_insert ? RRPV_LONG : RRPV_MAX;
+}
+
+static uint32_t rrip_victim(repl_policy_t *p, uint32_t set) {
+  uint64_t *rrpv = entry_state(p, set);
+  for (;;) {
+    for (uint32_t i = 0; i < p->ways; i++) {
+      if (rrpv[i] >= RRPV_MAX) {
+        return i;
+      }
+    }
+    for (uint32_t i = 0; i < p->ways; i++) {
+      rrpv[i]++;
+    }
+  }
+}
+
+/**
+ * Random
+ */
+
+static void random_noop(repl_policy_t *p, uint32_t set, uint32_t way) {}
+
+static uint32_t random_victim(repl_policy_t *p, uint32_t set) {
+  return (uint32_t)(next_rand(p) % p->ways);
+}
+
+static const repl_policy_ops_t policy_ops[REPL_POLICY_MAX] = {
+    [REPL_LFU_DECAY] = {"lfu-decay", lfu_on_hit, lfu_on_fill, lfu_victim},
+    [REPL_LRU] = {"lru", lru_touch, lru_touch, lru_victim},
+    [REPL_TREE_PLRU] = {"tree-plru", tree_plru_touch, tree_plru_touch,
+                        tree_plru_victim},
+    [REPL_BIT_PLRU] = {"bit-plru", bit_plru_touch, bit_plru_touch,
+                       bit_plru_victim},
+    [REPL_SRRIP] = {"srrip", rrip_on_hit, srrip_on_fill, rrip_victim},
+    [REPL_BRRIP] = {"brrip", rrip_on_hit, brrip_on_fill, rrip_victim},
+    [REPL_RANDOM] = {"random", random_noop, random_noop, random_victim},
+};
+
+repl_policy_t *create_repl_policy(repl_policy_kind_t kind, uint32_t sets,
+                                  uint32_t ways, uint64_t seed) {
+  if (kind >= REPL_POLICY_MAX || sets == 0 || ways == 0) {
+    return NULL;
+  }
+
+  // The tree needs a leaf per way and ways - 1 node bits in one word
+  if (kind == REPL_TREE_PLRU && ((ways & (ways - 1)) != 0 || ways > 64)) {
+    return NULL;
+  }
+
+  repl_policy_t *p = (repl_policy_t *)calloc(1, sizeof(repl_policy_t));
+  if (p == NULL) {
+    return NULL;
+  }
+
+  p->ops = &policy_ops[kind];
+  p->kind = kind;
+  p->sets = sets;
+  p->ways = ways;
+  p->rng = seed ? seed : DEFAULT_RNG_SEED;
+  p->entry_state = (uint64_t *)calloc((size_t)sets * ways, sizeof(uint64_t));
+  p->set_state = (uint64_t *)calloc(sets, sizeof(uint64_t));
+  if (p->entry_state == NULL || p->set_state == NULL) {
+    destroy_repl_policy(p);
+    return NULL;
+  }
+
+  return p;
+}
+
+void destroy_repl_policy(repl_policy_t *p) {
+  if (p == NULL) {
+    return;
+  }
+
+  PTR_FREE(p->entry_state);
+  PTR_FREE(p->set_state);
+  free(p);
+}
+
+void reset_repl_policy(repl_policy_t *p) {
+  memset(p->entry_state, 0, (size_t)p->sets * p->ways * sizeof(uint64_t));
+  memset(p->set_state, 0, p->sets * sizeof(uint64_t));
+  p->clock = 0;
+}
+
+const char *repl_policy_name(repl_policy_kind_t kind) {
+  if (kind >= REPL_POLICY_MAX) {
+    return "unknown";
+  }
+  return policy_ops[kind].name;
+}
+
+int parse_repl_policy(const char *name, repl_policy_kind_t *kind) {
+  for (int i = 0; i < REPL_POLICY_MAX; i++) {
+    if (strcmp(name, policy_ops[i].name) == 0) {
+      *kind = (repl_policy_kind_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
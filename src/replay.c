@@ -0,0 +1,218 @@
+/**
+ * @file replay.c
+ *
+ * Trace-driven replay. Traces are memory-mapped and streamed through
+ * translate_batch() a batch of records at a time.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "address_space.h"
+#include "config.h"
+#include "replay.h"
+#include "translation.h"
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+int open_trace(const char *path, replay_trace_t *trace) {
+  trace->records = NULL;
+  trace->n_records = 0;
+  trace->map_len = 0;
+  trace->fd = open(path, O_RDONLY);
+  if (trace->fd < 0) {
+    perror("open_trace: open");
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(trace->fd, &st) != 0) {
+    perror("open_trace: fstat");
+    close(trace->fd);
+    trace->fd = -1;
+    return -1;
+  }
+
+  if (st.st_size % sizeof(trace_record_t) != 0) {
+    fprintf(stderr, "open_trace: %s is not a whole number of records.\n",
+            path);
+    close(trace->fd);
+    trace->fd = -1;
+    return -1;
+  }
+
+  // mmap() rejects zero-length maps. An empty trace is valid, just boring.
+  if (st.st_size == 0) {
+    return 0;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, trace->fd, 0);
+  if (map == MAP_FAILED) {
+    perror("open_trace: mmap");
+    close(trace->fd);
+    trace->fd = -1;
+    return -1;
+  }
+
+  // The replay loop reads front to back exactly once
+  madvise(map, st.st_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+  trace->records = (const trace_record_t *)map;
+  trace->map_len = st.st_size;
+  trace->n_records = st.st_size / sizeof(trace_record_t);
+  return 0;
+}
+
+void close_trace(replay_trace_t *trace) {
+  if (trace->records != NULL) {
+    munmap((void *)trace->records, trace->map_len);
+    trace->records = NULL;
+  }
+
+  if (trace->fd >= 0) {
+    close(trace->fd);
+    trace->fd = -1;
+  }
+
+  trace->n_records = 0;
+  trace->map_len = 0;
+}
+
+int demand_map_fault_handler(ptw_sim_context_t *ctx, address_context_t *a_ctx,
+                             uintptr_t fault, void *arg) {
+  // Only not-present faults can be fixed by mapping a page. Permission faults
+  // would fault again on the same mapping.
+  if (fault != (uintptr_t)-EINVAL) {
+    return -1;
+  }
+
+  permissions_t perms = {0};
+  perms.val.read = 1;
+  perms.val.write = 1;
+  perms.val.execute = 1;
+
+  return map_page(ctx, a_ctx->pid, a_ctx->va & VPN_MASK_4KB,
+                  allocate_physical_frame(a_ctx->va), FOUR_K, perms);
+}
+
+/**
+ * Count a fault, give the handler one chance to fix it, then retry once
+ */
+static void handle_fault(ptw_sim_context_t *ctx, address_context_t *a_ctx,
+                         uintptr_t fault, replay_fault_handler_t handler,
+                         void *arg, replay_stats_t *stats) {
+  stats->faults++;
+
+  if (handler == NULL || handler(ctx, a_ctx, fault, arg) != 0) {
+    return;
+  }
+
+  stats->faults_handled++;
+  if (!IS_FAULT(translate(a_ctx, ctx))) {
+    stats->translations++;
+  }
+}
+
+void replay_access(ptw_sim_context_t *ctx, address_context_t *a_ctx,
+                   replay_fault_handler_t handler, void *arg,
+                   replay_stats_t *stats) {
+  uintptr_t pa = translate(a_ctx, ctx);
+  if (!IS_FAULT(pa)) {
+    stats->translations++;
+    return;
+  }
+
+  handle_fault(ctx, a_ctx, pa, handler, arg, stats);
+}
+
+void replay_batch(ptw_sim_context_t *ctx, const address_context_t *batch,
+                  size_t n, translation_result_t *results,
+                  replay_fault_handler_t handler, void *arg,
+                  replay_stats_t *stats) {
+  size_t done = 0;
+  while (done < n) {
+    size_t k = translate_batch(ctx, batch + done, n - done, results);
+    done += k;
+
+    for (size_t i = 0; i < k; i++) {
+      stats->coalesced += results[i].source == TRANSLATION_COALESCED;
+    }
+
+    // Only the last result of a call can be a fault
+    if (results[k - 1].source != TRANSLATION_FAULT) {
+      stats->translations += k;
+      continue;
+    }
+
+    stats->translations += k - 1;
+    address_context_t a_ctx = batch[done - 1];
+    handle_fault(ctx, &a_ctx, results[k - 1].pa, handler, arg, stats);
+  }
+}
+
+int replay_trace(const replay_trace_t *trace, ptw_sim_context_t *ctx,
+                 replay_fault_handler_t handler, void *arg,
+                 replay_stats_t *stats) {
+  if (trace == NULL || ctx == NULL || stats == NULL) {
+    return -1;
+  }
+
+  *stats = (replay_stats_t){0};
+
+  address_context_t *batch = malloc(REPLAY_BATCH_SIZE * sizeof(*batch));
+  translation_result_t *results =
+      malloc(REPLAY_BATCH_SIZE * sizeof(*results));
+  if (batch == NULL || results == NULL) {
+    free(batch);
+    free(results);
+    return -1;
+  }
+
+  const trace_record_t *rec = trace->records;
+  const trace_record_t *end = rec + trace->n_records;
+
+  uint64_t start = now_ns();
+  while (rec != end) {
+    size_t n = 0;
+    for (; rec != end && n < REPLAY_BATCH_SIZE; rec++) {
+      stats->records++;
+
+      if (!trace_record_to_address_context(rec, &batch[n])) {
+        stats->skipped++;
+        continue;
+      }
+      n++;
+    }
+
+    replay_batch(ctx, batch, n, results, handler, arg, stats);
+  }
+  stats->elapsed_ns = now_ns() - start;
+
+  free(batch);
+  free(results);
+  return 0;
+}
+
+void print_replay_stats(FILE *out, const replay_stats_t *stats) {
+  double seconds = (double)stats->elapsed_ns / 1e9;
+  double rate = seconds > 0 ? (double)stats->records / seconds : 0.0;
+
+  fprintf(out, "Records:          %lu\n", stats->records);
+  fprintf(out, "Translations:     %lu\n", stats->translations);
+  fprintf(out, "Coalesced:        %lu\n", stats->coalesced);
+  fprintf(out, "Faults:           %lu\n", stats->faults);
+  fprintf(out, "Faults handled:   %lu\n", stats->faults_handled);
+  fprintf(out, "Skipped records:  %lu\n", stats->skipped);
+  fprintf(out, "Elapsed:          %.3f s\n", seconds);
+  fprintf(out, "Throughput:       %.2f M translations/s\n", rate / 1e6);
+}
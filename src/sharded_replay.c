@@ -0,0 +1,352 @@
+/**
+ * @file sharded_replay.c
+ *
+ * Parallel trace replay, one thread and one simulation context per shard of
+ * PIDs
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "compact_trace.h"
+#include "sharded_replay.h"
+#include "sim_context.h"
+
+// Batches each shard can have queued before the dispatcher waits for it
+#define SHARD_QUEUE_DEPTH 4
+
+/**
+ * Accesses routed to one shard
+ */
+typedef struct shard_batch {
+  address_context_t *accesses; //< REPLAY_BATCH_SIZE entries
+  size_t n;                    //< Accesses in use
+  uint64_t records;            //< Records routed here, including skipped ones
+  uint64_t skipped;            //< Malformed records among them
+} shard_batch_t;
+
+/**
+ * Bounded queue of batches from the dispatcher to one shard's thread
+ *
+ * The batches are a ring. The thread replays the `count` batches starting at
+ * `head`. The dispatcher fills the batch at `tail`, just past them, without
+ * the lock, and publishes it by bumping `count`.
+ */
+typedef struct shard_queue {
+  pthread_mutex_t lock;
+  pthread_cond_t filled;  //< A batch was published, or the trace ended
+  pthread_cond_t drained; //< A batch was replayed
+  shard_batch_t batches[SHARD_QUEUE_DEPTH];
+  uint32_t head;
+  uint32_t count;
+  uint32_t tail;  //< Batch the dispatcher fills, if `filling`
+  bool filling;
+  bool done;      //< No more batches will be published
+} shard_queue_t;
+
+/**
+ * What one worker thread needs
+ */
+typedef struct shard_worker {
+  replay_shard_t *shard;
+  shard_queue_t queue;
+  translation_result_t *results; //< REPLAY_BATCH_SIZE entries
+  replay_fault_handler_t handler;
+  void *arg;
+} shard_worker_t;
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Take the next free batch of a shard, waiting for its thread if the queue
+ * is full
+ */
+static void acquire_batch(shard_queue_t *q) {
+  pthread_mutex_lock(&q->lock);
+  while (q->count == SHARD_QUEUE_DEPTH) {
+    pthread_cond_wait(&q->drained, &q->lock);
+  }
+  q->tail = (q->head + q->count) % SHARD_QUEUE_DEPTH;
+  pthread_mutex_unlock(&q->lock);
+
+  shard_batch_t *b = &q->batches[q->tail];
+  b->n = 0;
+  b->records = 0;
+  b->skipped = 0;
+  q->filling = true;
+}
+
+static void publish_batch(shard_queue_t *q) {
+  pthread_mutex_lock(&q->lock);
+  q->count++;
+  q->filling = false;
+  pthread_cond_signal(&q->filled);
+  pthread_mutex_unlock(&q->lock);
+}
+
+/**
+ * Publish what is left of a shard's last batch and tell its thread the trace
+ * has ended
+ */
+static void finish_queue(shard_queue_t *q) {
+  if (q->filling) {
+    publish_batch(q);
+  }
+  pthread_mutex_lock(&q->lock);
+  q->done = true;
+  pthread_cond_signal(&q->filled);
+  pthread_mutex_unlock(&q->lock);
+}
+
+/**
+ * Hand a record to the shard of its PID. Records with an out-of-range PID go
+ * to shard 0.
+ */
+static void route_record(shard_worker_t *workers, uint32_t n_shards,
+                         const trace_record_t *rec) {
+  uint32_t owner =
+      rec->pid < MAX_PID ? replay_shard_of(rec->pid, n_shards) : 0;
+  shard_queue_t *q = &workers[owner].queue;
+  if (!q->filling) {
+    acquire_batch(q);
+  }
+
+  shard_batch_t *b = &q->batches[q->tail];
+  b->records++;
+  if (!trace_record_to_address_context(rec, &b->accesses[b->n])) {
+    b->skipped++;
+    return;
+  }
+  if (++b->n == REPLAY_BATCH_SIZE) {
+    publish_batch(q);
+  }
+}
+
+/**
+ * Route every record of a raw trace
+ */
+static int dispatch_raw_trace(const char *path, shard_worker_t *workers,
+                              uint32_t n_shards) {
+  replay_trace_t trace;
+  if (open_trace(path, &trace) != 0) {
+    return -1;
+  }
+  for (size_t i = 0; i < trace.n_records; i++) {
+    route_record(workers, n_shards, &trace.records[i]);
+  }
+  close_trace(&trace);
+  return 0;
+}
+
+/**
+ * Route every record of a compact trace, decoding a batch at a time
+ */
+static int dispatch_compact_trace(const char *path, shard_worker_t *workers,
+                                  uint32_t n_shards) {
+  trace_record_t *records = malloc(REPLAY_BATCH_SIZE * sizeof(*records));
+  compact_trace_reader_t r;
+  if (records == NULL || compact_trace_reader_open(&r, path) != 0) {
+    free(records);
+    return -1;
+  }
+
+  size_t n;
+  while ((n = compact_trace_read_records(&r, records, REPLAY_BATCH_SIZE)) >
+         0) {
+    for (size_t i = 0; i < n; i++) {
+      route_record(workers, n_shards, &records[i]);
+    }
+  }
+
+  int ret = r.corrupt ? -1 : 0;
+  compact_trace_reader_close(&r);
+  free(records);
+  return ret;
+}
+
+static void *shard_worker_main(void *arg) {
+  shard_worker_t *w = (shard_worker_t *)arg;
+  shard_queue_t *q = &w->queue;
+  replay_stats_t *stats = &w->shard->stats;
+  uint64_t start = now_ns();
+
+  for (;;) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && !q->done) {
+      pthread_cond_wait(&q->filled, &q->lock);
+    }
+    if (q->count == 0) {
+      pthread_mutex_unlock(&q->lock);
+      break;
+    }
+    shard_batch_t *b = &q->batches[q->head];
+    pthread_mutex_unlock(&q->lock);
+
+    stats->records += b->records;
+    stats->skipped += b->skipped;
+    replay_batch(&w->shard->ctx, b->accesses, b->n, w->results, w->handler,
+                 w->arg, stats);
+
+    pthread_mutex_lock(&q->lock);
+    q->head = (q->head + 1) % SHARD_QUEUE_DEPTH;
+    q->count--;
+    pthread_cond_signal(&q->drained);
+    pthread_mutex_unlock(&q->lock);
+  }
+
+  stats->elapsed_ns = now_ns() - start;
+  return NULL;
+}
+
+static void add_replay_stats(replay_stats_t *dst, const replay_stats_t *src) {
+  dst->records += src->records;
+  dst->translations += src->translations;
+  dst->coalesced += src->coalesced;
+  dst->faults += src->faults;
+  dst->faults_handled += src->faults_handled;
+  dst->skipped += src->skipped;
+}
+
+/**
+ * Set up a worker and allocate its queue's batches
+ */
+static int init_worker(shard_worker_t *w, replay_shard_t *shard,
+                       replay_fault_handler_t handler, void *arg) {
+  memset(w, 0, sizeof(*w));
+  w->shard = shard;
+  w->handler = handler;
+  w->arg = arg;
+  pthread_mutex_init(&w->queue.lock, NULL);
+  pthread_cond_init(&w->queue.filled, NULL);
+  pthread_cond_init(&w->queue.drained, NULL);
+
+  w->results = malloc(REPLAY_BATCH_SIZE * sizeof(*w->results));
+  if (w->results == NULL) {
+    return -1;
+  }
+  for (uint32_t i = 0; i < SHARD_QUEUE_DEPTH; i++) {
+    w->queue.batches[i].accesses =
+        malloc(REPLAY_BATCH_SIZE * sizeof(address_context_t));
+    if (w->queue.batches[i].accesses == NULL) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static void destroy_worker(shard_worker_t *w) {
+  for (uint32_t i = 0; i < SHARD_QUEUE_DEPTH; i++) {
+    free(w->queue.batches[i].accesses);
+  }
+  free(w->results);
+  pthread_mutex_destroy(&w->queue.lock);
+  pthread_cond_destroy(&w->queue.filled);
+  pthread_cond_destroy(&w->queue.drained);
+}
+
+/**
+ * Start a worker per shard, route the trace to them from this thread, and
+ * wait for all of them
+ */
+static int run_workers(const char *path, shard_worker_t *workers,
+                       uint32_t n_shards) {
+  pthread_t threads[MAX_REPLAY_SHARDS];
+  uint32_t started = 0;
+  int ret = 0;
+
+  for (; started < n_shards; started++) {
+    if (pthread_create(&threads[started], NULL, shard_worker_main,
+                       &workers[started]) != 0) {
+      fprintf(stderr, "Failed to start replay thread %u.\n", started);
+      ret = -1;
+      break;
+    }
+  }
+
+  // Without every worker running, routing could wait on a full queue forever
+  if (ret == 0) {
+    ret = is_compact_trace(path) ? dispatch_compact_trace(path, workers,
+                                                          n_shards)
+                                 : dispatch_raw_trace(path, workers, n_shards);
+  }
+
+  for (uint32_t i = 0; i < n_shards; i++) {
+    finish_queue(&workers[i].queue);
+  }
+  for (uint32_t i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  return ret;
+}
+
+int run_sharded_replay(sharded_replay_t *replay, const char *path,
+                       const sim_config_t *cfg, uint32_t n_shards,
+                       replay_fault_handler_t handler, void *arg) {
+  memset(replay, 0, sizeof(*replay));
+  if (path == NULL || cfg == NULL || n_shards == 0 ||
+      n_shards > MAX_REPLAY_SHARDS) {
+    return -1;
+  }
+
+  replay->shards = calloc(n_shards, sizeof(replay_shard_t));
+  shard_worker_t *workers = calloc(n_shards, sizeof(shard_worker_t));
+  if (replay->shards == NULL || workers == NULL) {
+    free(replay->shards);
+    free(workers);
+    replay->shards = NULL;
+    return -1;
+  }
+  replay->n_shards = n_shards;
+
+  // Contexts are created up front so a bad configuration is reported once
+  int ret = 0;
+  uint32_t n_workers = 0;
+  while (n_workers < n_shards && ret == 0) {
+    ret = init_worker(&workers[n_workers], &replay->shards[n_workers],
+                      handler, arg);
+    if (ret == 0) {
+      ret = create_sim_context(&replay->shards[n_workers].ctx, 0, cfg);
+    }
+    n_workers++;
+  }
+
+  uint64_t start = now_ns();
+  if (ret == 0) {
+    ret = run_workers(path, workers, n_shards);
+  }
+  replay->stats.elapsed_ns = now_ns() - start;
+
+  for (uint32_t i = 0; i < n_workers; i++) {
+    destroy_worker(&workers[i]);
+  }
+  free(workers);
+
+  if (ret != 0) {
+    destroy_sharded_replay(replay);
+    return -1;
+  }
+
+  for (uint32_t i = 0; i < n_shards; i++) {
+    add_replay_stats(&replay->stats, &replay->shards[i].stats);
+  }
+  return 0;
+}
+
+void destroy_sharded_replay(sharded_replay_t *replay) {
+  if (replay->shards != NULL) {
+    for (uint32_t i = 0; i < replay->n_shards; i++) {
+      destroy_sim_context(&replay->shards[i].ctx);
+    }
+    free(replay->shards);
+  }
+  memset(replay, 0, sizeof(*replay));
+}
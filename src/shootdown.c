@@ -0,0 +1,120 @@
+/**
+ * @file shootdown.c
+ *
+ * TLB shootdowns between simulated cores
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "pwc.h"
+#include "shootdown.h"
+#include "tlb.h"
+
+/**
+ * Drop every cached translation of the pages on one core
+ *
+ * The L1 TLB of the page size and the STLB hold leaves. The paging-structure
+ * caches are invalidated along the way too, like INVLPG does.
+ *
+ * @return Cycles the core spent.
+ */
+static uint64_t invalidate_on_core(const ptw_sim_context_t *ctx,
+                                   mmu_core_t *core, uint32_t pid,
+                                   uintptr_t va, page_size_t page_size,
+                                   size_t n_pages, bool *flushed) {
+  tlb_t *tlbs[] = {core->oneg_tlb, core->twom_tlb, core->fourk_tlb,
+                   core->stlb};
+  size_t n_tlbs = sizeof(tlbs) / sizeof(tlbs[0]);
+
+  *flushed = n_pages > ctx->shootdown_cost.flush_threshold;
+  if (*flushed) {
+    for (size_t i = 0; i < n_tlbs; i++) {
+      if (tlbs[i] != NULL) {
+        flush_tlb_pid(tlbs[i], pid);
+      }
+    }
+    for (int level = 0; level < PWC_LEVELS; level++) {
+      if (core->pwc[level] != NULL) {
+        flush_pwc_pid(core->pwc[level], pid);
+      }
+    }
+    return ctx->shootdown_cost.flush;
+  }
+
+  uint64_t page = 1ULL << page_size_shift(page_size);
+  for (size_t p = 0; p < n_pages; p++, va += page) {
+    for (size_t i = 0; i < n_tlbs; i++) {
+      if (tlbs[i] != NULL) {
+        tlb_invalidate_page(tlbs[i], va, page_size, pid);
+      }
+    }
+    for (int level = 0; level < PWC_LEVELS; level++) {
+      if (core->pwc[level] != NULL) {
+        pwc_invalidate(core->pwc[level], va, pid);
+      }
+    }
+  }
+  return (uint64_t)n_pages * ctx->shootdown_cost.invlpg;
+}
+
+void tlb_shootdown(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va,
+                   page_size_t page_size, size_t n_pages) {
+  if (pid >= MAX_PID || n_pages == 0) {
+    return;
+  }
+
+  const shootdown_cost_t *cost = &ctx->shootdown_cost;
+  shootdown_stats_t *stats = &ctx->shootdown_stats;
+  uint64_t pid_bit = 1ULL << pid;
+  uint64_t local_cycles = 0;
+  uint64_t remote_inv_cycles = 0;
+  uint32_t targets = 0;
+  bool any = false;
+
+  for (uint32_t i = 0; i < ctx->n_cores; i++) {
+    mmu_core_t *core = &ctx->cores[i];
+    if ((core->pid_mask & pid_bit) == 0) {
+      continue;
+    }
+
+    bool flushed;
+    uint64_t cycles =
+        invalidate_on_core(ctx, core, pid, va, page_size, n_pages, &flushed);
+    any = true;
+    stats->pid_flushes += flushed;
+    stats->pages_invalidated += flushed ? 0 : n_pages;
+
+    if (i == ctx->current_core) {
+      local_cycles = cycles;
+      continue;
+    }
+
+    // Every target has the same work, so they all finish together
+    targets++;
+    remote_inv_cycles = cycles;
+    stats->remote_cycles += cost->ipi_handler + cycles;
+  }
+
+  if (!any) {
+    return;
+  }
+
+  stats->shootdowns++;
+  stats->ipis += targets;
+  stats->initiator_cycles += local_cycles + (uint64_t)targets * cost->ipi_send;
+  if (targets > 0) {
+    stats->initiator_cycles +=
+        cost->ipi_latency + cost->ipi_handler + remote_inv_cycles;
+  }
+}
+
+void print_shootdown_stats(FILE *out, const ptw_sim_context_t *ctx) {
+  const shootdown_stats_t *s = &ctx->shootdown_stats;
+  fprintf(out, "Shootdowns:       %lu (%lu IPIs)\n", s->shootdowns, s->ipis);
+  fprintf(out, "Invalidations:    %lu pages, %lu PID flushes\n",
+          s->pages_invalidated, s->pid_flushes);
+  fprintf(out, "Shootdown cycles: %lu initiator, %lu remote\n",
+          s->initiator_cycles, s->remote_cycles);
+}
@@ -0,0 +1,213 @@
+/**
+ * @file sim_config.c
+ *
+ * Simulator configuration defaults and parsing
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_config.h"
+
+void default_sim_config(sim_config_t *cfg) {
+  cfg->oneg_tlb = (tlb_geometry_t){ONEG_TLB_SETS, ONEG_TLB_WAYS};
+  cfg->twom_tlb = (tlb_geometry_t){TWOM_TLB_SETS, TWOM_TLB_WAYS};
+  cfg->fourk_tlb = (tlb_geometry_t){FOURK_TLB_SETS, FOURK_TLB_WAYS};
+  cfg->tlb_policy = REPL_LFU_DECAY;
+  cfg->stlb = (tlb_geometry_t){STLB_SETS, STLB_WAYS};
+  cfg->stlb_policy = REPL_LRU;
+  cfg->stlb_oneg = false;
+  cfg->pwc[PWC_SDP] = (tlb_geometry_t){PWC_SDP_SETS, PWC_SDP_WAYS};
+  cfg->pwc[PWC_PDP] = (tlb_geometry_t){PWC_PDP_SETS, PWC_PDP_WAYS};
+  cfg->pwc[PWC_PDE] = (tlb_geometry_t){PWC_PDE_SETS, PWC_PDE_WAYS};
+  cfg->pwc_policy = REPL_LRU;
+  cfg->dcache[CACHE_L1D] =
+      (cache_geometry_t){L1D_SIZE, L1D_WAYS, CACHE_LINE_SIZE};
+  cfg->dcache[CACHE_L2] = (cache_geometry_t){L2_SIZE, L2_WAYS, CACHE_LINE_SIZE};
+  cfg->dcache[CACHE_LLC] =
+      (cache_geometry_t){LLC_SIZE, LLC_WAYS, CACHE_LINE_SIZE};
+  cfg->dcache_policy = REPL_LRU;
+  cfg->latency = (latency_model_t){
+      .l1_tlb = LATENCY_L1_TLB_CYCLES,
+      .stlb = LATENCY_STLB_CYCLES,
+      .walk_start = LATENCY_WALK_START_CYCLES,
+      .pt_read = LATENCY_PT_READ_CYCLES,
+      .fault = LATENCY_FAULT_CYCLES,
+      .l1d = LATENCY_L1D_CYCLES,
+      .l2 = LATENCY_L2_CYCLES,
+      .llc = LATENCY_LLC_CYCLES,
+      .memory = LATENCY_MEMORY_CYCLES,
+  };
+  cfg->n_cores = 1;
+  cfg->shootdown_cost = (shootdown_cost_t){
+      .ipi_send = SHOOTDOWN_IPI_SEND_CYCLES,
+      .ipi_latency = SHOOTDOWN_IPI_LATENCY_CYCLES,
+      .ipi_handler = SHOOTDOWN_IPI_HANDLER_CYCLES,
+      .invlpg = SHOOTDOWN_INVLPG_CYCLES,
+      .flush = SHOOTDOWN_FLUSH_CYCLES,
+      .flush_threshold = SHOOTDOWN_FLUSH_THRESHOLD,
+  };
+  cfg->pte_format = PTE_FORMAT_SIM;
+  cfg->pt_levels = PT_LEVELS;
+  cfg->pt_backend = PT_BACKEND_RADIX;
+  cfg->hpt_buckets = HPT_BUCKETS;
+  cfg->ecpt_slots = ECPT_SLOTS;
+}
+
+int parse_tlb_geometry(const char *str, tlb_geometry_t *geometry) {
+  char *end;
+  unsigned long sets = strtoul(str, &end, 10);
+  if (end == str || *end != 'x') {
+    return -1;
+  }
+
+  const char *ways_str = end + 1;
+  unsigned long ways = strtoul(ways_str, &end, 10);
+  if (end == ways_str || *end != '\0') {
+    return -1;
+  }
+
+  if (sets == 0 || (sets & (sets - 1)) != 0 || sets > UINT32_MAX ||
+      ways == 0 || ways > UINT32_MAX) {
+    return -1;
+  }
+
+  geometry->sets = (uint32_t)sets;
+  geometry->ways = (uint32_t)ways;
+  return 0;
+}
+
+int parse_cache_geometry(const char *str, cache_geometry_t *geometry) {
+  char *end;
+  unsigned long size = strtoul(str, &end, 10);
+  if (end == str) {
+    return -1;
+  }
+  if (*end == 'K' || *end == 'M') {
+    size <<= *end == 'K' ? 10 : 20;
+    end++;
+  }
+  if (*end != 'x') {
+    return -1;
+  }
+
+  const char *ways_str = end + 1;
+  unsigned long ways = strtoul(ways_str, &end, 10);
+  if (end == ways_str) {
+    return -1;
+  }
+
+  unsigned long line = CACHE_LINE_SIZE;
+  if (*end == 'x') {
+    const char *line_str = end + 1;
+    line = strtoul(line_str, &end, 10);
+    if (end == line_str) {
+      return -1;
+    }
+  }
+  if (*end != '\0') {
+    return -1;
+  }
+
+  if (size == 0 || size > UINT32_MAX || ways == 0 || ways > UINT32_MAX ||
+      line == 0 || line > UINT32_MAX || (line & (line - 1)) != 0 ||
+      size % (ways * line) != 0) {
+    return -1;
+  }
+  unsigned long sets = size / (ways * line);
+  if (sets == 0 || (sets & (sets - 1)) != 0) {
+    return -1;
+  }
+
+  geometry->size = (uint32_t)size;
+  geometry->ways = (uint32_t)ways;
+  geometry->line_size = (uint32_t)line;
+  return 0;
+}
+
+int parse_latency_model(const char *str, latency_model_t *latency) {
+  static const struct {
+    const char *key;
+    size_t offset;
+  } keys[] = {
+      {"l1-tlb", offsetof(latency_model_t, l1_tlb)},
+      {"stlb", offsetof(latency_model_t, stlb)},
+      {"walk-start", offsetof(latency_model_t, walk_start)},
+      {"pt-read", offsetof(latency_model_t, pt_read)},
+      {"fault", offsetof(latency_model_t, fault)},
+      {"l1d", offsetof(latency_model_t, l1d)},
+      {"l2", offsetof(latency_model_t, l2)},
+      {"llc", offsetof(latency_model_t, llc)},
+      {"memory", offsetof(latency_model_t, memory)},
+  };
+
+  const char *p = str;
+  while (*p != '\0') {
+    const char *eq = strchr(p, '=');
+    if (eq == NULL) {
+      return -1;
+    }
+
+    uint32_t *field = NULL;
+    size_t key_len = eq - p;
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+      if (strlen(keys[i].key) == key_len &&
+          strncmp(p, keys[i].key, key_len) == 0) {
+        field = (uint32_t *)((char *)latency + keys[i].offset);
+      }
+    }
+
+    char *end;
+    unsigned long cycles = strtoul(eq + 1, &end, 10);
+    if (field == NULL || end == eq + 1 || (*end != ',' && *end != '\0') ||
+        cycles > UINT32_MAX) {
+      return -1;
+    }
+
+    *field = (uint32_t)cycles;
+    p = *end == ',' ? end + 1 : end;
+  }
+
+  return 0;
+}
+
+static const char *pte_format_names[PTE_FORMAT_MAX] = {
+    [PTE_FORMAT_SIM] = "sim",
+    [PTE_FORMAT_HW] = "hw",
+};
+
+int parse_pte_format(const char *name, pte_format_t *format) {
+  for (int f = 0; f < PTE_FORMAT_MAX; f++) {
+    if (strcmp(name, pte_format_names[f]) == 0) {
+      *format = f;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+const char *pte_format_name(pte_format_t format) {
+  return format < PTE_FORMAT_MAX ? pte_format_names[format] : "unknown";
+}
+
+static const char *pt_backend_names[PT_BACKEND_MAX] = {
+    [PT_BACKEND_RADIX] = "radix",
+    [PT_BACKEND_HASHED] = "hashed",
+    [PT_BACKEND_CUCKOO] = "cuckoo",
+};
+
+int parse_pt_backend(const char *name, pt_backend_t *backend) {
+  for (int b = 0; b < PT_BACKEND_MAX; b++) {
+    if (strcmp(name, pt_backend_names[b]) == 0) {
+      *backend = b;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+const char *pt_backend_name(pt_backend_t backend) {
+  return backend < PT_BACKEND_MAX ? pt_backend_names[backend] : "unknown";
+}
@@ -0,0 +1,333 @@
+/**
+ * @file sim_context.c
+ *
+ * Simulation context lifecycle
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "address_space.h"
+#include "dcache.h"
+#include "event_trace.h"
+#include "pwc.h"
+#include "sim_context.h"
+#include "tlb.h"
+
+/**
+ * Create one TLB, reporting which one failed
+ */
+static tlb_t *create_named_tlb(const char *name, trace_unit_t unit,
+                               tlb_geometry_t geometry, uint8_t page_sizes,
+                               repl_policy_kind_t policy) {
+  tlb_t *tlb = create_tlb(geometry, page_sizes, policy);
+  if (tlb == NULL) {
+    fprintf(stderr, "Failed to create %ux%u %s %s.\n", geometry.sets,
+            geometry.ways, repl_policy_name(policy), name);
+    return NULL;
+  }
+  tlb->trace_unit = unit;
+  return tlb;
+}
+
+/**
+ * Create one data cache level, reporting which one failed
+ */
+static data_cache_t *create_named_dcache(const char *name,
+                                         cache_geometry_t geometry,
+                                         repl_policy_kind_t policy) {
+  data_cache_t *cache = create_dcache(geometry, policy);
+  if (cache == NULL) {
+    fprintf(stderr, "Failed to create %u-byte %u-way %s %s with %u-byte "
+                    "lines.\n",
+            geometry.size, geometry.ways, repl_policy_name(policy), name,
+            geometry.line_size);
+  }
+  return cache;
+}
+
+static const char *dcache_names[CACHE_LEVELS] = {"L1D", "L2", "LLC"};
+
+/**
+ * Create one core's TLBs and caches. Stops at the first failure and leaves
+ * the cleanup to the caller.
+ */
+static int create_core(mmu_core_t *core, const sim_config_t *cfg) {
+  core->oneg_tlb = create_named_tlb("1G TLB", TRACE_UNIT_1G_TLB, cfg->oneg_tlb,
+                                    PG_SIZE_BIT(ONE_G), cfg->tlb_policy);
+  core->twom_tlb = create_named_tlb("2M TLB", TRACE_UNIT_2M_TLB, cfg->twom_tlb,
+                                    PG_SIZE_BIT(TWO_M), cfg->tlb_policy);
+  core->fourk_tlb =
+      create_named_tlb("4K TLB", TRACE_UNIT_4K_TLB, cfg->fourk_tlb,
+                       PG_SIZE_BIT(FOUR_K), cfg->tlb_policy);
+  if (core->oneg_tlb == NULL || core->twom_tlb == NULL ||
+      core->fourk_tlb == NULL) {
+    return -1;
+  }
+
+  if (cfg->stlb.sets != 0) {
+    core->stlb = create_named_tlb("STLB", TRACE_UNIT_STLB, cfg->stlb,
+                                  stlb_page_sizes(cfg), cfg->stlb_policy);
+    if (core->stlb == NULL) {
+      return -1;
+    }
+  }
+
+  // A hashed page table has no levels to cache. Cuckoo page tables use the
+  // PDP and PDE caches as cuckoo walk caches of 1G and 2M regions.
+  for (int level = 0; level < PWC_LEVELS; level++) {
+    if (cfg->pwc[level].sets == 0 || cfg->pt_backend == PT_BACKEND_HASHED ||
+        (cfg->pt_backend == PT_BACKEND_CUCKOO && level == PWC_SDP)) {
+      continue;
+    }
+    core->pwc[level] = create_pwc(cfg->pwc[level], level, cfg->pwc_policy);
+    if (core->pwc[level] == NULL) {
+      fprintf(stderr, "Failed to create %ux%u %s PWC.\n", cfg->pwc[level].sets,
+              cfg->pwc[level].ways, repl_policy_name(cfg->pwc_policy));
+      return -1;
+    }
+  }
+
+  for (int level = 0; level < CACHE_PRIVATE_LEVELS; level++) {
+    if (cfg->dcache[level].size == 0) {
+      continue;
+    }
+    core->dcache[level] = create_named_dcache(
+        dcache_names[level], cfg->dcache[level], cfg->dcache_policy);
+    if (core->dcache[level] == NULL) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Create everything `cfg` describes. Stops at the first failure and leaves
+ * the cleanup to the caller.
+ */
+static int create_structures(ptw_sim_context_t *ctx, size_t max_pid,
+                             const sim_config_t *cfg) {
+  if (cfg->n_cores == 0 || cfg->n_cores > MAX_CORES) {
+    fprintf(stderr, "Core count must be 1 to %d.\n", MAX_CORES);
+    return -1;
+  }
+
+  if (cfg->pte_format >= PTE_FORMAT_MAX) {
+    fprintf(stderr, "Unknown page table entry format %d.\n", cfg->pte_format);
+    return -1;
+  }
+
+  if (cfg->pt_levels != PT_LEVELS && cfg->pt_levels != PT_LEVELS_LA57) {
+    fprintf(stderr, "Page tables must have %d or %d levels.\n", PT_LEVELS,
+            PT_LEVELS_LA57);
+    return -1;
+  }
+
+  if (cfg->pt_backend >= PT_BACKEND_MAX) {
+    fprintf(stderr, "Unknown page table organization %d.\n", cfg->pt_backend);
+    return -1;
+  }
+
+  if (cfg->pt_backend == PT_BACKEND_CUCKOO &&
+      (cfg->ecpt_slots == 0 || (cfg->ecpt_slots & (cfg->ecpt_slots - 1)))) {
+    fprintf(stderr, "Cuckoo page table ways need a power of 2 slots, not "
+                    "%u.\n",
+            cfg->ecpt_slots);
+    return -1;
+  }
+
+  ctx->n_cores = cfg->n_cores;
+  ctx->latency = cfg->latency;
+  ctx->shootdown_cost = cfg->shootdown_cost;
+  ctx->pte_format = cfg->pte_format;
+  ctx->pt_levels = cfg->pt_levels;
+  ctx->ecpt_slots = cfg->ecpt_slots;
+  if (cfg->pt_backend == PT_BACKEND_HASHED) {
+    ctx->hpt = create_hashed_pt(cfg->hpt_buckets);
+    if (ctx->hpt == NULL) {
+      fprintf(stderr, "Failed to create a hashed page table of %u buckets.\n",
+              cfg->hpt_buckets);
+      return -1;
+    }
+  }
+  // Only once the table exists, so a failed context tears down as radix
+  ctx->pt_backend = cfg->pt_backend;
+  for (uint32_t core = 0; core < ctx->n_cores; core++) {
+    if (create_core(&ctx->cores[core], cfg) != 0) {
+      return -1;
+    }
+  }
+  if (cfg->dcache[CACHE_LLC].size != 0) {
+    ctx->dcache[CACHE_LLC] = create_named_dcache(
+        dcache_names[CACHE_LLC], cfg->dcache[CACHE_LLC], cfg->dcache_policy);
+    if (ctx->dcache[CACHE_LLC] == NULL) {
+      return -1;
+    }
+  }
+  switch_core(ctx, 0);
+
+  // Only the top-level table exists up front. map_page() fills in the rest of
+  // the tree as mappings are added.
+  for (size_t pid = 0; pid < max_pid && pid < MAX_PID; pid++) {
+    if (create_address_space(ctx, pid) != 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int create_sim_context(ptw_sim_context_t *ctx, size_t max_pid,
+                       const sim_config_t *cfg) {
+  if (create_structures(ctx, max_pid, cfg) != 0) {
+    destroy_sim_context(ctx);
+    return -1;
+  }
+  return 0;
+}
+
+void destroy_sim_context(ptw_sim_context_t *ctx) {
+  for (uint32_t pid = 0; pid < MAX_PID; pid++) {
+    destroy_address_space(ctx, pid);
+  }
+
+  for (uint32_t i = 0; i < ctx->n_cores; i++) {
+    mmu_core_t *core = &ctx->cores[i];
+    destroy_tlb(core->oneg_tlb);
+    destroy_tlb(core->twom_tlb);
+    destroy_tlb(core->fourk_tlb);
+    destroy_tlb(core->stlb);
+
+    for (int level = 0; level < PWC_LEVELS; level++) {
+      destroy_pwc(core->pwc[level]);
+    }
+    for (int level = 0; level < CACHE_PRIVATE_LEVELS; level++) {
+      destroy_dcache(core->dcache[level]);
+    }
+  }
+  destroy_dcache(ctx->dcache[CACHE_LLC]);
+  destroy_hashed_pt(ctx->hpt);
+
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+int switch_core(ptw_sim_context_t *ctx, uint32_t core) {
+  if (core >= ctx->n_cores) {
+    fprintf(stderr, "Invalid core %u.\n", core);
+    return -1;
+  }
+
+  mmu_core_t *c = &ctx->cores[core];
+  ctx->current_core = core;
+  ctx->oneg_tlb = c->oneg_tlb;
+  ctx->twom_tlb = c->twom_tlb;
+  ctx->fourk_tlb = c->fourk_tlb;
+  ctx->stlb = c->stlb;
+  memcpy(ctx->pwc, c->pwc, sizeof(ctx->pwc));
+  memcpy(ctx->dcache, c->dcache, sizeof(c->dcache));
+  return 0;
+}
+
+static void merge_tlb_stats(tlb_t *dst, const tlb_t *src) {
+  if (dst == NULL || src == NULL) {
+    return;
+  }
+  dst->hits += src->hits;
+  dst->misses += src->misses;
+  dst->evictions += src->evictions;
+}
+
+static void merge_dcache_stats(data_cache_t *dst, const data_cache_t *src) {
+  if (dst == NULL || src == NULL) {
+    return;
+  }
+  dst->hits += src->hits;
+  dst->misses += src->misses;
+  dst->evictions += src->evictions;
+}
+
+void merge_sim_stats(ptw_sim_context_t *dst, const ptw_sim_context_t *src) {
+  for (uint32_t i = 0; i < src->n_cores; i++) {
+    const mmu_core_t *core = &src->cores[i];
+    merge_tlb_stats(dst->oneg_tlb, core->oneg_tlb);
+    merge_tlb_stats(dst->twom_tlb, core->twom_tlb);
+    merge_tlb_stats(dst->fourk_tlb, core->fourk_tlb);
+    merge_tlb_stats(dst->stlb, core->stlb);
+
+    for (int level = 0; level < PWC_LEVELS; level++) {
+      if (dst->pwc[level] == NULL || core->pwc[level] == NULL) {
+        continue;
+      }
+      dst->pwc[level]->hits += core->pwc[level]->hits;
+      dst->pwc[level]->misses += core->pwc[level]->misses;
+      dst->pwc[level]->evictions += core->pwc[level]->evictions;
+    }
+    for (int level = 0; level < CACHE_PRIVATE_LEVELS; level++) {
+      merge_dcache_stats(dst->dcache[level], core->dcache[level]);
+    }
+  }
+  merge_dcache_stats(dst->dcache[CACHE_LLC], src->dcache[CACHE_LLC]);
+
+  walk_stats_t *ws = &dst->walk_stats;
+  ws->walks += src->walk_stats.walks;
+  ws->pt_reads += src->walk_stats.pt_reads;
+  for (int size = 0; size < PG_SIZE_MAX; size++) {
+    ws->leaves[size] += src->walk_stats.leaves[size];
+  }
+  for (int depth = 0; depth <= PT_MAX_LEVELS; depth++) {
+    ws->depth[depth] += src->walk_stats.depth[depth];
+  }
+  for (int code = 0; code < N_FAULT_CODES; code++) {
+    ws->faults[code] += src->walk_stats.faults[code];
+  }
+
+  hpt_stats_t *hs = &dst->hpt_stats;
+  hs->lookups += src->hpt_stats.lookups;
+  hs->probes += src->hpt_stats.probes;
+  hs->mem_refs += src->hpt_stats.mem_refs;
+  for (int refs = 0; refs <= HPT_REFS_HIST; refs++) {
+    hs->refs[refs] += src->hpt_stats.refs[refs];
+  }
+
+  ecpt_stats_t *es = &dst->ecpt_stats;
+  es->lookups += src->ecpt_stats.lookups;
+  es->page_reads += src->ecpt_stats.page_reads;
+  es->cwt_reads += src->ecpt_stats.cwt_reads;
+  es->sizes_probed += src->ecpt_stats.sizes_probed;
+  es->parallel_cycles += src->ecpt_stats.parallel_cycles;
+  es->serial_cycles += src->ecpt_stats.serial_cycles;
+
+  cycle_stats_t *cy = &dst->cycle_stats;
+  cy->translations += src->cycle_stats.translations;
+  cy->tlb_cycles += src->cycle_stats.tlb_cycles;
+  cy->walk_cycles += src->cycle_stats.walk_cycles;
+  cy->fault_cycles += src->cycle_stats.fault_cycles;
+
+  for (uint32_t pid = 0; pid < MAX_PID; pid++) {
+    pid_stats_t *p = &dst->pid_stats[pid];
+    const pid_stats_t *s = &src->pid_stats[pid];
+    p->translations += s->translations;
+    p->tlb_hits += s->tlb_hits;
+    p->stlb_hits += s->stlb_hits;
+    p->coalesced += s->coalesced;
+    p->walks += s->walks;
+    p->faults += s->faults;
+    p->cycles += s->cycles;
+  }
+
+  shootdown_stats_t *sd = &dst->shootdown_stats;
+  sd->shootdowns += src->shootdown_stats.shootdowns;
+  sd->ipis += src->shootdown_stats.ipis;
+  sd->pages_invalidated += src->shootdown_stats.pages_invalidated;
+  sd->pid_flushes += src->shootdown_stats.pid_flushes;
+  sd->initiator_cycles += src->shootdown_stats.initiator_cycles;
+  sd->remote_cycles += src->shootdown_stats.remote_cycles;
+
+  invalidation_stats_t *inv = &dst->invalidation_stats;
+  inv->pages += src->invalidation_stats.pages;
+  inv->pid_flushes += src->invalidation_stats.pid_flushes;
+  inv->nonglobal_flushes += src->invalidation_stats.nonglobal_flushes;
+  inv->entries += src->invalidation_stats.entries;
+  inv->cycles += src->invalidation_stats.cycles;
+}
@@ -0,0 +1,329 @@
+/**
+ * @file stats.c
+ *
+ * JSON and CSV export of the simulator's counters
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "stats.h"
+
+/**
+ * Emits sections of named counters in either format
+ *
+ * A section holds counters directly, or groups of counters keyed by
+ * component. Only the JSON output needs to know whether a comma is due.
+ */
+typedef struct stats_writer {
+  FILE *out;
+  stats_format_t format;
+  const char *section;
+  const char *component; //< Current group, or "" outside of one
+  bool first_section;
+  bool first_member; //< Nothing written yet in the innermost open object
+} stats_writer_t;
+
+static void json_member(stats_writer_t *w, int indent, const char *key) {
+  fprintf(w->out, "%s\n%*s\"%s\": ", w->first_member ? "" : ",", indent, "",
+          key);
+  w->first_member = false;
+}
+
+static void section_begin(stats_writer_t *w, const char *section) {
+  w->section = section;
+  w->component = "";
+  if (w->format == STATS_JSON) {
+    fprintf(w->out, "%s\n  \"%s\": {", w->first_section ? "" : ",", section);
+    w->first_section = false;
+    w->first_member = true;
+  }
+}
+
+static void section_end(stats_writer_t *w) {
+  if (w->format == STATS_JSON) {
+    fprintf(w->out, "\n  }");
+  }
+}
+
+static void group_begin(stats_writer_t *w, const char *component) {
+  w->component = component;
+  if (w->format == STATS_JSON) {
+    json_member(w, 4, component);
+    fputc('{', w->out);
+    w->first_member = true;
+  }
+}
+
+static void group_end(stats_writer_t *w) {
+  w->component = "";
+  if (w->format == STATS_JSON) {
+    fprintf(w->out, "\n    }");
+    // The group itself was a member of the section
+    w->first_member = false;
+  }
+}
+
+static void counter(stats_writer_t *w, const char *name, uint64_t value) {
+  if (w->format == STATS_JSON) {
+    json_member(w, w->component[0] != '\0' ? 6 : 4, name);
+    fprintf(w->out, "%lu", value);
+  } else {
+    fprintf(w->out, "%s,%s,%s,%lu\n", w->section, w->component, name, value);
+  }
+}
+
+static void write_replay(stats_writer_t *w, const replay_stats_t *stats) {
+  section_begin(w, "replay");
+  counter(w, "records", stats->records);
+  counter(w, "translations", stats->translations);
+  counter(w, "coalesced", stats->coalesced);
+  counter(w, "faults", stats->faults);
+  counter(w, "faults_handled", stats->faults_handled);
+  counter(w, "skipped", stats->skipped);
+  counter(w, "elapsed_ns", stats->elapsed_ns);
+  section_end(w);
+}
+
+static void write_tlbs(stats_writer_t *w, const ptw_sim_context_t *ctx) {
+  const struct {
+    const char *name;
+    const tlb_t *tlb;
+  } tlbs[] = {
+      {"l1_1g", ctx->oneg_tlb},
+      {"l1_2m", ctx->twom_tlb},
+      {"l1_4k", ctx->fourk_tlb},
+      {"stlb", ctx->stlb},
+  };
+
+  section_begin(w, "tlbs");
+  for (size_t i = 0; i < sizeof(tlbs) / sizeof(tlbs[0]); i++) {
+    const tlb_t *tlb = tlbs[i].tlb;
+    if (tlb == NULL) {
+      continue;
+    }
+    group_begin(w, tlbs[i].name);
+    counter(w, "sets", tlb->sets);
+    counter(w, "ways", tlb->ways);
+    counter(w, "hits", tlb->hits);
+    counter(w, "misses", tlb->misses);
+    counter(w, "evictions", tlb->evictions);
+    group_end(w);
+  }
+  section_end(w);
+}
+
+static void write_pwcs(stats_writer_t *w, const ptw_sim_context_t *ctx) {
+  static const char *names[PWC_LEVELS] = {"sdp", "pdp", "pde"};
+
+  section_begin(w, "pwcs");
+  for (int level = 0; level < PWC_LEVELS; level++) {
+    const pwc_t *pwc = ctx->pwc[level];
+    if (pwc == NULL) {
+      continue;
+    }
+    group_begin(w, names[level]);
+    counter(w, "sets", pwc->sets);
+    counter(w, "ways", pwc->ways);
+    counter(w, "hits", pwc->hits);
+    counter(w, "misses", pwc->misses);
+    counter(w, "evictions", pwc->evictions);
+    group_end(w);
+  }
+  section_end(w);
+}
+
+static void write_dcaches(stats_writer_t *w, const ptw_sim_context_t *ctx) {
+  static const char *names[CACHE_LEVELS] = {"l1d", "l2", "llc"};
+
+  section_begin(w, "dcaches");
+  for (int level = 0; level < CACHE_LEVELS; level++) {
+    const data_cache_t *cache = ctx->dcache[level];
+    if (cache == NULL) {
+      continue;
+    }
+    group_begin(w, names[level]);
+    counter(w, "sets", cache->sets);
+    counter(w, "ways", cache->ways);
+    counter(w, "line_size", cache->line_size);
+    counter(w, "hits", cache->hits);
+    counter(w, "misses", cache->misses);
+    counter(w, "evictions", cache->evictions);
+    group_end(w);
+  }
+  section_end(w);
+}
+
+static void write_walks(stats_writer_t *w, const walk_stats_t *stats) {
+  static const struct {
+    const char *name;
+    page_size_t size;
+  } sizes[] = {{"4k", FOUR_K}, {"2m", TWO_M}, {"1g", ONE_G}};
+  static const char *depths[PT_MAX_LEVELS + 1] = {"0", "1", "2",
+                                                   "3", "4", "5"};
+  static const char *faults[N_FAULT_CODES] = {
+      [EINVAL] = "not_present",
+      [EFAULT] = "malformed",
+      [EUNAUTHORIZED] = "permission",
+      [EACCESS] = "user_supervisor",
+  };
+
+  section_begin(w, "walks");
+  counter(w, "walks", stats->walks);
+  counter(w, "pt_reads", stats->pt_reads);
+  section_end(w);
+
+  section_begin(w, "walk_page_sizes");
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    counter(w, sizes[i].name, stats->leaves[sizes[i].size]);
+  }
+  section_end(w);
+
+  section_begin(w, "walk_depths");
+  for (int depth = 0; depth <= PT_MAX_LEVELS; depth++) {
+    counter(w, depths[depth], stats->depth[depth]);
+  }
+  section_end(w);
+
+  section_begin(w, "walk_faults");
+  for (int code = 1; code < N_FAULT_CODES; code++) {
+    counter(w, faults[code], stats->faults[code]);
+  }
+  section_end(w);
+}
+
+static void write_hpt(stats_writer_t *w, const hpt_stats_t *stats) {
+  static const char *refs[HPT_REFS_HIST + 1] = {"0", "1", "2", "3", "4",
+                                                "5", "6", "7", "8+"};
+
+  section_begin(w, "hashed_lookups");
+  counter(w, "lookups", stats->lookups);
+  counter(w, "probes", stats->probes);
+  counter(w, "mem_refs", stats->mem_refs);
+  section_end(w);
+
+  section_begin(w, "hashed_refs");
+  for (int i = 0; i <= HPT_REFS_HIST; i++) {
+    counter(w, refs[i], stats->refs[i]);
+  }
+  section_end(w);
+}
+
+static void write_ecpt(stats_writer_t *w, const ecpt_stats_t *stats) {
+  section_begin(w, "cuckoo_walks");
+  counter(w, "lookups", stats->lookups);
+  counter(w, "page_reads", stats->page_reads);
+  counter(w, "cwt_reads", stats->cwt_reads);
+  counter(w, "sizes_probed", stats->sizes_probed);
+  counter(w, "parallel_cycles", stats->parallel_cycles);
+  counter(w, "serial_cycles", stats->serial_cycles);
+  section_end(w);
+}
+
+static void write_cycles(stats_writer_t *w, const cycle_stats_t *stats) {
+  section_begin(w, "cycles");
+  counter(w, "translations", stats->translations);
+  counter(w, "total",
+          stats->tlb_cycles + stats->walk_cycles + stats->fault_cycles);
+  counter(w, "tlb", stats->tlb_cycles);
+  counter(w, "walk", stats->walk_cycles);
+  counter(w, "fault", stats->fault_cycles);
+  section_end(w);
+}
+
+static void write_shootdowns(stats_writer_t *w,
+                             const shootdown_stats_t *stats) {
+  section_begin(w, "shootdowns");
+  counter(w, "shootdowns", stats->shootdowns);
+  counter(w, "ipis", stats->ipis);
+  counter(w, "pages_invalidated", stats->pages_invalidated);
+  counter(w, "pid_flushes", stats->pid_flushes);
+  counter(w, "initiator_cycles", stats->initiator_cycles);
+  counter(w, "remote_cycles", stats->remote_cycles);
+  section_end(w);
+}
+
+static void write_invalidations(stats_writer_t *w,
+                                const invalidation_stats_t *stats) {
+  section_begin(w, "invalidations");
+  counter(w, "pages", stats->pages);
+  counter(w, "pid_flushes", stats->pid_flushes);
+  counter(w, "nonglobal_flushes", stats->nonglobal_flushes);
+  counter(w, "entries", stats->entries);
+  counter(w, "cycles", stats->cycles);
+  section_end(w);
+}
+
+static void write_pids(stats_writer_t *w, const ptw_sim_context_t *ctx) {
+  section_begin(w, "pids");
+  for (uint32_t pid = 0; pid < MAX_PID; pid++) {
+    const pid_stats_t *p = &ctx->pid_stats[pid];
+    if (p->translations == 0) {
+      continue;
+    }
+
+    char key[16];
+    snprintf(key, sizeof(key), "%u", pid);
+    group_begin(w, key);
+    counter(w, "translations", p->translations);
+    counter(w, "tlb_hits", p->tlb_hits);
+    counter(w, "stlb_hits", p->stlb_hits);
+    counter(w, "coalesced", p->coalesced);
+    counter(w, "walks", p->walks);
+    counter(w, "faults", p->faults);
+    counter(w, "cycles", p->cycles);
+    group_end(w);
+  }
+  section_end(w);
+}
+
+void write_stats(FILE *out, stats_format_t format, const ptw_sim_context_t *ctx,
+                 const replay_stats_t *replay) {
+  stats_writer_t w = {.out = out, .format = format, .first_section = true};
+
+  if (format == STATS_JSON) {
+    fputc('{', out);
+  } else {
+    fprintf(out, "section,component,counter,value\n");
+  }
+
+  if (replay != NULL) {
+    write_replay(&w, replay);
+  }
+  write_tlbs(&w, ctx);
+  write_pwcs(&w, ctx);
+  write_dcaches(&w, ctx);
+  write_walks(&w, &ctx->walk_stats);
+  if (ctx->pt_backend == PT_BACKEND_HASHED) {
+    write_hpt(&w, &ctx->hpt_stats);
+  } else if (ctx->pt_backend == PT_BACKEND_CUCKOO) {
+    write_ecpt(&w, &ctx->ecpt_stats);
+  }
+  write_cycles(&w, &ctx->cycle_stats);
+  write_shootdowns(&w, &ctx->shootdown_stats);
+  write_invalidations(&w, &ctx->invalidation_stats);
+  write_pids(&w, ctx);
+
+  if (format == STATS_JSON) {
+    fprintf(out, "\n}\n");
+  }
+}
+
+int export_stats(const char *path, stats_format_t format,
+                 const ptw_sim_context_t *ctx, const replay_stats_t *replay) {
+  FILE *out = fopen(path, "w");
+  if (out == NULL) {
+    perror("export_stats: fopen");
+    return -1;
+  }
+
+  write_stats(out, format, ctx, replay);
+
+  bool failed = ferror(out) != 0;
+  if (fclose(out) != 0 || failed) {
+    fprintf(stderr, "Failed to write statistics to %s.\n", path);
+    return -1;
+  }
+  return 0;
+}
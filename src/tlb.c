@@ -5,264 +5,452 @@
  */
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "event_trace.h"
 #include "hw_structures.h"
 #include "tlb.h"
+#include "tlb_match.h"
 
-void lru_evict(tlb_t *tlb) {
-  // For now, this is really more of a LFU algorithm.
-  // I have some ideas about something closer to LRU,
-  // but it will take a long time to formalize enough to write them here.
+/**
+ * Result of probing one TLB
+ */
+typedef enum tlb_probe {
+  TLB_PROBE_MISS = 0,
+  TLB_PROBE_HIT = 1,
+  TLB_PROBE_PERM_FAIL = 2,
+} tlb_probe_t;
 
-  // Find the lowest counter, and evict it
-  // Record the empty slot in the TLB's metadata
+/**
+ * Allocate a zeroed, cache-line aligned array for one TLB field
+ */
+static void *alloc_tlb_array(size_t n, size_t elem_size) {
+  size_t bytes = n * elem_size;
+  bytes = (bytes + TLB_ARRAY_ALIGN - 1) & ~((size_t)TLB_ARRAY_ALIGN - 1);
 
-  // If there are already empty slots, do nothing
-  if (tlb->slots_in_use != TLB_ENTRY_COUNT) {
-    return;
+  void *arr = aligned_alloc(TLB_ARRAY_ALIGN, bytes);
+  if (arr != NULL) {
+    memset(arr, 0, bytes);
   }
+  return arr;
+}
 
-  uint8_t min_counter = 0xff;
-  uint8_t evict_idx = 0;
-  for (int i = 0; i < TLB_ENTRY_COUNT; i++) {
-    if (tlb->arr[i].plru_counter < min_counter) {
-      min_counter = tlb->arr[i].plru_counter;
-      evict_idx = i;
-    } else {
-      // If not evicting, decrement counter
-      tlb->arr[i].plru_counter--;
-    }
+tlb_t *create_tlb(tlb_geometry_t geometry, uint8_t page_sizes,
+                  repl_policy_kind_t policy) {
+  // Set indexing masks the VPN, so the set count has to be a power of 2
+  if (geometry.sets == 0 || (geometry.sets & (geometry.sets - 1)) != 0 ||
+      geometry.ways == 0 || page_sizes == 0) {
+    return NULL;
   }
 
-  tlb->occupancy[evict_idx] = false;
-  tlb->slots_in_use--;
-}
-
-void update_tlb(tlb_t *tlb, address_context_t *a_ctx, uint64_t phys_frame) {
-  // Caller must guarantee that there is a free slot
+  tlb_t *tlb = (tlb_t *)calloc(1, sizeof(tlb_t));
+  if (tlb == NULL) {
+    return NULL;
+  }
 
-  int slot = -1;
-  for (int i = 0; i < TLB_ENTRY_COUNT; i++) {
-    if (!tlb->occupancy[i]) {
-      slot = i;
-      break;
-    }
+  tlb->sets = geometry.sets;
+  tlb->ways = geometry.ways;
+  tlb->set_mask = geometry.sets - 1;
+  tlb->page_sizes = page_sizes;
+
+  size_t n = (size_t)geometry.sets * geometry.ways;
+  tlb->tags = alloc_tlb_array(n, sizeof(uint64_t));
+  tlb->pids = alloc_tlb_array(n, sizeof(uint32_t));
+  tlb->phys_frames = alloc_tlb_array(n, sizeof(uint64_t));
+  tlb->permissions = alloc_tlb_array(n, sizeof(permissions_t));
+  tlb->user_supervisor = alloc_tlb_array(n, sizeof(uint8_t));
+  tlb->globals = alloc_tlb_array(n, sizeof(uint8_t));
+  tlb->slots_in_use = alloc_tlb_array(geometry.sets, sizeof(uint32_t));
+  tlb->policy = create_repl_policy(policy, geometry.sets, geometry.ways, 0);
+  if (tlb->tags == NULL || tlb->pids == NULL || tlb->phys_frames == NULL ||
+      tlb->permissions == NULL || tlb->user_supervisor == NULL ||
+      tlb->globals == NULL || tlb->slots_in_use == NULL ||
+      tlb->policy == NULL) {
+    destroy_tlb(tlb);
+    return NULL;
   }
 
-  if (slot == -1) {
+  flush_tlb(tlb);
+  return tlb;
+}
+
+void destroy_tlb(tlb_t *tlb) {
+  if (tlb == NULL) {
     return;
   }
 
-  tlb->occupancy[slot] = true;
-  tlb->slots_in_use++;
+  PTR_FREE(tlb->tags);
+  PTR_FREE(tlb->pids);
+  PTR_FREE(tlb->phys_frames);
+  PTR_FREE(tlb->permissions);
+  PTR_FREE(tlb->user_supervisor);
+  PTR_FREE(tlb->globals);
+  PTR_FREE(tlb->slots_in_use);
+  destroy_repl_policy(tlb->policy);
+  free(tlb);
+}
 
-  tlb->arr[slot].plru_counter = 0;
-  tlb->arr[slot].pid = a_ctx->pid;
-  tlb->arr[slot].permissions = a_ctx->permissions;
-  tlb->arr[slot].va = a_ctx->va;
-  tlb->arr[slot].phys_frame = phys_frame;
+void flush_tlb(tlb_t *tlb) {
+  size_t n = (size_t)tlb->sets * tlb->ways;
+  for (size_t i = 0; i < n; i++) {
+    tlb->tags[i] = TLB_INVALID_TAG;
+  }
+  memset(tlb->slots_in_use, 0, tlb->sets * sizeof(uint32_t));
+  reset_repl_policy(tlb->policy);
 }
 
-void update_tlbs(bool update_oneg, bool update_twom, bool update_fourk,
-                 ptw_sim_context_t *ctx, address_context_t *a_ctx) {
+/**
+ * Invalidate one entry of a full scan
+ */
+static inline void drop_tlb_entry(tlb_t *tlb, size_t i) {
+  tlb->tags[i] = TLB_INVALID_TAG;
+  tlb->slots_in_use[i / tlb->ways]--;
+}
 
-  if (update_oneg) {
-    lru_evict(ctx->oneg_tlb);
-    update_tlb(ctx->oneg_tlb, a_ctx, a_ctx->va);
+uint32_t flush_tlb_pid(tlb_t *tlb, uint32_t pid) {
+  size_t n = (size_t)tlb->sets * tlb->ways;
+  uint32_t dropped = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (tlb->tags[i] != TLB_INVALID_TAG && tlb->pids[i] == pid) {
+      drop_tlb_entry(tlb, i);
+      dropped++;
+    }
   }
+  return dropped;
+}
 
-  if (update_twom) {
-    lru_evict(ctx->twom_tlb);
-    update_tlb(ctx->twom_tlb, a_ctx, a_ctx->va);
+uint32_t flush_tlb_pid_nonglobal(tlb_t *tlb, uint32_t pid) {
+  size_t n = (size_t)tlb->sets * tlb->ways;
+  uint32_t dropped = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (tlb->tags[i] != TLB_INVALID_TAG && tlb->pids[i] == pid &&
+        !tlb->globals[i]) {
+      drop_tlb_entry(tlb, i);
+      dropped++;
+    }
   }
+  return dropped;
+}
 
-  if (update_fourk) {
-    lru_evict(ctx->fourk_tlb);
-    update_tlb(ctx->fourk_tlb, a_ctx, a_ctx->va);
+uint32_t flush_tlb_nonglobal(tlb_t *tlb) {
+  size_t n = (size_t)tlb->sets * tlb->ways;
+  uint32_t dropped = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (tlb->tags[i] != TLB_INVALID_TAG && !tlb->globals[i]) {
+      drop_tlb_entry(tlb, i);
+      dropped++;
+    }
   }
+  return dropped;
 }
 
-uintptr_t check_tlb(address_context_t *a_ctx, ptw_sim_context_t *ctx,
-                    tlb_update_ctx_t *tuc) {
-  /**
-   * First, check the TLB
-   * If hit, return;
-   *
-   * If miss:
-   * 	  pseudo-lru_evict()
-   * 	  wait for walk
-   *    add adress translation that we just ran to TLB
-   */
+uint32_t flush_tlb_pid_global_range(tlb_t *tlb, uint32_t pid, uint64_t first,
+                                    uint64_t last) {
+  size_t n = (size_t)tlb->sets * tlb->ways;
+  uint32_t dropped = 0;
+  for (size_t i = 0; i < n; i++) {
+    uint64_t tag = tlb->tags[i];
+    if (tag == TLB_INVALID_TAG || tlb->pids[i] != pid || !tlb->globals[i]) {
+      continue;
+    }
+    uint8_t shift = page_size_shift((page_size_t)(tag >> TLB_TAG_SIZE_SHIFT));
+    uint64_t base = (tag & TLB_TAG_VPN_MASK) << shift;
+    if (base <= last && base + ((1ULL << shift) - 1) >= first) {
+      drop_tlb_entry(tlb, i);
+      dropped++;
+    }
+  }
+  return dropped;
+}
 
-  /**
-   * Our TLB check will just walk through the TLB linearly
-   * Since we would implement the TLB as a set-associative structure (or CAM if
-   * we need it to be single-cycle), we can handle that in cycle counting later.
-   */
+uint32_t tlb_invalidate_page(tlb_t *tlb, uint64_t va, page_size_t page_size,
+                             uint32_t pid) {
+  if (!tlb_holds_size(tlb, page_size)) {
+    return 0;
+  }
 
-  /**
-   * Also, we'll walk in all sizes.
-   *
-   * In hardware, that'd be all 3 in parallel and then returning the biggest
-   * matching page
-   */
-  uintptr_t va = a_ctx->va;
-  uint32_t pid = a_ctx->pid;
-  permissions_t permissions = a_ctx->permissions;
-  uint8_t user_supervisor = a_ctx->user_supervisor;
+  // update_tlb() keeps one entry per page, but drop every match anyway so a
+  // stale copy can never outlive the invalidation
+  uint32_t set = tlb_set_index(tlb, va, page_size);
+  size_t base = (size_t)set * tlb->ways;
+  uint64_t tag = tlb_tag(va, page_size);
+  uint32_t dropped = 0;
+  int64_t way = -1;
+  while ((way = tlb_match(&tlb->tags[base], &tlb->pids[base], way + 1,
+                          tlb->ways, tag, pid)) >= 0) {
+    tlb->tags[base + way] = TLB_INVALID_TAG;
+    tlb->slots_in_use[set]--;
+    dropped++;
+  }
+  return dropped;
+}
 
-  bool update_oneg_tlb = false;
-  bool update_twom_tlb = false;
-  bool update_fourk_tlb = false;
-  tuc->oneg = update_oneg_tlb;
-  tuc->twom = update_twom_tlb;
-  tuc->fourk = update_fourk_tlb;
+void get_tlb_entry(const tlb_t *tlb, uint32_t idx, tlbe_t *tlbe) {
+  uint64_t tag = tlb->tags[idx];
+  tlbe->valid = tag != TLB_INVALID_TAG;
+  tlbe->page_size =
+      tlbe->valid ? (page_size_t)(tag >> TLB_TAG_SIZE_SHIFT) : PG_SIZE_MAX;
+  tlbe->va = tlbe->valid
+                 ? (tag & TLB_TAG_VPN_MASK) << page_size_shift(tlbe->page_size)
+                 : 0;
+  tlbe->pid = tlb->pids[idx];
+  tlbe->phys_frame = tlb->phys_frames[idx];
+  tlbe->permissions = tlb->permissions[idx];
+  tlbe->user_supervisor = tlb->user_supervisor[idx];
+  tlbe->global = tlb->globals[idx];
+}
 
-  tlb_t *tlb = ctx->oneg_tlb;
+void print_tlb_stats(FILE *out, const char *name, const tlb_t *tlb) {
+  uint64_t lookups = tlb->hits + tlb->misses;
+  double miss_rate = lookups ? 100.0 * tlb->misses / lookups : 0.0;
+  fprintf(out,
+          "%-8s %5ux%-3u %-10s hits %-12lu misses %-12lu (%6.2f%%) "
+          "evictions %lu\n",
+          name, tlb->sets, tlb->ways, repl_policy_name(tlb->policy->kind),
+          tlb->hits, tlb->misses, miss_rate, tlb->evictions);
+}
 
-  for (int i = 0; i < TLB_ENTRY_COUNT; i++) {
+void tlb_evict(tlb_t *tlb, uint64_t va, page_size_t page_size) {
+  // The policy picks the victim. The TLB only records the empty slot in its
+  // metadata.
 
-    tlbe_t tlbe = tlb->arr[i];
+  uint32_t set = tlb_set_index(tlb, va, page_size);
 
-    // If the PID doesn't match, continue
-    if (pid != tlbe.pid) {
-      continue;
-    }
+  // If there are already empty slots, do nothing
+  if (tlb->slots_in_use[set] != tlb->ways) {
+    return;
+  }
 
-    // If the address doesn't match continue
-    // Address math for oneg is top (VA size - 30b)
-    if ((VPN_MASK_1GB & va) != (VPN_MASK_1GB & tlbe.va)) {
-      continue;
-    }
+  uint32_t evict_idx = repl_victim(tlb->policy, set);
+  size_t slot = (size_t)set * tlb->ways + evict_idx;
 
-    // If the permissions don't match, don't continue. Return failure. There
-    // can't be another page in the TLB that matches but has different
-    // permissions
-    if (!check_permissions(permissions, tlbe.permissions)) {
-      return SIXTY_FOUR_BIT_MASK;
+  TRACE_TLB_EVENT(EVENT_TLB_EVICT, tlb->trace_unit, tlb->pids[slot],
+                  (tlb->tags[slot] & TLB_TAG_VPN_MASK) << page_size_shift(
+                      (page_size_t)(tlb->tags[slot] >> TLB_TAG_SIZE_SHIFT)));
+  tlb->tags[slot] = TLB_INVALID_TAG;
+  tlb->slots_in_use[set]--;
+  tlb->evictions++;
+}
+
+void update_tlb(tlb_t *tlb, const tlbe_t *entry) {
+  uint32_t set = tlb_set_index(tlb, entry->va, entry->page_size);
+  size_t base = (size_t)set * tlb->ways;
+  uint64_t tag = tlb_tag(entry->va, entry->page_size);
+
+  // Refilling a page the set already holds, say after a permission miss,
+  // rewrites its entry. A page never takes two ways.
+  int64_t way = tlb_match(&tlb->tags[base], &tlb->pids[base], 0, tlb->ways,
+                          tag, entry->pid);
+  if (way >= 0) {
+    repl_on_hit(tlb->policy, set, (uint32_t)way);
+  } else {
+    tlb_evict(tlb, entry->va, entry->page_size);
+    for (uint32_t i = 0; i < tlb->ways; i++) {
+      if (tlb->tags[base + i] == TLB_INVALID_TAG) {
+        way = i;
+        break;
+      }
     }
 
-    // If user_supervisor is not identical, contine. Kernel and user have
-    // different address spaces
-    if (user_supervisor != tlbe.user_supervisor) {
-      continue;
+    if (way == -1) {
+      return;
     }
 
-    // If we get here, we found our match. Return the address. The VPN gets
-    // replaced by the physical frame, and the offset is identical
-    uintptr_t address = 0;
-    address |= (tlbe.phys_frame & VPN_MASK_1GB);
-    address |= (OFFSET_MASK_1GB & va);
+    tlb->slots_in_use[set]++;
+    repl_on_fill(tlb->policy, set, way);
+  }
 
-    // On hit, update the PLRU counter
-    tlb->arr[i].plru_counter = sat_inc(tlb->arr[i].plru_counter);
+  size_t slot = base + way;
+  tlb->tags[slot] = tag;
+  tlb->pids[slot] = entry->pid;
+  tlb->user_supervisor[slot] = entry->user_supervisor;
+  tlb->permissions[slot] = entry->permissions;
+  tlb->phys_frames[slot] = entry->phys_frame;
+  tlb->globals[slot] = entry->global;
+}
 
-    return address;
+void update_tlbs(bool update_oneg, bool update_twom, bool update_fourk,
+                 ptw_sim_context_t *ctx, const tlbe_t *entry) {
+
+  if (update_oneg) {
+    update_tlb(ctx->oneg_tlb, entry);
   }
 
-  update_oneg_tlb = true;
-  tuc->oneg = update_oneg_tlb;
-  tuc->twom = update_twom_tlb;
-  tuc->fourk = update_fourk_tlb;
+  if (update_twom) {
+    update_tlb(ctx->twom_tlb, entry);
+  }
 
-  tlb = ctx->twom_tlb;
-  for (int i = 0; i < TLB_ENTRY_COUNT; i++) {
+  if (update_fourk) {
+    update_tlb(ctx->fourk_tlb, entry);
+  }
+}
 
-    tlbe_t tlbe = tlb->arr[i];
+void update_stlb(ptw_sim_context_t *ctx, const tlbe_t *entry) {
+  if (ctx->stlb == NULL || !tlb_holds_size(ctx->stlb, entry->page_size)) {
+    return;
+  }
 
-    // If the PID doesn't match, continue
-    if (pid != tlbe.pid) {
-      continue;
-    }
+  update_tlb(ctx->stlb, entry);
+}
 
-    // If the address doesn't match continue
-    // Address math for oneg is top (VA size - 30b)
-    if ((VPN_MASK_2MB & va) != (VPN_MASK_2MB & tlbe.va)) {
-      continue;
-    }
+/**
+ * Probe the ways of the set `va` maps to as a page of `page_size`
+ *
+ * On a hit, the translated address is written to `pa` and the index of the
+ * entry to `slot`. Hit/miss counting is left to the caller, since the STLB
+ * probes several times per lookup.
+ */
+static inline tlb_probe_t probe_tlb(tlb_t *tlb, address_context_t *a_ctx,
+                                    page_size_t page_size, uintptr_t *pa,
+                                    size_t *slot) {
+  uintptr_t va = a_ctx->va;
+  uint64_t offset_mask = (1ULL << page_size_shift(page_size)) - 1;
+  uint64_t tag = tlb_tag(va, page_size);
+  uint32_t set = tlb_set_index(tlb, va, page_size);
+  size_t base = (size_t)set * tlb->ways;
+
+  // Empty ways hold TLB_INVALID_TAG, so they never match
+  int64_t i = -1;
+  while ((i = tlb_match(&tlb->tags[base], &tlb->pids[base], i + 1, tlb->ways,
+                        tag, a_ctx->pid)) >= 0) {
+    size_t e = base + i;
 
     // If the permissions don't match, don't continue. Return failure. There
     // can't be another page in the TLB that matches but has different
     // permissions
-    if (!check_permissions(permissions, tlbe.permissions)) {
-      return SIXTY_FOUR_BIT_MASK;
+    if (!check_permissions(a_ctx->permissions, tlb->permissions[e])) {
+      return TLB_PROBE_PERM_FAIL;
     }
 
     // If user_supervisor is not identical, contine. Kernel and user have
     // different address spaces
-    if (user_supervisor != tlbe.user_supervisor) {
+    if (a_ctx->user_supervisor != tlb->user_supervisor[e]) {
       continue;
     }
 
-    // On hit, update the PLRU counter
-    tlb->arr[i].plru_counter = sat_inc(tlb->arr[i].plru_counter);
+    // On hit, let the replacement policy know
+    repl_on_hit(tlb->policy, set, (uint32_t)i);
 
     // If we get here, we found our match. Return the address. The VPN gets
     // replaced by the physical frame, and the offset is identical
-    uintptr_t address = 0;
-    address |= (tlbe.phys_frame & VPN_MASK_2MB);
-    address |= (OFFSET_MASK_2MB & va);
-
-    return address;
+    *pa = (tlb->phys_frames[e] & ~offset_mask) | (offset_mask & va);
+    *slot = e;
+    return TLB_PROBE_HIT;
   }
 
-  update_twom_tlb = true;
-  tuc->oneg = update_oneg_tlb;
-  tuc->twom = update_twom_tlb;
-  tuc->fourk = update_fourk_tlb;
-
-  tlb = ctx->fourk_tlb;
-  for (int i = 0; i < TLB_ENTRY_COUNT; i++) {
+  return TLB_PROBE_MISS;
+}
 
-    tlbe_t tlbe = tlb->arr[i];
+/**
+ * Probe an L1 TLB, which holds a single page size, and count the lookup
+ */
+static inline tlb_probe_t probe_l1_tlb(tlb_t *tlb, address_context_t *a_ctx,
+                                       page_size_t page_size, uintptr_t *pa) {
+  size_t slot;
+  tlb_probe_t probe = probe_tlb(tlb, a_ctx, page_size, pa, &slot);
+  if (probe == TLB_PROBE_HIT) {
+    tlb->hits++;
+    TRACE_TLB_EVENT(EVENT_TLB_HIT, tlb->trace_unit, a_ctx->pid, a_ctx->va);
+  } else {
+    tlb->misses++;
+    TRACE_TLB_EVENT(EVENT_TLB_MISS, tlb->trace_unit, a_ctx->pid, a_ctx->va);
+  }
+  return probe;
+}
 
-    // If the PID doesn't match, continue
-    if (pid != tlbe.pid) {
-      continue;
-    }
+uintptr_t check_tlb(address_context_t *a_ctx, ptw_sim_context_t *ctx,
+                    tlb_update_ctx_t *tuc) {
+  /**
+   * First, check the TLB
+   * If hit, return;
+   *
+   * If miss:
+   * 	  tlb_evict()
+   * 	  wait for walk
+   *    add adress translation that we just ran to TLB
+   */
 
-    // If the address doesn't match continue
-    // Address math for oneg is top (VA size - 30b)
-    if ((VPN_MASK_4KB & va) != (VPN_MASK_4KB & tlbe.va)) {
-      continue;
-    }
+  /**
+   * Each TLB is set-associative. Only the ways of the set picked by the VPN
+   * are compared, so lookup cost is O(ways) regardless of TLB size. The ways
+   * are compared several at a time by tlb_match().
+   */
 
-    // If the permissions don't match, don't continue. Return failure. There
-    // can't be another page in the TLB that matches but has different
-    // permissions
-    if (!check_permissions(permissions, tlbe.permissions)) {
-      return SIXTY_FOUR_BIT_MASK;
-    }
+  /**
+   * Also, we'll walk in all sizes.
+   *
+   * In hardware, that'd be all 3 in parallel and then returning the biggest
+   * matching page
+   */
+  uintptr_t address = 0;
+  tlb_probe_t probe;
 
-    // If user_supervisor is not identical, contine. Kernel and user have
-    // different address spaces
-    if (user_supervisor != tlbe.user_supervisor) {
-      continue;
-    }
+  tuc->oneg = false;
+  tuc->twom = false;
+  tuc->fourk = false;
 
-    // On hit, update the PLRU counter
-    tlb->arr[i].plru_counter = sat_inc(tlb->arr[i].plru_counter);
+  probe = probe_l1_tlb(ctx->oneg_tlb, a_ctx, ONE_G, &address);
+  if (probe == TLB_PROBE_HIT) {
+    return address;
+  }
+  if (probe == TLB_PROBE_PERM_FAIL) {
+    return SIXTY_FOUR_BIT_MASK;
+  }
+  tuc->oneg = true;
 
-    // If we get here, we found our match. Return the address. The VPN gets
-    // replaced by the physical frame, and the offset is identical
-    uintptr_t address = 0;
-    address |= (tlbe.phys_frame & VPN_MASK_4KB);
-    address |= (OFFSET_MASK_4KB & va);
+  probe = probe_l1_tlb(ctx->twom_tlb, a_ctx, TWO_M, &address);
+  if (probe == TLB_PROBE_HIT) {
+    return address;
+  }
+  if (probe == TLB_PROBE_PERM_FAIL) {
+    return SIXTY_FOUR_BIT_MASK;
+  }
+  tuc->twom = true;
 
+  probe = probe_l1_tlb(ctx->fourk_tlb, a_ctx, FOUR_K, &address);
+  if (probe == TLB_PROBE_HIT) {
     return address;
   }
+  if (probe == TLB_PROBE_PERM_FAIL) {
+    return SIXTY_FOUR_BIT_MASK;
+  }
+  tuc->fourk = true;
 
-  update_fourk_tlb = true;
-  tuc->oneg = update_oneg_tlb;
-  tuc->twom = update_twom_tlb;
-  tuc->fourk = update_fourk_tlb;
+  // Evictions / populations are left to the caller. Only the walk knows which
+  // page size the translation belongs to, so only it knows which TLB to fill.
 
-  // Only do the LRU evictions / populations here.
-  // Because if we hit on one of them, there's no point in calling update on
-  // all 3. They will only map once.
+  // If we get here, it is a TLB miss.
+  return SIXTY_FOUR_BIT_MASK;
+}
 
-  update_tlbs(update_oneg_tlb, update_twom_tlb, update_fourk_tlb, ctx, a_ctx);
+uintptr_t check_stlb(address_context_t *a_ctx, ptw_sim_context_t *ctx,
+                     tlbe_t *hit) {
+  static const page_size_t sizes[] = {FOUR_K, TWO_M, ONE_G};
+  tlb_t *stlb = ctx->stlb;
+  uintptr_t address = 0;
 
-  // If we get here, it is a TLB miss.
+  // Hardware probes the sizes in parallel (or hashes them into one lookup).
+  // A VA is mapped by at most one page, so the order doesn't matter here.
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    if (!tlb_holds_size(stlb, sizes[i])) {
+      continue;
+    }
+
+    size_t slot;
+    tlb_probe_t probe = probe_tlb(stlb, a_ctx, sizes[i], &address, &slot);
+    if (probe == TLB_PROBE_HIT) {
+      stlb->hits++;
+      TRACE_TLB_EVENT(EVENT_TLB_HIT, stlb->trace_unit, a_ctx->pid, a_ctx->va);
+      get_tlb_entry(stlb, (uint32_t)slot, hit);
+      return address;
+    }
+    if (probe == TLB_PROBE_PERM_FAIL) {
+      break;
+    }
+  }
+
+  stlb->misses++;
+  TRACE_TLB_EVENT(EVENT_TLB_MISS, stlb->trace_unit, a_ctx->pid, a_ctx->va);
   return SIXTY_FOUR_BIT_MASK;
-}
\ No newline at end of file
+}
@@ -5,32 +5,253 @@
 
 #include "translation.h"
 
+#include "address_space.h"
+#include "hw_pte.h"
 #include "page_table.h"
 #include "tlb.h"
 
-uintptr_t translate(address_context_t *a_ctx, ptw_sim_context_t *ctx) {
+/**
+ * Charge a translation's cycles to the context and count it for its PID
+ */
+static inline uint32_t charge(ptw_sim_context_t *ctx, uint32_t pid,
+                              translation_source_t source,
+                              uint32_t tlb_cycles, uint32_t walk_cycles,
+                              uint32_t fault_cycles) {
+  uint32_t cycles = tlb_cycles + walk_cycles + fault_cycles;
+  cycle_stats_t *stats = &ctx->cycle_stats;
+  stats->translations++;
+  stats->tlb_cycles += tlb_cycles;
+  stats->walk_cycles += walk_cycles;
+  stats->fault_cycles += fault_cycles;
+
+  if (pid >= MAX_PID) {
+    return cycles;
+  }
+
+  pid_stats_t *p = &ctx->pid_stats[pid];
+  p->translations++;
+  p->cycles += cycles;
+  switch (source) {
+  case TRANSLATION_TLB:
+    p->tlb_hits++;
+    break;
+  case TRANSLATION_STLB:
+    p->stlb_hits++;
+    break;
+  case TRANSLATION_WALK:
+    p->walks++;
+    break;
+  case TRANSLATION_COALESCED:
+    p->coalesced++;
+    break;
+  case TRANSLATION_FAULT:
+    p->faults++;
+    break;
+  }
+  return cycles;
+}
+
+/**
+ * translate(), also reporting which structure resolved the access and how
+ * many cycles it took
+ */
+static uintptr_t translate_one(address_context_t *a_ctx,
+                               ptw_sim_context_t *ctx,
+                               translation_source_t *source,
+                               uint32_t *cycles) {
 
   tlb_update_ctx_t tuc = {0};
+  uint32_t tlb_cycles = ctx->latency.l1_tlb;
+
+  // Whatever this core caches for the PID now needs shooting down when the
+  // PID's mappings change
+  if (a_ctx->pid < MAX_PID) {
+    ctx->cores[ctx->current_core].pid_mask |= 1ULL << a_ctx->pid;
+  }
 
   // Try the TLB
   // Eviction (if necessary) is handled inside this call
   // This call tells us which TLBs to update as well - via output params
   // bool update_fourk_tlb, update_twom_tlb, udpate_oneg_tlb;
   uintptr_t translated_addr = check_tlb(a_ctx, ctx, &tuc);
+  if (translated_addr != SIXTY_FOUR_BIT_MASK) {
+    *source = TRANSLATION_TLB;
+    *cycles = charge(ctx, a_ctx->pid, *source, tlb_cycles, 0, 0);
+    return translated_addr;
+  }
+
+  // Try the STLB. A hit refills the L1 TLB of the page size that hit.
+  if (ctx->stlb != NULL) {
+    tlbe_t hit;
+    tlb_cycles += ctx->latency.stlb;
+    translated_addr = check_stlb(a_ctx, ctx, &hit);
+    if (translated_addr != SIXTY_FOUR_BIT_MASK) {
+      update_tlbs(tuc.oneg && hit.page_size == ONE_G,
+                  tuc.twom && hit.page_size == TWO_M,
+                  tuc.fourk && hit.page_size == FOUR_K, ctx, &hit);
+      *source = TRANSLATION_STLB;
+      *cycles = charge(ctx, a_ctx->pid, *source, tlb_cycles, 0, 0);
+      return translated_addr;
+    }
+  }
 
   // Walk the page table
-  translated_addr = walk(a_ctx, ctx);
+  walk_ctx_t w_ctx = {0};
+  translated_addr = walk(a_ctx, ctx, &w_ctx);
 
   // If it's still invalid, then we fault. This would result in going to the OS
   // and having the OS swap pages around For now, it's just a fault and is out
   // of scope of this project.
-  if (translated_addr == SIXTY_FOUR_BIT_MASK) {
-    return SIXTY_FOUR_BIT_MASK;
+  if (IS_FAULT(translated_addr)) {
+    *source = TRANSLATION_FAULT;
+    *cycles = charge(ctx, a_ctx->pid, *source, tlb_cycles, w_ctx.cycles,
+                     ctx->latency.fault);
+    return translated_addr;
   }
 
-  // Publish the found address into the TLB
-  // An entry is guaranteed to be free here since we already did the eviction
-  update_tlbs(tuc.oneg, tuc.twom, tuc.fourk, ctx, a_ctx);
+  // Publish the found address into the TLB for the page size the walk found
+  // update_tlbs() evicts first if the TLB is full. The entry carries the
+  // leaf's rights, so a later access the page allows hits whatever this one
+  // asked for.
+  tlbe_t leaf = {.va = a_ctx->va,
+                 .phys_frame = translated_addr,
+                 .user_supervisor = w_ctx.user_supervisor,
+                 .permissions = w_ctx.permissions,
+                 .pid = a_ctx->pid,
+                 .page_size = w_ctx.page_size,
+                 .global = w_ctx.global,
+                 .valid = 1};
+  update_tlbs(tuc.oneg && w_ctx.page_size == ONE_G,
+              tuc.twom && w_ctx.page_size == TWO_M,
+              tuc.fourk && w_ctx.page_size == FOUR_K, ctx, &leaf);
+  update_stlb(ctx, &leaf);
 
+  *source = TRANSLATION_WALK;
+  *cycles = charge(ctx, a_ctx->pid, *source, tlb_cycles, w_ctx.cycles, 0);
   return translated_addr;
 }
+
+uintptr_t translate(address_context_t *a_ctx, ptw_sim_context_t *ctx) {
+  translation_source_t source;
+  uint32_t cycles;
+  return translate_one(a_ctx, ctx, &source, &cycles);
+}
+
+uintptr_t translate_timed(address_context_t *a_ctx, ptw_sim_context_t *ctx,
+                          uint32_t *cycles) {
+  translation_source_t source;
+  return translate_one(a_ctx, ctx, &source, cycles);
+}
+
+/**
+ * True if `b` can reuse the translation of `a`: same 4K page, same address
+ * space, same access rights. The page might be bigger than 4K, but a 4K
+ * match is always safe.
+ */
+static inline bool same_page(const address_context_t *a,
+                             const address_context_t *b) {
+  return (a->va >> PTE_STARTING_BIT) == (b->va >> PTE_STARTING_BIT) &&
+         a->pid == b->pid && a->user_supervisor == b->user_supervisor &&
+         a->permissions.raw == b->permissions.raw;
+}
+
+/**
+ * Prefetch the entry a walk for `a_ctx` would end on
+ *
+ * Follows table pointers without any checks or counting. The upper levels
+ * are few and almost always in the host's cache, so the entry worth
+ * prefetching is the leaf.
+ */
+static inline void prefetch_walk(const ptw_sim_context_t *ctx,
+                                 const address_context_t *a_ctx) {
+  if (a_ctx->pid >= MAX_PID) {
+    return;
+  }
+
+  // A hashed lookup starts at the bucket of the smallest size
+  if (ctx->pt_backend == PT_BACKEND_HASHED) {
+    uint8_t sizes = hpt_page_sizes(ctx->hpt, a_ctx->pid);
+    if (sizes != 0) {
+      page_size_t size = (page_size_t)__builtin_ctz(sizes);
+      __builtin_prefetch(
+          hpt_bucket(ctx->hpt, a_ctx->pid, tlb_tag(a_ctx->va, size)));
+    }
+    return;
+  }
+
+  // A cuckoo walk reads every way at once, so prefetch the smallest size's
+  if (ctx->pt_backend == PT_BACKEND_CUCKOO) {
+    const ecpt_t *ecpt = ctx->ecpt[a_ctx->pid];
+    uint8_t sizes = ecpt != NULL ? ecpt_page_sizes(ecpt) : 0;
+    if (sizes != 0) {
+      page_size_t size = (page_size_t)__builtin_ctz(sizes);
+      for (int way = 0; way < ECPT_WAYS; way++) {
+        __builtin_prefetch(ecpt_probe(&ecpt->pages[size], way,
+                                      a_ctx->va >> page_size_shift(size)));
+      }
+    }
+    return;
+  }
+
+  const pt_level_desc_t *levels = pt_geometry(ctx);
+  uint8_t n_levels = pt_n_levels(ctx);
+  const void *table = ctx->page_table_pointers[a_ctx->pid];
+  for (uint8_t level = 0; table != NULL && level < n_levels; level++) {
+    size_t index = pt_level_index(&levels[level], a_ctx->va);
+    if (ctx->pte_format == PTE_FORMAT_HW) {
+      const hw_pte_t *entry = &((const hw_pte_t *)table)[index];
+      if (!hw_pte_is_table(*entry, pt_level_leaf_size(&levels[level]))) {
+        __builtin_prefetch(entry);
+        return;
+      }
+      table = (const void *)hw_pte_addr(*entry);
+      continue;
+    }
+
+    const pte_t *entry = &((const pte_t *)table)[index];
+    if (level == n_levels - 1 || !is_table_pointer(entry)) {
+      __builtin_prefetch(entry);
+      return;
+    }
+    table = (const void *)entry->phys_frame.oneg_pte_index;
+  }
+}
+
+size_t translate_batch(ptw_sim_context_t *ctx, const address_context_t *in,
+                       size_t n, translation_result_t *out) {
+  for (size_t i = 0; i < n; i++) {
+    size_t ahead = i + TRANSLATE_PREFETCH_DISTANCE;
+    if (ahead < n && !same_page(&in[ahead - 1], &in[ahead])) {
+      prefetch_walk(ctx, &in[ahead]);
+    }
+
+    // The previous access succeeded, or the batch would have stopped
+    if (i > 0 && same_page(&in[i - 1], &in[i])) {
+      uint64_t offset_mask = (1ULL << PTE_STARTING_BIT) - 1;
+      out[i].pa = (out[i - 1].pa & ~offset_mask) | (in[i].va & offset_mask);
+      out[i].source = TRANSLATION_COALESCED;
+      out[i].cycles = charge(ctx, in[i].pid, out[i].source,
+                             ctx->latency.l1_tlb, 0, 0);
+      continue;
+    }
+
+    address_context_t a_ctx = in[i];
+    out[i].pa = translate_one(&a_ctx, ctx, &out[i].source, &out[i].cycles);
+    if (out[i].source == TRANSLATION_FAULT) {
+      return i + 1;
+    }
+  }
+
+  return n;
+}
+
+void print_cycle_stats(FILE *out, const ptw_sim_context_t *ctx) {
+  const cycle_stats_t *stats = &ctx->cycle_stats;
+  uint64_t total = stats->tlb_cycles + stats->walk_cycles + stats->fault_cycles;
+  double per_translation =
+      stats->translations ? (double)total / stats->translations : 0.0;
+  fprintf(out, "Cycles:           %lu (%.2f per translation)\n", total,
+          per_translation);
+  fprintf(out, "  TLB %lu, walk %lu, fault %lu\n", stats->tlb_cycles,
+          stats->walk_cycles, stats->fault_cycles);
+}
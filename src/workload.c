@@ -0,0 +1,332 @@
+/**
+ * @file workload.c
+ *
+ * Synthetic address streams
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "workload.h"
+
+#define WORKLOAD_PAGE_SHIFT 12
+#define WORKLOAD_LINE_SIZE 64
+#define WORKLOAD_WORD_SIZE 8
+#define WORKLOAD_DEFAULT_SEED 0x2545F4914F6CDD1DULL
+#define WORKLOAD_DEFAULT_FOOTPRINT (64ULL << 20)
+#define WORKLOAD_DEFAULT_VA 0x10000000000ULL
+#define WORKLOAD_DEFAULT_ZIPF_S 0.99
+#define WORKLOAD_DEFAULT_QUANTUM 1000
+
+// Full-period LCG modulo any power of 2: a = 1 mod 4 and c is odd
+#define CHASE_LCG_A 6364136223846793005ULL
+#define CHASE_LCG_C 1442695040888963407ULL
+
+static const char *kind_names[WORKLOAD_KIND_MAX] = {
+    [WORKLOAD_SEQUENTIAL] = "sequential",
+    [WORKLOAD_STRIDE] = "stride",
+    [WORKLOAD_UNIFORM] = "uniform",
+    [WORKLOAD_ZIPF] = "zipf",
+    [WORKLOAD_POINTER_CHASE] = "pointer-chase",
+    [WORKLOAD_GUPS] = "gups",
+};
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t next_rand(workload_t *w) {
+  uint64_t x = w->rng;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  w->rng = x;
+  return x;
+}
+
+/**
+ * Uniform double in [0, 1)
+ */
+static double next_unit(workload_t *w) {
+  return (double)(next_rand(w) >> 11) / (double)(1ULL << 53);
+}
+
+/**
+ * Zipf sampling by rejection-inversion (Hörmann and Derflinger, 1996). Draws
+ * a rank in [1, n_pages] in constant expected time, without a table.
+ */
+
+// log1p(x) / x, accurate near 0
+static double zipf_helper1(double x) {
+  return fabs(x) > 1e-8 ? log1p(x) / x : 1.0 - x / 2.0 + x * x / 3.0;
+}
+
+// expm1(x) / x, accurate near 0
+static double zipf_helper2(double x) {
+  return fabs(x) > 1e-8 ? expm1(x) / x : 1.0 + x / 2.0 + x * x / 6.0;
+}
+
+// Integral of h(x) = x^-s, shifted so that it is continuous at s = 1
+static double zipf_h_integral(double s, double x) {
+  double log_x = log(x);
+  return zipf_helper2((1.0 - s) * log_x) * log_x;
+}
+
+static double zipf_h(double s, double x) { return exp(-s * log(x)); }
+
+static double zipf_h_integral_inv(double s, double x) {
+  double t = x * (1.0 - s);
+  if (t < -1.0) {
+    // Rounding pushed x out of the domain
+    t = -1.0;
+  }
+  return exp(zipf_helper1(t) * x);
+}
+
+static uint64_t zipf_rank(workload_t *w) {
+  double s = w->cfg.zipf_s;
+  for (;;) {
+    double u = w->zipf_h_n + next_unit(w) * (w->zipf_h_x1 - w->zipf_h_n);
+    double x = zipf_h_integral_inv(s, u);
+    double k = floor(x + 0.5);
+    if (k < 1.0) {
+      k = 1.0;
+    } else if (k > (double)w->n_pages) {
+      k = (double)w->n_pages;
+    }
+    if (k - x <= w->zipf_slack ||
+        u >= zipf_h_integral(s, k + 0.5) - zipf_h(s, k)) {
+      return (uint64_t)k;
+    }
+  }
+}
+
+/**
+ * Next page of a PID's pointer chase. The LCG state runs through every value
+ * below chase_mask + 1 once per period. A bijective scramble breaks up the
+ * regular low bits, and values past the footprint are skipped.
+ */
+static uint64_t next_chase_page(workload_t *w, uint64_t *state) {
+  uint64_t mask = w->chase_mask;
+  int shift = (__builtin_popcountll(mask) + 1) / 2;
+
+  for (;;) {
+    *state = (*state * CHASE_LCG_A + CHASE_LCG_C) & mask;
+    uint64_t page = (*state * 0x9E3779B97F4A7C15ULL) & mask;
+    if (shift > 0) {
+      page ^= page >> shift;
+    }
+    if (page < w->n_pages) {
+      return page;
+    }
+  }
+}
+
+void default_workload_config(workload_config_t *cfg) {
+  *cfg = (workload_config_t){
+      .kind = WORKLOAD_UNIFORM,
+      .base_va = WORKLOAD_DEFAULT_VA,
+      .footprint = WORKLOAD_DEFAULT_FOOTPRINT,
+      .stride = 1ULL << WORKLOAD_PAGE_SHIFT,
+      .zipf_s = WORKLOAD_DEFAULT_ZIPF_S,
+      .first_pid = 1,
+      .n_pids = 1,
+      .pid_quantum = WORKLOAD_DEFAULT_QUANTUM,
+      .write_percent = 0,
+      .seed = 0,
+  };
+}
+
+int workload_init(workload_t *w, const workload_config_t *cfg) {
+  const uint64_t page_mask = (1ULL << WORKLOAD_PAGE_SHIFT) - 1;
+
+  if (cfg->kind >= WORKLOAD_KIND_MAX) {
+    fprintf(stderr, "Unknown workload kind %d.\n", cfg->kind);
+    return -1;
+  }
+  if (cfg->footprint == 0 || (cfg->footprint & page_mask) != 0 ||
+      (cfg->base_va & page_mask) != 0) {
+    fprintf(stderr,
+            "Workload base and footprint must be 4K aligned, and the "
+            "footprint non-zero.\n");
+    return -1;
+  }
+  // Whether the region is mappable depends on the paging mode, so only the
+  // widest one is checked here
+  if (cfg->base_va >= (1ULL << VA_SIZE_LA57) ||
+      cfg->footprint > (1ULL << VA_SIZE_LA57) - cfg->base_va) {
+    fprintf(stderr, "Workload region does not fit in the address space.\n");
+    return -1;
+  }
+  if (cfg->n_pids == 0 || cfg->first_pid >= MAX_PID ||
+      cfg->n_pids > MAX_PID - cfg->first_pid) {
+    fprintf(stderr, "Workload PIDs must be between 0 and %d.\n", MAX_PID - 1);
+    return -1;
+  }
+  if (cfg->pid_quantum == 0) {
+    fprintf(stderr, "Workload PID quantum must be non-zero.\n");
+    return -1;
+  }
+  if (cfg->write_percent > 100) {
+    fprintf(stderr, "Workload write share must be at most 100%%.\n");
+    return -1;
+  }
+  if (cfg->kind == WORKLOAD_STRIDE && cfg->stride == 0) {
+    fprintf(stderr, "Workload stride must be non-zero.\n");
+    return -1;
+  }
+  if (cfg->kind == WORKLOAD_ZIPF && !(cfg->zipf_s > 0.0)) {
+    fprintf(stderr, "Zipf skew must be positive.\n");
+    return -1;
+  }
+
+  memset(w, 0, sizeof(*w));
+  w->cfg = *cfg;
+  w->rng = cfg->seed != 0 ? cfg->seed : WORKLOAD_DEFAULT_SEED;
+  w->n_pages = cfg->footprint >> WORKLOAD_PAGE_SHIFT;
+  w->quantum_left = cfg->pid_quantum;
+
+  if (cfg->kind == WORKLOAD_POINTER_CHASE) {
+    uint64_t m = 1;
+    while (m < w->n_pages) {
+      m <<= 1;
+    }
+    w->chase_mask = m - 1;
+    // Each PID starts at a different point of the cycle
+    for (uint32_t i = 0; i < cfg->n_pids; i++) {
+      w->cursor[cfg->first_pid + i] = next_rand(w) & w->chase_mask;
+    }
+  } else if (cfg->kind == WORKLOAD_ZIPF) {
+    double s = cfg->zipf_s;
+    w->zipf_h_x1 = zipf_h_integral(s, 1.5) - 1.0;
+    w->zipf_h_n = zipf_h_integral(s, (double)w->n_pages + 0.5);
+    w->zipf_slack =
+        2.0 - zipf_h_integral_inv(s, zipf_h_integral(s, 2.5) - zipf_h(s, 2.0));
+  }
+  return 0;
+}
+
+void workload_next(workload_t *w, address_context_t *a_ctx) {
+  const workload_config_t *cfg = &w->cfg;
+
+  // A GUPS update writes back the word it just read, in the same time slice
+  if (w->write_pending) {
+    w->write_pending = false;
+    a_ctx->va = w->write_va;
+    a_ctx->pid = cfg->first_pid + w->pid_index;
+    a_ctx->permissions = access_type_to_permissions(ACCESS_WRITE);
+    a_ctx->user_supervisor = 0;
+    return;
+  }
+
+  if (w->quantum_left == 0) {
+    w->pid_index = (w->pid_index + 1) % cfg->n_pids;
+    w->quantum_left = cfg->pid_quantum;
+  }
+  w->quantum_left--;
+
+  uint32_t pid = cfg->first_pid + w->pid_index;
+  uint64_t *cursor = &w->cursor[pid];
+  uint64_t offset;
+  switch (cfg->kind) {
+  case WORKLOAD_SEQUENTIAL:
+    offset = *cursor;
+    *cursor = (*cursor + WORKLOAD_LINE_SIZE) % cfg->footprint;
+    break;
+  case WORKLOAD_STRIDE:
+    offset = *cursor;
+    *cursor = (*cursor + cfg->stride % cfg->footprint) % cfg->footprint;
+    break;
+  case WORKLOAD_ZIPF:
+    // Spread the hot ranks so they do not share TLB sets
+    offset = (((zipf_rank(w) - 1) * 2654435761ULL) % w->n_pages)
+             << WORKLOAD_PAGE_SHIFT;
+    break;
+  case WORKLOAD_POINTER_CHASE: {
+    uint64_t page = next_chase_page(w, cursor);
+    // Vary the line within the page, as the nodes of a real list would
+    offset = (page << WORKLOAD_PAGE_SHIFT) |
+             ((page * WORKLOAD_LINE_SIZE) & ((1U << WORKLOAD_PAGE_SHIFT) - 1));
+    break;
+  }
+  default:
+    offset = (next_rand(w) % (cfg->footprint / WORKLOAD_WORD_SIZE)) *
+             WORKLOAD_WORD_SIZE;
+    break;
+  }
+
+  access_type_t type = ACCESS_READ;
+  if (cfg->kind == WORKLOAD_GUPS) {
+    w->write_pending = true;
+    w->write_va = cfg->base_va + offset;
+  } else if (cfg->write_percent > 0 &&
+             next_rand(w) % 100 < cfg->write_percent) {
+    type = ACCESS_WRITE;
+  }
+
+  a_ctx->va = cfg->base_va + offset;
+  a_ctx->pid = pid;
+  a_ctx->permissions = access_type_to_permissions(type);
+  a_ctx->user_supervisor = 0;
+}
+
+void workload_fill(workload_t *w, address_context_t *out, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    workload_next(w, &out[i]);
+  }
+}
+
+int run_workload(ptw_sim_context_t *ctx, workload_t *w, uint64_t n,
+                 replay_fault_handler_t handler, void *arg,
+                 replay_stats_t *stats) {
+  if (ctx == NULL || w == NULL || stats == NULL) {
+    return -1;
+  }
+
+  *stats = (replay_stats_t){0};
+
+  address_context_t *batch = malloc(REPLAY_BATCH_SIZE * sizeof(*batch));
+  translation_result_t *results =
+      malloc(REPLAY_BATCH_SIZE * sizeof(*results));
+  if (batch == NULL || results == NULL) {
+    free(batch);
+    free(results);
+    return -1;
+  }
+
+  uint64_t start = now_ns();
+  while (stats->records < n) {
+    size_t count = REPLAY_BATCH_SIZE;
+    if (n - stats->records < count) {
+      count = n - stats->records;
+    }
+    workload_fill(w, batch, count);
+    stats->records += count;
+    replay_batch(ctx, batch, count, results, handler, arg, stats);
+  }
+  stats->elapsed_ns = now_ns() - start;
+
+  free(batch);
+  free(results);
+  return 0;
+}
+
+const char *workload_kind_name(workload_kind_t kind) {
+  return kind < WORKLOAD_KIND_MAX ? kind_names[kind] : "unknown";
+}
+
+int parse_workload_kind(const char *name, workload_kind_t *kind) {
+  for (int k = 0; k < WORKLOAD_KIND_MAX; k++) {
+    if (strcmp(name, kind_names[k]) == 0) {
+      *kind = k;
+      return 0;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,137 @@
+/**
+ * The functions to run the address space test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "address_space.h"
+#include "address_space_test.h"
+#include "page_table.h"
+#include "pt_arena.h"
+
+static uintptr_t walk_va(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va) {
+  address_context_t a_ctx = {.va = va, .pid = pid};
+  a_ctx.permissions.val.read = 1;
+  walk_ctx_t w_ctx = {0};
+  return walk(&a_ctx, ctx, &w_ctx);
+}
+
+/**
+ * Map 2M - 4K before a 1G boundary, a 1G page, 2M, and 4K past it, all in
+ * one call, and check which page sizes were used
+ */
+static int check_map_range(ptw_sim_context_t *ctx, uint32_t pid) {
+  const uintptr_t va = 0x80000000ULL - MB(2) + KB(4);
+  const uintptr_t pa = 0x100000000ULL - MB(2) + KB(4);
+  const size_t len = (MB(2) - KB(4)) + GB(1) + MB(2) + KB(4);
+
+  permissions_t perms = {0};
+  perms.val.read = 1;
+  perms.val.write = 1;
+  if (map_range(ctx, pid, va, pa, len, perms) != 0) {
+    return -1;
+  }
+
+  // 511 4K pages, one 1G page, one 2M page, one 4K page
+  static const struct {
+    uintptr_t offset;
+    page_size_t page_size;
+  } probes[] = {
+      {0, FOUR_K},
+      {MB(2) - KB(8), FOUR_K},
+      {MB(2) - KB(4), ONE_G},
+      {MB(2) - KB(4) + GB(1) - 1, ONE_G},
+      {MB(2) - KB(4) + GB(1), TWO_M},
+      {MB(2) - KB(4) + GB(1) + MB(2), FOUR_K},
+  };
+
+  for (size_t i = 0; i < sizeof(probes) / sizeof(probes[0]); i++) {
+    address_context_t a_ctx = {.va = va + probes[i].offset, .pid = pid};
+    a_ctx.permissions.val.read = 1;
+    walk_ctx_t w_ctx = {0};
+    if (walk(&a_ctx, ctx, &w_ctx) != pa + probes[i].offset ||
+        w_ctx.page_size != probes[i].page_size) {
+      fprintf(stderr, "map_range offset 0x%lx mapped wrong.\n",
+              probes[i].offset);
+      return -1;
+    }
+  }
+
+  // Just past the end is unmapped
+  if (walk_va(ctx, pid, va + len) != (uintptr_t)-EINVAL) {
+    fprintf(stderr, "map_range mapped past the end.\n");
+    return -1;
+  }
+
+  // Unaligned ranges are refused
+  if (map_range(ctx, pid, va + 1, pa, KB(4), perms) == 0 ||
+      map_range(ctx, pid, va, pa, KB(4) + 1, perms) == 0) {
+    fprintf(stderr, "map_range accepted an unaligned range.\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+int run_address_space_test(ptw_sim_context_t *ctx) {
+  // The test context only creates address spaces for PIDs below MAX_PID, so
+  // start from a PID with none
+  const uint32_t pid = MAX_PID - 1;
+  destroy_address_space(ctx, pid);
+  if (walk_va(ctx, pid, 0x1000) != (uintptr_t)-EINVAL) {
+    fprintf(stderr, "Walk of a PID without page tables should be TNV.\n");
+    return -1;
+  }
+
+  permissions_t perms = {0};
+  perms.val.read = 1;
+
+  // 4K pages at both ends of the 48-bit space, and one 2M page
+  if (map_page(ctx, pid, 0x1000, 0xA000, FOUR_K, perms) != 0 ||
+      map_page(ctx, pid, 0x7FFFFFFFF000ULL, 0xB000, FOUR_K, perms) != 0 ||
+      map_page(ctx, pid, 0x40000000, 0x200000, TWO_M, perms) != 0) {
+    return -1;
+  }
+
+  // Root + 2 PDP + 3 PDE + 2 PTE tables, nothing else
+  pt_arena_t *arena = ctx->page_table_arenas[pid];
+  if (arena == NULL || arena->tables[0] != 1 || arena->tables[1] != 2 ||
+      arena->tables[2] != 3 || arena->tables[3] != 2) {
+    fprintf(stderr, "Unexpected tables built for three mappings.\n");
+    return -1;
+  }
+
+  if (walk_va(ctx, pid, 0x1234) != 0xA234 ||
+      walk_va(ctx, pid, 0x7FFFFFFFF567ULL) != 0xB567 ||
+      walk_va(ctx, pid, 0x40012345) != 0x212345) {
+    fprintf(stderr, "Sparse mappings translated wrong.\n");
+    return -1;
+  }
+
+  // A 4K page inside the 2M page, and a 2M page over the 4K page's PTE table,
+  // would each drop an existing mapping
+  if (map_page(ctx, pid, 0x40001000, 0xC000, FOUR_K, perms) == 0 ||
+      map_page(ctx, pid, 0x0, 0x400000, TWO_M, perms) == 0) {
+    fprintf(stderr, "Conflicting mappings were accepted.\n");
+    return -1;
+  }
+  if (walk_va(ctx, pid, 0x40001000) != 0x201000 ||
+      walk_va(ctx, pid, 0x1000) != 0xA000) {
+    fprintf(stderr, "A refused mapping changed the page table.\n");
+    return -1;
+  }
+
+  destroy_address_space(ctx, pid);
+  if (walk_va(ctx, pid, 0x1000) != (uintptr_t)-EINVAL) {
+    fprintf(stderr, "Destroyed address space still translates.\n");
+    return -1;
+  }
+
+  if (check_map_range(ctx, pid) != 0) {
+    return -1;
+  }
+
+  printf("Address space test passed!\n");
+  return 0;
+}
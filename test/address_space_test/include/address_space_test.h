@@ -0,0 +1,27 @@
+/**
+ * File with test functions for address space test
+ */
+
+#ifndef ADDRESS_SPACE_TEST_H
+#define ADDRESS_SPACE_TEST_H
+
+#include "page_table_api.h"
+
+/**
+ * @brief Checks sparse page table construction through `map_page`.
+ *
+ * Maps pages in a PID that has no address space yet, checks that only the
+ * tables on each mapped path were built, that conflicting mappings are
+ * refused, and that destroying the address space unmaps everything. Then
+ * maps a range spanning a 1G boundary with `map_range` and checks it was
+ * split into 4K, 2M and 1G pages as alignment allows.
+ *
+ * @param ctx Pointer to the pre-allocated and initialized simulator context.
+ *
+ * @return
+ * - 0 on success.
+ * - Non-zero on failure.
+ */
+int run_address_space_test(ptw_sim_context_t *ctx);
+
+#endif
@@ -0,0 +1,182 @@
+/**
+ * The functions to run the elastic cuckoo page table test
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "address_space.h"
+#include "ecpt.h"
+#include "ecpt_test.h"
+#include "page_table.h"
+#include "sim_context.h"
+#include "test_utils.h"
+
+#define PID 5
+#define VA_4K 0x7f0000001000ULL
+#define PA_4K 0x5000ULL
+#define VA_2M 0x40200000ULL
+#define PA_2M 0x80000000ULL
+#define VA_1G 0x8000000000ULL
+#define PA_1G 0x100000000ULL
+#define N_PAGES 512
+
+static void configure_cuckoo(ptw_sim_context_t *ctx, uint32_t slots,
+                             bool cwcs) {
+  sim_config_t cfg;
+  default_sim_config(&cfg);
+  cfg.pt_backend = PT_BACKEND_CUCKOO;
+  cfg.ecpt_slots = slots;
+  if (!cwcs) {
+    for (int level = 0; level < PWC_LEVELS; level++) {
+      cfg.pwc[level].sets = 0;
+    }
+  }
+  teardown_sim_context(ctx, MAX_PID);
+  configure_sim_context(ctx, MAX_PID, &cfg);
+}
+
+/**
+ * Walks `va` of `pid` and checks the PA and the number of slots read
+ */
+static int expect_walk(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va,
+                       uintptr_t expected, uint8_t reads) {
+  address_context_t a_ctx = {.va = va, .pid = pid};
+  a_ctx.permissions.val.read = 1;
+  walk_ctx_t w_ctx = {0};
+  uintptr_t pa = walk(&a_ctx, ctx, &w_ctx);
+  if (pa != expected || w_ctx.levels != reads) {
+    fprintf(stderr, "Walk of 0x%lx gave 0x%lx after %u reads, expected 0x%lx "
+                    "after %u.\n",
+            va, pa, w_ctx.levels, expected, reads);
+    return -1;
+  }
+  return 0;
+}
+
+static int check_walk_caches(ptw_sim_context_t *ctx) {
+  configure_cuckoo(ctx, ECPT_SLOTS, true);
+
+  permissions_t r = {0};
+  r.val.read = 1;
+  if (setup_mapping(ctx, PID, VA_4K, PA_4K, FOUR_K, r) != 0 ||
+      ctx->page_table_pointers[PID] != NULL) {
+    return -1;
+  }
+
+  // A cold walk reads both CWT entries along with the 4K ways, and a warm
+  // one only the ways of the sizes its 2M region has
+  if (expect_walk(ctx, PID, VA_4K + 0x10, PA_4K + 0x10, 9) != 0 ||
+      expect_walk(ctx, PID, VA_4K, PA_4K, 3) != 0) {
+    return -1;
+  }
+
+  // Until the caches warm up, every size mapped is probed
+  if (setup_mapping(ctx, PID, VA_2M, PA_2M, TWO_M, r) != 0 ||
+      setup_mapping(ctx, PID, VA_1G, PA_1G, ONE_G, r) != 0 ||
+      expect_walk(ctx, PID, VA_4K, PA_4K, 3) != 0 ||
+      expect_walk(ctx, PID, VA_2M + 0x1234, PA_2M + 0x1234, 15) != 0 ||
+      expect_walk(ctx, PID, VA_2M + 0x5678, PA_2M + 0x5678, 3) != 0 ||
+      expect_walk(ctx, PID, VA_1G + 0x123456, PA_1G + 0x123456, 15) != 0 ||
+      expect_walk(ctx, PID, VA_1G + 0x1abcde, PA_1G + 0x1abcde, 3) != 0) {
+    return -1;
+  }
+  const ecpt_stats_t *stats = &ctx->ecpt_stats;
+  if (stats->lookups != 7 || stats->cwt_reads != 18 ||
+      stats->page_reads != 33 ||
+      stats->parallel_cycles >= stats->serial_cycles) {
+    fprintf(stderr, "Counted %lu walks, %lu CWT and %lu page reads, %lu "
+                    "cycles in parallel and %lu serially.\n",
+            stats->lookups, stats->cwt_reads, stats->page_reads,
+            stats->parallel_cycles, stats->serial_cycles);
+    return -1;
+  }
+
+  // A region's cached sizes go stale once it gets a page of a new size
+  uint64_t va = 0x60000000ULL;
+  if (setup_mapping(ctx, PID, va, PA_4K, FOUR_K, r) != 0 ||
+      expect_walk(ctx, PID, va, PA_4K, 15) != 0 ||
+      unmap_range(ctx, PID, va, 1ULL << 12) != 0 ||
+      setup_mapping(ctx, PID, va, PA_2M, TWO_M, r) != 0 ||
+      expect_walk(ctx, PID, va + 0x1000, PA_2M + 0x1000, 15) != 0) {
+    return -1;
+  }
+
+  // Overlapping pages are refused, like in a radix tree
+  if (setup_mapping(ctx, PID, VA_2M + 0x1000, PA_4K, FOUR_K, r) == 0 ||
+      setup_mapping(ctx, PID, VA_1G + (2ULL << 20), PA_2M, TWO_M, r) == 0 ||
+      setup_mapping(ctx, PID, VA_4K & VPN_MASK_2MB, PA_2M, TWO_M, r) == 0) {
+    fprintf(stderr, "Mapped a page over a page of another size.\n");
+    return -1;
+  }
+
+  if (expect_walk(ctx, MAX_PID, VA_4K, -EINVAL, 0) != 0 ||
+      expect_walk(ctx, PID + 1, VA_4K, -EINVAL, 0) != 0 ||
+      expect_walk(ctx, PID, 1ULL << VA_SIZE, -EFAULT, 0) != 0) {
+    return -1;
+  }
+  return 0;
+}
+
+static int check_resizing(ptw_sim_context_t *ctx) {
+  // Tiny tables and no walk caches, so every walk probes every size
+  configure_cuckoo(ctx, 4, false);
+
+  permissions_t r = {0};
+  r.val.read = 1;
+  const ecpt_table_t *t = NULL;
+  bool migrated = false;
+  for (uint64_t i = 0; i < N_PAGES; i++) {
+    if (setup_mapping(ctx, PID, VA_4K + (i << 12), PA_4K + (i << 12), FOUR_K,
+                      r) != 0) {
+      return -1;
+    }
+    t = &ctx->ecpt[PID]->pages[FOUR_K];
+    if (t->old[0] == NULL || migrated) {
+      continue;
+    }
+
+    // Pages still in the old table translate as well as moved ones
+    migrated = true;
+    for (uint64_t j = 0; j <= i; j++) {
+      if (expect_walk(ctx, PID, VA_4K + (j << 12), PA_4K + (j << 12), 3) !=
+          0) {
+        return -1;
+      }
+    }
+  }
+  if (!migrated || t->entries != N_PAGES || t->resizes == 0 ||
+      t->slots < N_PAGES / ECPT_WAYS) {
+    fprintf(stderr, "%lu pages in %u slots per way after %lu resizes.\n",
+            t->entries, t->slots, t->resizes);
+    return -1;
+  }
+
+  if (setup_mapping(ctx, PID, VA_2M, PA_2M, TWO_M, r) != 0 ||
+      unmap_range(ctx, PID, VA_4K, (N_PAGES / 2) << 12) != 0 ||
+      t->entries != N_PAGES / 2 ||
+      expect_walk(ctx, PID, VA_4K, -EINVAL, 6) != 0 ||
+      expect_walk(ctx, PID, VA_4K + ((N_PAGES - 1) << 12),
+                  PA_4K + ((N_PAGES - 1) << 12), 6) != 0 ||
+      expect_walk(ctx, PID, VA_2M, PA_2M, 6) != 0) {
+    return -1;
+  }
+
+  destroy_address_space(ctx, PID);
+  if (ctx->ecpt[PID] != NULL ||
+      expect_walk(ctx, PID, VA_2M, -EINVAL, 0) != 0) {
+    fprintf(stderr, "Destroying PID %u left its tables.\n", PID);
+    return -1;
+  }
+  return 0;
+}
+
+int run_ecpt_test(ptw_sim_context_t *ctx) {
+  if (check_walk_caches(ctx) != 0 || check_resizing(ctx) != 0) {
+    return -1;
+  }
+
+  printf("Elastic cuckoo page table test passed!\n");
+  return 0;
+}
@@ -0,0 +1,29 @@
+/**
+ * File with test functions for the elastic cuckoo page table test
+ */
+
+#ifndef ECPT_TEST_H
+#define ECPT_TEST_H
+
+#include "page_table_api.h"
+
+/**
+ * @brief Checks translation, probe counts and resizing with the elastic
+ * cuckoo page table backend.
+ *
+ * Maps 4K, 2M and 1G pages into a cuckoo context and checks their
+ * translations and the slots each walk reads, with and without the cuckoo
+ * walk caches narrowing the sizes to probe, and that the parallel reads
+ * cost less than serial ones would. Then starts from tiny tables and checks
+ * that every page keeps translating while they resize, and that destroying
+ * an address space frees its tables.
+ *
+ * @param ctx Pointer to the pre-allocated and initialized simulator context.
+ *
+ * @return
+ * - 0 on success.
+ * - Non-zero on failure.
+ */
+int run_ecpt_test(ptw_sim_context_t *ctx);
+
+#endif
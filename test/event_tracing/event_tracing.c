@@ -0,0 +1,172 @@
+/**
+ * The functions to run the event tracing test
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "event_trace.h"
+#include "event_tracing.h"
+#include "test_utils.h"
+#include "translation.h"
+
+#define N_WORKERS 3
+#define EVENTS_PER_THREAD 5000
+#define THREAD_MARKER 7
+#define PID 4
+#define PAGE_VA 0x20000ULL
+#define PAGE_PA 0x600000ULL
+
+/**
+ * Record EVENTS_PER_THREAD events numbered by VA, tagged with the caller's
+ * number in the PID
+ */
+static void *record_events(void *arg) {
+  uint32_t id = (uint32_t)(uintptr_t)arg;
+  for (uint64_t i = 0; i < EVENTS_PER_THREAD; i++) {
+    event_trace_record(EVENT_TLB_HIT, THREAD_MARKER, id, i);
+  }
+  return NULL;
+}
+
+/**
+ * Check the header, and that every recording thread's events are in order.
+ * Returns the number of numbered events, or -1.
+ */
+static int64_t check_file(FILE *f) {
+  event_trace_header_t header;
+  if (fread(&header, sizeof(header), 1, f) != 1 ||
+      memcmp(header.magic, EVENT_TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != EVENT_TRACE_VERSION ||
+      header.event_size != sizeof(trace_event_t)) {
+    fprintf(stderr, "Bad event trace header.\n");
+    return -1;
+  }
+
+  int64_t next_va[N_WORKERS + 1] = {0};
+  int64_t n = 0;
+  trace_event_t ev;
+  while (fread(&ev, sizeof(ev), 1, f) == 1) {
+    if (ev.arg != THREAD_MARKER) {
+      continue;
+    }
+    // Dropped events leave gaps, but order is kept
+    if (ev.pid > N_WORKERS || (int64_t)ev.va < next_va[ev.pid]) {
+      fprintf(stderr, "Event %lu of thread %u is out of order.\n", ev.va,
+              ev.pid);
+      return -1;
+    }
+    next_va[ev.pid] = ev.va + 1;
+    n++;
+  }
+  return n;
+}
+
+#if EVENT_TRACE_HOOKS
+/**
+ * Check the walk events of a cold translation: one read per level, then the
+ * page size found
+ */
+static int check_walk_events(FILE *f) {
+  static const struct {
+    uint8_t type;
+    uint8_t arg;
+  } expected[] = {{EVENT_WALK_READ, 0},
+                  {EVENT_WALK_READ, 1},
+                  {EVENT_WALK_READ, 2},
+                  {EVENT_WALK_READ, 3},
+                  {EVENT_WALK_DONE, FOUR_K}};
+  size_t matched = 0;
+  trace_event_t ev;
+
+  fseek(f, sizeof(event_trace_header_t), SEEK_SET);
+  while (fread(&ev, sizeof(ev), 1, f) == 1 &&
+         matched < sizeof(expected) / sizeof(expected[0])) {
+    if (ev.pid != PID || ev.type < EVENT_WALK_READ) {
+      continue;
+    }
+    if (ev.type != expected[matched].type ||
+        ev.arg != expected[matched].arg || ev.va != PAGE_VA) {
+      fprintf(stderr, "Walk event %zu is type %u arg %u.\n", matched,
+              ev.type, ev.arg);
+      return -1;
+    }
+    matched++;
+  }
+  return matched == sizeof(expected) / sizeof(expected[0]) ? 0 : -1;
+}
+#endif
+
+int run_event_tracing_test(ptw_sim_context_t *ctx) {
+  char path[] = "/tmp/ptw_events_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return -1;
+  }
+  close(fd);
+
+  // Not running yet, so this goes nowhere
+  record_events((void *)0);
+
+  if (event_trace_start(path) != 0) {
+    unlink(path);
+    return -1;
+  }
+
+  record_events((void *)0);
+  pthread_t threads[N_WORKERS];
+  for (uintptr_t i = 0; i < N_WORKERS; i++) {
+    pthread_create(&threads[i], NULL, record_events, (void *)(i + 1));
+  }
+  for (int i = 0; i < N_WORKERS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  permissions_t perms = {0};
+  perms.val.read = 1;
+  address_context_t a_ctx;
+  populate_address_context(&a_ctx, PAGE_VA, perms, 0, PID);
+  if (setup_mapping(ctx, PID, PAGE_VA, PAGE_PA, FOUR_K, perms) != 0 ||
+      translate(&a_ctx, ctx) != PAGE_PA) {
+    event_trace_stop();
+    unlink(path);
+    return -1;
+  }
+
+  int64_t dropped = event_trace_stop();
+
+  // Stopped again, so this must not touch the freed rings
+  record_events((void *)0);
+
+  FILE *f = fopen(path, "rb");
+  unlink(path);
+  if (dropped < 0 || f == NULL) {
+    return -1;
+  }
+
+  int ret = 0;
+  int64_t written = check_file(f);
+  int64_t recorded = (N_WORKERS + 1) * EVENTS_PER_THREAD;
+  if (written < 0 || written + dropped != recorded) {
+    fprintf(stderr, "%ld events written and %ld dropped, expected %ld.\n",
+            written, dropped, recorded);
+    ret = -1;
+  }
+
+#if EVENT_TRACE_HOOKS
+  if (ret == 0 && dropped == 0 && check_walk_events(f) != 0) {
+    ret = -1;
+  }
+#endif
+
+  fclose(f);
+  if (ret == 0) {
+    printf("Event tracing test passed!\n");
+  }
+  return ret;
+}
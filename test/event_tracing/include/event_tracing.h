@@ -0,0 +1,27 @@
+/**
+ * File with test functions for event tracing test
+ */
+
+#ifndef EVENT_TRACING_H
+#define EVENT_TRACING_H
+
+#include "page_table_api.h"
+
+/**
+ * @brief Checks that recorded events reach the trace file intact.
+ *
+ * Records numbered events from the main thread and from worker threads,
+ * then checks that the file has every event that was not dropped, each
+ * thread's in order. Events recorded while tracing is stopped must be
+ * ignored. In a build with the hooks compiled in (EVENT_TRACE), also checks
+ * the events of a translation that walks all 4 levels.
+ *
+ * @param ctx Pointer to the pre-allocated and initialized simulator context.
+ *
+ * @return
+ * - 0 on success.
+ * - Non-zero on failure.
+ */
+int run_event_tracing_test(ptw_sim_context_t *ctx);
+
+#endif
@@ -0,0 +1,166 @@
+/**
+ * The functions to run the hashed page table test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "address_space.h"
+#include "hashed_pt.h"
+#include "hashed_pt_test.h"
+#include "page_table.h"
+#include "sim_context.h"
+#include "test_utils.h"
+#include "translation.h"
+
+#define PID 3
+#define OTHER_PID 4
+#define VA_4K 0x7f0000001000ULL
+#define PA_4K 0x5000ULL
+#define VA_2M 0x40200000ULL
+#define PA_2M 0x80000000ULL
+#define VA_1G 0x8000000000ULL
+#define PA_1G 0x100000000ULL
+
+static void configure_hashed(ptw_sim_context_t *ctx, uint32_t n_buckets) {
+  sim_config_t cfg;
+  default_sim_config(&cfg);
+  cfg.pt_backend = PT_BACKEND_HASHED;
+  cfg.hpt_buckets = n_buckets;
+  teardown_sim_context(ctx, MAX_PID);
+  configure_sim_context(ctx, MAX_PID, &cfg);
+}
+
+/**
+ * Walks `va` of `pid` and checks the PA and the number of entries read
+ */
+static int expect_walk(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va,
+                       uintptr_t expected, uint8_t refs) {
+  address_context_t a_ctx = {.va = va, .pid = pid};
+  a_ctx.permissions.val.read = 1;
+  walk_ctx_t w_ctx = {0};
+  uintptr_t pa = walk(&a_ctx, ctx, &w_ctx);
+  if (pa != expected || w_ctx.levels != refs) {
+    fprintf(stderr, "Walk of 0x%lx gave 0x%lx after %u reads, expected 0x%lx "
+                    "after %u.\n",
+            va, pa, w_ctx.levels, expected, refs);
+    return -1;
+  }
+  return 0;
+}
+
+static int check_page_sizes(ptw_sim_context_t *ctx) {
+  configure_hashed(ctx, HPT_BUCKETS);
+
+  permissions_t r = {0};
+  r.val.read = 1;
+  if (setup_mapping(ctx, PID, VA_4K, PA_4K, FOUR_K, r) != 0 ||
+      expect_walk(ctx, PID, VA_4K + 0x10, PA_4K + 0x10, 1) != 0 ||
+      ctx->page_table_pointers[PID] != NULL) {
+    return -1;
+  }
+
+  // Only the sizes PID has mapped are probed, smallest first
+  if (setup_mapping(ctx, PID, VA_2M, PA_2M, TWO_M, r) != 0 ||
+      setup_mapping(ctx, PID, VA_1G, PA_1G, ONE_G, r) != 0 ||
+      expect_walk(ctx, PID, VA_4K, PA_4K, 1) != 0 ||
+      expect_walk(ctx, PID, VA_2M + 0x1234, PA_2M + 0x1234, 2) != 0 ||
+      expect_walk(ctx, PID, VA_1G + 0x123456, PA_1G + 0x123456, 3) != 0 ||
+      expect_walk(ctx, PID, 0x1000, -EINVAL, 3) != 0) {
+    return -1;
+  }
+  const hpt_stats_t *stats = &ctx->hpt_stats;
+  if (stats->lookups != 5 || stats->probes != 10 || stats->mem_refs != 10 ||
+      stats->refs[1] != 2 || stats->refs[3] != 2) {
+    fprintf(stderr, "Counted %lu lookups, %lu probes and %lu entries read.\n",
+            stats->lookups, stats->probes, stats->mem_refs);
+    return -1;
+  }
+
+  // Overlapping pages are refused, like in a radix tree
+  if (setup_mapping(ctx, PID, VA_2M + 0x1000, PA_4K, FOUR_K, r) == 0 ||
+      setup_mapping(ctx, PID, VA_4K & VPN_MASK_2MB, PA_2M, TWO_M, r) == 0) {
+    fprintf(stderr, "Mapped a page over a page of another size.\n");
+    return -1;
+  }
+
+  // Permissions are checked at the entry
+  address_context_t w_ctx;
+  permissions_t w = {0};
+  w.val.write = 1;
+  populate_address_context(&w_ctx, VA_4K, w, 0, PID);
+  if (translate(&w_ctx, ctx) != (uintptr_t)-EUNAUTHORIZED ||
+      expect_walk(ctx, MAX_PID, VA_4K, -EINVAL, 0) != 0 ||
+      expect_walk(ctx, PID, 1ULL << VA_SIZE, -EFAULT, 0) != 0) {
+    return -1;
+  }
+  return 0;
+}
+
+static int check_chains(ptw_sim_context_t *ctx) {
+  // One bucket, so every page after the first goes in its chain
+  configure_hashed(ctx, 1);
+  hashed_pt_t *hpt = ctx->hpt;
+
+  permissions_t r = {0};
+  r.val.read = 1;
+  for (uint64_t i = 0; i < 4; i++) {
+    if (setup_mapping(ctx, PID, VA_4K + (i << 12), PA_4K + (i << 12), FOUR_K,
+                      r) != 0) {
+      return -1;
+    }
+  }
+  if (setup_mapping(ctx, OTHER_PID, VA_4K, PA_2M, FOUR_K, r) != 0 ||
+      hpt->entries != 5 || hpt->overflow != 4) {
+    fprintf(stderr, "%lu pages, %lu in chains, expected 5 and 4.\n",
+            hpt->entries, hpt->overflow);
+    return -1;
+  }
+
+  // The first page stays in the bucket and new ones go right after it
+  if (expect_walk(ctx, PID, VA_4K, PA_4K, 1) != 0 ||
+      expect_walk(ctx, OTHER_PID, VA_4K, PA_2M, 2) != 0 ||
+      expect_walk(ctx, PID, VA_4K + 0x1000, PA_4K + 0x1000, 5) != 0 ||
+      expect_walk(ctx, PID, VA_4K + 0x4000, -EINVAL, 5) != 0) {
+    return -1;
+  }
+
+  // Removing the bucket's page moves the next one into the bucket
+  if (unmap_range(ctx, PID, VA_4K, 2ULL << 12) != 0 ||
+      hpt->entries != 3 || hpt->overflow != 2 ||
+      expect_walk(ctx, PID, VA_4K, -EINVAL, 3) != 0 ||
+      expect_walk(ctx, OTHER_PID, VA_4K, PA_2M, 1) != 0 ||
+      expect_walk(ctx, PID, VA_4K + 0x3000, PA_4K + 0x3000, 2) != 0) {
+    return -1;
+  }
+
+  // Freed overflow entries are reused before new memory is carved
+  size_t bytes = hpt->chains->bytes_used;
+  if (setup_mapping(ctx, PID, VA_4K, PA_4K, FOUR_K, r) != 0 ||
+      setup_mapping(ctx, PID, VA_4K + 0x1000, PA_4K, FOUR_K, r) != 0 ||
+      hpt->chains->bytes_used != bytes) {
+    fprintf(stderr, "Chains grew to %zu bytes, expected %zu.\n",
+            hpt->chains->bytes_used, bytes);
+    return -1;
+  }
+
+  // Only OTHER_PID's page is left after tearing PID down
+  destroy_address_space(ctx, PID);
+  if (hpt->entries != 1 || hpt->overflow != 0 ||
+      hpt_page_sizes(hpt, PID) != 0 ||
+      expect_walk(ctx, OTHER_PID, VA_4K, PA_2M, 1) != 0 ||
+      expect_walk(ctx, PID, VA_4K + 0x3000, -EINVAL, 0) != 0) {
+    fprintf(stderr, "Destroying PID %u left %lu pages.\n", PID, hpt->entries);
+    return -1;
+  }
+  return 0;
+}
+
+int run_hashed_pt_test(ptw_sim_context_t *ctx) {
+  if (check_page_sizes(ctx) != 0 || check_chains(ctx) != 0) {
+    return -1;
+  }
+
+  printf("Hashed page table test passed!\n");
+  return 0;
+}
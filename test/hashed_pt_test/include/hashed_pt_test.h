@@ -0,0 +1,28 @@
+/**
+ * File with test functions for the hashed page table test
+ */
+
+#ifndef HASHED_PT_TEST_H
+#define HASHED_PT_TEST_H
+
+#include "page_table_api.h"
+
+/**
+ * @brief Checks translation, lookup costs and chaining with the hashed page
+ * table backend.
+ *
+ * Maps 4K, 2M and 1G pages into a hashed context and checks their
+ * translations and the entries each lookup reads. Then forces every page
+ * into one bucket and checks that lookups follow the chain, that removing
+ * pages relinks it and reuses its entries, and that destroying an address
+ * space leaves the other PIDs' pages alone.
+ *
+ * @param ctx Pointer to the pre-allocated and initialized simulator context.
+ *
+ * @return
+ * - 0 on success.
+ * - Non-zero on failure.
+ */
+int run_hashed_pt_test(ptw_sim_context_t *ctx);
+
+#endif
@@ -0,0 +1,161 @@
+/**
+ * The functions to run the packed hardware PTE test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "address_space.h"
+#include "hw_pte.h"
+#include "hw_pte_test.h"
+#include "pt_arena.h"
+#include "sim_context.h"
+#include "test_utils.h"
+#include "translation.h"
+
+#define PID 5
+// A read-only 4K page, a writable 2M page and an executable 1G page, each in
+// its own 1G region of the first 512G
+#define PAGE_4K_VA 0x1000ULL
+#define PAGE_4K_PA 0x7000ULL
+#define PAGE_2M_VA 0x40200000ULL
+#define PAGE_2M_PA 0x80400000ULL
+#define PAGE_1G_VA 0x80000000ULL
+#define PAGE_1G_PA 0x140000000ULL
+
+static int check_encoding(void) {
+  permissions_t perms = {0};
+  perms.val.read = 1;
+  perms.val.write = 1;
+
+  // The offset bits of the PA don't survive
+  hw_pte_t e = hw_pte_encode_leaf(0x80412345ULL, TWO_M, perms, 1, true);
+  if (e != (0x80400000ULL | HW_PTE_P | HW_PTE_RW | HW_PTE_PS | HW_PTE_G |
+            HW_PTE_NX)) {
+    fprintf(stderr, "Encoded a 2M leaf as 0x%lx.\n", e);
+    return -1;
+  }
+
+  pte_t entry;
+  hw_pte_to_pte(e, TWO_M, PAGE_2M_VA, PID, &entry);
+  if (!entry.page_metadata.valid || entry.page_metadata.page_size != TWO_M ||
+      entry.phys_frame.fourk_pte_index != 0x80400000ULL ||
+      entry.page_metadata.permissions.raw != perms.raw ||
+      entry.page_metadata.user_supervisor != 1 ||
+      !entry.page_metadata.global || entry.page_metadata.pid != PID ||
+      hw_pte_from_pte(&entry) != e) {
+    fprintf(stderr, "2M leaf didn't round-trip through pte_t.\n");
+    return -1;
+  }
+
+  // Without PS, a PDE entry points at a table, and a PTE is always a leaf
+  hw_pte_t table = hw_pte_encode_table((void *)0x12345000ULL);
+  if (hw_pte_is_leaf(table, TWO_M) || !hw_pte_is_leaf(table, FOUR_K) ||
+      hw_pte_addr(table) != 0x12345000ULL || hw_pte_is_table(0, ONE_G)) {
+    fprintf(stderr, "Misclassified a table entry.\n");
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Returns the entry a walk of `va` reads at `level`
+ */
+static hw_pte_t *entry_at_level(const ptw_sim_context_t *ctx, uintptr_t va,
+                                uint8_t level) {
+  static const uint8_t shifts[PT_LEVELS] = {
+      SDP_STARTING_BIT, PDP_STARTING_BIT, PDE_STARTING_BIT, PTE_STARTING_BIT};
+  hw_pte_t *table = ctx->page_table_pointers[PID];
+  for (uint8_t l = 0;; l++) {
+    hw_pte_t *entry =
+        &table[(va >> shifts[l]) & (NUM_ENTRIES_PER_PAGE - 1)];
+    if (l == level) {
+      return entry;
+    }
+    table = (hw_pte_t *)hw_pte_addr(*entry);
+  }
+}
+
+static int expect_translation(ptw_sim_context_t *ctx, uintptr_t va,
+                              permissions_t perms, uintptr_t expected) {
+  address_context_t a_ctx;
+  populate_address_context(&a_ctx, va, perms, 0, PID);
+  uintptr_t pa = translate(&a_ctx, ctx);
+  if (pa != expected) {
+    fprintf(stderr, "0x%lx translated to 0x%lx, expected 0x%lx.\n", va, pa,
+            expected);
+    return -1;
+  }
+  return 0;
+}
+
+int run_hw_pte_test(ptw_sim_context_t *ctx) {
+  if (check_encoding() != 0) {
+    return -1;
+  }
+
+  sim_config_t cfg;
+  default_sim_config(&cfg);
+  cfg.pte_format = PTE_FORMAT_HW;
+  teardown_sim_context(ctx, MAX_PID);
+  configure_sim_context(ctx, MAX_PID, &cfg);
+
+  permissions_t r = {0};
+  r.val.read = 1;
+  permissions_t rw = r;
+  rw.val.write = 1;
+  permissions_t rx = r;
+  rx.val.execute = 1;
+  if (setup_mapping(ctx, PID, PAGE_4K_VA, PAGE_4K_PA, FOUR_K, r) != 0 ||
+      setup_mapping(ctx, PID, PAGE_2M_VA, PAGE_2M_PA, TWO_M, rw) != 0 ||
+      setup_mapping(ctx, PID, PAGE_1G_VA, PAGE_1G_PA, ONE_G, rx) != 0) {
+    return -1;
+  }
+
+  // SDP, PDP, 2 PDE and 1 PTE tables, one 4 KiB page each
+  const pt_arena_t *arena = ctx->page_table_arenas[PID];
+  if (arena->bytes_used != 5 * HW_PT_TABLE_BYTES ||
+      HW_PT_TABLE_BYTES != PT_TABLE_ALIGN) {
+    fprintf(stderr, "Tables take %zu bytes.\n", arena->bytes_used);
+    return -1;
+  }
+
+  if (expect_translation(ctx, PAGE_4K_VA + 0x123, r, PAGE_4K_PA + 0x123) !=
+          0 ||
+      expect_translation(ctx, PAGE_2M_VA + 0x12345, rw,
+                         PAGE_2M_PA + 0x12345) != 0 ||
+      expect_translation(ctx, PAGE_1G_VA + 0x1234567, rx,
+                         PAGE_1G_PA + 0x1234567) != 0 ||
+      expect_translation(ctx, PAGE_4K_VA + 0x1000, r, -EINVAL) != 0 ||
+      expect_translation(ctx, PAGE_4K_VA, rw, -EUNAUTHORIZED) != 0 ||
+      expect_translation(ctx, PAGE_2M_VA, rx, -EUNAUTHORIZED) != 0) {
+    return -1;
+  }
+
+  // The walker sets A on every entry it uses, and D on a written leaf
+  hw_pte_t pte = *entry_at_level(ctx, PAGE_4K_VA, PT_LEVELS - 1);
+  hw_pte_t pde = *entry_at_level(ctx, PAGE_2M_VA, 2);
+  hw_pte_t pdp = *entry_at_level(ctx, PAGE_1G_VA, 1);
+  if (!(pte & HW_PTE_A) || (pte & HW_PTE_D) || !(pde & HW_PTE_A) ||
+      !(pde & HW_PTE_D) || !(pde & HW_PTE_PS) || !(pdp & HW_PTE_A) ||
+      (pdp & HW_PTE_D) || !(*entry_at_level(ctx, PAGE_1G_VA, 0) & HW_PTE_A)) {
+    fprintf(stderr, "Accessed or dirty bits are wrong.\n");
+    return -1;
+  }
+
+  if (set_page_global(ctx, PID, PAGE_2M_VA, true) != 0 ||
+      !(*entry_at_level(ctx, PAGE_2M_VA, 2) & HW_PTE_G)) {
+    fprintf(stderr, "Failed to make the 2M page global.\n");
+    return -1;
+  }
+
+  // Unmapping clears the entry and shoots down the cached translation
+  if (unmap_range(ctx, PID, PAGE_2M_VA, 1ULL << 21) != 0 ||
+      *entry_at_level(ctx, PAGE_2M_VA, 2) != 0 ||
+      expect_translation(ctx, PAGE_2M_VA, r, -EINVAL) != 0) {
+    return -1;
+  }
+
+  printf("Hardware PTE test passed!\n");
+  return 0;
+}
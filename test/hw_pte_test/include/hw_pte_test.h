@@ -0,0 +1,25 @@
+/**
+ * File with test functions for the packed hardware PTE test
+ */
+
+#ifndef HW_PTE_TEST_H
+#define HW_PTE_TEST_H
+
+#include "page_table_api.h"
+
+/**
+ * @brief Checks packed 8-byte page table entries.
+ *
+ * Round-trips entries through the encode and decode helpers, then maps 4K,
+ * 2M and 1G pages in a PTE_FORMAT_HW context and checks their translations,
+ * faults, accessed and dirty bits, table sizes and unmapping.
+ *
+ * @param ctx Pointer to the pre-allocated and initialized simulator context.
+ *
+ * @return
+ * - 0 on success.
+ * - Non-zero on failure.
+ */
+int run_hw_pte_test(ptw_sim_context_t *ctx);
+
+#endif
@@ -11,6 +11,7 @@
 #include "hw_structures.h"
 #include "page_table.h"
 #include "page_table_api.h"
+#include "sim_config.h"
 #include "tlb.h"
 #include "util.h"
 
@@ -29,22 +30,40 @@ void populate_address_context(address_context_t *a_ctx, uint64_t va,
                               uint8_t user_supervisor, uint32_t pid);
 
 /**
- * @brief Populates a ptw_sim_context_t structure with default or provided
- * values.
+ * @brief Sets up a simulation context with empty TLBs and an empty top-level
+ * page table for each PID.
  *
- * @param ctx Pointer to the ptw_sim_context_t structure to populate.
- * @param max_pid Maximum number of PIDs supported (defines page table array
- * size).
+ * No lower-level tables are built. Use `setup_mapping` to add mappings.
+ * Release with `teardown_sim_context`. Exits on failure.
+ *
+ * @param ctx Pointer to the ptw_sim_context_t structure to initialize.
+ * @param max_pid Number of PIDs to create top-level tables for.
+ */
+void initialize_sim_context(ptw_sim_context_t *ctx, size_t max_pid);
+
+/**
+ * @brief Same as `initialize_sim_context`, but with TLB geometries taken
+ * from `cfg` instead of the defaults.
+ *
+ * @param ctx Pointer to the ptw_sim_context_t structure to initialize.
+ * @param max_pid Number of PIDs to create top-level tables for.
+ * @param cfg Simulator configuration.
  */
-void populate_sim_context(ptw_sim_context_t *ctx, size_t max_pid);
+void configure_sim_context(ptw_sim_context_t *ctx, size_t max_pid,
+                           const sim_config_t *cfg);
 
 /**
- * @brief Helper function to initialize a TLB.
+ * @brief Helper function to allocate and initialize a TLB.
+ *
+ * Exits on failure, like `allocate_page_table`.
  *
- * @param tlb Pointer to the TLB structure to initialize.
- * @param page_size The page size associated with the TLB (e.g., 4KB, 2MB, 1GB).
+ * @param tlb_ptr Pointer to the TLB pointer to set to the new TLB.
+ * @param geometry Sets and ways of the new TLB.
+ * @param page_sizes PG_SIZE_BIT() of each page size the TLB caches.
+ * @param policy Replacement policy.
  */
-void initialize_tlb(tlb_t *tlb);
+void initialize_tlb(tlb_t **tlb_ptr, tlb_geometry_t geometry,
+                    uint8_t page_sizes, repl_policy_kind_t policy);
 
 /**
  * @brief Helper function to initialize a page table entry.
@@ -61,12 +80,12 @@ void initialize_page_table_entry(page_table_entry_t *entry, uint32_t pid,
  * initialization.
  *
  * This function undoes all allocations and setups performed by
- * `populate_sim_context`. It iterates through all PIDs and releases memory for
- * each layer of page tables (SDP, PDP, PDE, and PTE), as well as any other
- * dynamically allocated resources within the simulation context.
+ * `initialize_sim_context`. Wraps `destroy_sim_context`, which releases every
+ * PID's page tables, as well as any other dynamically allocated resources
+ * within the simulation context.
  *
  * @param ctx Pointer to the simulation context to be torn down.
- * @param max_pid The maximum number of PIDs for which resources were allocated.
+ * @param max_pid Unused. Every PID's address space is released.
  *
  * @note After calling this function, `ctx` should not be used unless
  * reinitialized.
@@ -77,7 +96,7 @@ void teardown_sim_context(ptw_sim_context_t *ctx, size_t max_pid);
  * @brief Resets and clears all entries in a given Translation Lookaside Buffer
  * (TLB).
  *
- * This function zeroes out all entries in the specified TLB and resets its
+ * This function invalidates all entries in the specified TLB and resets its
  * metadata, such as the number of valid entries and any LRU-related indices. It
  * ensures the TLB is in a clean state, ready for new translations.
  *
@@ -118,9 +137,9 @@ page_table_entry_t *allocate_page_table();
  * @brief Sets up a mapping in the page table hierarchy.
  *
  * This function configures a virtual-to-physical address mapping in the
- * hierarchical page tables of the simulator. It navigates through the levels
- * (SDP, PDP, PDE, PTE) to set up the mapping, creating intermediate levels
- * if they do not already exist.
+ * hierarchical page tables of the simulator. Wraps `map_page`, which
+ * navigates through the levels (SDP, PDP, PDE, PTE) to set up the mapping,
+ * creating intermediate levels if they do not already exist.
  *
  * @param ctx Pointer to the page table walker simulator context.
  * @param pid Process ID for which the mapping should be set.
@@ -0,0 +1,27 @@
+/**
+ * File with test functions for the 5-level paging test
+ */
+
+#ifndef LA57_H
+#define LA57_H
+
+#include "page_table_api.h"
+
+/**
+ * @brief Checks walks, TLB hits and paging-structure cache hits with 5-level
+ * page tables.
+ *
+ * Maps pages above and below 2^48 in both entry formats, checks that cold
+ * walks read all five levels and that PWC hits skip the PML5 table. Then
+ * checks that VAs differing only above bit 47 don't alias in the TLBs, and
+ * that a 4-level context rejects them.
+ *
+ * @param ctx Pointer to the pre-allocated and initialized simulator context.
+ *
+ * @return
+ * - 0 on success.
+ * - Non-zero on failure.
+ */
+int run_la57_test(ptw_sim_context_t *ctx);
+
+#endif
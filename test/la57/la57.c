@@ -0,0 +1,155 @@
+/**
+ * The functions to run the 5-level paging test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "address_space.h"
+#include "la57.h"
+#include "page_table.h"
+#include "pwc.h"
+#include "sim_context.h"
+#include "test_utils.h"
+#include "translation.h"
+
+#define PID 7
+// PML5 index 0x91, beyond what 4-level paging can map
+#define HIGH_VA 0x1234567890ab000ULL
+#define HIGH_PA 0x5000ULL
+#define LOW_VA 0x1000ULL
+#define LOW_PA 0x6000ULL
+
+static void flush_pwcs(ptw_sim_context_t *ctx) {
+  for (int level = 0; level < PWC_LEVELS; level++) {
+    if (ctx->pwc[level] != NULL) {
+      flush_pwc(ctx->pwc[level]);
+    }
+  }
+}
+
+/**
+ * Walks `va` and checks the PA and the number of entries read
+ */
+static int expect_walk(ptw_sim_context_t *ctx, uintptr_t va,
+                       uintptr_t expected, uint8_t levels) {
+  address_context_t a_ctx = {.va = va, .pid = PID};
+  a_ctx.permissions.val.read = 1;
+  walk_ctx_t w_ctx = {0};
+  uintptr_t pa = walk(&a_ctx, ctx, &w_ctx);
+  if (pa != expected || w_ctx.levels != levels) {
+    fprintf(stderr, "Walk of 0x%lx gave 0x%lx after %u reads, expected 0x%lx "
+                    "after %u.\n",
+            va, pa, w_ctx.levels, expected, levels);
+    return -1;
+  }
+  return 0;
+}
+
+static int expect_translation(ptw_sim_context_t *ctx, uintptr_t va,
+                              uintptr_t expected) {
+  permissions_t r = {0};
+  r.val.read = 1;
+  address_context_t a_ctx;
+  populate_address_context(&a_ctx, va, r, 0, PID);
+  uintptr_t pa = translate(&a_ctx, ctx);
+  if (pa != expected) {
+    fprintf(stderr, "0x%lx translated to 0x%lx, expected 0x%lx.\n", va, pa,
+            expected);
+    return -1;
+  }
+  return 0;
+}
+
+static int check_5level(ptw_sim_context_t *ctx, pte_format_t format) {
+  sim_config_t cfg;
+  default_sim_config(&cfg);
+  cfg.pte_format = format;
+  cfg.pt_levels = PT_LEVELS_LA57;
+  teardown_sim_context(ctx, MAX_PID);
+  configure_sim_context(ctx, MAX_PID, &cfg);
+
+  permissions_t r = {0};
+  r.val.read = 1;
+  if (setup_mapping(ctx, PID, HIGH_VA, HIGH_PA, FOUR_K, r) != 0 ||
+      setup_mapping(ctx, PID, LOW_VA, LOW_PA, FOUR_K, r) != 0) {
+    return -1;
+  }
+
+  // The two pages share no table, so each level has two
+  const pt_arena_t *arena = ctx->page_table_arenas[PID];
+  static const uint64_t tables[PT_LEVELS_LA57] = {1, 2, 2, 2, 2};
+  for (uint8_t level = 0; level < PT_LEVELS_LA57; level++) {
+    if (arena->tables[level] != tables[level]) {
+      fprintf(stderr, "%lu %s tables, expected %lu.\n", arena->tables[level],
+              pt_level_name(PT_LEVELS_LA57, level), tables[level]);
+      return -1;
+    }
+  }
+
+  // A cold walk reads one more entry than with 4 levels. The PDE cache then
+  // skips every level but the PTE, and the SDP cache all but the PML5.
+  flush_pwcs(ctx);
+  if (expect_walk(ctx, HIGH_VA + 0x123, HIGH_PA + 0x123, PT_LEVELS_LA57) !=
+          0 ||
+      expect_walk(ctx, HIGH_VA, HIGH_PA, 1) != 0 ||
+      expect_walk(ctx, LOW_VA, LOW_PA, PT_LEVELS_LA57) != 0 ||
+      ctx->walk_stats.depth[PT_LEVELS_LA57] != 2) {
+    return -1;
+  }
+  flush_pwc(ctx->pwc[PWC_PDE]);
+  flush_pwc(ctx->pwc[PWC_PDP]);
+  if (expect_walk(ctx, HIGH_VA, HIGH_PA, PT_LEVELS_LA57 - 2) != 0) {
+    return -1;
+  }
+
+  // Same low 48 bits as LOW_VA, so it would alias it with 4 levels
+  uintptr_t alias = LOW_VA | (1ULL << VA_SIZE);
+  if (expect_translation(ctx, LOW_VA, LOW_PA) != 0 ||
+      expect_translation(ctx, HIGH_VA, HIGH_PA) != 0 ||
+      expect_translation(ctx, alias, -EINVAL) != 0 ||
+      expect_walk(ctx, 1ULL << VA_SIZE_LA57, -EFAULT, 0) != 0) {
+    return -1;
+  }
+
+  // Only the first translations of each page walked
+  uint64_t walks = ctx->walk_stats.walks;
+  if (expect_translation(ctx, HIGH_VA + 0x8, HIGH_PA + 0x8) != 0 ||
+      expect_translation(ctx, LOW_VA + 0x8, LOW_PA + 0x8) != 0 ||
+      ctx->walk_stats.walks != walks) {
+    fprintf(stderr, "High and low pages didn't both stay in the TLBs.\n");
+    return -1;
+  }
+
+  if (unmap_range(ctx, PID, HIGH_VA, 1ULL << 12) != 0 ||
+      expect_translation(ctx, HIGH_VA, -EINVAL) != 0 ||
+      setup_mapping(ctx, PID, 1ULL << VA_SIZE_LA57, HIGH_PA, FOUR_K, r) ==
+          0) {
+    return -1;
+  }
+  return 0;
+}
+
+int run_la57_test(ptw_sim_context_t *ctx) {
+  if (check_5level(ctx, PTE_FORMAT_SIM) != 0 ||
+      check_5level(ctx, PTE_FORMAT_HW) != 0) {
+    return -1;
+  }
+
+  // 4-level paging can't map the high page, and doesn't alias it either
+  sim_config_t cfg;
+  default_sim_config(&cfg);
+  teardown_sim_context(ctx, MAX_PID);
+  configure_sim_context(ctx, MAX_PID, &cfg);
+  permissions_t r = {0};
+  r.val.read = 1;
+  if (setup_mapping(ctx, PID, HIGH_VA & ((1ULL << VA_SIZE) - 1), HIGH_PA,
+                    FOUR_K, r) != 0 ||
+      setup_mapping(ctx, PID, HIGH_VA, HIGH_PA, FOUR_K, r) == 0 ||
+      expect_walk(ctx, HIGH_VA, -EFAULT, 0) != 0) {
+    return -1;
+  }
+
+  printf("5-level paging test passed!\n");
+  return 0;
+}
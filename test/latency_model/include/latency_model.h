@@ -0,0 +1,27 @@
+/**
+ * File with test functions for translation latency test
+ */
+
+#ifndef LATENCY_MODEL_H
+#define LATENCY_MODEL_H
+
+#include "page_table_api.h"
+
+/**
+ * @brief Checks the cycles charged to each kind of translation.
+ *
+ * Turns the data caches off so every page table read costs the same, and
+ * uses latencies of distinct magnitudes so every sum is unambiguous, then
+ * translates a cold walk, an L1 TLB hit, a walk shortened by the PDE
+ * paging-structure cache, an STLB hit, a fault, and a coalesced batch access.
+ * Each must cost what the model says, and the context totals must add up.
+ *
+ * @param ctx Pointer to the pre-allocated and initialized simulator context.
+ *
+ * @return
+ * - 0 on success.
+ * - Non-zero on failure.
+ */
+int run_latency_model_test(ptw_sim_context_t *ctx);
+
+#endif
@@ -0,0 +1,111 @@
+/**
+ * The functions to run the translation latency test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "latency_model.h"
+#include "test_utils.h"
+#include "tlb.h"
+#include "translation.h"
+
+#define PID 3
+#define PAGE_A_VA 0x10000ULL
+#define PAGE_A_PA 0x500000ULL
+#define PAGE_B_VA 0x11000ULL
+#define PAGE_B_PA 0x7000ULL
+// Under a different SDP entry, so no paging-structure cache can help
+#define UNMAPPED_VA 0x8000000000ULL
+
+#define L1_TLB 1
+#define STLB 10
+#define WALK_START 100
+#define PT_READ 1000
+#define FAULT 100000
+
+static int expect_cycles(ptw_sim_context_t *ctx, uint64_t va,
+                         permissions_t perms, uint32_t expected,
+                         const char *what) {
+  address_context_t a_ctx;
+  uint32_t cycles;
+  populate_address_context(&a_ctx, va, perms, 0, PID);
+  translate_timed(&a_ctx, ctx, &cycles);
+  if (cycles != expected) {
+    fprintf(stderr, "%s took %u cycles, expected %u.\n", what, cycles,
+            expected);
+    return -1;
+  }
+  return 0;
+}
+
+int run_latency_model_test(ptw_sim_context_t *ctx) {
+  // Without data caches, every page table read costs the same
+  sim_config_t cfg;
+  default_sim_config(&cfg);
+  for (int level = 0; level < CACHE_LEVELS; level++) {
+    cfg.dcache[level].size = 0;
+  }
+  teardown_sim_context(ctx, MAX_PID);
+  configure_sim_context(ctx, MAX_PID, &cfg);
+
+  permissions_t perms = {0};
+  perms.val.read = 1;
+  if (setup_mapping(ctx, PID, PAGE_A_VA, PAGE_A_PA, FOUR_K, perms) != 0 ||
+      setup_mapping(ctx, PID, PAGE_B_VA, PAGE_B_PA, FOUR_K, perms) != 0) {
+    return -1;
+  }
+
+  ctx->latency = (latency_model_t){.l1_tlb = L1_TLB,
+                                   .stlb = STLB,
+                                   .walk_start = WALK_START,
+                                   .pt_read = PT_READ,
+                                   .fault = FAULT};
+
+  uint32_t tlb_miss = L1_TLB + STLB;
+  if (expect_cycles(ctx, PAGE_A_VA, perms,
+                    tlb_miss + WALK_START + PT_LEVELS * PT_READ,
+                    "Cold walk") != 0 ||
+      expect_cycles(ctx, PAGE_A_VA, perms, L1_TLB, "L1 TLB hit") != 0 ||
+      expect_cycles(ctx, PAGE_B_VA, perms, tlb_miss + WALK_START + PT_READ,
+                    "PDE PWC walk") != 0) {
+    return -1;
+  }
+
+  flush_tlb(ctx->fourk_tlb);
+  if (expect_cycles(ctx, PAGE_A_VA, perms, tlb_miss, "STLB hit") != 0 ||
+      expect_cycles(ctx, UNMAPPED_VA, perms,
+                    tlb_miss + WALK_START + PT_READ + FAULT, "Fault") != 0) {
+    return -1;
+  }
+
+  // The 4K TLB flush left page B in the STLB only. The second access is on
+  // the same page and never reaches the TLBs.
+  address_context_t in[2];
+  translation_result_t out[2];
+  populate_address_context(&in[0], PAGE_B_VA, perms, 0, PID);
+  populate_address_context(&in[1], PAGE_B_VA + 0x40, perms, 0, PID);
+  if (translate_batch(ctx, in, 2, out) != 2 || out[0].cycles != tlb_miss ||
+      out[1].cycles != L1_TLB) {
+    fprintf(stderr, "Batch took %u and %u cycles, expected %u and %u.\n",
+            out[0].cycles, out[1].cycles, tlb_miss, L1_TLB);
+    return -1;
+  }
+
+  const cycle_stats_t *stats = &ctx->cycle_stats;
+  uint64_t walk_cycles =
+      3 * WALK_START + (PT_LEVELS + 1 + 1) * (uint64_t)PT_READ;
+  if (stats->translations != 7 ||
+      stats->tlb_cycles != 5 * tlb_miss + 2 * L1_TLB ||
+      stats->walk_cycles != walk_cycles || stats->fault_cycles != FAULT) {
+    fprintf(stderr,
+            "Charged %lu translations: TLB %lu, walk %lu, fault %lu "
+            "cycles.\n",
+            stats->translations, stats->tlb_cycles, stats->walk_cycles,
+            stats->fault_cycles);
+    return -1;
+  }
+
+  printf("Translation latency test passed!\n");
+  return 0;
+}
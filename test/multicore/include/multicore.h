@@ -0,0 +1,28 @@
+/**
+ * File with test functions for multi-core shootdown test
+ */
+
+#ifndef MULTICORE_H
+#define MULTICORE_H
+
+#include "page_table_api.h"
+
+/**
+ * @brief Checks that mapping changes are shot down on every core.
+ *
+ * Rebuilds the context with three cores. Two of them cache a page, then one
+ * remaps it. The other must see the new mapping, and the shootdown must cost
+ * one IPI. An unmap must make the page fault on every core, and a large
+ * unmap must flush the PID instead of invalidating page by page. Finally,
+ * every core reads and writes a read-write page before it is remapped, and
+ * must see the new mapping for both.
+ *
+ * @param ctx Pointer to the pre-allocated and initialized simulator context.
+ *
+ * @return
+ * - 0 on success.
+ * - Non-zero on failure.
+ */
+int run_multicore_test(ptw_sim_context_t *ctx);
+
+#endif
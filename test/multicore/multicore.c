@@ -0,0 +1,155 @@
+/**
+ * The functions to run the multi-core shootdown test
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "address_space.h"
+#include "multicore.h"
+#include "shootdown.h"
+#include "sim_config.h"
+#include "sim_context.h"
+#include "test_utils.h"
+#include "translation.h"
+
+#define N_CORES 3
+#define PID 1
+#define PAGE_VA 0x200000ULL
+#define OLD_PA 0x40000ULL
+#define NEW_PA 0x80000ULL
+#define RANGE_VA 0x40000000ULL
+#define RANGE_PA 0x10000000ULL
+#define RANGE_PAGES 64
+#define RW_VA 0x201000ULL
+
+static uintptr_t access_on(ptw_sim_context_t *ctx, uint32_t core,
+                           uintptr_t va, bool write) {
+  address_context_t a_ctx = {.va = va, .pid = PID};
+  a_ctx.permissions.val.read = !write;
+  a_ctx.permissions.val.write = write;
+  switch_core(ctx, core);
+  return translate(&a_ctx, ctx);
+}
+
+static uintptr_t translate_on(ptw_sim_context_t *ctx, uint32_t core,
+                              uintptr_t va) {
+  return access_on(ctx, core, va, false);
+}
+
+/**
+ * Every core reads and writes a read-write page, then one remaps it. Reads
+ * and writes must see the new PA on every core.
+ */
+static int check_rw_remap(ptw_sim_context_t *ctx) {
+  permissions_t rw = {0};
+  rw.val.read = 1;
+  rw.val.write = 1;
+  if (setup_mapping(ctx, PID, RW_VA, OLD_PA, FOUR_K, rw) != 0) {
+    return -1;
+  }
+  for (uint32_t core = 0; core < N_CORES; core++) {
+    if (access_on(ctx, core, RW_VA, false) != OLD_PA ||
+        access_on(ctx, core, RW_VA, true) != OLD_PA) {
+      fprintf(stderr, "Read-write page translated wrong on core %u.\n",
+              core);
+      return -1;
+    }
+  }
+
+  if (setup_mapping(ctx, PID, RW_VA, NEW_PA, FOUR_K, rw) != 0) {
+    return -1;
+  }
+  // Writes first, so a stale entry left by the earlier write gets hit
+  // before a read walks again
+  for (uint32_t core = 0; core < N_CORES; core++) {
+    for (int write = 1; write >= 0; write--) {
+      uintptr_t pa = access_on(ctx, core, RW_VA + 0x10, write);
+      if (pa != NEW_PA + 0x10) {
+        fprintf(stderr,
+                "Core %u %s 0x%lx after the remap, expected 0x%llx.\n", core,
+                write ? "writes" : "reads", pa, NEW_PA + 0x10);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+int run_multicore_test(ptw_sim_context_t *ctx) {
+  sim_config_t cfg;
+  default_sim_config(&cfg);
+  cfg.n_cores = N_CORES;
+  teardown_sim_context(ctx, MAX_PID);
+  configure_sim_context(ctx, MAX_PID, &cfg);
+
+  permissions_t perms = {0};
+  perms.val.read = 1;
+  if (setup_mapping(ctx, PID, PAGE_VA, OLD_PA, FOUR_K, perms) != 0) {
+    return -1;
+  }
+
+  // Cores 0 and 1 cache the page. Core 2 never runs the PID.
+  if (translate_on(ctx, 0, PAGE_VA) != OLD_PA ||
+      translate_on(ctx, 1, PAGE_VA) != OLD_PA) {
+    fprintf(stderr, "Initial translation failed.\n");
+    return -1;
+  }
+
+  // Core 1 remaps it: invalidate locally, one IPI to core 0
+  if (setup_mapping(ctx, PID, PAGE_VA, NEW_PA, FOUR_K, perms) != 0) {
+    return -1;
+  }
+  const shootdown_cost_t *c = &ctx->shootdown_cost;
+  const shootdown_stats_t *s = &ctx->shootdown_stats;
+  uint64_t initiator = c->invlpg + c->ipi_send + c->ipi_latency +
+                       c->ipi_handler + c->invlpg;
+  if (s->shootdowns != 1 || s->ipis != 1 || s->pages_invalidated != 2 ||
+      s->initiator_cycles != initiator ||
+      s->remote_cycles != c->ipi_handler + c->invlpg) {
+    fprintf(stderr, "Remap shootdown was not modeled as expected.\n");
+    print_shootdown_stats(stderr, ctx);
+    return -1;
+  }
+
+  if (translate_on(ctx, 0, PAGE_VA) != NEW_PA) {
+    fprintf(stderr, "Core 0 still sees the old mapping.\n");
+    return -1;
+  }
+
+  // Unmap from core 0. Core 1 must not keep a stale translation.
+  if (unmap_range(ctx, PID, PAGE_VA, KB(4)) != 0 ||
+      !IS_FAULT(translate_on(ctx, 1, PAGE_VA)) ||
+      !IS_FAULT(translate_on(ctx, 0, PAGE_VA))) {
+    fprintf(stderr, "Unmapped page still translates.\n");
+    return -1;
+  }
+
+  // A large unmap flushes the PID on each core that ran it
+  if (map_range(ctx, PID, RANGE_VA, RANGE_PA, RANGE_PAGES * KB(4), perms) !=
+      0) {
+    return -1;
+  }
+  for (uint32_t core = 0; core < N_CORES; core++) {
+    if (translate_on(ctx, core, RANGE_VA) != RANGE_PA) {
+      fprintf(stderr, "Range translation failed on core %u.\n", core);
+      return -1;
+    }
+  }
+  uint64_t ipis = s->ipis;
+  if (unmap_range(ctx, PID, RANGE_VA, RANGE_PAGES * KB(4)) != 0 ||
+      s->pid_flushes != N_CORES || s->ipis != ipis + N_CORES - 1 ||
+      !IS_FAULT(translate_on(ctx, 1, RANGE_VA))) {
+    fprintf(stderr, "Large unmap did not flush every core.\n");
+    print_shootdown_stats(stderr, ctx);
+    return -1;
+  }
+
+  if (check_rw_remap(ctx) != 0) {
+    return -1;
+  }
+
+  printf("Multi-core shootdown test passed!\n");
+  return 0;
+}
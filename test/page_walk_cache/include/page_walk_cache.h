@@ -0,0 +1,25 @@
+/**
+ * File with test functions for paging-structure cache test
+ */
+
+#ifndef PAGE_WALK_CACHE_H
+#define PAGE_WALK_CACHE_H
+
+#include "page_table_api.h"
+
+/**
+ * @brief Checks that walks resume at the deepest cached page table level.
+ *
+ * Walks a 4K page, a neighbour in the same PTE table, a page in another PTE
+ * table under the same PDP entry, and a 1G page under the same SDP entry, and
+ * checks how many levels each walk read and which caches hit.
+ *
+ * @param ctx Pointer to the pre-allocated and initialized simulator context.
+ *
+ * @return
+ * - 0 on success.
+ * - Non-zero on failure.
+ */
+int run_page_walk_cache_test(ptw_sim_context_t *ctx);
+
+#endif
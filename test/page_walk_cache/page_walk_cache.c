@@ -0,0 +1,91 @@
+/**
+ * The functions to run the paging-structure cache test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "page_table.h"
+#include "page_walk_cache.h"
+#include "pwc.h"
+#include "test_utils.h"
+
+#define PID 2
+
+/**
+ * Map a 4K page or 1G page and walk it
+ *
+ * Returns the number of levels read, or -1 if the walk gave the wrong address
+ */
+static int map_and_walk(ptw_sim_context_t *ctx, uintptr_t va, uintptr_t pa,
+                        page_size_t page_size) {
+  permissions_t perms = {0};
+  perms.val.read = 1;
+  if (setup_mapping(ctx, PID, va, pa, page_size, perms) != 0) {
+    return -1;
+  }
+
+  address_context_t a_ctx = {.va = va, .pid = PID};
+  a_ctx.permissions.val.read = 1;
+  walk_ctx_t w_ctx = {0};
+  if (walk(&a_ctx, ctx, &w_ctx) != pa) {
+    fprintf(stderr, "Walk of 0x%lx gave the wrong address.\n", va);
+    return -1;
+  }
+  return w_ctx.levels;
+}
+
+static bool check_hits(ptw_sim_context_t *ctx, uint64_t sdp, uint64_t pdp,
+                       uint64_t pde) {
+  if (ctx->pwc[PWC_SDP]->hits != sdp || ctx->pwc[PWC_PDP]->hits != pdp ||
+      ctx->pwc[PWC_PDE]->hits != pde) {
+    fprintf(stderr, "PWC hits %lu/%lu/%lu, expected %lu/%lu/%lu.\n",
+            ctx->pwc[PWC_SDP]->hits, ctx->pwc[PWC_PDP]->hits,
+            ctx->pwc[PWC_PDE]->hits, sdp, pdp, pde);
+    return false;
+  }
+  return true;
+}
+
+int run_page_walk_cache_test(ptw_sim_context_t *ctx) {
+  for (int level = 0; level < PWC_LEVELS; level++) {
+    if (ctx->pwc[level] == NULL) {
+      fprintf(stderr, "Default config has no PWC at level %d.\n", level);
+      return -1;
+    }
+  }
+
+  // Cold: all four levels
+  if (map_and_walk(ctx, 0x40201000, 0x1000000, FOUR_K) != 4 ||
+      !check_hits(ctx, 0, 0, 0)) {
+    return -1;
+  }
+
+  // Same PTE table: PDE cache hit, only the PTE is read
+  if (map_and_walk(ctx, 0x40202000, 0x1001000, FOUR_K) != 1 ||
+      !check_hits(ctx, 0, 0, 1)) {
+    return -1;
+  }
+
+  // Another 2M region under the same PDP entry: PDP cache hit
+  if (map_and_walk(ctx, 0x40400000, 0x1002000, FOUR_K) != 2 ||
+      !check_hits(ctx, 0, 1, 1)) {
+    return -1;
+  }
+
+  // A 1G page in the next PDP entry: SDP cache hit, the PDP entry is the leaf
+  if (map_and_walk(ctx, 0x80000000, 0xC0000000, ONE_G) != 1 ||
+      !check_hits(ctx, 1, 1, 1)) {
+    return -1;
+  }
+
+  // 4 + 1 + 2 + 1 entries read in 4 walks
+  if (ctx->walk_stats.walks != 4 || ctx->walk_stats.pt_reads != 8) {
+    fprintf(stderr, "Walk stats %lu walks %lu reads, expected 4 and 8.\n",
+            ctx->walk_stats.walks, ctx->walk_stats.pt_reads);
+    return -1;
+  }
+
+  printf("Page walk cache test passed!\n");
+  return 0;
+}
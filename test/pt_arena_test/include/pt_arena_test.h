@@ -0,0 +1,26 @@
+/**
+ * File with test functions for page table arena test
+ */
+
+#ifndef PT_ARENA_TEST_H
+#define PT_ARENA_TEST_H
+
+#include "page_table_api.h"
+
+/**
+ * @brief Checks tables handed out by the page table arena.
+ *
+ * Allocates enough tables to span several chunks and checks that each one is
+ * aligned, zeroed, and disjoint from the previous one, that the chunk count
+ * grows logarithmically, and that mappings set up in the context land in the
+ * PID's arena with the right per-level counts.
+ *
+ * @param ctx Pointer to the pre-allocated and initialized simulator context.
+ *
+ * @return
+ * - 0 on success.
+ * - Non-zero on failure.
+ */
+int run_pt_arena_test(ptw_sim_context_t *ctx);
+
+#endif
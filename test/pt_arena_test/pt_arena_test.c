@@ -0,0 +1,93 @@
+/**
+ * The functions to run the page table arena test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "pt_arena.h"
+#include "pt_arena_test.h"
+#include "test_utils.h"
+
+#define N_TABLES 1000
+#define PID 3
+
+static bool table_is_zero(const pte_t *table) {
+  const uint8_t *bytes = (const uint8_t *)table;
+  for (size_t i = 0; i < PT_TABLE_BYTES; i++) {
+    if (bytes[i] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static int check_standalone_arena(void) {
+  pt_arena_t *arena = create_pt_arena();
+  if (arena == NULL) {
+    return -1;
+  }
+
+  int ret = 0;
+  uint8_t *prev = NULL;
+  for (int i = 0; i < N_TABLES && ret == 0; i++) {
+    pte_t *table =
+        (pte_t *)pt_arena_alloc(arena, PT_TABLE_BYTES, PT_LEVELS - 1);
+    if (table == NULL || (uintptr_t)table % PT_TABLE_ALIGN != 0 ||
+        !table_is_zero(table)) {
+      fprintf(stderr, "Table %d is NULL, misaligned or dirty.\n", i);
+      ret = -1;
+      break;
+    }
+
+    // Scribble on it so a table handed out twice would show up dirty
+    table[511].vpn = i + 1;
+    if (prev != NULL && (uint8_t *)table < prev + PT_TABLE_BYTES &&
+        (uint8_t *)table > prev - PT_TABLE_BYTES) {
+      fprintf(stderr, "Table %d overlaps table %d.\n", i, i - 1);
+      ret = -1;
+    }
+    prev = (uint8_t *)table;
+  }
+
+  // 1000 16 KiB tables fit in 64K + 128K + ... + 16M, 9 doubling chunks
+  if (ret == 0 && (arena->tables[PT_LEVELS - 1] != N_TABLES ||
+                   arena->n_chunks > 9)) {
+    fprintf(stderr, "Arena has %lu tables in %zu chunks.\n",
+            arena->tables[PT_LEVELS - 1], arena->n_chunks);
+    ret = -1;
+  }
+
+  destroy_pt_arena(arena);
+  return ret;
+}
+
+int run_pt_arena_test(ptw_sim_context_t *ctx) {
+  if (check_standalone_arena() != 0) {
+    return -1;
+  }
+
+  pt_arena_t *arena = ctx->page_table_arenas[PID];
+  if (arena == NULL || arena->tables[0] != 1) {
+    fprintf(stderr, "PID %d has no arena-backed root table.\n", PID);
+    return -1;
+  }
+
+  // Two 4K pages in different 1G regions: 2 PDP, 2 PDE and 2 PTE tables
+  permissions_t perms = {0};
+  perms.val.read = 1;
+  if (setup_mapping(ctx, PID, 0x1000, 0x5000, FOUR_K, perms) != 0 ||
+      setup_mapping(ctx, PID, 0x8000000000ULL, 0x6000, FOUR_K, perms) != 0) {
+    return -1;
+  }
+
+  if (arena->tables[1] != 2 || arena->tables[2] != 2 ||
+      arena->tables[3] != 2) {
+    fprintf(stderr, "Arena counts %lu/%lu/%lu, expected 2/2/2.\n",
+            arena->tables[1], arena->tables[2], arena->tables[3]);
+    return -1;
+  }
+
+  printf("Page table arena test passed!\n");
+  return 0;
+}
@@ -0,0 +1,26 @@
+/**
+ * File with test functions for page table data cache test
+ */
+
+#ifndef PT_DCACHE_H
+#define PT_DCACHE_H
+
+#include "page_table_api.h"
+
+/**
+ * @brief Checks that page table reads go through the data caches.
+ *
+ * Walks the same path with the entries in memory, in the L1D, in the L2, in
+ * the LLC, and in another core's private caches, and checks that each read
+ * costs the latency of the level that held it. Also checks that neighbouring
+ * entries share a line, and the cache geometry parser.
+ *
+ * @param ctx Pointer to the pre-allocated and initialized simulator context.
+ *
+ * @return
+ * - 0 on success.
+ * - Non-zero on failure.
+ */
+int run_pt_dcache_test(ptw_sim_context_t *ctx);
+
+#endif
@@ -0,0 +1,154 @@
+/**
+ * The functions to run the page table data cache test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "dcache.h"
+#include "pt_dcache.h"
+#include "pwc.h"
+#include "sim_context.h"
+#include "test_utils.h"
+#include "tlb.h"
+#include "translation.h"
+
+#define PID 4
+#define PAGE_A_VA 0x10000ULL
+#define PAGE_A_PA 0x500000ULL
+// Next PTE after page A's, so in the same cache line
+#define PAGE_B_VA 0x11000ULL
+#define PAGE_B_PA 0x7000ULL
+
+// Only page table reads cost anything, at distinct magnitudes
+#define L1D 1
+#define L2 10
+#define LLC 100
+#define MEMORY 1000
+
+/**
+ * Make the next access to any page walk from the root
+ */
+static void flush_translations(ptw_sim_context_t *ctx) {
+  flush_tlb(ctx->oneg_tlb);
+  flush_tlb(ctx->twom_tlb);
+  flush_tlb(ctx->fourk_tlb);
+  if (ctx->stlb != NULL) {
+    flush_tlb(ctx->stlb);
+  }
+  for (int level = 0; level < PWC_LEVELS; level++) {
+    if (ctx->pwc[level] != NULL) {
+      flush_pwc(ctx->pwc[level]);
+    }
+  }
+}
+
+static int expect_walk(ptw_sim_context_t *ctx, uint64_t va, uint32_t expected,
+                       const char *what) {
+  address_context_t a_ctx;
+  permissions_t perms = {0};
+  perms.val.read = 1;
+  populate_address_context(&a_ctx, va, perms, 0, PID);
+
+  uint32_t cycles;
+  translate_timed(&a_ctx, ctx, &cycles);
+  if (cycles != expected) {
+    fprintf(stderr, "%s took %u cycles, expected %u.\n", what, cycles,
+            expected);
+    return -1;
+  }
+  return 0;
+}
+
+static int check_geometry_parser() {
+  cache_geometry_t g;
+  if (parse_cache_geometry("32Kx8", &g) != 0 || g.size != 32 << 10 ||
+      g.ways != 8 || g.line_size != CACHE_LINE_SIZE ||
+      parse_cache_geometry("8Mx16x128", &g) != 0 || g.size != 8 << 20 ||
+      g.ways != 16 || g.line_size != 128) {
+    fprintf(stderr, "Failed to parse a cache geometry.\n");
+    return -1;
+  }
+
+  // 96 sets, a 48-byte line, no ways, trailing junk
+  static const char *bad[] = {"48Kx8", "32Kx8x48", "32Kx0", "32Kx8y", "x8"};
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    if (parse_cache_geometry(bad[i], &g) == 0) {
+      fprintf(stderr, "Accepted cache geometry '%s'.\n", bad[i]);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int run_pt_dcache_test(ptw_sim_context_t *ctx) {
+  if (check_geometry_parser() != 0) {
+    return -1;
+  }
+
+  sim_config_t cfg;
+  default_sim_config(&cfg);
+  cfg.n_cores = 2;
+  cfg.latency = (latency_model_t){
+      .l1d = L1D, .l2 = L2, .llc = LLC, .memory = MEMORY};
+  teardown_sim_context(ctx, MAX_PID);
+  configure_sim_context(ctx, MAX_PID, &cfg);
+
+  permissions_t perms = {0};
+  perms.val.read = 1;
+  if (setup_mapping(ctx, PID, PAGE_A_VA, PAGE_A_PA, FOUR_K, perms) != 0 ||
+      setup_mapping(ctx, PID, PAGE_B_VA, PAGE_B_PA, FOUR_K, perms) != 0) {
+    return -1;
+  }
+
+  // The cold walk misses everywhere. Page B's walk only reads its PTE, which
+  // came in with page A's.
+  if (expect_walk(ctx, PAGE_A_VA, PT_LEVELS * MEMORY, "Cold walk") != 0 ||
+      expect_walk(ctx, PAGE_B_VA, L1D, "Neighbouring PTE") != 0) {
+    return -1;
+  }
+
+  flush_translations(ctx);
+  if (expect_walk(ctx, PAGE_A_VA, PT_LEVELS * L1D, "L1D walk") != 0) {
+    return -1;
+  }
+
+  flush_translations(ctx);
+  flush_dcache(ctx->dcache[CACHE_L1D]);
+  if (expect_walk(ctx, PAGE_A_VA, PT_LEVELS * L2, "L2 walk") != 0) {
+    return -1;
+  }
+
+  flush_translations(ctx);
+  flush_dcache(ctx->dcache[CACHE_L1D]);
+  flush_dcache(ctx->dcache[CACHE_L2]);
+  if (expect_walk(ctx, PAGE_A_VA, PT_LEVELS * LLC, "LLC walk") != 0) {
+    return -1;
+  }
+
+  // Core 1 has cold private caches but shares the LLC
+  const data_cache_t *core0_l1d = ctx->dcache[CACHE_L1D];
+  switch_core(ctx, 1);
+  if (ctx->dcache[CACHE_L1D] == core0_l1d ||
+      expect_walk(ctx, PAGE_A_VA, PT_LEVELS * LLC, "Other core's walk") !=
+          0 ||
+      ctx->dcache[CACHE_L1D]->misses != PT_LEVELS ||
+      ctx->dcache[CACHE_L2]->misses != PT_LEVELS) {
+    return -1;
+  }
+  switch_core(ctx, 0);
+
+  // Core 0's L1D missed the cold walk and both walks after a flush. The LLC
+  // missed only the cold walk.
+  const data_cache_t *l1d = ctx->dcache[CACHE_L1D];
+  const data_cache_t *llc = ctx->dcache[CACHE_LLC];
+  if (l1d->hits != 1 + PT_LEVELS || l1d->misses != 3 * PT_LEVELS ||
+      llc->hits != 2 * PT_LEVELS || llc->misses != PT_LEVELS) {
+    fprintf(stderr, "L1D %lu hits %lu misses, LLC %lu hits %lu misses.\n",
+            l1d->hits, l1d->misses, llc->hits, llc->misses);
+    return -1;
+  }
+
+  printf("Page table data cache test passed!\n");
+  return 0;
+}
@@ -0,0 +1,26 @@
+/**
+ * File with test functions for sharded replay test
+ */
+
+#ifndef SHARDED_REPLAY_TEST_H
+#define SHARDED_REPLAY_TEST_H
+
+#include "page_table_api.h"
+
+/**
+ * @brief Checks that a sharded replay matches a single-threaded one.
+ *
+ * Writes a trace touching several PIDs, replays it on one context and then
+ * on three shards. The summed counters must match, and each shard must only
+ * have address spaces for its own PIDs. The same trace converted to the
+ * compact format must replay the same way.
+ *
+ * @param ctx Pointer to the pre-allocated and initialized simulator context.
+ *
+ * @return
+ * - 0 on success.
+ * - Non-zero on failure.
+ */
+int run_sharded_replay_test(ptw_sim_context_t *ctx);
+
+#endif
@@ -14,10 +14,10 @@ int run_simple_mapping_test(ptw_sim_context_t *ctx) {
   // Initialize test variables
   uintptr_t test_va_4k = 0x12345000;     // A virtual address to map (4K page)
   uintptr_t test_va_2m = 0x45678000;     // A virtual address to map (2M page)
-  uintptr_t test_va_1g = 0x789A0000;     // A virtual address to map (1G page)
+  uintptr_t test_va_1g = 0xF89A0000;     // A virtual address to map (1G page)
   uintptr_t expected_pa_4k = 0xABC45000; // Expected physical address (4K)
-  uintptr_t expected_pa_2m = 0xDEF78000; // Expected physical address (2M)
-  uintptr_t expected_pa_1g = 0x123A0000; // Expected physical address (1G)
+  uintptr_t expected_pa_2m = 0xDEE78000; // Expected physical address (2M)
+  uintptr_t expected_pa_1g = 0x789A0000; // Expected physical address (1G)
 
   // Define the PID and permissions for the mappings
   uint32_t test_pid = 1;
@@ -55,17 +55,28 @@ int run_simple_mapping_test(ptw_sim_context_t *ctx) {
 
   // Test 2M page translation
   a_ctx.va = test_va_2m;
-  result_pa += translate(&a_ctx, ctx);
+  result_pa = translate(&a_ctx, ctx);
   assert(result_pa == expected_pa_2m && "2M translation failed.");
 
   // Test 1G page translation
   a_ctx.va = test_va_1g;
-  result_pa += translate(&a_ctx, ctx);
+  result_pa = translate(&a_ctx, ctx);
   assert(result_pa == expected_pa_1g && "1G translation failed.");
 
+  // Translate again. These should all be TLB hits now.
+  a_ctx.va = test_va_4k;
+  result_pa = translate(&a_ctx, ctx);
+  assert(result_pa == expected_pa_4k && "4K TLB hit failed.");
+
+  a_ctx.va = test_va_2m;
+  result_pa = translate(&a_ctx, ctx);
+  assert(result_pa == expected_pa_2m && "2M TLB hit failed.");
+
+  a_ctx.va = test_va_1g;
+  result_pa = translate(&a_ctx, ctx);
+  assert(result_pa == expected_pa_1g && "1G TLB hit failed.");
+
   // If all tests pass
-  if (result_pa == 0) {
-    printf("All translations passed!\n");
-  }
-  return result_pa;
+  printf("All translations passed!\n");
+  return 0;
 }
@@ -0,0 +1,25 @@
+/**
+ * File with test functions for statistics export test
+ */
+
+#ifndef STATS_EXPORT_H
+#define STATS_EXPORT_H
+
+#include "page_table_api.h"
+
+/**
+ * @brief Checks the walk histograms, the per-PID counters, and their export.
+ *
+ * Translates a cold walk, a TLB hit, an unmapped page and a write to a
+ * read-only page, then checks the page size, depth and fault type counts,
+ * and that the CSV and JSON exports carry them.
+ *
+ * @param ctx Pointer to the pre-allocated and initialized simulator context.
+ *
+ * @return
+ * - 0 on success.
+ * - Non-zero on failure.
+ */
+int run_stats_export_test(ptw_sim_context_t *ctx);
+
+#endif
@@ -0,0 +1,117 @@
+/**
+ * The functions to run the statistics export test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "stats.h"
+#include "stats_export.h"
+#include "test_utils.h"
+#include "translation.h"
+
+#define PID 5
+#define PAGE_A_VA 0x40000ULL
+#define PAGE_A_PA 0x300000ULL
+#define READ_ONLY_VA 0x41000ULL
+#define READ_ONLY_PA 0x301000ULL
+// Under a different SDP entry, so the walk stops after one read
+#define UNMAPPED_VA 0x8000000000ULL
+
+#define EXPORT_SIZE 16384
+
+static uintptr_t translate_va(ptw_sim_context_t *ctx, uint64_t va,
+                              permissions_t perms) {
+  address_context_t a_ctx;
+  populate_address_context(&a_ctx, va, perms, 0, PID);
+  return translate(&a_ctx, ctx);
+}
+
+/**
+ * Export `ctx` and check that every string in `expected` is in the output
+ */
+static int check_export(const ptw_sim_context_t *ctx, stats_format_t format,
+                        const char *const *expected, size_t n_expected) {
+  static char buf[EXPORT_SIZE];
+  FILE *f = tmpfile();
+  if (f == NULL) {
+    return -1;
+  }
+
+  write_stats(f, format, ctx, NULL);
+  rewind(f);
+  size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+  buf[len] = '\0';
+  fclose(f);
+
+  for (size_t i = 0; i < n_expected; i++) {
+    if (strstr(buf, expected[i]) == NULL) {
+      fprintf(stderr, "Export is missing '%s':\n%s", expected[i], buf);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int run_stats_export_test(ptw_sim_context_t *ctx) {
+  permissions_t read = {0};
+  read.val.read = 1;
+  permissions_t write = read;
+  write.val.write = 1;
+  if (setup_mapping(ctx, PID, PAGE_A_VA, PAGE_A_PA, FOUR_K, read) != 0 ||
+      setup_mapping(ctx, PID, READ_ONLY_VA, READ_ONLY_PA, FOUR_K, read) != 0) {
+    return -1;
+  }
+
+  if (translate_va(ctx, PAGE_A_VA, read) != PAGE_A_PA ||
+      translate_va(ctx, PAGE_A_VA, read) != PAGE_A_PA ||
+      translate_va(ctx, UNMAPPED_VA, read) != (uintptr_t)-EINVAL ||
+      translate_va(ctx, READ_ONLY_VA, write) != (uintptr_t)-EUNAUTHORIZED) {
+    fprintf(stderr, "Unexpected translation.\n");
+    return -1;
+  }
+
+  // The cold walk reads all 4 levels, the unmapped one stops at the SDP, and
+  // the read-only page is reached through the PDE cache
+  const walk_stats_t *ws = &ctx->walk_stats;
+  if (ws->walks != 3 || ws->leaves[FOUR_K] != 1 || ws->depth[PT_LEVELS] != 1 ||
+      ws->depth[1] != 2 || ws->faults[EINVAL] != 1 ||
+      ws->faults[EUNAUTHORIZED] != 1) {
+    fprintf(stderr, "Unexpected walk histograms.\n");
+    return -1;
+  }
+
+  const pid_stats_t *p = &ctx->pid_stats[PID];
+  if (p->translations != 4 || p->tlb_hits != 1 || p->walks != 1 ||
+      p->faults != 2 || p->cycles != ctx->cycle_stats.tlb_cycles +
+                                         ctx->cycle_stats.walk_cycles +
+                                         ctx->cycle_stats.fault_cycles) {
+    fprintf(stderr, "Unexpected per-PID counters.\n");
+    return -1;
+  }
+
+  static const char *const csv[] = {
+      "section,component,counter,value\n",
+      "tlbs,l1_4k,hits,1\n",
+      "walks,,walks,3\n",
+      "walk_page_sizes,,4k,1\n",
+      "walk_depths,,4,1\n",
+      "walk_faults,,not_present,1\n",
+      "walk_faults,,permission,1\n",
+      "pids,5,translations,4\n",
+  };
+  static const char *const json[] = {
+      "\"walk_depths\": {\n    \"0\": 0,\n    \"1\": 2,",
+      "\"pids\": {\n    \"5\": {\n      \"translations\": 4,",
+      "\"user_supervisor\": 0\n  },",
+  };
+  if (check_export(ctx, STATS_CSV, csv, sizeof(csv) / sizeof(csv[0])) != 0 ||
+      check_export(ctx, STATS_JSON, json, sizeof(json) / sizeof(json[0])) !=
+          0) {
+    return -1;
+  }
+
+  printf("Statistics export test passed!\n");
+  return 0;
+}
@@ -0,0 +1,27 @@
+/**
+ * File with test functions for STLB test
+ */
+
+#ifndef STLB_H
+#define STLB_H
+
+#include "page_table_api.h"
+
+/**
+ * @brief Checks that the STLB catches L1 TLB misses for mixed page sizes.
+ *
+ * Maps a 4K page and a 2M page whose VPNs have the same value, so both land
+ * in the same STLB set. Translates both, flushes the L1 TLBs, and translates
+ * again. The second round must hit in the STLB, return the same addresses,
+ * and refill the L1 TLBs. Then alternates reads and writes to the read-write
+ * 4K page, which must walk once and take a single STLB entry.
+ *
+ * @param ctx Pointer to the pre-allocated and initialized simulator context.
+ *
+ * @return
+ * - 0 on success.
+ * - Non-zero on failure.
+ */
+int run_stlb_test(ptw_sim_context_t *ctx);
+
+#endif
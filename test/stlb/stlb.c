@@ -0,0 +1,141 @@
+/**
+ * The functions to run the STLB test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "stlb.h"
+#include "test_utils.h"
+#include "tlb.h"
+#include "translation.h"
+
+// Same VPN value (0x123) as a 4K page and as a 2M page
+#define FOURK_VA 0x123000ULL
+#define FOURK_PA 0xABC000ULL
+#define TWOM_VA 0x24600000ULL
+#define TWOM_PA 0x80000000ULL
+#define OFFSET 0x456ULL
+
+static int translate_both(ptw_sim_context_t *ctx) {
+  address_context_t a_ctx = {.pid = 1};
+  a_ctx.permissions.val.read = 1;
+
+  a_ctx.va = FOURK_VA + OFFSET;
+  if (translate(&a_ctx, ctx) != FOURK_PA + OFFSET) {
+    fprintf(stderr, "4K page translated wrong.\n");
+    return -1;
+  }
+
+  a_ctx.va = TWOM_VA + OFFSET;
+  if (translate(&a_ctx, ctx) != TWOM_PA + OFFSET) {
+    fprintf(stderr, "2M page translated wrong.\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Count the STLB entries caching the 4K page at `va` of `pid`
+ */
+static uint32_t stlb_copies(const tlb_t *stlb, uint64_t va, uint32_t pid) {
+  uint32_t copies = 0;
+  for (uint32_t i = 0; i < stlb->sets * stlb->ways; i++) {
+    tlbe_t e;
+    get_tlb_entry(stlb, i, &e);
+    copies += e.valid && e.page_size == FOUR_K && e.va == va && e.pid == pid;
+  }
+  return copies;
+}
+
+/**
+ * Alternate reads and writes to one read-write page. The first walk caches
+ * the page's rights, so the rest hit and the page takes one entry.
+ */
+static int check_mixed_access(ptw_sim_context_t *ctx) {
+  address_context_t a_ctx = {.va = FOURK_VA + OFFSET, .pid = 1};
+  uint64_t walks = ctx->walk_stats.walks;
+  for (int i = 0; i < 4; i++) {
+    a_ctx.permissions.raw = 0;
+    a_ctx.permissions.val.read = i % 2 == 0;
+    a_ctx.permissions.val.write = i % 2 == 1;
+    if (translate(&a_ctx, ctx) != FOURK_PA + OFFSET) {
+      fprintf(stderr, "Access %d to the 4K page translated wrong.\n", i);
+      return -1;
+    }
+    clear_tlb(ctx->fourk_tlb);
+  }
+
+  uint32_t copies = stlb_copies(ctx->stlb, FOURK_VA, 1);
+  if (copies != 1 || ctx->walk_stats.walks != walks + 1) {
+    fprintf(stderr, "Mixed accesses walked %lu times and left %u STLB "
+                    "entries, expected 1 and 1.\n",
+            ctx->walk_stats.walks - walks, copies);
+    return -1;
+  }
+  return 0;
+}
+
+int run_stlb_test(ptw_sim_context_t *ctx) {
+  if (ctx->stlb == NULL) {
+    fprintf(stderr, "Default config has no STLB.\n");
+    return -1;
+  }
+
+  permissions_t perms = {0};
+  perms.val.read = 1;
+  perms.val.write = 1;
+  if (setup_mapping(ctx, 1, FOURK_VA, FOURK_PA, FOUR_K, perms) != 0 ||
+      setup_mapping(ctx, 1, TWOM_VA, TWOM_PA, TWO_M, perms) != 0) {
+    return -1;
+  }
+
+  // First round walks and fills both levels
+  if (translate_both(ctx) != 0) {
+    return -1;
+  }
+  if (ctx->stlb->hits != 0 || ctx->stlb->misses != 2) {
+    fprintf(stderr, "STLB should have missed twice, saw %lu hits %lu "
+                    "misses.\n",
+            ctx->stlb->hits, ctx->stlb->misses);
+    return -1;
+  }
+
+  // Both entries share a set but must not alias
+  uint32_t set = tlb_set_index(ctx->stlb, FOURK_VA, FOUR_K);
+  if (set != tlb_set_index(ctx->stlb, TWOM_VA, TWO_M) ||
+      ctx->stlb->slots_in_use[set] != 2) {
+    fprintf(stderr, "STLB set %u should hold both pages.\n", set);
+    return -1;
+  }
+
+  // Second round must be served by the STLB
+  clear_tlb(ctx->twom_tlb);
+  clear_tlb(ctx->fourk_tlb);
+  if (translate_both(ctx) != 0) {
+    return -1;
+  }
+  if (ctx->stlb->hits != 2) {
+    fprintf(stderr, "STLB should have hit twice, saw %lu.\n",
+            ctx->stlb->hits);
+    return -1;
+  }
+
+  // And the STLB hits refilled the L1 TLBs
+  uint64_t stlb_lookups = ctx->stlb->hits + ctx->stlb->misses;
+  if (translate_both(ctx) != 0 ||
+      ctx->stlb->hits + ctx->stlb->misses != stlb_lookups) {
+    fprintf(stderr, "L1 TLBs were not refilled from the STLB.\n");
+    return -1;
+  }
+
+  flush_tlb(ctx->stlb);
+  clear_tlb(ctx->fourk_tlb);
+  if (check_mixed_access(ctx) != 0) {
+    return -1;
+  }
+
+  printf("STLB test passed!\n");
+  return 0;
+}
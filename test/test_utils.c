@@ -8,22 +8,17 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "address_space.h"
 #include "config.h"
 #include "hw_structures.h"
 #include "page_table.h"
 #include "page_table_api.h"
+#include "sim_config.h"
+#include "sim_context.h"
 #include "test_utils.h"
 #include "tlb.h"
 #include "util.h"
 
-uintptr_t allocate_physical_frame(uintptr_t vpn) {
-  static uintptr_t next_frame =
-      0x100000; // Example start address for physical memory
-  uintptr_t frame = next_frame;
-  next_frame += FOUR_K; // Increment by 4KB for each allocation
-  return frame;
-}
-
 void populate_address_context(address_context_t *a_ctx, uint64_t va,
                               permissions_t permissions,
                               uint8_t user_supervisor, uint32_t pid) {
@@ -40,18 +35,22 @@ void populate_address_context(address_context_t *a_ctx, uint64_t va,
 /**
  * @brief Helper function to initialize a TLB.
  *
- * @param tlb Pointer to the TLB structure to initialize.
+ * @param tlb_ptr Pointer to the TLB pointer to set to the new TLB.
+ * @param geometry Sets and ways of the new TLB.
+ * @param page_sizes PG_SIZE_BIT() of each page size the TLB caches.
+ * @param policy Replacement policy.
  */
-void initialize_tlb(tlb_t *tlb) {
-
-  tlb = (tlb_t *)malloc(sizeof(tlb_t));
-
-  memset(tlb, 0, sizeof(tlb_t));
+void initialize_tlb(tlb_t **tlb_ptr, tlb_geometry_t geometry,
+                    uint8_t page_sizes, repl_policy_kind_t policy) {
 
-  // Optionally initialize each TLB entry to a default invalid state
-  for (size_t i = 0; i < TLB_ENTRY_COUNT; i++) {
-    tlb->arr[i].valid = 0; // Mark all entries as invalid initially
+  tlb_t *tlb = create_tlb(geometry, page_sizes, policy);
+  if (tlb == NULL) {
+    fprintf(stderr, "Error: Failed to create %ux%u %s TLB.\n", geometry.sets,
+            geometry.ways, repl_policy_name(policy));
+    exit(EXIT_FAILURE);
   }
+
+  *tlb_ptr = tlb;
 }
 
 page_table_entry_t *allocate_page_table() {
@@ -63,91 +62,27 @@ page_table_entry_t *allocate_page_table() {
   }
 
   // Initialize each entry in the page table
-  for (size_t i = 0; i < 512; i++) {
-    table[i].phys_frame.oneg_pte_index = 0;
-    table[i].phys_frame.twom_pte_index = 0;
-    table[i].phys_frame.fourk_pte_index = 0;
-    table[i].vpn = 0;
-    table[i].page_metadata.valid = 0; // Mark as invalid initially
-    table[i].page_metadata.permissions.raw = 0;
-    table[i].page_metadata.page_size = 0;
-  }
+  // Zeroing covers the bitfields too, so every entry starts invalid
+  memset(table, 0, sizeof(page_table_entry_t) * 512);
   return table;
 }
 
-void populate_sim_context(ptw_sim_context_t *ctx, size_t max_pid) {
+void initialize_sim_context(ptw_sim_context_t *ctx, size_t max_pid) {
+  sim_config_t cfg;
+  default_sim_config(&cfg);
+  configure_sim_context(ctx, max_pid, &cfg);
+}
+
+void configure_sim_context(ptw_sim_context_t *ctx, size_t max_pid,
+                           const sim_config_t *cfg) {
   if (ctx == NULL) {
-    return; // Handle null pointer gracefully.
+    return;
   }
 
-  // Initialize the TLBs
-  initialize_tlb(ctx->oneg_tlb);  // 1GB page TLB
-  initialize_tlb(ctx->twom_tlb);  // 2MB page TLB
-  initialize_tlb(ctx->fourk_tlb); // 4KB page TLB
-
-  // Initialize the page table pointers for each PID
-  for (size_t pid = 0; pid < max_pid && pid < MAX_PID; pid++) {
-    // Allocate memory for the SDP table (1st level)
-    ctx->page_table_pointers[pid] = allocate_page_table();
-
-    // Populate the SDP table
-    for (size_t sdp_idx = 0; sdp_idx < 512; sdp_idx++) {
-      page_table_entry_t *sdp_entry = &ctx->page_table_pointers[pid][sdp_idx];
-
-      // Allocate memory for PDP table (2nd level)
-      sdp_entry->phys_frame.oneg_pte_index = (uintptr_t)allocate_page_table();
-      sdp_entry->page_metadata.valid = 1;
-      sdp_entry->page_metadata.page_size = PG_SIZE_MAX; // Set to SDP level size
-      sdp_entry->vpn = (pid << 20) | sdp_idx;           // Example VPN
-
-      // Populate the PDP table
-      page_table_entry_t *pdp_table =
-          (page_table_entry_t *)sdp_entry->phys_frame.oneg_pte_index;
-      for (size_t pdp_idx = 0; pdp_idx < 512; pdp_idx++) {
-        page_table_entry_t *pdp_entry = &pdp_table[pdp_idx];
-
-        // Allocate memory for PDE table (3rd level)
-        pdp_entry->phys_frame.twom_pte_index = (uintptr_t)allocate_page_table();
-        pdp_entry->page_metadata.valid = 1;
-        pdp_entry->page_metadata.page_size = ONE_G; // Set to PDP level size
-        pdp_entry->vpn = (sdp_idx << 9) | pdp_idx;  // Example VPN
-
-        // Populate the PDE table
-        page_table_entry_t *pde_table =
-            (page_table_entry_t *)pdp_entry->phys_frame.twom_pte_index;
-        for (size_t pde_idx = 0; pde_idx < 512; pde_idx++) {
-          page_table_entry_t *pde_entry = &pde_table[pde_idx];
-
-          // Allocate memory for PTE table (4th level)
-          pde_entry->phys_frame.fourk_pte_index =
-              (uintptr_t)allocate_page_table();
-          pde_entry->page_metadata.valid = 1;
-          pde_entry->page_metadata.page_size = TWO_M; // Set to PDE level size
-          pde_entry->vpn = (pdp_idx << 9) | pde_idx;  // Example VPN
-
-          // Populate the PTE table
-          page_table_entry_t *pte_table =
-              (page_table_entry_t *)pde_entry->phys_frame.fourk_pte_index;
-          for (size_t pte_idx = 0; pte_idx < 512; pte_idx++) {
-            page_table_entry_t *pte_entry = &pte_table[pte_idx];
-
-            // Set up leaf-level PTE
-            pte_entry->page_metadata.valid = 1;
-            pte_entry->page_metadata.page_size = FOUR_K; // Leaf size
-            pte_entry->vpn = (pde_idx << 9) | pte_idx;   // Example VPN
-            pte_entry->phys_frame.fourk_pte_index = allocate_physical_frame(
-                pte_entry->vpn); // Allocate physical frame
-            pte_entry->page_metadata.permissions.val.read = 0;
-            pte_entry->page_metadata.permissions.val.write = 0;
-            pte_entry->page_metadata.permissions.val.execute = 0;
-          }
-        }
-      }
-    }
+  if (create_sim_context(ctx, max_pid, cfg) != 0) {
+    fprintf(stderr, "Error: Failed to create simulation context.\n");
+    exit(EXIT_FAILURE);
   }
-
-  // Initialize any additional backend management structures here
-  // e.g., page fault handlers, statistics tracking, etc.
 }
 
 void initialize_page_table_entry(page_table_entry_t *entry, uint32_t pid,
@@ -176,153 +111,18 @@ void teardown_sim_context(ptw_sim_context_t *ctx, size_t max_pid) {
   if (!ctx)
     return;
 
-  // Iterate over all PIDs to free page table memory
-  for (size_t pid = 0; pid < max_pid; pid++) {
-    page_table_entry_t *sdp_base = ctx->page_table_pointers[pid];
-
-    if (!sdp_base)
-      continue;
-
-    // Free each level of page table entries
-    for (size_t sdp_idx = 0; sdp_idx < NUM_ENTRIES_PER_PAGE; sdp_idx++) {
-      page_table_entry_t *pdp_base =
-          (page_table_entry_t *)sdp_base[sdp_idx].phys_frame.oneg_pte_index;
-      if (!pdp_base)
-        continue;
-
-      for (size_t pdp_idx = 0; pdp_idx < NUM_ENTRIES_PER_PAGE; pdp_idx++) {
-        page_table_entry_t *pde_base =
-            (page_table_entry_t *)pdp_base[pdp_idx].phys_frame.twom_pte_index;
-        if (!pde_base)
-          continue;
-
-        for (size_t pde_idx = 0; pde_idx < NUM_ENTRIES_PER_PAGE; pde_idx++) {
-          page_table_entry_t *pte_base = (page_table_entry_t *)pde_base[pde_idx]
-                                             .phys_frame.fourk_pte_index;
-          if (pte_base) {
-            free(pte_base); // Free PTE base
-          }
-        }
-
-        free(pde_base); // Free PDE base
-      }
-
-      free(pdp_base); // Free PDP base
-    }
-
-    free(sdp_base); // Free SDP base
-    ctx->page_table_pointers[pid] = NULL;
-  }
-
-  // Clear the TLBs (optional depending on simulator design)
-  clear_tlb(ctx->oneg_tlb);
-  clear_tlb(ctx->twom_tlb);
-  clear_tlb(ctx->fourk_tlb);
+  destroy_sim_context(ctx);
 }
 
 void clear_tlb(tlb_t *tlb) {
   if (!tlb)
     return;
 
-  // Clear all TLB entries
-  memset(tlb->arr, 0, sizeof(tlb_entry_t) * TLB_ENTRY_COUNT);
-
-  // Reset metadata (optional, depending on your implementation)
-  tlb->slots_in_use = 0;
-  for (int i = 0; i < TLB_ENTRY_COUNT; i++) {
-    tlb->arr[i].plru_counter = 0; // Reset any tracking of LRU or similar
-  }
+  // Clear all TLB entries, metadata and any LRU tracking
+  flush_tlb(tlb);
 }
 
 int setup_mapping(ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va,
                   uintptr_t pa, page_size_t page_size, permissions_t perms) {
-  if (!ctx || pid >= MAX_PID) {
-    fprintf(stderr, "Invalid context or PID.\n");
-    return -1;
-  }
-
-  // Step 1: Get the base page table for the given PID
-  pte_t *sdp_base = ctx->page_table_pointers[pid];
-  if (!sdp_base) {
-    fprintf(stderr, "Invalid page table base for PID %u.\n", pid);
-    return -1;
-  }
-
-  // Step 2: Navigate to the SDP entry
-  uint16_t sdp_idx = GET_SDP_ENTRY_IDX(va);
-  pte_t *sdp_entry = &sdp_base[sdp_idx];
-  if (!sdp_entry->page_metadata.valid) {
-    // Allocate a new page directory if not already present
-    sdp_entry->phys_frame.oneg_pte_index = (uintptr_t)allocate_page_table();
-    if (!sdp_entry->phys_frame.oneg_pte_index) {
-      fprintf(stderr, "Failed to allocate SDP table.\n");
-      return -1;
-    }
-    sdp_entry->page_metadata.valid = 1;
-  }
-
-  // Step 3: Navigate to the PDP entry
-  pte_t *pdp_base = (pte_t *)sdp_entry->phys_frame.oneg_pte_index;
-  uint16_t pdp_idx = GET_PDP_ENTRY_IDX(va);
-  pte_t *pdp_entry = &pdp_base[pdp_idx];
-  if (!pdp_entry->page_metadata.valid) {
-    pdp_entry->phys_frame.oneg_pte_index = (uintptr_t)allocate_page_table();
-    if (!pdp_entry->phys_frame.oneg_pte_index) {
-      fprintf(stderr, "Failed to allocate PDP table.\n");
-      return -1;
-    }
-    pdp_entry->page_metadata.valid = 1;
-  }
-
-  // If the page size is 1G, set up the mapping here
-  if (page_size == ONE_G) {
-    pdp_entry->page_metadata.valid = 1;
-    pdp_entry->page_metadata.page_size = ONE_G;
-    pdp_entry->page_metadata.permissions = perms;
-    pdp_entry->phys_frame.oneg_pte_index = pa;
-    return 0;
-  }
-
-  // Step 4: Navigate to the PDE entry
-  pte_t *pde_base = (pte_t *)pdp_entry->phys_frame.twom_pte_index;
-  uint16_t pde_idx = GET_PDE_ENTRY_IDX(va);
-  pte_t *pde_entry = &pde_base[pde_idx];
-  if (!pde_entry->page_metadata.valid) {
-    pde_entry->phys_frame.twom_pte_index = (uintptr_t)allocate_page_table();
-    if (!pde_entry->phys_frame.twom_pte_index) {
-      fprintf(stderr, "Failed to allocate PDE table.\n");
-      return -1;
-    }
-    pde_entry->page_metadata.valid = 1;
-  }
-
-  // If the page size is 2M, set up the mapping here
-  if (page_size == TWO_M) {
-    pde_entry->page_metadata.valid = 1;
-    pde_entry->page_metadata.page_size = TWO_M;
-    pde_entry->page_metadata.permissions = perms;
-    pde_entry->phys_frame.twom_pte_index = pa;
-    return 0;
-  }
-
-  // Step 5: Navigate to the PTE entry
-  pte_t *pte_base = (pte_t *)pde_entry->phys_frame.fourk_pte_index;
-  uint16_t pte_idx = GET_PTE_ENTRY_IDX(va);
-  pte_t *pte_entry = &pte_base[pte_idx];
-  if (!pte_entry->page_metadata.valid) {
-    pte_entry->page_metadata.valid = 1;
-  }
-
-  // Set up the final 4K mapping
-  if (page_size == FOUR_K) {
-    pte_entry->page_metadata.valid = 1;
-    pte_entry->page_metadata.page_size = FOUR_K;
-    pte_entry->page_metadata.permissions = perms;
-    pte_entry->phys_frame.fourk_pte_index = pa;
-    return 0;
-  }
-
-  // If we reached here, something went wrong
-  fprintf(stderr, "Invalid page size or mapping configuration.\n");
-  return -1;
+  return map_page(ctx, pid, va, pa, page_size, perms);
 }
@@ -0,0 +1,28 @@
+/**
+ * File with test functions for TLB invalidation test
+ */
+
+#ifndef TLB_INVALIDATE_H
+#define TLB_INVALIDATE_H
+
+#include "page_table_api.h"
+
+/**
+ * @brief Checks the selective TLB invalidation APIs.
+ *
+ * Caches translations of two PIDs, one of them for a global page, then
+ * invalidates one page, ranges below and above the flush threshold, one PID
+ * and every non-global entry, and checks that exactly the expected entries
+ * are dropped and the expected cycles charged. Then caches a read-write page
+ * through a read and a write and checks that invalidating it leaves no entry
+ * in any TLB.
+ *
+ * @param ctx Pointer to the pre-allocated and initialized simulator context.
+ *
+ * @return
+ * - 0 on success.
+ * - Non-zero on failure.
+ */
+int run_tlb_invalidate_test(ptw_sim_context_t *ctx);
+
+#endif
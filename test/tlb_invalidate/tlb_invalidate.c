@@ -0,0 +1,255 @@
+/**
+ * The functions to run the TLB invalidation test
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "address_space.h"
+#include "invalidate.h"
+#include "sim_context.h"
+#include "test_utils.h"
+#include "tlb.h"
+#include "tlb_invalidate.h"
+#include "translation.h"
+
+#define PID_A 1
+#define PID_B 2
+// 4K pages, next to each other
+#define PAGE_VA 0x400000ULL
+#define GLOBAL_VA 0x401000ULL
+// A 2M page
+#define HUGE_VA 0x40000000ULL
+// A read-write 4K page of PID A, touched by reads and writes
+#define RW_VA 0x402000ULL
+#define RW_PA 0x30000000ULL
+
+#define N_PAGES 3
+
+static const uintptr_t pages[N_PAGES] = {PAGE_VA, GLOBAL_VA, HUGE_VA};
+
+/**
+ * Returns true if any TLB of the current core holds a translation of `va`
+ * for `pid`
+ */
+static bool cached(const ptw_sim_context_t *ctx, uint32_t pid, uintptr_t va) {
+  const tlb_t *tlbs[] = {ctx->oneg_tlb, ctx->twom_tlb, ctx->fourk_tlb,
+                         ctx->stlb};
+  for (size_t i = 0; i < sizeof(tlbs) / sizeof(tlbs[0]); i++) {
+    if (tlbs[i] == NULL) {
+      continue;
+    }
+    for (uint32_t idx = 0; idx < tlbs[i]->sets * tlbs[i]->ways; idx++) {
+      tlbe_t e;
+      get_tlb_entry(tlbs[i], idx, &e);
+      uint64_t mask = ~((1ULL << page_size_shift(e.page_size)) - 1);
+      if (e.valid && e.pid == pid && e.va == (va & mask)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/**
+ * Translate every page of both PIDs, so they are all cached
+ */
+static int touch_all(ptw_sim_context_t *ctx) {
+  static const uint32_t pids[] = {PID_A, PID_B};
+  permissions_t perms = {0};
+  perms.val.read = 1;
+
+  for (size_t p = 0; p < sizeof(pids) / sizeof(pids[0]); p++) {
+    for (size_t i = 0; i < N_PAGES; i++) {
+      address_context_t a_ctx;
+      populate_address_context(&a_ctx, pages[i], perms, 0, pids[p]);
+      if (IS_FAULT(translate(&a_ctx, ctx))) {
+        fprintf(stderr, "PID %u faulted on 0x%lx.\n", pids[p], pages[i]);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+/**
+ * Check which of PID A's pages are still cached. PID B's are never touched.
+ */
+static int expect_cached(const ptw_sim_context_t *ctx, const bool a[N_PAGES],
+                         const char *after) {
+  for (size_t i = 0; i < N_PAGES; i++) {
+    if (cached(ctx, PID_A, pages[i]) != a[i]) {
+      fprintf(stderr, "After %s, PID %u page 0x%lx is %scached.\n", after,
+              PID_A, pages[i], a[i] ? "not " : "");
+      return -1;
+    }
+    if (!cached(ctx, PID_B, pages[i])) {
+      fprintf(stderr, "After %s, PID %u page 0x%lx was dropped.\n", after,
+              PID_B, pages[i]);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int expect_cycles(uint64_t cycles, uint64_t expected,
+                         const char *what) {
+  if (cycles != expected) {
+    fprintf(stderr, "%s cost %lu cycles, expected %lu.\n", what, cycles,
+            expected);
+    return -1;
+  }
+  return 0;
+}
+
+static int map_pages(ptw_sim_context_t *ctx) {
+  static const uint32_t pids[] = {PID_A, PID_B};
+  permissions_t perms = {0};
+  perms.val.read = 1;
+
+  for (size_t p = 0; p < sizeof(pids) / sizeof(pids[0]); p++) {
+    uintptr_t pa = 0x10000000ULL * (p + 1);
+    if (setup_mapping(ctx, pids[p], PAGE_VA, pa, FOUR_K, perms) != 0 ||
+        setup_mapping(ctx, pids[p], GLOBAL_VA, pa + 0x1000, FOUR_K, perms) !=
+            0 ||
+        setup_mapping(ctx, pids[p], HUGE_VA, pa + 0x200000, TWO_M, perms) !=
+            0 ||
+        set_page_global(ctx, pids[p], GLOBAL_VA, true) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int run_tlb_invalidate_test(ptw_sim_context_t *ctx) {
+  sim_config_t cfg;
+  default_sim_config(&cfg);
+  teardown_sim_context(ctx, MAX_PID);
+  configure_sim_context(ctx, MAX_PID, &cfg);
+  const shootdown_cost_t *cost = &ctx->shootdown_cost;
+
+  if (map_pages(ctx) != 0 || set_page_global(ctx, PID_A, 0x800000, true) == 0) {
+    fprintf(stderr, "Failed to set up the global page.\n");
+    return -1;
+  }
+
+  // The global bit makes it from the PTE into the TLB entry
+  if (touch_all(ctx) != 0) {
+    return -1;
+  }
+  for (uint32_t idx = 0; idx < ctx->fourk_tlb->sets * ctx->fourk_tlb->ways;
+       idx++) {
+    tlbe_t e;
+    get_tlb_entry(ctx->fourk_tlb, idx, &e);
+    if (e.valid && e.global != (e.va == GLOBAL_VA)) {
+      fprintf(stderr, "TLB entry for 0x%lx has global bit %u.\n", e.va,
+              e.global);
+      return -1;
+    }
+  }
+
+  // One page, of one PID
+  uint64_t total = invalidate_page(ctx, PID_A, PAGE_VA + 0x123);
+  if (expect_cycles(total, cost->invlpg, "INVLPG") != 0 ||
+      expect_cached(ctx, (bool[]){false, true, true}, "INVLPG") != 0) {
+    return -1;
+  }
+
+  // A range drops global pages too, and pages it only overlaps
+  touch_all(ctx);
+  uint64_t cycles = invalidate_range(ctx, PID_A, PAGE_VA, 0x2000);
+  total += cycles;
+  if (expect_cycles(cycles, 2 * cost->invlpg, "Two page range") != 0 ||
+      expect_cached(ctx, (bool[]){false, false, true}, "range") != 0) {
+    return -1;
+  }
+  touch_all(ctx);
+  cycles = invalidate_range(ctx, PID_A, HUGE_VA + 0x5000, 0x10);
+  total += cycles;
+  if (expect_cycles(cycles, cost->invlpg, "Range in a 2M page") != 0 ||
+      expect_cached(ctx, (bool[]){true, true, false}, "2M range") != 0) {
+    return -1;
+  }
+
+  // Past the threshold, the range flushes the PID's non-global entries
+  // instead. Its global pages are dropped only if they are in the range, as
+  // they are below the threshold.
+  touch_all(ctx);
+  cycles = invalidate_range(ctx, PID_A, HUGE_VA, 1ULL << 21);
+  total += cycles;
+  if (expect_cycles(cycles, cost->flush, "2M range") != 0 ||
+      expect_cached(ctx, (bool[]){false, true, false}, "large range") != 0) {
+    return -1;
+  }
+  touch_all(ctx);
+  cycles = invalidate_range(ctx, PID_A, PAGE_VA,
+                            (cost->flush_threshold + 1) * KB(4));
+  total += cycles;
+  if (expect_cycles(cycles, cost->flush, "Range over a global page") != 0 ||
+      expect_cached(ctx, (bool[]){false, false, false}, "large global range") !=
+          0) {
+    return -1;
+  }
+
+  // A PID flush keeps global entries
+  touch_all(ctx);
+  cycles = invalidate_pid(ctx, PID_A);
+  total += cycles;
+  if (expect_cycles(cycles, cost->flush, "PID flush") != 0 ||
+      expect_cached(ctx, (bool[]){false, true, false}, "PID flush") != 0) {
+    return -1;
+  }
+
+  // So does a flush of every PID, which leaves PID B with only its global
+  // page
+  touch_all(ctx);
+  cycles = invalidate_nonglobal(ctx);
+  total += cycles;
+  if (expect_cycles(cycles, cost->flush, "Non-global flush") != 0 ||
+      !cached(ctx, PID_A, GLOBAL_VA) || !cached(ctx, PID_B, GLOBAL_VA) ||
+      cached(ctx, PID_A, PAGE_VA) || cached(ctx, PID_B, PAGE_VA) ||
+      cached(ctx, PID_B, HUGE_VA)) {
+    fprintf(stderr, "Non-global flush kept the wrong entries.\n");
+    return -1;
+  }
+
+  const invalidation_stats_t *s = &ctx->invalidation_stats;
+  if (s->pages != 4 || s->pid_flushes != 3 || s->nonglobal_flushes != 1 ||
+      s->cycles != total) {
+    print_invalidation_stats(stderr, ctx);
+    return -1;
+  }
+
+  // A page cached by both a read and a write is gone after one INVLPG,
+  // STLB included
+  permissions_t rw = {0};
+  rw.val.read = 1;
+  rw.val.write = 1;
+  if (setup_mapping(ctx, PID_A, RW_VA, RW_PA, FOUR_K, rw) != 0) {
+    return -1;
+  }
+  for (int i = 0; i < 2; i++) {
+    address_context_t a_ctx;
+    permissions_t access = {0};
+    access.val.read = i == 0;
+    access.val.write = i == 1;
+    populate_address_context(&a_ctx, RW_VA, access, 0, PID_A);
+    if (translate(&a_ctx, ctx) != RW_PA) {
+      fprintf(stderr, "Access %d to 0x%llx translated wrong.\n", i, RW_VA);
+      return -1;
+    }
+    clear_tlb(ctx->fourk_tlb);
+  }
+  uint64_t entries = s->entries;
+  invalidate_page(ctx, PID_A, RW_VA);
+  if (cached(ctx, PID_A, RW_VA) || s->entries != entries + 1) {
+    fprintf(stderr, "INVLPG of a read and written page left it cached, or "
+                    "dropped %lu entries.\n",
+            s->entries - entries);
+    return -1;
+  }
+
+  printf("TLB invalidation test passed!\n");
+  return 0;
+}
@@ -0,0 +1,25 @@
+/**
+ * File with test functions for TLB replacement policy test
+ */
+
+#ifndef TLB_POLICY_H
+#define TLB_POLICY_H
+
+#include "page_table_api.h"
+
+/**
+ * @brief Checks which entry each replacement policy evicts.
+ *
+ * For every policy, swaps a 1-set 4-way 4K TLB into the context, fills it
+ * with four pages, hits the first one, then inserts a fifth page. Checks the
+ * victim against what the policy should pick, and that the hit page survives.
+ *
+ * @param ctx Pointer to the pre-allocated and initialized simulator context.
+ *
+ * @return
+ * - 0 on success.
+ * - Non-zero on failure.
+ */
+int run_tlb_policy_test(ptw_sim_context_t *ctx);
+
+#endif
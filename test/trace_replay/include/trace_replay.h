@@ -0,0 +1,29 @@
+/**
+ * File with test functions for trace replay test
+ */
+
+#ifndef TRACE_REPLAY_H
+#define TRACE_REPLAY_H
+
+#include "page_table_api.h"
+
+/**
+ * @brief Replays a small generated trace through the simulator.
+ *
+ * Writes a raw trace to a temporary file, maps it, and replays it with the
+ * demand-mapping fault handler. Checks that every page faults exactly once,
+ * that every valid record translates, and that malformed records are skipped.
+ * Then converts the trace to the compact format and checks that conversion
+ * drops the malformed records and that seeking and replaying it give the
+ * same translations. Finally empties its block index and checks that it is
+ * refused.
+ *
+ * @param ctx Pointer to the pre-allocated and initialized simulator context.
+ *
+ * @return
+ * - 0 on success.
+ * - Non-zero on failure.
+ */
+int run_trace_replay_test(ptw_sim_context_t *ctx);
+
+#endif
@@ -0,0 +1,181 @@
+/**
+ * The functions to run the trace replay test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "compact_trace.h"
+#include "replay.h"
+#include "test_utils.h"
+#include "trace_replay.h"
+
+#define N_PAGES 8
+#define N_PASSES 4
+
+// Small blocks so the compact trace has several and seeking crosses them
+#define TEST_BLOCK_RECORDS 16
+#define SEEK_RECORD 37
+
+/**
+ * Empty the block index of the compact trace at `path`, which has records,
+ * and check that it no longer opens
+ */
+static int check_empty_index(const char *path, uint64_t index_offset) {
+  FILE *f = fopen(path, "r+b");
+  uint64_t n_blocks = 0;
+  if (f == NULL || fseek(f, (long)index_offset, SEEK_SET) != 0 ||
+      fwrite(&n_blocks, sizeof(n_blocks), 1, f) != 1) {
+    perror("check_empty_index");
+    if (f != NULL) {
+      fclose(f);
+    }
+    return -1;
+  }
+  fclose(f);
+
+  compact_trace_reader_t r;
+  if (compact_trace_reader_open(&r, path) == 0) {
+    fprintf(stderr, "Opened a compact trace whose index is empty.\n");
+    compact_trace_reader_close(&r);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Convert the raw trace to the compact format, check that seeking lands on
+ * the right record, and check that replaying it matches the raw replay.
+ * Every page is already mapped by the raw replay, so nothing should fault.
+ */
+static int run_compact_replay(ptw_sim_context_t *ctx, const char *raw_path,
+                              uint64_t n_valid) {
+  char path[] = "/tmp/ptw_ctrace_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return -1;
+  }
+  close(fd);
+
+  int ret = -1;
+  compact_trace_reader_t r;
+  replay_trace_t raw;
+  if (convert_raw_trace(raw_path, path, TEST_BLOCK_RECORDS) != 0 ||
+      !is_compact_trace(path) || compact_trace_reader_open(&r, path) != 0) {
+    unlink(path);
+    return -1;
+  }
+
+  if (open_trace(raw_path, &raw) != 0) {
+    goto out_reader;
+  }
+
+  address_context_t a_ctx;
+  const trace_record_t *expected = &raw.records[SEEK_RECORD];
+  if (compact_trace_seek(&r, SEEK_RECORD) != 0 ||
+      compact_trace_next_batch(&r, &a_ctx, 1, NULL) != 1 ||
+      a_ctx.va != expected->va || a_ctx.pid != expected->pid) {
+    fprintf(stderr, "Compact trace seek failed.\n");
+    goto out_raw;
+  }
+
+  // Conversion drops the malformed records instead of replaying them as
+  // something else
+  replay_stats_t stats;
+  if (r.header.n_records != n_valid || compact_trace_seek(&r, 0) != 0 ||
+      replay_compact_trace(&r, ctx, NULL, NULL, &stats) != 0 ||
+      stats.records != n_valid || stats.skipped != 0 ||
+      stats.translations != n_valid || stats.faults != 0) {
+    fprintf(stderr, "Compact trace replay failed.\n");
+    print_replay_stats(stderr, &stats);
+    goto out_raw;
+  }
+
+  if (check_empty_index(path, r.header.index_offset) != 0) {
+    goto out_raw;
+  }
+
+  ret = 0;
+
+out_raw:
+  close_trace(&raw);
+out_reader:
+  compact_trace_reader_close(&r);
+  unlink(path);
+  return ret;
+}
+
+int run_trace_replay_test(ptw_sim_context_t *ctx) {
+  char path[] = "/tmp/ptw_trace_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return -1;
+  }
+
+  FILE *f = fdopen(fd, "wb");
+  if (f == NULL) {
+    perror("fdopen");
+    close(fd);
+    unlink(path);
+    return -1;
+  }
+
+  // Two PIDs touch the same VAs several times over. Each (PID, page) pair
+  // should fault once and hit afterwards.
+  uint64_t n_valid = 0;
+  for (int pass = 0; pass < N_PASSES; pass++) {
+    for (uint32_t pid = 1; pid <= 2; pid++) {
+      for (uint64_t page = 0; page < N_PAGES; page++) {
+        trace_record_t rec = {.va = 0x7f0000000000ULL + page * KB(4) + 0x10,
+                              .pid = pid,
+                              .access_type = (page % 2) ? ACCESS_WRITE
+                                                        : ACCESS_READ};
+        fwrite(&rec, sizeof(rec), 1, f);
+        n_valid++;
+      }
+    }
+  }
+
+  // Malformed records
+  trace_record_t bad_pid = {.va = 0x1000, .pid = MAX_PID};
+  trace_record_t bad_access = {.va = 0x1000, .pid = 1, .access_type = 7};
+  trace_record_t bad_access_low = {.va = 0x1000, .pid = 1, .access_type = 4};
+  trace_record_t bad_reserved = {.va = 0x1000, .pid = 1, .reserved = 1};
+  fwrite(&bad_pid, sizeof(bad_pid), 1, f);
+  fwrite(&bad_access, sizeof(bad_access), 1, f);
+  fwrite(&bad_access_low, sizeof(bad_access_low), 1, f);
+  fwrite(&bad_reserved, sizeof(bad_reserved), 1, f);
+  fclose(f);
+
+  replay_trace_t trace;
+  if (open_trace(path, &trace) != 0) {
+    unlink(path);
+    return -1;
+  }
+
+  replay_stats_t stats;
+  int ret = replay_trace(&trace, ctx, demand_map_fault_handler, NULL, &stats);
+  close_trace(&trace);
+
+  if (ret != 0 || stats.records != n_valid + 4 || stats.skipped != 4 ||
+      stats.translations != n_valid || stats.faults != 2 * N_PAGES ||
+      stats.faults_handled != 2 * N_PAGES) {
+    fprintf(stderr, "Trace replay test failed.\n");
+    print_replay_stats(stderr, &stats);
+    unlink(path);
+    return -1;
+  }
+
+  ret = run_compact_replay(ctx, path, n_valid);
+  unlink(path);
+  if (ret != 0) {
+    return -1;
+  }
+
+  printf("Trace replay passed!\n");
+  return 0;
+}
@@ -0,0 +1,26 @@
+/**
+ * File with test functions for batched translation test
+ */
+
+#ifndef TRANSLATE_BATCH_H
+#define TRANSLATE_BATCH_H
+
+#include "page_table_api.h"
+
+/**
+ * @brief Checks that translate_batch() matches translate() access by access.
+ *
+ * Translates a batch with runs of same-page accesses, a page change, and an
+ * unmapped page. Same-page accesses must be coalesced without touching the
+ * TLBs, and the batch must stop at the fault. After the page is mapped, the
+ * rest of the batch must translate.
+ *
+ * @param ctx Pointer to the pre-allocated and initialized simulator context.
+ *
+ * @return
+ * - 0 on success.
+ * - Non-zero on failure.
+ */
+int run_translate_batch_test(ptw_sim_context_t *ctx);
+
+#endif
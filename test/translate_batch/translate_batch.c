@@ -0,0 +1,96 @@
+/**
+ * The functions to run the batched translation test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "test_utils.h"
+#include "translate_batch.h"
+#include "translation.h"
+
+#define PID 2
+#define PAGE_A_VA 0x10000ULL
+#define PAGE_A_PA 0x500000ULL
+#define PAGE_B_VA 0x11000ULL
+#define PAGE_B_PA 0x7000ULL
+#define PAGE_C_VA 0x12000ULL
+#define PAGE_C_PA 0x9000ULL
+
+#define N_ACCESSES 6
+
+static const struct {
+  uint64_t va;
+  uint64_t pa;
+  translation_source_t source;
+} expected[N_ACCESSES] = {
+    {PAGE_A_VA + 0x10, PAGE_A_PA + 0x10, TRANSLATION_WALK},
+    {PAGE_A_VA + 0x20, PAGE_A_PA + 0x20, TRANSLATION_COALESCED},
+    {PAGE_B_VA + 0x30, PAGE_B_PA + 0x30, TRANSLATION_WALK},
+    {PAGE_C_VA + 0x40, PAGE_C_PA + 0x40, TRANSLATION_FAULT},
+    {PAGE_C_VA + 0x50, PAGE_C_PA + 0x50, TRANSLATION_COALESCED},
+    {PAGE_A_VA + 0x60, PAGE_A_PA + 0x60, TRANSLATION_TLB},
+};
+
+static int check_results(const translation_result_t *out, size_t first,
+                         size_t n) {
+  for (size_t i = first; i < first + n; i++) {
+    const translation_result_t *r = &out[i - first];
+    if (r->source != expected[i].source) {
+      fprintf(stderr, "Access %zu came from %d, expected %d.\n", i, r->source,
+              expected[i].source);
+      return -1;
+    }
+    if (r->source != TRANSLATION_FAULT && r->pa != expected[i].pa) {
+      fprintf(stderr, "Access %zu translated to 0x%lx, expected 0x%lx.\n", i,
+              r->pa, expected[i].pa);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int run_translate_batch_test(ptw_sim_context_t *ctx) {
+  permissions_t perms = {0};
+  perms.val.read = 1;
+  if (setup_mapping(ctx, PID, PAGE_A_VA, PAGE_A_PA, FOUR_K, perms) != 0 ||
+      setup_mapping(ctx, PID, PAGE_B_VA, PAGE_B_PA, FOUR_K, perms) != 0) {
+    return -1;
+  }
+
+  address_context_t in[N_ACCESSES];
+  translation_result_t out[N_ACCESSES];
+  for (size_t i = 0; i < N_ACCESSES; i++) {
+    populate_address_context(&in[i], expected[i].va, perms, 0, PID);
+  }
+
+  // Page C is not mapped yet, so the batch stops there
+  size_t done = translate_batch(ctx, in, N_ACCESSES, out);
+  if (done != 4 || check_results(out, 0, done) != 0) {
+    fprintf(stderr, "First call translated %zu accesses, expected 4.\n",
+            done);
+    return -1;
+  }
+
+  // The coalesced access must not have been looked up
+  uint64_t fourk_lookups = ctx->fourk_tlb->hits + ctx->fourk_tlb->misses;
+  if (fourk_lookups != 3) {
+    fprintf(stderr, "4K TLB saw %lu lookups, expected 3.\n", fourk_lookups);
+    return -1;
+  }
+
+  if (setup_mapping(ctx, PID, PAGE_C_VA, PAGE_C_PA, FOUR_K, perms) != 0) {
+    return -1;
+  }
+
+  // Retry from the fault on. The retried access walks, not faults.
+  done = translate_batch(ctx, in + 3, N_ACCESSES - 3, out);
+  if (done != N_ACCESSES - 3 || out[0].source != TRANSLATION_WALK ||
+      out[0].pa != expected[3].pa || check_results(out + 1, 4, 2) != 0) {
+    fprintf(stderr, "Retry after mapping page C failed.\n");
+    return -1;
+  }
+
+  printf("Batched translation test passed!\n");
+  return 0;
+}
@@ -0,0 +1,26 @@
+/**
+ * File with test functions for the table-driven walk test
+ */
+
+#ifndef WALK_GEOMETRY_H
+#define WALK_GEOMETRY_H
+
+#include "page_table_api.h"
+
+/**
+ * @brief Checks the page table level descriptors and the walker built on
+ * them.
+ *
+ * Checks the descriptor helpers against the 4-level geometry, then corrupts
+ * entries of both formats and checks that the walker reports them as
+ * malformed.
+ *
+ * @param ctx Pointer to the pre-allocated and initialized simulator context.
+ *
+ * @return
+ * - 0 on success.
+ * - Non-zero on failure.
+ */
+int run_walk_geometry_test(ptw_sim_context_t *ctx);
+
+#endif
@@ -0,0 +1,139 @@
+/**
+ * The functions to run the table-driven walk test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "address_space.h"
+#include "hw_pte.h"
+#include "page_table.h"
+#include "pwc.h"
+#include "sim_context.h"
+#include "test_utils.h"
+#include "walk_geometry.h"
+
+#define PID 6
+#define VA 0x12345678000ULL
+#define PA 0x9000ULL
+
+static int check_descriptors(void) {
+  static const struct {
+    page_size_t page_size;
+    uint8_t level;
+  } leaves[] = {{ONE_G, 1}, {TWO_M, 2}, {FOUR_K, 3}};
+
+  for (size_t i = 0; i < sizeof(leaves) / sizeof(leaves[0]); i++) {
+    uint8_t level = pt_leaf_level(pt_levels_4, PT_LEVELS, leaves[i].page_size);
+    if (level != leaves[i].level ||
+        pt_level_leaf_size(&pt_levels_4[level]) != leaves[i].page_size ||
+        pt_levels_4[level].shift != page_size_shift(leaves[i].page_size)) {
+      fprintf(stderr, "Page size %d has no leaf level.\n",
+              leaves[i].page_size);
+      return -1;
+    }
+  }
+
+  if (pt_level_leaf_size(&pt_levels_4[0]) != PG_SIZE_MAX ||
+      pt_leaf_level(pt_levels_4, PT_LEVELS, PG_SIZE_MAX) != PT_LEVELS) {
+    fprintf(stderr, "The SDP level holds leaves.\n");
+    return -1;
+  }
+
+  // 0x12345678000 is SDP 2, PDP 141, PDE 43, PTE 120
+  static const size_t indices[PT_LEVELS] = {2, 141, 43, 120};
+  for (uint8_t level = 0; level < PT_LEVELS; level++) {
+    if (pt_level_index(&pt_levels_4[level], VA) != indices[level] ||
+        pt_level_bits(&pt_levels_4[level], VA) >> pt_levels_4[level].shift !=
+            indices[level]) {
+      fprintf(stderr, "Level %u indexes 0x%llx wrong.\n", level, VA);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static uintptr_t walk_va(ptw_sim_context_t *ctx) {
+  address_context_t a_ctx = {.va = VA, .pid = PID};
+  a_ctx.permissions.val.read = 1;
+  walk_ctx_t w_ctx = {0};
+  return walk(&a_ctx, ctx, &w_ctx);
+}
+
+/**
+ * Returns the entry of VA at `level`, following table pointers of either
+ * format
+ */
+static void *entry_of(ptw_sim_context_t *ctx, uint8_t level) {
+  void *table = ctx->page_table_pointers[PID];
+  for (uint8_t l = 0;; l++) {
+    size_t index = pt_level_index(&pt_levels_4[l], VA);
+    if (ctx->pte_format == PTE_FORMAT_HW) {
+      hw_pte_t *entry = &((hw_pte_t *)table)[index];
+      if (l == level) {
+        return entry;
+      }
+      table = (void *)hw_pte_addr(*entry);
+    } else {
+      pte_t *entry = &((pte_t *)table)[index];
+      if (l == level) {
+        return entry;
+      }
+      table = (void *)entry->phys_frame.fourk_pte_index;
+    }
+  }
+}
+
+int run_walk_geometry_test(ptw_sim_context_t *ctx) {
+  if (check_descriptors() != 0) {
+    return -1;
+  }
+
+  permissions_t perms = {0};
+  perms.val.read = 1;
+  if (setup_mapping(ctx, PID, VA, PA, FOUR_K, perms) != 0 ||
+      walk_va(ctx) != PA) {
+    return -1;
+  }
+
+  // A PTE can only map a 4K page
+  pte_t *pte = entry_of(ctx, PT_LEVELS - 1);
+  pte->page_metadata.page_size = TWO_M;
+  if (walk_va(ctx) != (uintptr_t)-EFAULT) {
+    fprintf(stderr, "Walked through a 2M PTE.\n");
+    return -1;
+  }
+
+  // A PTE whose VPN is for another page is malformed
+  pte->page_metadata.page_size = FOUR_K;
+  pte->vpn += 1ULL << PTE_STARTING_BIT;
+  if (walk_va(ctx) != (uintptr_t)-EFAULT) {
+    fprintf(stderr, "Walked through a PTE of another page.\n");
+    return -1;
+  }
+
+  sim_config_t cfg;
+  default_sim_config(&cfg);
+  cfg.pte_format = PTE_FORMAT_HW;
+  teardown_sim_context(ctx, MAX_PID);
+  configure_sim_context(ctx, MAX_PID, &cfg);
+  if (setup_mapping(ctx, PID, VA, PA, FOUR_K, perms) != 0 ||
+      walk_va(ctx) != PA) {
+    return -1;
+  }
+
+  // The SDP level has no page size to set PS for. The PWCs would skip it.
+  *(hw_pte_t *)entry_of(ctx, 0) |= HW_PTE_PS;
+  for (int level = 0; level < PWC_LEVELS; level++) {
+    if (ctx->pwc[level] != NULL) {
+      flush_pwc(ctx->pwc[level]);
+    }
+  }
+  if (walk_va(ctx) != (uintptr_t)-EFAULT) {
+    fprintf(stderr, "Walked through an SDP entry with PS set.\n");
+    return -1;
+  }
+
+  printf("Walk geometry test passed!\n");
+  return 0;
+}
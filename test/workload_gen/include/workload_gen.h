@@ -0,0 +1,26 @@
+/**
+ * File with test functions for workload generator test
+ */
+
+#ifndef WORKLOAD_GEN_H
+#define WORKLOAD_GEN_H
+
+#include "page_table_api.h"
+
+/**
+ * @brief Checks the synthetic address streams.
+ *
+ * Checks that every pattern stays inside its footprint and is reproducible
+ * from its seed, that the scans, the pointer chase, GUPS and the PID
+ * round-robin produce the expected sequences, that the Zipf pattern is
+ * skewed, and that run_workload() translates every access.
+ *
+ * @param ctx Pointer to the pre-allocated and initialized simulator context.
+ *
+ * @return
+ * - 0 on success.
+ * - Non-zero on failure.
+ */
+int run_workload_gen_test(ptw_sim_context_t *ctx);
+
+#endif
@@ -0,0 +1,251 @@
+/**
+ * The functions to run the workload generator test
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "test_utils.h"
+#include "workload.h"
+#include "workload_gen.h"
+
+#define BASE_VA 0x7f0000000000ULL
+#define FOOTPRINT_PAGES 100
+#define FOOTPRINT ((uint64_t)FOOTPRINT_PAGES << 12)
+#define N_ACCESSES 10000
+#define RUN_PAGES 16
+#define RUN_ACCESSES 5000
+
+static workload_t w;
+static workload_t other;
+
+static void test_config(workload_config_t *cfg, workload_kind_t kind) {
+  default_workload_config(cfg);
+  cfg->kind = kind;
+  cfg->base_va = BASE_VA;
+  cfg->footprint = FOOTPRINT;
+  cfg->stride = 3 << 12;
+  cfg->seed = 42;
+}
+
+static bool is_write(const address_context_t *a_ctx) {
+  return a_ctx->permissions.val.write && !a_ctx->permissions.val.read;
+}
+
+/**
+ * Every pattern stays in its footprint, and the same seed gives the same
+ * stream
+ */
+static int check_bounds_and_seeds() {
+  for (int kind = 0; kind < WORKLOAD_KIND_MAX; kind++) {
+    workload_config_t cfg;
+    test_config(&cfg, kind);
+    cfg.n_pids = 3;
+    cfg.pid_quantum = 7;
+    cfg.write_percent = 30;
+    if (workload_init(&w, &cfg) != 0 || workload_init(&other, &cfg) != 0) {
+      return -1;
+    }
+
+    for (int i = 0; i < N_ACCESSES; i++) {
+      address_context_t a, b;
+      workload_next(&w, &a);
+      workload_next(&other, &b);
+      if (a.va < BASE_VA || a.va >= BASE_VA + FOOTPRINT ||
+          a.pid < cfg.first_pid || a.pid >= cfg.first_pid + cfg.n_pids) {
+        fprintf(stderr, "%s access %d out of range: pid %u va 0x%lx\n",
+                workload_kind_name(kind), i, a.pid, a.va);
+        return -1;
+      }
+      if (a.va != b.va || a.pid != b.pid || a.permissions.val.write !=
+                                                b.permissions.val.write) {
+        fprintf(stderr, "%s is not reproducible.\n",
+                workload_kind_name(kind));
+        return -1;
+      }
+    }
+  }
+
+  // A different seed gives a different stream
+  workload_config_t cfg;
+  test_config(&cfg, WORKLOAD_UNIFORM);
+  workload_init(&w, &cfg);
+  cfg.seed = 43;
+  workload_init(&other, &cfg);
+  int same = 0;
+  for (int i = 0; i < N_ACCESSES; i++) {
+    address_context_t a, b;
+    workload_next(&w, &a);
+    workload_next(&other, &b);
+    same += a.va == b.va;
+  }
+  if (same > N_ACCESSES / 100) {
+    fprintf(stderr, "Seeds 42 and 43 agree on %d accesses.\n", same);
+    return -1;
+  }
+  return 0;
+}
+
+static int check_scans() {
+  workload_config_t cfg;
+  test_config(&cfg, WORKLOAD_SEQUENTIAL);
+  workload_init(&w, &cfg);
+  for (uint64_t i = 0; i < N_ACCESSES; i++) {
+    address_context_t a;
+    workload_next(&w, &a);
+    if (a.va != BASE_VA + (i * 64) % FOOTPRINT || a.pid != 1 ||
+        !a.permissions.val.read) {
+      fprintf(stderr, "Sequential access %lu is 0x%lx.\n", i, a.va);
+      return -1;
+    }
+  }
+
+  test_config(&cfg, WORKLOAD_STRIDE);
+  workload_init(&w, &cfg);
+  for (uint64_t i = 0; i < N_ACCESSES; i++) {
+    address_context_t a;
+    workload_next(&w, &a);
+    if (a.va != BASE_VA + (i * cfg.stride) % FOOTPRINT) {
+      fprintf(stderr, "Stride access %lu is 0x%lx.\n", i, a.va);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * The pointer chase visits every page once before it repeats
+ */
+static int check_pointer_chase() {
+  workload_config_t cfg;
+  test_config(&cfg, WORKLOAD_POINTER_CHASE);
+  workload_init(&w, &cfg);
+
+  bool seen[FOOTPRINT_PAGES] = {0};
+  address_context_t first;
+  for (int i = 0; i < FOOTPRINT_PAGES; i++) {
+    address_context_t a;
+    workload_next(&w, &a);
+    uint64_t page = (a.va - BASE_VA) >> 12;
+    if (seen[page]) {
+      fprintf(stderr, "Pointer chase revisits page %lu after %d steps.\n",
+              page, i);
+      return -1;
+    }
+    seen[page] = true;
+    if (i == 0) {
+      first = a;
+    }
+  }
+
+  address_context_t again;
+  workload_next(&w, &again);
+  if (again.va != first.va) {
+    fprintf(stderr, "Pointer chase does not cycle.\n");
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Each GUPS update is a read followed by a write of the same word, and PIDs
+ * take turns every quantum
+ */
+static int check_gups_round_robin() {
+  workload_config_t cfg;
+  test_config(&cfg, WORKLOAD_GUPS);
+  cfg.first_pid = 2;
+  cfg.n_pids = 3;
+  cfg.pid_quantum = 5;
+  workload_init(&w, &cfg);
+
+  for (uint32_t update = 0; update < N_ACCESSES; update++) {
+    address_context_t read, write;
+    workload_next(&w, &read);
+    workload_next(&w, &write);
+    uint32_t pid = cfg.first_pid + (update / cfg.pid_quantum) % cfg.n_pids;
+    if (is_write(&read) || !is_write(&write) || read.va != write.va ||
+        read.va % 8 != 0 || read.pid != pid || write.pid != pid) {
+      fprintf(stderr, "GUPS update %u is wrong.\n", update);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * The hottest Zipf rank lands on the first page and takes its share
+ */
+static int check_zipf() {
+  workload_config_t cfg;
+  test_config(&cfg, WORKLOAD_ZIPF);
+  workload_init(&w, &cfg);
+
+  uint32_t counts[FOOTPRINT_PAGES] = {0};
+  for (int i = 0; i < N_ACCESSES; i++) {
+    address_context_t a;
+    workload_next(&w, &a);
+    counts[(a.va - BASE_VA) >> 12]++;
+  }
+
+  // With s = 0.99 over 100 pages, rank 1 is about 19% of the accesses and
+  // rank 2 about half of that
+  for (int page = 1; page < FOOTPRINT_PAGES; page++) {
+    if (counts[page] >= counts[0]) {
+      fprintf(stderr, "Zipf page %d is hotter than rank 1.\n", page);
+      return -1;
+    }
+  }
+  if (counts[0] < N_ACCESSES / 7 || counts[0] > N_ACCESSES / 4) {
+    fprintf(stderr, "Zipf rank 1 got %u accesses.\n", counts[0]);
+    return -1;
+  }
+  return 0;
+}
+
+static int check_run(ptw_sim_context_t *ctx) {
+  workload_config_t cfg;
+  test_config(&cfg, WORKLOAD_UNIFORM);
+  cfg.footprint = RUN_PAGES << 12;
+  cfg.write_percent = 50;
+  workload_init(&w, &cfg);
+
+  replay_stats_t stats;
+  if (run_workload(ctx, &w, RUN_ACCESSES, demand_map_fault_handler, NULL,
+                   &stats) != 0) {
+    return -1;
+  }
+
+  // Every page faults once, on first touch
+  if (stats.records != RUN_ACCESSES || stats.translations != RUN_ACCESSES ||
+      stats.faults != RUN_PAGES || stats.faults_handled != RUN_PAGES) {
+    fprintf(stderr,
+            "Unexpected workload stats: %lu records, %lu translations, %lu "
+            "faults, %lu handled.\n",
+            stats.records, stats.translations, stats.faults,
+            stats.faults_handled);
+    return -1;
+  }
+  return 0;
+}
+
+int run_workload_gen_test(ptw_sim_context_t *ctx) {
+  workload_config_t cfg;
+  test_config(&cfg, WORKLOAD_ZIPF);
+  cfg.footprint = 0x1800;
+  if (workload_init(&w, &cfg) == 0) {
+    fprintf(stderr, "Accepted a footprint that is not 4K aligned.\n");
+    return -1;
+  }
+
+  if (check_bounds_and_seeds() != 0 || check_scans() != 0 ||
+      check_pointer_chase() != 0 || check_gups_round_robin() != 0 ||
+      check_zipf() != 0 || check_run(ctx) != 0) {
+    return -1;
+  }
+
+  printf("Workload generator test passed!\n");
+  return 0;
+}